@@ -0,0 +1,168 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Artax developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Headers-first initial block download: a fresh node syncs a regtest
+# chain from three peers at once, then rejects headers it must not
+# accept: headers past the PoW range, headers without a known parent
+# and headers without valid proof of work.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import hashlib
+import random
+import socket
+import struct
+import time
+
+REGTEST_MAGIC = "\x20\xee\x32\xbc"
+PROTOCOL_VERSION = 70920
+RAW_PEER_SUBVER = "/headers_first_sync:0.1/"
+LAST_POW_BLOCK = 200
+
+def sha256d(s):
+    return hashlib.sha256(hashlib.sha256(s).digest()).digest()
+
+def ser_address(port):
+    return struct.pack("<Q", 1) + "\x00" * 10 + "\xff\xff" + socket.inet_aton("127.0.0.1") + struct.pack(">H", port)
+
+class RawPeer(object):
+    """Just enough of the p2p protocol to hand a node made up headers"""
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=60)
+        self.buf = ""
+        version = struct.pack("<iQq", PROTOCOL_VERSION, 1, int(time.time()))
+        version += ser_address(port) + ser_address(0)
+        version += struct.pack("<Q", random.getrandbits(64))
+        version += chr(len(RAW_PEER_SUBVER)) + RAW_PEER_SUBVER
+        version += struct.pack("<i", 0) + "\x01"
+        self.send("version", version)
+        self.send("verack", "")
+
+    def send(self, command, payload):
+        self.sock.sendall(REGTEST_MAGIC + command.ljust(12, "\x00") + struct.pack("<I", len(payload)) +
+                          sha256d(payload)[:4] + payload)
+
+    def receive(self):
+        """Next (command, payload), or None once the node has closed the connection"""
+        while True:
+            if len(self.buf) >= 24:
+                length = struct.unpack("<I", self.buf[16:20])[0]
+                if len(self.buf) >= 24 + length:
+                    command = self.buf[4:16].rstrip("\x00")
+                    payload = self.buf[24:24 + length]
+                    self.buf = self.buf[24 + length:]
+                    return (command, payload)
+            try:
+                data = self.sock.recv(65536)
+            except socket.error:
+                return None
+            if not data:
+                return None
+            self.buf += data
+
+    def sync(self):
+        """Wait until the node has processed everything sent so far; False if it disconnected us"""
+        nonce = random.getrandbits(64)
+        try:
+            self.send("ping", struct.pack("<Q", nonce))
+        except socket.error:
+            return False
+        while True:
+            msg = self.receive()
+            if msg is None:
+                return False
+            if msg[0] == "pong" and msg[1] == struct.pack("<Q", nonce):
+                return True
+
+    def send_header(self, hash_prev, ntime, nbits):
+        header = struct.pack("<i", 4) + hash_prev.decode("hex")[::-1] + os.urandom(32)
+        header += struct.pack("<III", ntime, nbits, random.getrandbits(32))
+        self.send("headers", "\x01" + header + "\x00")
+
+class HeadersFirstSyncTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--blocks", dest="blocks", default=150, type="int",
+                          help="Length of the chain to sync, at most %d (default: %%default)" % LAST_POW_BLOCK)
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 4)
+
+    def setup_network(self):
+        self.nodes = start_nodes(3, self.options.tmpdir)
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 0, 2)
+        self.is_network_split = False
+
+    def raw_peer_info(self, node):
+        peers = [ p for p in node.getpeerinfo() if p["subver"] == RAW_PEER_SUBVER ]
+        assert(len(peers) <= 1)
+        return peers[0] if peers else None
+
+    def run_test(self):
+        assert(self.options.blocks <= LAST_POW_BLOCK)
+        self.nodes[0].setgenerate(True, self.options.blocks)
+        sync_blocks(self.nodes)
+        tip = self.nodes[0].getbestblockhash()
+
+        # Start an empty node that only knows the three seeders
+        self.nodes.append(start_node(3, self.options.tmpdir, ["-debug=net"]))
+        start = time.time()
+        for i in range(3):
+            connect_nodes(self.nodes[3], i)
+        while self.nodes[3].getbestblockhash() != tip:
+            assert(time.time() - start < 120)
+            time.sleep(0.1)
+        elapsed = time.time() - start
+
+        assert_equal(self.nodes[3].getblockcount(), self.options.blocks)
+        tips = self.nodes[3].getchaintips()
+        assert_equal(len(tips), 1)
+        assert_equal(tips[0]["hash"], tip)
+        assert_equal(tips[0]["status"], "active")
+        served = [ p["bytesrecv"] for p in self.nodes[3].getpeerinfo() ]
+        print("Synced %d blocks in %.2f s (%.1f blocks/s), bytes received per peer: %s" %
+              (self.options.blocks, elapsed, self.options.blocks / elapsed, served))
+
+        # Complete the PoW range, so that the next header would be a proof-of-stake one
+        self.nodes[0].setgenerate(True, LAST_POW_BLOCK - self.options.blocks)
+        sync_blocks(self.nodes)
+        tips = self.nodes[3].getchaintips()
+        assert_equal(self.nodes[3].getblockcount(), LAST_POW_BLOCK)
+
+        peer = RawPeer(p2p_port(3))
+        assert(peer.sync())
+        now = int(time.time())
+
+        # A header past LAST_POW_BLOCK is not synced headers-first: it is ignored, without a penalty
+        peer.send_header(self.nodes[3].getbestblockhash(), now, 0x207fffff)
+        assert(peer.sync())
+        assert_equal(self.nodes[3].getchaintips(), tips)
+
+        # A header without a known parent is not stored either
+        peer.send_header("%064x" % random.getrandbits(256), now, 0x207fffff)
+        assert(peer.sync())
+        assert_equal(self.nodes[3].getchaintips(), tips)
+        assert_equal(self.raw_peer_info(self.nodes[3])["banscore"], 0)
+
+        # Headers in the PoW range without valid proof of work are rejected and get the sender disconnected
+        fork_point = self.nodes[3].getblockhash(LAST_POW_BLOCK / 2)
+        peer.send_header(fork_point, now, 0x1d00ffff)
+        assert(peer.sync())
+        assert_equal(self.raw_peer_info(self.nodes[3])["banscore"], 50)
+        peer.send_header(fork_point, now, 0x1d00ffff)
+        assert(not peer.sync())
+        assert_equal(self.nodes[3].getchaintips(), tips)
+        start = time.time()
+        while self.raw_peer_info(self.nodes[3]) is not None:
+            assert(time.time() - start < 30)
+            time.sleep(0.1)
+
+if __name__ == '__main__':
+    HeadersFirstSyncTest().main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python2
+# Copyright (c) 2018 The Artax developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Load test for the read-only RPC calls served from the chain tip snapshot:
+# several clients poll while the node keeps validating new blocks, and the
+# achieved queries per second are compared with a call that takes cs_main.
+#
+from test_framework import BitcoinTestFramework
+from bitcoinrpc.authproxy import AuthServiceProxy, JSONRPCException
+from util import *
+import threading
+import time
+
+class RPCSnapshotLoadTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--clients", dest="clients", default=4, type="int",
+                          help="Concurrent RPC clients (default: %default)")
+        parser.add_option("--seconds", dest="seconds", default=10, type="int",
+                          help="Duration of each measurement (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 1)
+
+    def setup_network(self):
+        self.nodes = start_nodes(1, self.options.tmpdir, [["-rpcthreads=%d" % (self.options.clients + 2)]])
+        self.is_network_split = False
+
+    def measure(self, method, args):
+        url = self.nodes[0].url
+        stop = threading.Event()
+        counts = [0] * self.options.clients
+
+        def client(n):
+            proxy = AuthServiceProxy(url, timeout=600)
+            while not stop.is_set():
+                getattr(proxy, method)(*args)
+                counts[n] += 1
+
+        # Keep connecting blocks for the whole measurement; paced so the three
+        # runs stay inside the regtest proof-of-work phase (200 blocks)
+        def miner():
+            proxy = AuthServiceProxy(url, timeout=600)
+            while not stop.is_set():
+                proxy.setgenerate(True, 1)
+                time.sleep(0.25)
+
+        threads = [ threading.Thread(target=client, args=(n,)) for n in range(self.options.clients) ]
+        threads.append(threading.Thread(target=miner))
+        height = self.nodes[0].getblockcount()
+        for t in threads:
+            t.start()
+        time.sleep(self.options.seconds)
+        stop.set()
+        for t in threads:
+            t.join()
+
+        blocks = self.nodes[0].getblockcount() - height
+        qps = sum(counts) / float(self.options.seconds)
+        print("%-16s %8.0f qps with %d clients, %d blocks connected meanwhile" % (method, qps, self.options.clients, blocks))
+        return qps
+
+    def run_test(self):
+        self.nodes[0].setgenerate(True, 10)
+        snapshot_qps = self.measure("getblockcount", [])
+        self.measure("getblockhash", [1])
+        locked_qps = self.measure("getchaintips", [])
+
+        stats = self.nodes[0].getrpcstats()["methods"]
+        assert_equal(stats["getblockcount"]["class"], "concurrent")
+        assert_equal(stats["getchaintips"]["class"], "chainstate")
+        assert_greater_than(snapshot_qps, locked_qps)
+
+if __name__ == '__main__':
+    RPCSnapshotLoadTest().main()
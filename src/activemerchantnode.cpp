@@ -189,12 +189,12 @@ bool CActiveMerchantnode::SendMerchantnodePing(std::string& errorMessage)
         }
 
         pmn->lastPing = mnp;
-        mnodeman.mapSeenMerchantnodePing.insert(make_pair(mnp.GetHash(), mnp));
+        mnodeman.AddSeenPing(mnp);
 
         //mnodeman.mapSeenMerchantnodeBroadcast.lastPing is probably outdated, so we'll update it
         CMerchantnodeBroadcast mnb(*pmn);
         uint256 hash = mnb.GetHash();
-        if (mnodeman.mapSeenMerchantnodeBroadcast.count(hash)) mnodeman.mapSeenMerchantnodeBroadcast[hash].lastPing = mnp;
+        mnodeman.UpdateSeenBroadcastPing(hash, mnp);
 
         mnp.Relay();
 
@@ -0,0 +1,26 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/quark.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "util.h"
+
+int main(int argc, char** argv)
+{
+    SHA256AutoDetect();
+    QuarkAutoDetect();
+    ECC_Start();
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::UNITTEST);
+
+    benchmark::BenchRunner::RunAll();
+
+    ECC_Stop();
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "main.h"
+#include "mappedfile.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include <boost/filesystem.hpp>
+
+// Proof of stake blocks of a busy chain, read back the way a wallet rescan
+// (hash every transaction) and a node serving a syncing peer (serialize the
+// block into a message) do.
+static const int BLOCK_READ_BENCH_BLOCKS = 400;
+static const int BLOCK_READ_BENCH_TXS = 250;
+
+static std::vector<CDiskBlockPos> vBenchBlockPos;
+
+static CBlock MakeBenchBlock(int nHeight)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = GetRandHash();
+    block.nTime = 1500000000 + nHeight * 60;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    coinbase.vout.resize(1);
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    coinstake.vout.resize(3);
+    coinstake.vout[0].SetEmpty();
+    block.vtx.push_back(coinstake);
+
+    for (int i = 0; i < BLOCK_READ_BENCH_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            tx.vout[j].nValue = (i + 1) * COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Write the bench blocks to blk00000.dat in the bench data directory once */
+static void WriteBenchBlocks()
+{
+    if (!vBenchBlockPos.empty())
+        return;
+    benchmark::GetDataDir();
+    CDiskBlockPos pos(0, 0);
+    for (int nHeight = 0; nHeight < BLOCK_READ_BENCH_BLOCKS; nHeight++) {
+        CBlock block = MakeBenchBlock(nHeight);
+        if (!WriteBlockToDisk(block, pos))
+            throw std::runtime_error("WriteBenchBlocks : writing block failed");
+        vBenchBlockPos.push_back(pos);
+        // WriteBlockToDisk opens the file at pos, so point it past this block
+        pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    }
+}
+
+static void RescanBlocks(benchmark::State& state, size_t nMaps)
+{
+    WriteBenchBlocks();
+    mappedBlockFiles.SetMaxFiles(nMaps);
+    uint256 hashAll = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vBenchBlockPos.size(); i++) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, vBenchBlockPos[i]))
+                throw std::runtime_error("RescanBlocks : reading block failed");
+            for (size_t j = 0; j < block.vtx.size(); j++)
+                hashAll ^= block.vtx[j].GetHash();
+        }
+    }
+    mappedBlockFiles.SetMaxFiles(DEFAULT_BLOCK_FILE_MAPS);
+}
+
+static void ServeBlocks(benchmark::State& state, size_t nMaps)
+{
+    WriteBenchBlocks();
+    mappedBlockFiles.SetMaxFiles(nMaps);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vBenchBlockPos.size(); i++) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, vBenchBlockPos[i]))
+                throw std::runtime_error("ServeBlocks : reading block failed");
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << block;
+        }
+    }
+    mappedBlockFiles.SetMaxFiles(DEFAULT_BLOCK_FILE_MAPS);
+}
+
+static void BlockRescanFileIO(benchmark::State& state)
+{
+    RescanBlocks(state, 0);
+}
+
+static void BlockRescanMapped(benchmark::State& state)
+{
+    RescanBlocks(state, DEFAULT_BLOCK_FILE_MAPS);
+}
+
+static void BlockServeFileIO(benchmark::State& state)
+{
+    ServeBlocks(state, 0);
+}
+
+static void BlockServeMapped(benchmark::State& state)
+{
+    ServeBlocks(state, DEFAULT_BLOCK_FILE_MAPS);
+}
+
+BENCHMARK(BlockRescanFileIO);
+BENCHMARK(BlockRescanMapped);
+BENCHMARK(BlockServeFileIO);
+BENCHMARK(BlockServeMapped);
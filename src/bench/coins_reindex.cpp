@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "leveldbwrapper.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <sys/resource.h>
+
+#include <boost/filesystem.hpp>
+
+// A chain of coinstake-like transactions: each spends a few outputs of
+// large, long lived transactions and creates many new ones, so most
+// flushes touch transactions of which only one output changed.
+static const int REINDEX_BENCH_BLOCKS = 2000;
+static const int REINDEX_BENCH_INPUTS = 4;
+static const int REINDEX_BENCH_OUTPUTS = 40;
+static const int REINDEX_BENCH_FLUSH_INTERVAL = 100;
+static const size_t REINDEX_BENCH_DB_CACHE = 8 << 20;
+
+/** The chainstate layout before the upgrade: one record per transaction */
+class CCoinsViewLegacyDB : public CCoinsView
+{
+private:
+    CLevelDBWrapper db;
+
+public:
+    CCoinsViewLegacyDB(const boost::filesystem::path& path) : db(path, REINDEX_BENCH_DB_CACHE, false, true) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        return db.Read(std::make_pair('c', txid), coins);
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        return db.Exists(std::make_pair('c', txid));
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    {
+        CLevelDBBatch batch;
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                if (it->second.coins.IsPruned())
+                    batch.Erase(std::make_pair('c', it->first));
+                else
+                    batch.Write(std::make_pair('c', it->first), it->second.coins);
+            }
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        }
+        return db.WriteBatch(batch);
+    }
+};
+
+static void ReplayChain(CCoinsView& view)
+{
+    CCoinsViewCache cache(&view);
+    std::vector<COutPoint> vUnspent;
+    for (int nHeight = 1; nHeight <= REINDEX_BENCH_BLOCKS; nHeight++) {
+        CMutableTransaction tx;
+        tx.vin.resize(REINDEX_BENCH_INPUTS);
+        for (int i = 0; i < REINDEX_BENCH_INPUTS && !vUnspent.empty(); i++) {
+            size_t nPick = GetRand(vUnspent.size());
+            tx.vin[i].prevout = vUnspent[nPick];
+            vUnspent[nPick] = vUnspent.back();
+            vUnspent.pop_back();
+            cache.ModifyCoins(tx.vin[i].prevout.hash)->Spend(tx.vin[i].prevout.n);
+        }
+        tx.vout.resize(REINDEX_BENCH_OUTPUTS);
+        for (int i = 0; i < REINDEX_BENCH_OUTPUTS; i++) {
+            tx.vout[i].nValue = 1 + i;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        tx.nLockTime = nHeight;
+        uint256 hash = tx.GetHash();
+        cache.ModifyCoins(hash)->FromTx(tx, nHeight);
+        for (int i = 0; i < REINDEX_BENCH_OUTPUTS; i++)
+            vUnspent.push_back(COutPoint(hash, i));
+        if (nHeight % REINDEX_BENCH_FLUSH_INTERVAL == 0) {
+            cache.SetBestBlock(hash);
+            cache.Flush();
+        }
+    }
+}
+
+/** Report the peak resident set of the benchmark process; it only grows, so compare runs done in separate processes */
+static void LogPeakMemory(const char* pszView)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        printf("%s: peak RSS %ld KiB\n", pszView, usage.ru_maxrss);
+}
+
+static void CoinsReindexLegacy(benchmark::State& state)
+{
+    boost::filesystem::path path = benchmark::GetDataDir() / "chainstate_legacy";
+    while (state.KeepRunning()) {
+        CCoinsViewLegacyDB view(path);
+        ReplayChain(view);
+    }
+    LogPeakMemory("legacy per-transaction records");
+    boost::filesystem::remove_all(path);
+}
+
+static void CoinsReindexPerOutput(benchmark::State& state)
+{
+    boost::filesystem::path path = benchmark::GetDataDir() / "chainstate";
+    size_t nCacheUsage = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewDB view(REINDEX_BENCH_DB_CACHE, false, true);
+        ReplayChain(view);
+        nCacheUsage = view.GetCacheUsage();
+    }
+    LogPeakMemory("per-output records");
+    printf("per-output records: flat cache %u KiB\n", (unsigned int)(nCacheUsage >> 10));
+    boost::filesystem::remove_all(path);
+}
+
+BENCHMARK(CoinsReindexLegacy);
+BENCHMARK(CoinsReindexPerOutput);
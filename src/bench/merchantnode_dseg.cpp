@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "merchantnode.h"
+#include "merchantnodeman.h"
+#include "random.h"
+
+// A node back from a short outage compares its list with a peer's: a few
+// entries are missing and a few were re-broadcast while it was away.
+static const size_t DSEG_BENCH_NODES = 5000;
+static const size_t DSEG_BENCH_CHANGED = 50;
+
+static void MakeBenchLists(CMerchantnodeMan& manPeer, CMerchantnodeMan& manLocal)
+{
+    int64_t nNow = GetAdjustedTime();
+    for (size_t i = 0; i < DSEG_BENCH_NODES; i++) {
+        CMerchantnode mn;
+        mn.vin = CTxIn(GetRandHash(), i % 4);
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mn.sigTime = nNow - 24 * 60 * 60;
+        mn.lastPing.vin = mn.vin;
+        mn.lastPing.sigTime = nNow;
+        mn.unitTest = true;
+        manPeer.Add(mn);
+        if (i < DSEG_BENCH_CHANGED)
+            continue;
+        if (i < DSEG_BENCH_CHANGED * 2)
+            mn.sigTime--;
+        manLocal.Add(mn);
+    }
+}
+
+static void MerchantnodeListDigestDiff(benchmark::State& state)
+{
+    CMerchantnodeMan manPeer, manLocal;
+    MakeBenchLists(manPeer, manLocal);
+
+    unsigned int nBuckets = CMerchantnodeListDigest::GetBucketCount(manLocal.CountEnabled());
+    while (state.KeepRunning()) {
+        CMerchantnodeListDigest digest = manLocal.GetListDigest(nBuckets);
+        CMerchantnodeListDigest ours = manPeer.GetListDigest(digest.vBuckets.size());
+        size_t nDiffBuckets = 0;
+        for (size_t i = 0; i < ours.vBuckets.size(); i++) {
+            if (ours.vBuckets[i] != digest.vBuckets[i])
+                nDiffBuckets++;
+        }
+        if (nDiffBuckets == 0 || nDiffBuckets > DSEG_BENCH_CHANGED * 2)
+            throw std::runtime_error("MerchantnodeListDigestDiff : unexpected difference");
+    }
+}
+
+BENCHMARK(MerchantnodeListDigestDiff);
@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "main.h"
+#include "merchantnode.h"
+#include "merchantnodeman.h"
+#include "random.h"
+
+// Payment votes are checked against the ranks of the last few blocks, for a
+// random merchantnode each, on lists of a few thousand to tens of thousands.
+static const int RANK_BENCH_BLOCKS = 100;
+static const int RANK_BENCH_HEIGHTS = 10;
+static const int RANK_BENCH_LOOKUPS = 100;
+
+static std::vector<uint256> vBenchBlockHashes;
+static std::vector<CBlockIndex> vBenchBlockIndex;
+
+/** Point chainActive at a short chain of made up blocks, once */
+static void MakeBenchChain()
+{
+    if (!vBenchBlockIndex.empty())
+        return;
+    vBenchBlockHashes.resize(RANK_BENCH_BLOCKS);
+    vBenchBlockIndex.resize(RANK_BENCH_BLOCKS);
+    for (int i = 0; i < RANK_BENCH_BLOCKS; i++) {
+        vBenchBlockHashes[i] = GetRandHash();
+        vBenchBlockIndex[i].phashBlock = &vBenchBlockHashes[i];
+        vBenchBlockIndex[i].nHeight = i;
+        vBenchBlockIndex[i].pprev = i > 0 ? &vBenchBlockIndex[i - 1] : NULL;
+    }
+    chainActive.SetTip(&vBenchBlockIndex.back());
+}
+
+static void MakeBenchMerchantnodes(CMerchantnodeMan& man, std::vector<CTxIn>& vin, size_t nCount)
+{
+    int64_t nNow = GetAdjustedTime();
+    for (size_t i = 0; i < nCount; i++) {
+        CMerchantnode mn;
+        mn.vin = CTxIn(GetRandHash(), i % 4);
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mn.sigTime = nNow - 24 * 60 * 60;
+        mn.lastPing.vin = mn.vin;
+        mn.lastPing.sigTime = nNow;
+        mn.unitTest = true;
+        man.Add(mn);
+        vin.push_back(mn.vin);
+    }
+}
+
+static void MerchantnodeRank(benchmark::State& state, size_t nCount, bool fCached)
+{
+    MakeBenchChain();
+    CMerchantnodeMan man;
+    std::vector<CTxIn> vin;
+    MakeBenchMerchantnodes(man, vin, nCount);
+
+    int nTip = chainActive.Height();
+    while (state.KeepRunning()) {
+        if (!fCached)
+            man.ClearRankCache();
+        for (int i = 0; i < RANK_BENCH_LOOKUPS; i++) {
+            int nHeight = nTip - i % RANK_BENCH_HEIGHTS;
+            if (man.GetMerchantnodeRank(vin[i * 7919 % nCount], nHeight, PROTOCOL_VERSION, true) < 1)
+                throw std::runtime_error("MerchantnodeRank : merchantnode not ranked");
+        }
+    }
+}
+
+static void MerchantnodeRankRebuild5k(benchmark::State& state)
+{
+    MerchantnodeRank(state, 5000, false);
+}
+
+static void MerchantnodeRankCached5k(benchmark::State& state)
+{
+    MerchantnodeRank(state, 5000, true);
+}
+
+static void MerchantnodeRankRebuild20k(benchmark::State& state)
+{
+    MerchantnodeRank(state, 20000, false);
+}
+
+static void MerchantnodeRankCached20k(benchmark::State& state)
+{
+    MerchantnodeRank(state, 20000, true);
+}
+
+BENCHMARK(MerchantnodeRankRebuild5k);
+BENCHMARK(MerchantnodeRankCached5k);
+BENCHMARK(MerchantnodeRankRebuild20k);
+BENCHMARK(MerchantnodeRankCached20k);
@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "merchantnode.h"
+#include "merchantnodeman.h"
+#include "random.h"
+
+// The list lookups a node does for a flood of broadcasts and pings: every
+// mnb looks up its collateral and is added, every mnp finds its merchantnode,
+// and payment votes look merchantnodes up by payee and by pubkey.
+static const size_t REGISTRY_BENCH_NODES = 10000;
+static const int REGISTRY_BENCH_PINGS = 3;
+static const size_t REGISTRY_BENCH_EXCLUDED = 100;
+
+struct CBenchMerchantnode {
+    CMerchantnode mn;
+    CScript payee;
+};
+
+static std::vector<CBenchMerchantnode> vBenchNodes;
+
+static void MakeBenchNodes()
+{
+    if (!vBenchNodes.empty())
+        return;
+    int64_t nNow = GetAdjustedTime();
+    vBenchNodes.resize(REGISTRY_BENCH_NODES);
+    for (size_t i = 0; i < vBenchNodes.size(); i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        CMerchantnode& mn = vBenchNodes[i].mn;
+        mn.vin = CTxIn(GetRandHash(), i % 4);
+        mn.pubKeyCollateralAddress = key.GetPubKey();
+        key.MakeNewKey(true);
+        mn.pubKeyMerchantnode = key.GetPubKey();
+        mn.protocolVersion = PROTOCOL_VERSION;
+        mn.sigTime = nNow - 24 * 60 * 60;
+        mn.lastPing.vin = mn.vin;
+        mn.lastPing.sigTime = nNow;
+        mn.unitTest = true;
+        vBenchNodes[i].payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+    }
+}
+
+static void MerchantnodeRegistryReplay(benchmark::State& state)
+{
+    MakeBenchNodes();
+    while (state.KeepRunning()) {
+        CMerchantnodeMan man;
+        // mnb: unknown collateral, so add it
+        for (size_t i = 0; i < vBenchNodes.size(); i++) {
+            if (man.Find(vBenchNodes[i].mn.vin) == NULL)
+                man.Add(vBenchNodes[i].mn);
+        }
+        // mnp and mnw for every merchantnode, in a different order each round
+        for (int nPing = 0; nPing < REGISTRY_BENCH_PINGS; nPing++) {
+            for (size_t i = 0; i < vBenchNodes.size(); i++) {
+                const CBenchMerchantnode& node = vBenchNodes[(i * 7919 + nPing) % vBenchNodes.size()];
+                CMerchantnode* pmn = man.Find(node.mn.vin);
+                if (pmn == NULL || man.Find(node.payee) != pmn || man.Find(node.mn.pubKeyMerchantnode) != pmn)
+                    throw std::runtime_error("MerchantnodeRegistryReplay : merchantnode not found");
+                pmn->lastPing.sigTime++;
+            }
+        }
+    }
+}
+
+static void MerchantnodeFindRandomNotInVec(benchmark::State& state)
+{
+    MakeBenchNodes();
+    CMerchantnodeMan man;
+    for (size_t i = 0; i < vBenchNodes.size(); i++)
+        man.Add(vBenchNodes[i].mn);
+    std::vector<CTxIn> vecToExclude;
+    for (size_t i = 0; i < REGISTRY_BENCH_EXCLUDED; i++)
+        vecToExclude.push_back(vBenchNodes[i * 37].mn.vin);
+
+    while (state.KeepRunning()) {
+        if (man.FindRandomNotInVec(vecToExclude, PROTOCOL_VERSION) == NULL)
+            throw std::runtime_error("MerchantnodeFindRandomNotInVec : no merchantnode found");
+    }
+}
+
+BENCHMARK(MerchantnodeRegistryReplay);
+BENCHMARK(MerchantnodeFindRandomNotInVec);
@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "merchantnode-helpers.h"
+#include "merchantnode-sigcheck.h"
+#include "random.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+// A full list sync: a broadcast and its ping for every merchantnode, each
+// with a compact signature over a string message.
+static const size_t SIGCHECK_BENCH_NODES = 2000;
+
+struct CBenchSignedMessage {
+    CPubKey pubkey;
+    std::string strMessage;
+    std::vector<unsigned char> vchSig;
+};
+
+static std::vector<CBenchSignedMessage> vBenchMessages;
+
+static void MakeBenchMessages()
+{
+    if (!vBenchMessages.empty())
+        return;
+    for (size_t i = 0; i < SIGCHECK_BENCH_NODES * 2; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        CBenchSignedMessage msg;
+        msg.pubkey = key.GetPubKey();
+        msg.strMessage = GetRandHash().ToString() + "1500000000";
+        std::string errorMessage;
+        if (!merchantnodeSigner.SignMessage(msg.strMessage, errorMessage, msg.vchSig, key))
+            throw std::runtime_error("MakeBenchMessages : signing failed");
+        vBenchMessages.push_back(msg);
+    }
+}
+
+static void VerifyBenchMessages()
+{
+    std::string errorMessage;
+    for (size_t i = 0; i < vBenchMessages.size(); i++) {
+        if (!merchantnodeSigner.VerifyMessage(vBenchMessages[i].pubkey, vBenchMessages[i].vchSig, vBenchMessages[i].strMessage, errorMessage))
+            throw std::runtime_error("VerifyBenchMessages : bad signature");
+    }
+}
+
+static void MerchantnodeSyncVerifySerial(benchmark::State& state)
+{
+    MakeBenchMessages();
+    while (state.KeepRunning()) {
+        merchantnodeSigCache.Clear();
+        VerifyBenchMessages();
+    }
+}
+
+static void MerchantnodeSyncVerifyQueued(benchmark::State& state)
+{
+    MakeBenchMessages();
+    boost::thread_group threadGroup;
+    int nThreads = std::max(1, (int)boost::thread::hardware_concurrency() - 1);
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(&ThreadMerchantnodeSigCheck);
+
+    while (state.KeepRunning()) {
+        merchantnodeSigCache.Clear();
+        std::vector<CMerchantnodeSigCheck> vChecks;
+        for (size_t i = 0; i < vBenchMessages.size(); i++)
+            vChecks.push_back(CMerchantnodeSigCheck(vBenchMessages[i].strMessage, vBenchMessages[i].vchSig));
+        // Wait for the workers to start before the first batch
+        while (!VerifyMerchantnodeSigChecks(vChecks))
+            MilliSleep(1);
+        VerifyBenchMessages();
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BENCHMARK(MerchantnodeSyncVerifySerial);
+BENCHMARK(MerchantnodeSyncVerifyQueued);
@@ -0,0 +1,130 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/quark.h"
+#include "primitives/block.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+#include <string.h>
+#include <vector>
+
+// Headers hashed per iteration: headers/sec is HEADERS divided by the time of one iteration
+static const unsigned int HEADERS = 256;
+
+static std::vector<CBlockHeader> MakeHeaders()
+{
+    std::vector<CBlockHeader> vHeaders(HEADERS);
+    for (unsigned int i = 0; i < HEADERS; i++) {
+        vHeaders[i].hashPrevBlock = uint256(i);
+        vHeaders[i].nTime = 1500000000 + 60 * i;
+        vHeaders[i].nBits = 0x1e0ffff0;
+        vHeaders[i].nNonce = i * 7919;
+    }
+    return vHeaders;
+}
+
+// Validation: distinct headers, one GetHash() each
+static void QuarkValidationSerial(benchmark::State& state)
+{
+    std::vector<CBlockHeader> vHeaders = MakeHeaders();
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < HEADERS; i++)
+            hash = vHeaders[i].GetHash();
+    }
+}
+
+// Validation: the same headers through QuarkHashBatch, restricted to the given backends
+static void QuarkValidationBatch(benchmark::State& state, int nBackends)
+{
+    QuarkAutoDetect(nBackends);
+    std::vector<CBlockHeader> vHeaders = MakeHeaders();
+    std::vector<unsigned char> vData(80 * HEADERS);
+    for (unsigned int i = 0; i < HEADERS; i++)
+        memcpy(&vData[80 * i], BEGIN(vHeaders[i].nVersion), 80);
+    std::vector<uint256> vHashes(HEADERS);
+    while (state.KeepRunning())
+        QuarkHashBatch(vHashes[0].begin(), &vData[0], 80, HEADERS);
+    QuarkAutoDetect();
+}
+
+// Mining: one header, nonce incremented between GetHash() calls as the miner used to
+static void QuarkMiningSerial(benchmark::State& state)
+{
+    CBlockHeader header = MakeHeaders()[0];
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < HEADERS; i++) {
+            hash = header.GetHash();
+            header.nNonce++;
+        }
+    }
+}
+
+// Mining: one header, a nonce window per CBlockHeaderHasher, restricted to the given backends
+static void QuarkMiningBatch(benchmark::State& state, int nBackends)
+{
+    QuarkAutoDetect(nBackends);
+    CBlockHeader header = MakeHeaders()[0];
+    std::vector<uint256> vHashes(HEADERS);
+    while (state.KeepRunning()) {
+        CBlockHeaderHasher(header).GetHashes(header.nNonce, HEADERS, &vHashes[0]);
+        header.nNonce += HEADERS;
+    }
+    QuarkAutoDetect();
+}
+
+static void QuarkValidationBatchStandard(benchmark::State& state)
+{
+    QuarkValidationBatch(state, QUARK_BACKEND_STANDARD);
+}
+
+static void QuarkValidationBatchAESNI(benchmark::State& state)
+{
+    QuarkValidationBatch(state, QUARK_BACKEND_AESNI);
+}
+
+static void QuarkValidationBatchAVX2(benchmark::State& state)
+{
+    QuarkValidationBatch(state, QUARK_BACKEND_AVX2);
+}
+
+static void QuarkValidationBatchAuto(benchmark::State& state)
+{
+    QuarkValidationBatch(state, QUARK_BACKEND_ALL);
+}
+
+static void QuarkMiningBatchStandard(benchmark::State& state)
+{
+    QuarkMiningBatch(state, QUARK_BACKEND_STANDARD);
+}
+
+static void QuarkMiningBatchAESNI(benchmark::State& state)
+{
+    QuarkMiningBatch(state, QUARK_BACKEND_AESNI);
+}
+
+static void QuarkMiningBatchAVX2(benchmark::State& state)
+{
+    QuarkMiningBatch(state, QUARK_BACKEND_AVX2);
+}
+
+static void QuarkMiningBatchAuto(benchmark::State& state)
+{
+    QuarkMiningBatch(state, QUARK_BACKEND_ALL);
+}
+
+BENCHMARK(QuarkValidationSerial);
+BENCHMARK(QuarkValidationBatchStandard);
+BENCHMARK(QuarkValidationBatchAESNI);
+BENCHMARK(QuarkValidationBatchAVX2);
+BENCHMARK(QuarkValidationBatchAuto);
+BENCHMARK(QuarkMiningSerial);
+BENCHMARK(QuarkMiningBatchStandard);
+BENCHMARK(QuarkMiningBatchAESNI);
+BENCHMARK(QuarkMiningBatchAVX2);
+BENCHMARK(QuarkMiningBatchAuto);
@@ -0,0 +1,70 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+// Messages per batch: a merkle tree level of 1024 transactions
+static const size_t BATCH_SIZE = 512;
+
+// Double-SHA256 of 64 byte messages, as in merkle tree nodes, one message at a time
+static void SHA256D64Serial(benchmark::State& state)
+{
+    SHA256AutoDetect();
+    std::vector<uint256> vIn(BATCH_SIZE * 2);
+    std::vector<uint256> vOut(BATCH_SIZE);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < BATCH_SIZE; i++)
+            vOut[i] = Hash(BEGIN(vIn[2 * i]), END(vIn[2 * i]), BEGIN(vIn[2 * i + 1]), END(vIn[2 * i + 1]));
+    }
+}
+
+// Same messages through SHA256DBatch, restricted to the given backends
+static void SHA256D64Batch(benchmark::State& state, int nBackends)
+{
+    SHA256AutoDetect(nBackends);
+    std::vector<uint256> vIn(BATCH_SIZE * 2);
+    std::vector<uint256> vOut(BATCH_SIZE);
+    while (state.KeepRunning())
+        SHA256DBatch(vOut[0].begin(), vIn[0].begin(), 64, BATCH_SIZE);
+    SHA256AutoDetect();
+}
+
+static void SHA256D64BatchStandard(benchmark::State& state)
+{
+    SHA256D64Batch(state, SHA256_BACKEND_STANDARD);
+}
+
+static void SHA256D64BatchSSE41(benchmark::State& state)
+{
+    SHA256D64Batch(state, SHA256_BACKEND_SSE41);
+}
+
+static void SHA256D64BatchAVX2(benchmark::State& state)
+{
+    SHA256D64Batch(state, SHA256_BACKEND_AVX2);
+}
+
+static void SHA256D64BatchSHANI(benchmark::State& state)
+{
+    SHA256D64Batch(state, SHA256_BACKEND_SHANI);
+}
+
+static void SHA256D64BatchAuto(benchmark::State& state)
+{
+    SHA256D64Batch(state, SHA256_BACKEND_ALL);
+}
+
+BENCHMARK(SHA256D64Serial);
+BENCHMARK(SHA256D64BatchStandard);
+BENCHMARK(SHA256D64BatchSSE41);
+BENCHMARK(SHA256D64BatchAVX2);
+BENCHMARK(SHA256D64BatchSHANI);
+BENCHMARK(SHA256D64BatchAuto);
@@ -0,0 +1,162 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "netbase.h"
+#include "socketpoller.h"
+#include "utiltime.h"
+
+#include <stdio.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#ifndef WIN32
+#include <sys/resource.h>
+
+// Connections that receive a message in each round; the others stay idle, as most peers do
+static const size_t POLL_BENCH_ACTIVE = 64;
+// Size of a message header without payload
+static const size_t POLL_BENCH_MESSAGE = 24;
+
+/** Loopback TCP connections: vLocal is the side the poller watches, vRemote plays the peers */
+struct CLoopbackPeers {
+    std::vector<SOCKET> vLocal;
+    std::vector<SOCKET> vRemote;
+
+    ~CLoopbackPeers()
+    {
+        for (size_t i = 0; i < vLocal.size(); i++)
+            CloseSocket(vLocal[i]);
+        for (size_t i = 0; i < vRemote.size(); i++)
+            CloseSocket(vRemote[i]);
+    }
+
+    bool Open(size_t nPeers)
+    {
+        // Two descriptors per connection plus some slack
+        struct rlimit limitFD;
+        if (getrlimit(RLIMIT_NOFILE, &limitFD) == 0 && limitFD.rlim_cur < 2 * nPeers + 64) {
+            limitFD.rlim_cur = std::min((rlim_t)(2 * nPeers + 64), limitFD.rlim_max);
+            setrlimit(RLIMIT_NOFILE, &limitFD);
+        }
+
+        SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (hListen == INVALID_SOCKET)
+            return false;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(hListen, SOMAXCONN) != 0 ||
+            getsockname(hListen, (struct sockaddr*)&addr, &len) != 0) {
+            CloseSocket(hListen);
+            return false;
+        }
+
+        bool fResult = true;
+        for (size_t i = 0; i < nPeers; i++) {
+            SOCKET hRemote = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (hRemote == INVALID_SOCKET || connect(hRemote, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                if (hRemote != INVALID_SOCKET)
+                    CloseSocket(hRemote);
+                fResult = false;
+                break;
+            }
+            vRemote.push_back(hRemote);
+            SOCKET hLocal = accept(hListen, NULL, NULL);
+            if (hLocal == INVALID_SOCKET) {
+                fResult = false;
+                break;
+            }
+            SetSocketNonBlocking(hLocal, true);
+            vLocal.push_back(hLocal);
+        }
+        CloseSocket(hListen);
+        return fResult;
+    }
+};
+
+static double GetProcessCPUSeconds()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 0.000001;
+}
+
+/**
+ * One iteration is one round of the socket handler: POLL_BENCH_ACTIVE of the
+ * nPeers connections send a message, the poller is given the interest of all
+ * nPeers sockets and waited on until every message has been read. Reports the
+ * messages per second and the CPU time spent per connection and round.
+ */
+static void SocketPollRounds(benchmark::State& state, bool fSelect, size_t nPeers)
+{
+    CLoopbackPeers peers;
+    if (!peers.Open(nPeers)) {
+        fprintf(stderr, "SocketPoll: could not open %u loopback connections\n", (unsigned int)nPeers);
+        return;
+    }
+    boost::scoped_ptr<CSocketPoller> poller(CSocketPoller::Create(fSelect));
+    std::vector<int> vPollState(nPeers, 0);
+    std::vector<CSocketEvent> vEvents;
+    char pchMessage[POLL_BENCH_MESSAGE] = {};
+    char pchBuf[0x10000];
+    size_t nNext = 0;
+    uint64_t nMessages = 0;
+    uint64_t nRounds = 0;
+    int64_t nStart = GetTimeMicros();
+    double dCPUStart = GetProcessCPUSeconds();
+
+    while (state.KeepRunning()) {
+        size_t nActive = std::min(POLL_BENCH_ACTIVE, nPeers);
+        for (size_t i = 0; i < nActive; i++)
+            send(peers.vRemote[(nNext + i) % nPeers], pchMessage, sizeof(pchMessage), MSG_NOSIGNAL);
+        nNext = (nNext + nActive) % nPeers;
+
+        size_t nReceived = 0;
+        while (nReceived < nActive * sizeof(pchMessage)) {
+            for (size_t i = 0; i < nPeers; i++)
+                poller->Watch(peers.vLocal[i], i, CSocketPoller::POLL_RECV, vPollState[i]);
+            poller->Wait(50, vEvents);
+            for (size_t i = 0; i < vEvents.size(); i++) {
+                int nBytes = recv(peers.vLocal[vEvents[i].nToken], pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                if (nBytes > 0)
+                    nReceived += nBytes;
+            }
+        }
+        nMessages += nActive;
+        nRounds++;
+    }
+
+    double dElapsed = (GetTimeMicros() - nStart) * 0.000001;
+    double dCPU = GetProcessCPUSeconds() - dCPUStart;
+    if (nRounds > 0 && dElapsed > 0)
+        fprintf(stderr, "SocketPoll %s %u peers: %.0f msg/s, %.3f us CPU per connection and round\n", poller->GetName(),
+            (unsigned int)nPeers, nMessages / dElapsed, dCPU * 1000000 / (nRounds * nPeers));
+}
+
+// Below FD_SETSIZE, so both backends can run it
+static void SocketPollSelect400(benchmark::State& state)
+{
+    SocketPollRounds(state, true, 400);
+}
+
+static void SocketPollEpoll400(benchmark::State& state)
+{
+    SocketPollRounds(state, false, 400);
+}
+
+static void SocketPollEpoll10000(benchmark::State& state)
+{
+    SocketPollRounds(state, false, 10000);
+}
+
+BENCHMARK(SocketPollSelect400);
+BENCHMARK(SocketPollEpoll400);
+BENCHMARK(SocketPollEpoll10000);
+#endif
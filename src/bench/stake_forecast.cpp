@@ -0,0 +1,41 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "kernel.h"
+#include "random.h"
+
+// A large synthetic wallet forecast over the whole future drift window
+static const size_t FORECAST_BENCH_INPUTS = 100000;
+static const unsigned int FORECAST_BENCH_BITS = 0x1b0404cb;
+
+static void StakeForecast(benchmark::State& state, int nThreads)
+{
+    std::vector<CStakeKernelInput> vInputs(FORECAST_BENCH_INPUTS);
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        vInputs[i].nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        vInputs[i].nTimeBlockFrom = 1500000000 + i;
+        vInputs[i].prevout = COutPoint(GetRandHash(), i % 4);
+        vInputs[i].nValueIn = 100 * COIN;
+    }
+
+    while (state.KeepRunning()) {
+        CStakeForecast forecast;
+        ForecastStakeKernels(FORECAST_BENCH_BITS, vInputs, 1600000001, 1600000000 + MAX_STAKE_FUTURE_DRIFT, nThreads, forecast);
+    }
+}
+
+static void StakeForecastOneThread(benchmark::State& state)
+{
+    StakeForecast(state, 1);
+}
+
+static void StakeForecastAllThreads(benchmark::State& state)
+{
+    StakeForecast(state, 0);
+}
+
+BENCHMARK(StakeForecastOneThread);
+BENCHMARK(StakeForecastAllThreads);
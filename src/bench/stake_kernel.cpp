@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "kernel.h"
+#include "random.h"
+
+#include <boost/thread.hpp>
+
+// Kernels per search: STAKE_BENCH_INPUTS * STAKE_BENCH_DRIFT
+static const size_t STAKE_BENCH_INPUTS = 2000;
+static const unsigned int STAKE_BENCH_DRIFT = 45;
+// Target of 1 per coin day: no kernel is ever found, so every search covers the whole grid
+static const unsigned int STAKE_BENCH_BITS = 0x03000001;
+
+static std::vector<CStakeKernelInput> MakeStakeInputs()
+{
+    std::vector<CStakeKernelInput> vInputs(STAKE_BENCH_INPUTS);
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        vInputs[i].nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        vInputs[i].nTimeBlockFrom = 1500000000 + i;
+        vInputs[i].prevout = COutPoint(GetRandHash(), i % 4);
+        vInputs[i].nValueIn = 1000 * COIN;
+    }
+    return vInputs;
+}
+
+// The per-UTXO loop CreateCoinStake used before the parallel search
+static void StakeKernelSerialLoop(benchmark::State& state)
+{
+    std::vector<CStakeKernelInput> vInputs = MakeStakeInputs();
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(STAKE_BENCH_BITS);
+    unsigned int nTimeTx = 1600000000;
+
+    while (state.KeepRunning()) {
+        for (const CStakeKernelInput& input : vInputs) {
+            CDataStream ss(SER_GETHASH, 0);
+            ss << input.nStakeModifier;
+            for (unsigned int i = 0; i < STAKE_BENCH_DRIFT; i++) {
+                uint256 hashProofOfStake = stakeHash(nTimeTx + STAKE_BENCH_DRIFT - i, ss, input.prevout.n, input.prevout.hash, input.nTimeBlockFrom);
+                if (stakeTargetHit(hashProofOfStake, input.nValueIn, bnTargetPerCoinDay))
+                    break;
+            }
+        }
+    }
+}
+
+static void StakeKernelSearch(benchmark::State& state, int nThreads)
+{
+    std::vector<CStakeKernelInput> vInputs = MakeStakeInputs();
+
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = 1600000000;
+        size_t nInput = 0;
+        uint256 hashProofOfStake;
+        SearchStakeKernel(STAKE_BENCH_BITS, vInputs, NULL, nTimeTx, STAKE_BENCH_DRIFT, nThreads, nInput, hashProofOfStake);
+    }
+}
+
+static void StakeKernelSearchOneThread(benchmark::State& state)
+{
+    StakeKernelSearch(state, 1);
+}
+
+static void StakeKernelSearchAllThreads(benchmark::State& state)
+{
+    StakeKernelSearch(state, 0);
+}
+
+BENCHMARK(StakeKernelSerialLoop);
+BENCHMARK(StakeKernelSearchOneThread);
+BENCHMARK(StakeKernelSearchAllThreads);
+
+// Single kernel hash per iteration: stream copy + full serialization
+static void StakeHashStream(benchmark::State& state)
+{
+    COutPoint prevout(GetRandHash(), 1);
+    CDataStream ss(SER_GETHASH, 0);
+    ss << GetRand(std::numeric_limits<uint64_t>::max());
+    unsigned int nTimeTx = 1600000000;
+
+    while (state.KeepRunning())
+        stakeHash(nTimeTx++, ss, prevout.n, prevout.hash, 1500000000);
+}
+
+// Single kernel hash per iteration: prefix serialized once, copied and completed with the 4-byte time
+static void StakeHashPrefix(benchmark::State& state)
+{
+    COutPoint prevout(GetRandHash(), 1);
+    CStakeKernelHasher hasher(GetRand(std::numeric_limits<uint64_t>::max()), 1500000000, prevout);
+    unsigned int nTimeTx = 1600000000;
+
+    while (state.KeepRunning())
+        hasher.GetHash(nTimeTx++);
+}
+
+// Whole drift window of one input per iteration, through the multi-buffer backend
+static void StakeHashBatch(benchmark::State& state)
+{
+    COutPoint prevout(GetRandHash(), 1);
+    CStakeKernelHasher hasher(GetRand(std::numeric_limits<uint64_t>::max()), 1500000000, prevout);
+    std::vector<uint256> vHashes(STAKE_BENCH_DRIFT);
+    unsigned int nTimeTx = 1600000000;
+
+    while (state.KeepRunning()) {
+        hasher.GetHashes(nTimeTx, STAKE_BENCH_DRIFT, vHashes.data());
+        nTimeTx += STAKE_BENCH_DRIFT;
+    }
+}
+
+BENCHMARK(StakeHashStream);
+BENCHMARK(StakeHashPrefix);
+BENCHMARK(StakeHashBatch);
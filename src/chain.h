@@ -154,6 +154,7 @@ public:
         BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
         BLOCK_STAKE_ENTROPY = (1 << 1),  // entropy bit for stake modifier
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
+        BLOCK_STAKE_PENDING = (1 << 3),  // stake fields are computed once the parent is connected
     };
 
     // proof-of-stake specific fields
@@ -270,6 +271,8 @@ public:
         block.nTime = nTime;
         block.nBits = nBits;
         block.nNonce = nNonce;
+        if (phashBlock && (pprev || nHeight == 0))
+            block.SetCachedHash(*phashBlock);
         return block;
     }
 
@@ -451,6 +454,10 @@ public:
 
     uint256 GetBlockHash() const
     {
+        // Copied from an indexed block: the hash is known. Read from disk: compute it.
+        if (phashBlock)
+            return *phashBlock;
+
         CBlockHeader block;
         block.nVersion = nVersion;
         block.hashPrevBlock = hashPrev;
@@ -63,6 +63,11 @@ bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return fal
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
 bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+bool CCoinsView::BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    CCoinsMap mapCopy(mapCoins);
+    return BatchWrite(mapCopy, hashBlock);
+}
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
 
 
@@ -72,6 +77,7 @@ bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveC
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWriteSnapshot(mapCoins, hashBlock); }
 bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
@@ -285,6 +285,102 @@ public:
     }
 };
 
+/**
+ * One unspent transaction output together with the metadata of the
+ * transaction that created it. The chainstate database stores one of these
+ * per output, so spending an output touches only its own record.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode), with nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+class CTxOutCoin
+{
+public:
+    //! the output itself; IsNull() when spent
+    CTxOut out;
+
+    //! at which height the creating transaction was included in the active block chain
+    int nHeight;
+
+    //! version of the creating transaction
+    int nVersion;
+
+    bool fCoinBase;
+    bool fCoinStake;
+
+    CTxOutCoin() : nHeight(0), nVersion(0), fCoinBase(false), fCoinStake(false) {}
+
+    //! output nPos of coins, which must be in range
+    CTxOutCoin(const CCoins& coins, unsigned int nPos) : out(coins.vout[nPos]), nHeight(coins.nHeight), nVersion(coins.nVersion),
+                                                         fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake) {}
+
+    void Clear()
+    {
+        out.SetNull();
+        nHeight = 0;
+        nVersion = 0;
+        fCoinBase = false;
+        fCoinStake = false;
+    }
+
+    bool IsSpent() const
+    {
+        return out.IsNull();
+    }
+
+    //! whether this output belongs to the transaction described by coins
+    bool HasMetadataOf(const CCoins& coins) const
+    {
+        return nHeight == coins.nHeight && nVersion == coins.nVersion && fCoinBase == coins.fCoinBase && fCoinStake == coins.fCoinStake;
+    }
+
+    //! take over the transaction metadata into coins, and this output as vout[nPos]
+    void AddTo(CCoins& coins, unsigned int nPos) const
+    {
+        coins.fCoinBase = fCoinBase;
+        coins.fCoinStake = fCoinStake;
+        coins.nHeight = nHeight;
+        coins.nVersion = nVersion;
+        if (coins.vout.size() <= nPos)
+            coins.vout.resize(nPos + 1);
+        coins.vout[nPos] = out;
+    }
+
+    void swap(CTxOutCoin& to)
+    {
+        std::swap(to.out.nValue, out.nValue);
+        to.out.scriptPubKey.swap(out.scriptPubKey);
+        std::swap(to.nHeight, nHeight);
+        std::swap(to.nVersion, nVersion);
+        std::swap(to.fCoinBase, fCoinBase);
+        std::swap(to.fCoinStake, fCoinStake);
+    }
+
+    //! heap memory held by the output script
+    size_t DynamicMemoryUsage() const
+    {
+        return out.scriptPubKey.capacity();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        unsigned int nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(this->nVersion));
+        READWRITE(VARINT(nCode));
+        READWRITE(REF(CTxOutCompressor(REF(out))));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 4;
+            fCoinStake = (nCode & 2) != 0;
+            fCoinBase = (nCode & 1) != 0;
+        }
+    }
+};
+
 class CCoinsKeyHasher
 {
 private:
@@ -349,6 +445,10 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
 
+    //! Like BatchWrite, but leaves mapCoins as it is, for callers that keep
+    //! reading it during the write. The default writes a copy.
+    virtual bool BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock);
+
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats& stats) const;
 
@@ -370,6 +470,7 @@ public:
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
 };
 
@@ -0,0 +1,165 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflat.h"
+
+#include "random.h"
+
+CCoinsFlatCache::CCoinsFlatCache() : nUsed(0), nScriptUsage(0), salt(GetRandHash())
+{
+}
+
+size_t CCoinsFlatCache::HomeSlot(const COutPoint& outpoint) const
+{
+    uint64_t nHash = outpoint.hash.GetHash(salt) ^ (outpoint.n * 0x9e3779b97f4a7c15ULL);
+    return (size_t)nHash & (vSlots.size() - 1);
+}
+
+size_t CCoinsFlatCache::FindSlot(const COutPoint& outpoint) const
+{
+    if (vSlots.empty())
+        return NOT_FOUND;
+    size_t nMask = vSlots.size() - 1;
+    // The load factor stays below 3/4, so the probe always reaches a free slot
+    for (size_t i = HomeSlot(outpoint);; i = (i + 1) & nMask) {
+        const Entry& entry = vSlots[i];
+        if (!(entry.flags & USED))
+            return NOT_FOUND;
+        if (entry.outpoint == outpoint)
+            return i;
+    }
+}
+
+void CCoinsFlatCache::Resize(size_t nSlots)
+{
+    std::vector<Entry> vOld(nSlots);
+    vOld.swap(vSlots);
+    for (size_t i = 0; i < vOld.size(); i++) {
+        Entry& old = vOld[i];
+        if (!(old.flags & USED))
+            continue;
+        size_t nMask = vSlots.size() - 1;
+        size_t j = HomeSlot(old.outpoint);
+        while (vSlots[j].flags & USED)
+            j = (j + 1) & nMask;
+        vSlots[j].outpoint = old.outpoint;
+        vSlots[j].coin.swap(old.coin);
+        vSlots[j].flags = old.flags;
+    }
+}
+
+CCoinsFlatCache::Entry& CCoinsFlatCache::InsertSlot(const COutPoint& outpoint)
+{
+    size_t nSlot = FindSlot(outpoint);
+    if (nSlot != NOT_FOUND)
+        return vSlots[nSlot];
+
+    if ((nUsed + 1) * 4 > vSlots.size() * 3)
+        Resize(vSlots.empty() ? MIN_SLOTS : vSlots.size() * 2);
+    size_t nMask = vSlots.size() - 1;
+    nSlot = HomeSlot(outpoint);
+    while (vSlots[nSlot].flags & USED)
+        nSlot = (nSlot + 1) & nMask;
+    Entry& entry = vSlots[nSlot];
+    entry.outpoint = outpoint;
+    entry.coin.Clear();
+    entry.flags = USED;
+    nUsed++;
+    return entry;
+}
+
+void CCoinsFlatCache::EraseSlot(size_t nSlot)
+{
+    size_t nMask = vSlots.size() - 1;
+    nScriptUsage -= vSlots[nSlot].coin.DynamicMemoryUsage();
+    nUsed--;
+
+    // Move back every following entry of the probe run that the hole would
+    // otherwise cut off from its home slot
+    size_t i = nSlot;
+    for (size_t j = (i + 1) & nMask; vSlots[j].flags & USED; j = (j + 1) & nMask) {
+        size_t k = HomeSlot(vSlots[j].outpoint);
+        bool fStays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (fStays)
+            continue;
+        vSlots[i].outpoint = vSlots[j].outpoint;
+        vSlots[i].coin.swap(vSlots[j].coin);
+        vSlots[i].flags = vSlots[j].flags;
+        i = j;
+    }
+    Entry& entry = vSlots[i];
+    entry.outpoint.SetNull();
+    CTxOutCoin().swap(entry.coin);
+    entry.flags = 0;
+}
+
+bool CCoinsFlatCache::GetCoin(const COutPoint& outpoint, CTxOutCoin& coin) const
+{
+    size_t nSlot = FindSlot(outpoint);
+    if (nSlot == NOT_FOUND)
+        return false;
+    coin = vSlots[nSlot].coin;
+    return true;
+}
+
+bool CCoinsFlatCache::GetCoins(const uint256& txid, CCoins& coins, bool& fHave) const
+{
+    coins.Clear();
+    fHave = false;
+    for (uint32_t n = 0;; n++) {
+        size_t nSlot = FindSlot(COutPoint(txid, n));
+        if (nSlot == NOT_FOUND) {
+            // Not cached. SetCoins and EraseCoins handle all entries of a
+            // transaction at once, so this happens at n == 0.
+            coins.Clear();
+            fHave = false;
+            return false;
+        }
+        const Entry& entry = vSlots[nSlot];
+        if (!entry.coin.IsSpent()) {
+            entry.coin.AddTo(coins, n);
+            fHave = true;
+        }
+        if (entry.flags & LAST)
+            return true;
+    }
+}
+
+void CCoinsFlatCache::EraseCoins(const uint256& txid)
+{
+    for (uint32_t n = 0;; n++) {
+        size_t nSlot = FindSlot(COutPoint(txid, n));
+        if (nSlot == NOT_FOUND)
+            return;
+        bool fLast = vSlots[nSlot].flags & LAST;
+        EraseSlot(nSlot);
+        if (fLast)
+            return;
+    }
+}
+
+void CCoinsFlatCache::SetCoins(const uint256& txid, const CCoins& coins)
+{
+    EraseCoins(txid);
+
+    // vout never ends in a spent output (see CCoins::Cleanup), so the last
+    // entry is the last unspent output, or index 0 when there is none
+    uint32_t nLast = coins.vout.empty() ? 0 : coins.vout.size() - 1;
+    for (uint32_t n = 0; n <= nLast; n++) {
+        Entry& entry = InsertSlot(COutPoint(txid, n));
+        if (coins.IsAvailable(n)) {
+            entry.coin = CTxOutCoin(coins, n);
+            nScriptUsage += entry.coin.DynamicMemoryUsage();
+        }
+        if (n == nLast)
+            entry.flags |= LAST;
+    }
+}
+
+void CCoinsFlatCache::Clear()
+{
+    std::vector<Entry>().swap(vSlots);
+    nUsed = 0;
+    nScriptUsage = 0;
+}
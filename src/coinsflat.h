@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSFLAT_H
+#define BITCOIN_COINSFLAT_H
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Open-addressing hash table of transaction outputs keyed by COutPoint.
+ *
+ * All entries live in one contiguous vector and collisions are resolved by
+ * linear probing, so a lookup touches one or two cache lines instead of
+ * following the node pointers of a boost::unordered_map. Erasing shifts the
+ * following entries back, so no tombstones build up. The table accounts for
+ * the memory it uses, output scripts included.
+ *
+ * Besides single outputs it holds whole transactions: SetCoins stores every
+ * index up to the last unspent output, spent holes included, and flags the
+ * last one. GetCoins can therefore tell a fully cached transaction from one
+ * that is not cached at all. A transaction without unspent outputs is stored
+ * as a single spent entry at index 0, which caches the fact that it has none.
+ */
+class CCoinsFlatCache
+{
+private:
+    struct Entry {
+        COutPoint outpoint;
+        CTxOutCoin coin;
+        unsigned char flags;
+
+        Entry() : flags(0) {}
+    };
+
+    enum Flags {
+        USED = (1 << 0), //! the slot holds an entry
+        LAST = (1 << 1), //! highest index stored for the transaction
+    };
+
+    static const size_t NOT_FOUND = (size_t)-1;
+    static const size_t MIN_SLOTS = 1024;
+
+    std::vector<Entry> vSlots;
+    size_t nUsed;
+    size_t nScriptUsage;
+    uint256 salt;
+
+    size_t HomeSlot(const COutPoint& outpoint) const;
+    size_t FindSlot(const COutPoint& outpoint) const;
+    Entry& InsertSlot(const COutPoint& outpoint);
+    void EraseSlot(size_t nSlot);
+    void Resize(size_t nSlots);
+
+public:
+    CCoinsFlatCache();
+
+    //! Look up a single output; a spent entry means the output is known to be unavailable
+    bool GetCoin(const COutPoint& outpoint, CTxOutCoin& coin) const;
+
+    /**
+     * Assemble the unspent outputs of txid. Returns false when the
+     * transaction is not (completely) cached; otherwise fHave tells whether
+     * it has unspent outputs, and coins holds them.
+     */
+    bool GetCoins(const uint256& txid, CCoins& coins, bool& fHave) const;
+
+    //! Replace whatever is cached for txid by coins, which may be pruned
+    void SetCoins(const uint256& txid, const CCoins& coins);
+
+    //! Forget txid
+    void EraseCoins(const uint256& txid);
+
+    void Clear();
+
+    //! Number of outputs stored, spent markers included
+    size_t GetSize() const
+    {
+        return nUsed;
+    }
+
+    //! Heap memory used by the table and the scripts in it
+    size_t DynamicMemoryUsage() const
+    {
+        return vSlots.capacity() * sizeof(Entry) + nScriptUsage;
+    }
+};
+
+#endif // BITCOIN_COINSFLAT_H
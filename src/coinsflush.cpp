@@ -0,0 +1,160 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflush.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <string.h>
+
+#include <boost/bind.hpp>
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsView* baseIn, bool fBackground) : CCoinsViewBacked(baseIn),
+                                                                                              hashPendingBlock(0),
+                                                                                              fWriting(false),
+                                                                                              fWriteFailed(false),
+                                                                                              fStop(false)
+{
+    memset(&stats, 0, sizeof(stats));
+    if (fBackground)
+        thread = boost::thread(boost::bind(&CCoinsViewBackgroundFlush::ThreadFlush, this));
+}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+void CCoinsViewBackgroundFlush::ThreadFlush()
+{
+    RenameThread("artax-coinsflush");
+    while (true) {
+        uint256 hashBlock;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fWriting && !fStop)
+                cond.wait(lock);
+            // A snapshot handed over before shutdown is still written
+            if (!fWriting)
+                return;
+            hashBlock = hashPendingBlock;
+        }
+
+        // mapPending does not change while fWriting is set, so it can be
+        // written without the lock while readers keep using it. The base
+        // view writes it in place instead of consuming a copy.
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWriteSnapshot(mapPending, hashBlock);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        int64_t nDuration = GetTimeMicros() - nStart;
+        LogPrint("coindb", "Background flush of %u entries: %.2fms\n", (unsigned int)mapPending.size(), nDuration * 0.001);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fOk) {
+                CCoinsMap().swap(mapPending);
+            } else {
+                // Keep serving the snapshot; the next flush reports the failure
+                LogPrintf("%s : failed to write the chainstate\n", __func__);
+                fWriteFailed = true;
+            }
+            fWriting = false;
+            stats.nFlushes++;
+            stats.nLastWriteMicros = nDuration;
+            stats.nTotalWriteMicros += nDuration;
+        }
+        cond.notify_all();
+    }
+}
+
+bool CCoinsViewBackgroundFlush::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    // Not part of the snapshot, so the write in flight does not touch it
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoins(const uint256& txid) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end())
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if ((fWriting || fWriteFailed) && hashPendingBlock != 0)
+            return hashPendingBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (!thread.joinable())
+        return base->BatchWrite(mapCoins, hashBlock);
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (fWriting) {
+        int64_t nStart = GetTimeMicros();
+        while (fWriting)
+            cond.wait(lock);
+        int64_t nStall = GetTimeMicros() - nStart;
+        stats.nStalls++;
+        stats.nLastStallMicros = nStall;
+        stats.nMaxStallMicros = std::max(stats.nMaxStallMicros, nStall);
+        stats.nTotalStallMicros += nStall;
+        LogPrint("coindb", "Chainstate flush waited %.2fms for the previous write\n", nStall * 0.001);
+    }
+    if (fWriteFailed)
+        return false;
+
+    // The previous snapshot is in the base view now, so mapPending is empty
+    // and the flushed entries are relative to the base view alone.
+    mapPending.swap(mapCoins);
+    hashPendingBlock = hashBlock;
+    fWriting = true;
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fWriting)
+        cond.wait(lock);
+    return !fWriteFailed;
+}
+
+void CCoinsViewBackgroundFlush::GetFlushStats(CCoinsFlushStats& statsOut) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    statsOut = stats;
+    statsOut.fWriting = fWriting;
+    statsOut.nPendingEntries = fWriting ? mapPending.size() : 0;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSFLUSH_H
+#define BITCOIN_COINSFLUSH_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** -backgroundflush default */
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+
+struct CCoinsFlushStats {
+    uint64_t nFlushes;          //! snapshots written
+    bool fWriting;              //! a snapshot is being written right now
+    size_t nPendingEntries;     //! entries of that snapshot
+    int64_t nLastWriteMicros;   //! duration of the last completed write
+    int64_t nTotalWriteMicros;  //! duration of all completed writes
+    uint64_t nStalls;           //! flushes that had to wait for the previous one
+    int64_t nLastStallMicros;   //! time the last such flush waited
+    int64_t nMaxStallMicros;
+    int64_t nTotalStallMicros;
+};
+
+/**
+ * Write-behind layer between the coins tip cache and the database.
+ *
+ * BatchWrite takes over the flushed cache entries in one swap and returns;
+ * a background thread writes them to the base view while validation goes
+ * on. Until that write completes the entries stay readable here, so the
+ * layers above see the new state while the database still has the old
+ * one. The base view writes the entries together with the best block
+ * marker in one atomic batch, so after a crash the database is at one of
+ * the flushed blocks and the blocks after it are connected again.
+ *
+ * At most one snapshot is in flight: a flush arriving while the previous
+ * write is still running waits for it. That bounds the memory held here
+ * to one snapshot of the tip cache, and the waits are counted as stalls.
+ */
+class CCoinsViewBackgroundFlush : public CCoinsViewBacked
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Snapshot handed over by the last BatchWrite; only changed while no write is running
+    CCoinsMap mapPending;
+    uint256 hashPendingBlock;
+    bool fWriting;
+    bool fWriteFailed;
+    bool fStop;
+    CCoinsFlushStats stats;
+    boost::thread thread;
+
+    void ThreadFlush();
+
+public:
+    //! Without fBackground, writes go straight through to the base view
+    CCoinsViewBackgroundFlush(CCoinsView* baseIn, bool fBackground);
+    //! Finishes the write in flight
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+
+    /** Wait until the snapshot in flight is in the base view. Returns false if writing it failed. */
+    bool Wait();
+
+    void GetFlushStats(CCoinsFlushStats& statsOut) const;
+};
+
+#endif // BITCOIN_COINSFLUSH_H
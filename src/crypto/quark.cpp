@@ -0,0 +1,314 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/artax-config.h"
+#endif
+
+#include "crypto/quark.h"
+
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_skein.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace quark_aesni
+{
+void Groestl512(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace quark_avx2
+{
+void Groestl512_4way(unsigned char* out, const unsigned char* in);
+void JH512_4way(unsigned char* out, const unsigned char* in);
+void Skein512_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+namespace
+{
+/** Initialized contexts, copied instead of running the init functions for every hash. */
+struct CQuarkContexts {
+    sph_blake512_context blake;
+    sph_bmw512_context bmw;
+    sph_groestl512_context groestl;
+    sph_jh512_context jh;
+    sph_keccak512_context keccak;
+    sph_skein512_context skein;
+
+    CQuarkContexts()
+    {
+        sph_blake512_init(&blake);
+        sph_bmw512_init(&bmw);
+        sph_groestl512_init(&groestl);
+        sph_jh512_init(&jh);
+        sph_keccak512_init(&keccak);
+        sph_skein512_init(&skein);
+    }
+};
+
+/** Function-local so hashes computed during static initialization (chain params) see initialized contexts. */
+const CQuarkContexts& Contexts()
+{
+    static const CQuarkContexts contexts;
+    return contexts;
+}
+
+/** Every stage after the first one hashes the 64 byte output of the previous stage. */
+const size_t STAGE_SIZE = 64;
+
+typedef void (*StageType)(unsigned char* out, const unsigned char* in);
+
+void Blake(unsigned char* out, const unsigned char* in)
+{
+    sph_blake512_context ctx = Contexts().blake;
+    sph_blake512(&ctx, in, STAGE_SIZE);
+    sph_blake512_close(&ctx, out);
+}
+
+void Bmw(unsigned char* out, const unsigned char* in)
+{
+    sph_bmw512_context ctx = Contexts().bmw;
+    sph_bmw512(&ctx, in, STAGE_SIZE);
+    sph_bmw512_close(&ctx, out);
+}
+
+void Groestl(unsigned char* out, const unsigned char* in)
+{
+    sph_groestl512_context ctx = Contexts().groestl;
+    sph_groestl512(&ctx, in, STAGE_SIZE);
+    sph_groestl512_close(&ctx, out);
+}
+
+void JH(unsigned char* out, const unsigned char* in)
+{
+    sph_jh512_context ctx = Contexts().jh;
+    sph_jh512(&ctx, in, STAGE_SIZE);
+    sph_jh512_close(&ctx, out);
+}
+
+void Keccak(unsigned char* out, const unsigned char* in)
+{
+    sph_keccak512_context ctx = Contexts().keccak;
+    sph_keccak512(&ctx, in, STAGE_SIZE);
+    sph_keccak512_close(&ctx, out);
+}
+
+void Skein(unsigned char* out, const unsigned char* in)
+{
+    sph_skein512_context ctx = Contexts().skein;
+    sph_skein512(&ctx, in, STAGE_SIZE);
+    sph_skein512_close(&ctx, out);
+}
+
+/** A stage implementation: one message at a time, and optionally four at once. */
+struct CStage {
+    StageType single;
+    StageType multi;
+};
+
+CStage stageBlake = {Blake, NULL};
+CStage stageBmw = {Bmw, NULL};
+CStage stageGroestl = {Groestl, NULL};
+CStage stageJH = {JH, NULL};
+CStage stageKeccak = {Keccak, NULL};
+CStage stageSkein = {Skein, NULL};
+
+const size_t MULTI_LANES = 4;
+
+/** Stages 2 to 9. A branching stage runs first if bit 3 of the previous output is set, else second. */
+struct CStep {
+    const CStage* first;
+    const CStage* second;
+};
+
+const CStep steps[] = {
+    {&stageBmw, NULL},
+    {&stageGroestl, &stageSkein},
+    {&stageGroestl, NULL},
+    {&stageJH, NULL},
+    {&stageBlake, &stageBmw},
+    {&stageKeccak, NULL},
+    {&stageSkein, NULL},
+    {&stageKeccak, &stageJH},
+};
+
+bool inline TakesFirst(const unsigned char* hash)
+{
+    return (hash[0] & 8) != 0;
+}
+
+/** Run the chain after the first stage on one 64 byte state. */
+void HashChain(unsigned char* hash)
+{
+    unsigned char tmp[STAGE_SIZE];
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        const CStage* stage = (!steps[i].second || TakesFirst(hash)) ? steps[i].first : steps[i].second;
+        stage->single(tmp, hash);
+        memcpy(hash, tmp, STAGE_SIZE);
+    }
+}
+
+/** Run one stage on the states listed in vIndex, four at a time where the stage allows it. */
+void RunStage(const CStage& stage, unsigned char* hashes, const size_t* vIndex, size_t count)
+{
+    unsigned char in[STAGE_SIZE * MULTI_LANES];
+    unsigned char out[STAGE_SIZE * MULTI_LANES];
+    size_t n = 0;
+    if (stage.multi) {
+        for (; n + MULTI_LANES <= count; n += MULTI_LANES) {
+            for (size_t lane = 0; lane < MULTI_LANES; lane++)
+                memcpy(in + STAGE_SIZE * lane, hashes + STAGE_SIZE * vIndex[n + lane], STAGE_SIZE);
+            stage.multi(out, in);
+            for (size_t lane = 0; lane < MULTI_LANES; lane++)
+                memcpy(hashes + STAGE_SIZE * vIndex[n + lane], out + STAGE_SIZE * lane, STAGE_SIZE);
+        }
+    }
+    for (; n < count; n++) {
+        unsigned char* hash = hashes + STAGE_SIZE * vIndex[n];
+        stage.single(out, hash);
+        memcpy(hash, out, STAGE_SIZE);
+    }
+}
+
+/** Largest number of states HashChainBatch works on at once. */
+const size_t MAX_BATCH = 64;
+
+/** Run the chain after the first stage on count (at most MAX_BATCH) 64 byte states side by side. */
+void HashChainBatch(unsigned char* hashes, size_t count)
+{
+    size_t vFirst[MAX_BATCH], vSecond[MAX_BATCH];
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        // Split the states by the branch they take
+        size_t nFirst = 0, nSecond = 0;
+        for (size_t n = 0; n < count; n++) {
+            if (!steps[i].second || TakesFirst(hashes + STAGE_SIZE * n))
+                vFirst[nFirst++] = n;
+            else
+                vSecond[nSecond++] = n;
+        }
+        RunStage(*steps[i].first, hashes, vFirst, nFirst);
+        if (nSecond > 0)
+            RunStage(*steps[i].second, hashes, vSecond, nSecond);
+    }
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv"
+            : "=a"(a), "=d"(d)
+            : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+std::string QuarkAutoDetect(int nAllowedBackends)
+{
+    std::string ret = "standard";
+    stageGroestl.single = Groestl;
+    stageGroestl.multi = NULL;
+    stageJH.multi = NULL;
+    stageSkein.multi = NULL;
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_aesni = false, have_avx2 = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_aesni = ((ecx >> 9) & 1) && ((ecx >> 25) & 1);
+        bool have_xsave = (ecx >> 27) & 1;
+        bool have_avx = (ecx >> 28) & 1;
+        if (__get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = have_xsave && have_avx && ((ebx >> 5) & 1) && AVXEnabled();
+        }
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && (nAllowedBackends & QUARK_BACKEND_AVX2)) {
+        stageGroestl.multi = quark_avx2::Groestl512_4way;
+        stageJH.multi = quark_avx2::JH512_4way;
+        stageSkein.multi = quark_avx2::Skein512_4way;
+        ret += ",avx2(4way groestl,jh,skein)";
+    }
+#endif
+
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_aesni && (nAllowedBackends & QUARK_BACKEND_AESNI)) {
+        // One message at a time on AES-NI is faster than four lanes of table gathers
+        stageGroestl.single = quark_aesni::Groestl512;
+        stageGroestl.multi = NULL;
+        ret += ",aesni(1way groestl)";
+    }
+#endif
+#endif
+
+    return ret;
+}
+
+////// Quark
+
+CQuarkHasher::CQuarkHasher()
+{
+    Reset();
+}
+
+CQuarkHasher& CQuarkHasher::Write(const unsigned char* data, size_t len)
+{
+    sph_blake512(&ctx_blake, data, len);
+    return *this;
+}
+
+void CQuarkHasher::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    unsigned char state[STAGE_SIZE];
+    sph_blake512_context ctx = ctx_blake;
+    sph_blake512_close(&ctx, state);
+    HashChain(state);
+    memcpy(hash, state, OUTPUT_SIZE);
+}
+
+void CQuarkHasher::FinalizeTails(unsigned char* hashes, const unsigned char* tails, size_t tail_len, size_t count) const
+{
+    unsigned char states[STAGE_SIZE * MAX_BATCH];
+    while (count > 0) {
+        size_t nBatch = count < MAX_BATCH ? count : MAX_BATCH;
+        for (size_t n = 0; n < nBatch; n++) {
+            sph_blake512_context ctx = ctx_blake;
+            sph_blake512(&ctx, tails + tail_len * n, tail_len);
+            sph_blake512_close(&ctx, states + STAGE_SIZE * n);
+        }
+        HashChainBatch(states, nBatch);
+        for (size_t n = 0; n < nBatch; n++)
+            memcpy(hashes + OUTPUT_SIZE * n, states + STAGE_SIZE * n, OUTPUT_SIZE);
+        hashes += OUTPUT_SIZE * nBatch;
+        tails += tail_len * nBatch;
+        count -= nBatch;
+    }
+}
+
+CQuarkHasher& CQuarkHasher::Reset()
+{
+    ctx_blake = Contexts().blake;
+    return *this;
+}
+
+void QuarkHashBatch(unsigned char* output, const unsigned char* input, size_t len, size_t count)
+{
+    // Every message is a "tail" of an empty prefix
+    CQuarkHasher().FinalizeTails(output, input, len, count);
+}
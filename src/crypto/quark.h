@@ -0,0 +1,54 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_QUARK_H
+#define BITCOIN_CRYPTO_QUARK_H
+
+#include "crypto/sph_blake.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/**
+ * A hasher class for Quark, the nine stage blake/bmw/groestl/jh/keccak/skein chain
+ * used for block headers.
+ *
+ * Only the first stage sees the message, so the state after a common prefix can be
+ * kept and finalized for many different tails, e.g. a header for a range of nonces.
+ * Finalizing does not consume the state.
+ */
+class CQuarkHasher
+{
+private:
+    sph_blake512_context ctx_blake;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CQuarkHasher();
+    CQuarkHasher& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+    /** Hash count messages of the written data followed by tail_len bytes of tails each. */
+    void FinalizeTails(unsigned char* hashes, const unsigned char* tails, size_t tail_len, size_t count) const;
+    CQuarkHasher& Reset();
+};
+
+/** Quark stage backends QuarkAutoDetect() may pick from, as a bit mask. */
+enum QuarkBackend {
+    QUARK_BACKEND_STANDARD = 0,
+    QUARK_BACKEND_AESNI = 1, //!< single-message AES-NI groestl
+    QUARK_BACKEND_AVX2 = 2,  //!< 4-way multi-buffer groestl, jh and skein
+    QUARK_BACKEND_ALL = 3,
+};
+
+/** Select the fastest stage implementations among the allowed backends the CPU supports.
+ *  Returns a description of the selection. */
+std::string QuarkAutoDetect(int nAllowedBackends = QUARK_BACKEND_ALL);
+
+/** Quark hash count messages of len bytes each, stored back to back in input.
+ *  Writes count * 32 bytes to output. */
+void QuarkHashBatch(unsigned char* output, const unsigned char* input, size_t len, size_t count);
+
+#endif // BITCOIN_CRYPTO_QUARK_H
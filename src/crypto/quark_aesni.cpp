@@ -0,0 +1,156 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Groestl-512 stage of the Quark hash on AES-NI, for the 64 byte messages it hashes.
+// The state is kept as 8 rows of 16 bytes: SubBytes is AESENCLAST with a zero key after a
+// shuffle undoing AES ShiftRows (and doing Groestl ShiftBytes), MixBytes is computed row-wise.
+// Built with -mssse3 -maes.
+
+#ifdef ENABLE_AESNI
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace quark_aesni
+{
+namespace
+{
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+
+/** Multiply every byte by 2 in GF(2^8) mod x^8 + x^4 + x^3 + x + 1. */
+__m128i inline Mul2(__m128i x)
+{
+    const __m128i carry = _mm_cmplt_epi8(x, _mm_setzero_si128());
+    return Xor(_mm_add_epi8(x, x), _mm_and_si128(carry, _mm_set1_epi8(0x1b)));
+}
+
+/** ShiftBytes by shift columns followed by SubBytes. */
+template <int shift>
+__m128i inline ShiftSub(__m128i row)
+{
+    // AESENCLAST applies AES ShiftRows before SubBytes: pre-shuffle with its inverse
+    const __m128i mask = _mm_setr_epi8(
+        (0 + shift) & 15, (13 + shift) & 15, (10 + shift) & 15, (7 + shift) & 15,
+        (4 + shift) & 15, (1 + shift) & 15, (14 + shift) & 15, (11 + shift) & 15,
+        (8 + shift) & 15, (5 + shift) & 15, (2 + shift) & 15, (15 + shift) & 15,
+        (12 + shift) & 15, (9 + shift) & 15, (6 + shift) & 15, (3 + shift) & 15);
+    return _mm_aesenclast_si128(_mm_shuffle_epi8(row, mask), _mm_setzero_si128());
+}
+
+/** MixBytes: out[i] = 2y[i] + 2y[i+1] + 3y[i+2] + 4y[i+3] + 5y[i+4] + 3y[i+5] + 5y[i+6] + 7y[i+7]. */
+void inline MixBytes(__m128i* a, const __m128i* y)
+{
+    for (int i = 0; i < 8; i++) {
+        const __m128i x1 = Xor(Xor(y[(i + 2) & 7], y[(i + 4) & 7]), Xor(Xor(y[(i + 5) & 7], y[(i + 6) & 7]), y[(i + 7) & 7]));
+        const __m128i x2 = Xor(Xor(y[i], y[(i + 1) & 7]), Xor(Xor(y[(i + 2) & 7], y[(i + 5) & 7]), y[(i + 7) & 7]));
+        const __m128i x4 = Xor(Xor(y[(i + 3) & 7], y[(i + 4) & 7]), Xor(y[(i + 6) & 7], y[(i + 7) & 7]));
+        a[i] = Xor(x1, Mul2(Xor(x2, Mul2(x4))));
+    }
+}
+
+__m128i inline Columns()
+{
+    return _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+                         (char)0x80, (char)0x90, (char)0xA0, (char)0xB0, (char)0xC0, (char)0xD0, (char)0xE0, (char)0xF0);
+}
+
+void inline RoundP(__m128i* a, int r)
+{
+    __m128i y[8];
+    a[0] = Xor(a[0], Xor(Columns(), _mm_set1_epi8(r)));
+    // Row i of column c is taken from column c + shift
+    y[0] = ShiftSub<0>(a[0]);
+    y[1] = ShiftSub<1>(a[1]);
+    y[2] = ShiftSub<2>(a[2]);
+    y[3] = ShiftSub<3>(a[3]);
+    y[4] = ShiftSub<4>(a[4]);
+    y[5] = ShiftSub<5>(a[5]);
+    y[6] = ShiftSub<6>(a[6]);
+    y[7] = ShiftSub<11>(a[7]);
+    MixBytes(a, y);
+}
+
+void inline RoundQ(__m128i* a, int r)
+{
+    __m128i y[8];
+    const __m128i ones = _mm_set1_epi8(-1);
+    for (int i = 0; i < 7; i++)
+        a[i] = Xor(a[i], ones);
+    a[7] = Xor(a[7], Xor(Xor(Columns(), ones), _mm_set1_epi8(r)));
+    y[0] = ShiftSub<1>(a[0]);
+    y[1] = ShiftSub<3>(a[1]);
+    y[2] = ShiftSub<5>(a[2]);
+    y[3] = ShiftSub<11>(a[3]);
+    y[4] = ShiftSub<0>(a[4]);
+    y[5] = ShiftSub<2>(a[5]);
+    y[6] = ShiftSub<4>(a[6]);
+    y[7] = ShiftSub<6>(a[7]);
+    MixBytes(a, y);
+}
+
+/** P(p) and Q(q), interleaved so the two independent permutations overlap. */
+void PermPQ(__m128i* p, __m128i* q)
+{
+    for (int r = 0; r < 14; r++) {
+        RoundP(p, r);
+        RoundQ(q, r);
+    }
+}
+
+void PermP(__m128i* a)
+{
+    for (int r = 0; r < 14; r++)
+        RoundP(a, r);
+}
+
+/** Byte 8 * c + r of the 128 byte block goes to row r, column c. */
+void ToRows(__m128i* rows, const unsigned char* block)
+{
+    unsigned char tmp[8][16];
+    for (int c = 0; c < 16; c++)
+        for (int r = 0; r < 8; r++)
+            tmp[r][c] = block[8 * c + r];
+    for (int r = 0; r < 8; r++)
+        rows[r] = _mm_loadu_si128((const __m128i*)tmp[r]);
+}
+} // namespace
+
+void Groestl512(unsigned char* out, const unsigned char* in)
+{
+    // One 128 byte block: the message, the 0x80 terminator and a block count of 1
+    unsigned char block[128] = {0};
+    memcpy(block, in, 64);
+    block[64] = 0x80;
+    block[127] = 0x01;
+
+    __m128i h[8], g[8], m[8];
+    ToRows(m, block);
+
+    // The initial state only encodes the 512 bit output size, in the last column
+    for (int r = 0; r < 8; r++)
+        h[r] = _mm_setzero_si128();
+    h[6] = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x02);
+
+    for (int r = 0; r < 8; r++)
+        g[r] = Xor(m[r], h[r]);
+    PermPQ(g, m);
+    for (int r = 0; r < 8; r++)
+        h[r] = Xor(h[r], Xor(g[r], m[r]));
+
+    // Output transformation, keeping the last 8 columns
+    for (int r = 0; r < 8; r++)
+        g[r] = h[r];
+    PermP(g);
+    unsigned char tmp[8][16];
+    for (int r = 0; r < 8; r++)
+        _mm_storeu_si128((__m128i*)tmp[r], Xor(h[r], g[r]));
+    for (int c = 8; c < 16; c++)
+        for (int r = 0; r < 8; r++)
+            out[8 * (c - 8) + r] = tmp[r][c];
+}
+
+} // namespace quark_aesni
+
+#endif
@@ -0,0 +1,567 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way AVX2 versions of the Groestl-512, JH-512 and Skein-512 stages of the Quark hash.
+// They are translations of the 64-bit sph code, restricted to the 64 byte messages every
+// stage after the first one hashes: lane i of each vector holds one 64-bit word of message i.
+// Built with -mavx -mavx2.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+#include <utility>
+
+#include "crypto/common.h"
+
+#define C64e(x)     ((0x##x##ULL >> 56) \
+                    | ((0x##x##ULL >> 40) & 0x000000000000FF00ULL) \
+                    | ((0x##x##ULL >> 24) & 0x0000000000FF0000ULL) \
+                    | ((0x##x##ULL >>  8) & 0x00000000FF000000ULL) \
+                    | ((0x##x##ULL <<  8) & 0x000000FF00000000ULL) \
+                    | ((0x##x##ULL << 24) & 0x0000FF0000000000ULL) \
+                    | ((0x##x##ULL << 40) & 0x00FF000000000000ULL) \
+                    | ((0x##x##ULL << 56) & 0xFF00000000000000ULL))
+
+namespace quark_avx2
+{
+namespace
+{
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); } //!< ~x & y
+__m256i inline Not(__m256i x) { return _mm256_xor_si256(x, _mm256_set1_epi64x(-1)); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+/** Word w of the four consecutive 64 byte messages at in. */
+__m256i inline Load(const unsigned char* in, int w)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 192 + 8 * w), ReadLE64(in + 128 + 8 * w), ReadLE64(in + 64 + 8 * w), ReadLE64(in + 8 * w));
+}
+
+/** Store x as word w of the four consecutive 64 byte digests at out. */
+void inline Store(unsigned char* out, int w, __m256i x)
+{
+    uint64_t v[4];
+    _mm256_storeu_si256((__m256i*)v, x);
+    for (int i = 0; i < 4; i++)
+        WriteLE64(out + 64 * i + 8 * w, v[i]);
+}
+
+////// Groestl-512
+
+/** MixBytes(SubBytes(x)) column for byte 0, as in sph_groestl. */
+const uint64_t T0[256] = {
+    C64e(c632f4a5f497a5c6), C64e(f86f978497eb84f8),
+    C64e(ee5eb099b0c799ee), C64e(f67a8c8d8cf78df6),
+    C64e(ffe8170d17e50dff), C64e(d60adcbddcb7bdd6),
+    C64e(de16c8b1c8a7b1de), C64e(916dfc54fc395491),
+    C64e(6090f050f0c05060), C64e(0207050305040302),
+    C64e(ce2ee0a9e087a9ce), C64e(56d1877d87ac7d56),
+    C64e(e7cc2b192bd519e7), C64e(b513a662a67162b5),
+    C64e(4d7c31e6319ae64d), C64e(ec59b59ab5c39aec),
+    C64e(8f40cf45cf05458f), C64e(1fa3bc9dbc3e9d1f),
+    C64e(8949c040c0094089), C64e(fa68928792ef87fa),
+    C64e(efd03f153fc515ef), C64e(b29426eb267febb2),
+    C64e(8ece40c94007c98e), C64e(fbe61d0b1ded0bfb),
+    C64e(416e2fec2f82ec41), C64e(b31aa967a97d67b3),
+    C64e(5f431cfd1cbefd5f), C64e(456025ea258aea45),
+    C64e(23f9dabfda46bf23), C64e(535102f702a6f753),
+    C64e(e445a196a1d396e4), C64e(9b76ed5bed2d5b9b),
+    C64e(75285dc25deac275), C64e(e1c5241c24d91ce1),
+    C64e(3dd4e9aee97aae3d), C64e(4cf2be6abe986a4c),
+    C64e(6c82ee5aeed85a6c), C64e(7ebdc341c3fc417e),
+    C64e(f5f3060206f102f5), C64e(8352d14fd11d4f83),
+    C64e(688ce45ce4d05c68), C64e(515607f407a2f451),
+    C64e(d18d5c345cb934d1), C64e(f9e1180818e908f9),
+    C64e(e24cae93aedf93e2), C64e(ab3e9573954d73ab),
+    C64e(6297f553f5c45362), C64e(2a6b413f41543f2a),
+    C64e(081c140c14100c08), C64e(9563f652f6315295),
+    C64e(46e9af65af8c6546), C64e(9d7fe25ee2215e9d),
+    C64e(3048782878602830), C64e(37cff8a1f86ea137),
+    C64e(0a1b110f11140f0a), C64e(2febc4b5c45eb52f),
+    C64e(0e151b091b1c090e), C64e(247e5a365a483624),
+    C64e(1badb69bb6369b1b), C64e(df98473d47a53ddf),
+    C64e(cda76a266a8126cd), C64e(4ef5bb69bb9c694e),
+    C64e(7f334ccd4cfecd7f), C64e(ea50ba9fbacf9fea),
+    C64e(123f2d1b2d241b12), C64e(1da4b99eb93a9e1d),
+    C64e(58c49c749cb07458), C64e(3446722e72682e34),
+    C64e(3641772d776c2d36), C64e(dc11cdb2cda3b2dc),
+    C64e(b49d29ee2973eeb4), C64e(5b4d16fb16b6fb5b),
+    C64e(a4a501f60153f6a4), C64e(76a1d74dd7ec4d76),
+    C64e(b714a361a37561b7), C64e(7d3449ce49face7d),
+    C64e(52df8d7b8da47b52), C64e(dd9f423e42a13edd),
+    C64e(5ecd937193bc715e), C64e(13b1a297a2269713),
+    C64e(a6a204f50457f5a6), C64e(b901b868b86968b9),
+    C64e(0000000000000000), C64e(c1b5742c74992cc1),
+    C64e(40e0a060a0806040), C64e(e3c2211f21dd1fe3),
+    C64e(793a43c843f2c879), C64e(b69a2ced2c77edb6),
+    C64e(d40dd9bed9b3bed4), C64e(8d47ca46ca01468d),
+    C64e(671770d970ced967), C64e(72afdd4bdde44b72),
+    C64e(94ed79de7933de94), C64e(98ff67d4672bd498),
+    C64e(b09323e8237be8b0), C64e(855bde4ade114a85),
+    C64e(bb06bd6bbd6d6bbb), C64e(c5bb7e2a7e912ac5),
+    C64e(4f7b34e5349ee54f), C64e(edd73a163ac116ed),
+    C64e(86d254c55417c586), C64e(9af862d7622fd79a),
+    C64e(6699ff55ffcc5566), C64e(11b6a794a7229411),
+    C64e(8ac04acf4a0fcf8a), C64e(e9d9301030c910e9),
+    C64e(040e0a060a080604), C64e(fe66988198e781fe),
+    C64e(a0ab0bf00b5bf0a0), C64e(78b4cc44ccf04478),
+    C64e(25f0d5bad54aba25), C64e(4b753ee33e96e34b),
+    C64e(a2ac0ef30e5ff3a2), C64e(5d4419fe19bafe5d),
+    C64e(80db5bc05b1bc080), C64e(0580858a850a8a05),
+    C64e(3fd3ecadec7ead3f), C64e(21fedfbcdf42bc21),
+    C64e(70a8d848d8e04870), C64e(f1fd0c040cf904f1),
+    C64e(63197adf7ac6df63), C64e(772f58c158eec177),
+    C64e(af309f759f4575af), C64e(42e7a563a5846342),
+    C64e(2070503050403020), C64e(e5cb2e1a2ed11ae5),
+    C64e(fdef120e12e10efd), C64e(bf08b76db7656dbf),
+    C64e(8155d44cd4194c81), C64e(18243c143c301418),
+    C64e(26795f355f4c3526), C64e(c3b2712f719d2fc3),
+    C64e(be8638e13867e1be), C64e(35c8fda2fd6aa235),
+    C64e(88c74fcc4f0bcc88), C64e(2e654b394b5c392e),
+    C64e(936af957f93d5793), C64e(55580df20daaf255),
+    C64e(fc619d829de382fc), C64e(7ab3c947c9f4477a),
+    C64e(c827efacef8bacc8), C64e(ba8832e7326fe7ba),
+    C64e(324f7d2b7d642b32), C64e(e642a495a4d795e6),
+    C64e(c03bfba0fb9ba0c0), C64e(19aab398b3329819),
+    C64e(9ef668d16827d19e), C64e(a322817f815d7fa3),
+    C64e(44eeaa66aa886644), C64e(54d6827e82a87e54),
+    C64e(3bdde6abe676ab3b), C64e(0b959e839e16830b),
+    C64e(8cc945ca4503ca8c), C64e(c7bc7b297b9529c7),
+    C64e(6b056ed36ed6d36b), C64e(286c443c44503c28),
+    C64e(a72c8b798b5579a7), C64e(bc813de23d63e2bc),
+    C64e(1631271d272c1d16), C64e(ad379a769a4176ad),
+    C64e(db964d3b4dad3bdb), C64e(649efa56fac85664),
+    C64e(74a6d24ed2e84e74), C64e(1436221e22281e14),
+    C64e(92e476db763fdb92), C64e(0c121e0a1e180a0c),
+    C64e(48fcb46cb4906c48), C64e(b88f37e4376be4b8),
+    C64e(9f78e75de7255d9f), C64e(bd0fb26eb2616ebd),
+    C64e(43692aef2a86ef43), C64e(c435f1a6f193a6c4),
+    C64e(39dae3a8e372a839), C64e(31c6f7a4f762a431),
+    C64e(d38a593759bd37d3), C64e(f274868b86ff8bf2),
+    C64e(d583563256b132d5), C64e(8b4ec543c50d438b),
+    C64e(6e85eb59ebdc596e), C64e(da18c2b7c2afb7da),
+    C64e(018e8f8c8f028c01), C64e(b11dac64ac7964b1),
+    C64e(9cf16dd26d23d29c), C64e(49723be03b92e049),
+    C64e(d81fc7b4c7abb4d8), C64e(acb915fa1543faac),
+    C64e(f3fa090709fd07f3), C64e(cfa06f256f8525cf),
+    C64e(ca20eaafea8fafca), C64e(f47d898e89f38ef4),
+    C64e(476720e9208ee947), C64e(1038281828201810),
+    C64e(6f0b64d564ded56f), C64e(f073838883fb88f0),
+    C64e(4afbb16fb1946f4a), C64e(5cca967296b8725c),
+    C64e(38546c246c702438), C64e(575f08f108aef157),
+    C64e(732152c752e6c773), C64e(9764f351f3355197),
+    C64e(cbae6523658d23cb), C64e(a125847c84597ca1),
+    C64e(e857bf9cbfcb9ce8), C64e(3e5d6321637c213e),
+    C64e(96ea7cdd7c37dd96), C64e(611e7fdc7fc2dc61),
+    C64e(0d9c9186911a860d), C64e(0f9b9485941e850f),
+    C64e(e04bab90abdb90e0), C64e(7cbac642c6f8427c),
+    C64e(712657c457e2c471), C64e(cc29e5aae583aacc),
+    C64e(90e373d8733bd890), C64e(06090f050f0c0506),
+    C64e(f7f4030103f501f7), C64e(1c2a36123638121c),
+    C64e(c23cfea3fe9fa3c2), C64e(6a8be15fe1d45f6a),
+    C64e(aebe10f91047f9ae), C64e(69026bd06bd2d069),
+    C64e(17bfa891a82e9117), C64e(9971e858e8295899),
+    C64e(3a5369276974273a), C64e(27f7d0b9d04eb927),
+    C64e(d991483848a938d9), C64e(ebde351335cd13eb),
+    C64e(2be5ceb3ce56b32b), C64e(2277553355443322),
+    C64e(d204d6bbd6bfbbd2), C64e(a9399070904970a9),
+    C64e(07878089800e8907), C64e(33c1f2a7f266a733),
+    C64e(2decc1b6c15ab62d), C64e(3c5a66226678223c),
+    C64e(15b8ad92ad2a9215), C64e(c9a96020608920c9),
+    C64e(875cdb49db154987), C64e(aab01aff1a4fffaa),
+    C64e(50d8887888a07850), C64e(a52b8e7a8e517aa5),
+    C64e(03898a8f8a068f03), C64e(594a13f813b2f859),
+    C64e(09929b809b128009), C64e(1a2339173934171a),
+    C64e(651075da75cada65), C64e(d784533153b531d7),
+    C64e(84d551c65113c684), C64e(d003d3b8d3bbb8d0),
+    C64e(82dc5ec35e1fc382), C64e(29e2cbb0cb52b029),
+    C64e(5ac3997799b4775a), C64e(1e2d3311333c111e),
+    C64e(7b3d46cb46f6cb7b), C64e(a8b71ffc1f4bfca8),
+    C64e(6d0c61d661dad66d), C64e(2c624e3a4e583a2c)};
+
+/** T0 rotated left by 8 * k bits: the lookup table for byte k of a column. */
+struct GroestlTables {
+    uint64_t T[8][256];
+    GroestlTables()
+    {
+        for (int k = 0; k < 8; k++)
+            for (int i = 0; i < 256; i++)
+                T[k][i] = k == 0 ? T0[i] : (T0[i] << (8 * k)) | (T0[i] >> (64 - 8 * k));
+    }
+};
+const GroestlTables groestlTables;
+
+__m256i inline Lookup(int k, __m256i x)
+{
+    const __m256i idx = _mm256_and_si256(_mm256_srli_epi64(x, 8 * k), _mm256_set1_epi64x(0xFF));
+    return _mm256_i64gather_epi64((const long long*)groestlTables.T[k], idx, 8);
+}
+
+/** One column of the round: SubBytes, ShiftBytes and MixBytes through the tables. */
+__m256i inline RBTT(const __m256i* a, int b0, int b1, int b2, int b3, int b4, int b5, int b6, int b7)
+{
+    return Xor(Xor(Xor(Lookup(0, a[b0]), Lookup(1, a[b1])), Xor(Lookup(2, a[b2]), Lookup(3, a[b3]))),
+               Xor(Xor(Lookup(4, a[b4]), Lookup(5, a[b5])), Xor(Lookup(6, a[b6]), Lookup(7, a[b7]))));
+}
+
+void PermP(__m256i* a)
+{
+    for (uint64_t r = 0; r < 14; r++) {
+        __m256i t[16];
+        for (int i = 0; i < 16; i++)
+            a[i] = Xor(a[i], K((uint64_t)(i << 4) + r));
+        for (int i = 0; i < 16; i++)
+            t[i] = RBTT(a, i, (i + 1) & 15, (i + 2) & 15, (i + 3) & 15, (i + 4) & 15, (i + 5) & 15, (i + 6) & 15, (i + 11) & 15);
+        for (int i = 0; i < 16; i++)
+            a[i] = t[i];
+    }
+}
+
+void PermQ(__m256i* a)
+{
+    for (uint64_t r = 0; r < 14; r++) {
+        __m256i t[16];
+        for (int i = 0; i < 16; i++)
+            a[i] = Xor(a[i], K((r << 56) ^ ~((uint64_t)(i << 4) << 56)));
+        for (int i = 0; i < 16; i++)
+            t[i] = RBTT(a, (i + 1) & 15, (i + 3) & 15, (i + 5) & 15, (i + 11) & 15, i, (i + 2) & 15, (i + 4) & 15, (i + 6) & 15);
+        for (int i = 0; i < 16; i++)
+            a[i] = t[i];
+    }
+}
+
+////// JH-512
+
+/** Round constants: even high, even low, odd high, odd low 64-bit words per round. */
+const uint64_t JH_C[168] = {
+    C64e(72d5dea2df15f867), C64e(7b84150ab7231557),
+    C64e(81abd6904d5a87f6), C64e(4e9f4fc5c3d12b40),
+    C64e(ea983ae05c45fa9c), C64e(03c5d29966b2999a),
+    C64e(660296b4f2bb538a), C64e(b556141a88dba231),
+    C64e(03a35a5c9a190edb), C64e(403fb20a87c14410),
+    C64e(1c051980849e951d), C64e(6f33ebad5ee7cddc),
+    C64e(10ba139202bf6b41), C64e(dc786515f7bb27d0),
+    C64e(0a2c813937aa7850), C64e(3f1abfd2410091d3),
+    C64e(422d5a0df6cc7e90), C64e(dd629f9c92c097ce),
+    C64e(185ca70bc72b44ac), C64e(d1df65d663c6fc23),
+    C64e(976e6c039ee0b81a), C64e(2105457e446ceca8),
+    C64e(eef103bb5d8e61fa), C64e(fd9697b294838197),
+    C64e(4a8e8537db03302f), C64e(2a678d2dfb9f6a95),
+    C64e(8afe7381f8b8696c), C64e(8ac77246c07f4214),
+    C64e(c5f4158fbdc75ec4), C64e(75446fa78f11bb80),
+    C64e(52de75b7aee488bc), C64e(82b8001e98a6a3f4),
+    C64e(8ef48f33a9a36315), C64e(aa5f5624d5b7f989),
+    C64e(b6f1ed207c5ae0fd), C64e(36cae95a06422c36),
+    C64e(ce2935434efe983d), C64e(533af974739a4ba7),
+    C64e(d0f51f596f4e8186), C64e(0e9dad81afd85a9f),
+    C64e(a7050667ee34626a), C64e(8b0b28be6eb91727),
+    C64e(47740726c680103f), C64e(e0a07e6fc67e487b),
+    C64e(0d550aa54af8a4c0), C64e(91e3e79f978ef19e),
+    C64e(8676728150608dd4), C64e(7e9e5a41f3e5b062),
+    C64e(fc9f1fec4054207a), C64e(e3e41a00cef4c984),
+    C64e(4fd794f59dfa95d8), C64e(552e7e1124c354a5),
+    C64e(5bdf7228bdfe6e28), C64e(78f57fe20fa5c4b2),
+    C64e(05897cefee49d32e), C64e(447e9385eb28597f),
+    C64e(705f6937b324314a), C64e(5e8628f11dd6e465),
+    C64e(c71b770451b920e7), C64e(74fe43e823d4878a),
+    C64e(7d29e8a3927694f2), C64e(ddcb7a099b30d9c1),
+    C64e(1d1b30fb5bdc1be0), C64e(da24494ff29c82bf),
+    C64e(a4e7ba31b470bfff), C64e(0d324405def8bc48),
+    C64e(3baefc3253bbd339), C64e(459fc3c1e0298ba0),
+    C64e(e5c905fdf7ae090f), C64e(947034124290f134),
+    C64e(a271b701e344ed95), C64e(e93b8e364f2f984a),
+    C64e(88401d63a06cf615), C64e(47c1444b8752afff),
+    C64e(7ebb4af1e20ac630), C64e(4670b6c5cc6e8ce6),
+    C64e(a4d5a456bd4fca00), C64e(da9d844bc83e18ae),
+    C64e(7357ce453064d1ad), C64e(e8a6ce68145c2567),
+    C64e(a3da8cf2cb0ee116), C64e(33e906589a94999a),
+    C64e(1f60b220c26f847b), C64e(d1ceac7fa0d18518),
+    C64e(32595ba18ddd19d3), C64e(509a1cc0aaa5b446),
+    C64e(9f3d6367e4046bba), C64e(f6ca19ab0b56ee7e),
+    C64e(1fb179eaa9282174), C64e(e9bdf7353b3651ee),
+    C64e(1d57ac5a7550d376), C64e(3a46c2fea37d7001),
+    C64e(f735c1af98a4d842), C64e(78edec209e6b6779),
+    C64e(41836315ea3adba8), C64e(fac33b4d32832c83),
+    C64e(a7403b1f1c2747f3), C64e(5940f034b72d769a),
+    C64e(e73e4e6cd2214ffd), C64e(b8fd8d39dc5759ef),
+    C64e(8d9b0c492b49ebda), C64e(5ba2d74968f3700d),
+    C64e(7d3baed07a8d5584), C64e(f5a5e9f0e4f88e65),
+    C64e(a0b8a2f436103b53), C64e(0ca8079e753eec5a),
+    C64e(9168949256e8884f), C64e(5bb05c55f8babc4c),
+    C64e(e3bb3b99f387947b), C64e(75daf4d6726b1c5d),
+    C64e(64aeac28dc34b36d), C64e(6c34a550b828db71),
+    C64e(f861e2f2108d512a), C64e(e3db643359dd75fc),
+    C64e(1cacbcf143ce3fa2), C64e(67bbd13c02e843b0),
+    C64e(330a5bca8829a175), C64e(7f34194db416535c),
+    C64e(923b94c30e794d1e), C64e(797475d7b6eeaf3f),
+    C64e(eaa8d4f7be1a3921), C64e(5cf47e094c232751),
+    C64e(26a32453ba323cd2), C64e(44a3174a6da6d5ad),
+    C64e(b51d3ea6aff2c908), C64e(83593d98916b3c56),
+    C64e(4cf87ca17286604d), C64e(46e23ecc086ec7f6),
+    C64e(2f9833b3b1bc765e), C64e(2bd666a5efc4e62a),
+    C64e(06f4b6e8bec1d436), C64e(74ee8215bcef2163),
+    C64e(fdc14e0df453c969), C64e(a77d5ac406585826),
+    C64e(7ec1141606e0fa16), C64e(7e90af3d28639d3f),
+    C64e(d2c9f2e3009bd20c), C64e(5faace30b7d40c30),
+    C64e(742a5116f2e03298), C64e(0deb30d8e3cef89a),
+    C64e(4bc59e7bb5f17992), C64e(ff51e66e048668d3),
+    C64e(9b234d57e6966731), C64e(cce6a6f3170a7505),
+    C64e(b17681d913326cce), C64e(3c175284f805a262),
+    C64e(f42bcbb378471547), C64e(ff46548223936a48),
+    C64e(38df58074e5e6565), C64e(f2fc7c89fc86508e),
+    C64e(31702e44d00bca86), C64e(f04009a23078474e),
+    C64e(65a0ee39d1f73883), C64e(f75ee937e42c3abd),
+    C64e(2197b2260113f86f), C64e(a344edd1ef9fdee7),
+    C64e(8ba0df15762592d9), C64e(3c85f7f612dc42be),
+    C64e(d8a7ec7cab27b07e), C64e(538d7ddaaa3ea8de),
+    C64e(aa25ce93bd0269d8), C64e(5af643fd1a7308f9),
+    C64e(c05fefda174a19a5), C64e(974d66334cfd216a),
+    C64e(35b49831db411570), C64e(ea1e0fbbedcd549b),
+    C64e(9ad063a151974072), C64e(f6759dbf91476fe2)};
+
+const uint64_t JH_IV512[16] = {
+    C64e(6fd14b963e00aa17), C64e(636a2e057a15d543),
+    C64e(8a225e8d0c97ef0b), C64e(e9341259f2b3c361),
+    C64e(891da0c1536f801e), C64e(2aa9056bea2b6d80),
+    C64e(588eccdb2075baa6), C64e(a90f3a76baf83bf7),
+    C64e(0169e60541e34a69), C64e(46b58a8e2e6fe65a),
+    C64e(1047a7d0c1843c24), C64e(3b6e71b12d5ac199),
+    C64e(cf57f6ec9db1f856), C64e(a706887c5716b156),
+    C64e(e3c2fcdfe68517fb), C64e(545a4678cc8cdd4b)};
+
+/** Bitsliced 4-bit S-box, with the round constant selecting between the two S-boxes. */
+void inline Sb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i c)
+{
+    x3 = Not(x3);
+    x0 = Xor(x0, AndNot(x2, c));
+    __m256i tmp = Xor(c, And(x0, x1));
+    x0 = Xor(x0, And(x2, x3));
+    x3 = Xor(x3, AndNot(x1, x2));
+    x1 = Xor(x1, And(x0, x2));
+    x2 = Xor(x2, AndNot(x3, x0));
+    x0 = Xor(x0, Or(x1, x3));
+    x3 = Xor(x3, And(x1, x2));
+    x1 = Xor(x1, And(tmp, x0));
+    x2 = Xor(x2, tmp);
+}
+
+/** Linear transform over two groups of four words. */
+void inline Lb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i& x4, __m256i& x5, __m256i& x6, __m256i& x7)
+{
+    x4 = Xor(x4, x1);
+    x5 = Xor(x5, x2);
+    x6 = Xor(x6, Xor(x3, x0));
+    x7 = Xor(x7, x0);
+    x0 = Xor(x0, x5);
+    x1 = Xor(x1, x6);
+    x2 = Xor(x2, Xor(x7, x4));
+    x3 = Xor(x3, x4);
+}
+
+/** Swap adjacent n-bit groups of both halves of a 128-bit word. */
+void inline Wz(__m256i& h, __m256i& l, uint64_t c, int n)
+{
+    const __m256i mask = K(c);
+    h = Or(And(_mm256_srli_epi64(h, n), mask), _mm256_slli_epi64(And(h, mask), n));
+    l = Or(And(_mm256_srli_epi64(l, n), mask), _mm256_slli_epi64(And(l, mask), n));
+}
+
+template <int ro>
+void inline W(__m256i& h, __m256i& l)
+{
+    switch (ro) {
+    case 0: Wz(h, l, 0x5555555555555555ULL, 1); break;
+    case 1: Wz(h, l, 0x3333333333333333ULL, 2); break;
+    case 2: Wz(h, l, 0x0F0F0F0F0F0F0F0FULL, 4); break;
+    case 3: Wz(h, l, 0x00FF00FF00FF00FFULL, 8); break;
+    case 4: Wz(h, l, 0x0000FFFF0000FFFFULL, 16); break;
+    case 5: Wz(h, l, 0x00000000FFFFFFFFULL, 32); break;
+    case 6: std::swap(h, l); break;
+    }
+}
+
+/** Round r of E8 on the 16 words h[0]=h0h, h[1]=h0l, ..., h[15]=h7l; ro is r mod 7. */
+template <int ro>
+void inline Round(__m256i* h, int r)
+{
+    // S-boxes on the even and the odd 128-bit words, then the linear transform mixing them
+    for (int half = 0; half < 2; half++) {
+        Sb(h[0 + half], h[4 + half], h[8 + half], h[12 + half], K(JH_C[4 * r + half]));
+        Sb(h[2 + half], h[6 + half], h[10 + half], h[14 + half], K(JH_C[4 * r + 2 + half]));
+        Lb(h[0 + half], h[4 + half], h[8 + half], h[12 + half], h[2 + half], h[6 + half], h[10 + half], h[14 + half]);
+    }
+    W<ro>(h[2], h[3]);
+    W<ro>(h[6], h[7]);
+    W<ro>(h[10], h[11]);
+    W<ro>(h[14], h[15]);
+}
+
+void E8(__m256i* h)
+{
+    for (int r = 0; r < 42; r += 7) {
+        Round<0>(h, r);
+        Round<1>(h, r + 1);
+        Round<2>(h, r + 2);
+        Round<3>(h, r + 3);
+        Round<4>(h, r + 4);
+        Round<5>(h, r + 5);
+        Round<6>(h, r + 6);
+    }
+}
+
+////// Skein-512
+
+const uint64_t SKEIN_IV[8] = {
+    0x4903ADFF749C51CEULL, 0x0D95DE399746DF03ULL, 0x8FD1934127C79BCEULL, 0x9A255629FF352CB1ULL,
+    0x5DB62599DF6CA7B0ULL, 0xEABE394CA9D5C3F4ULL, 0x991112C71A75B523ULL, 0xAE18A40B660FCC33ULL};
+
+void inline Mix(__m256i& x0, __m256i& x1, int rc)
+{
+    x0 = Add(x0, x1);
+    x1 = Xor(RotL(x1, rc), x0);
+}
+
+void inline Mix8(__m256i* p, int w0, int w1, int w2, int w3, int w4, int w5, int w6, int w7, int rc0, int rc1, int rc2, int rc3)
+{
+    Mix(p[w0], p[w1], rc0);
+    Mix(p[w2], p[w3], rc1);
+    Mix(p[w4], p[w5], rc2);
+    Mix(p[w6], p[w7], rc3);
+}
+
+template <int s>
+void inline AddKey(__m256i* p, const __m256i* k, const __m256i* t)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = Add(p[i], k[(s + i) % 9]);
+    p[5] = Add(p[5], t[s % 3]);
+    p[6] = Add(p[6], t[(s + 1) % 3]);
+    p[7] = Add(p[7], K((uint64_t)s));
+}
+
+/** Eight Threefish rounds, with the key injections for subkeys s and s + 1. */
+template <int s>
+void inline Rounds8(__m256i* p, const __m256i* k, const __m256i* t)
+{
+    AddKey<s>(p, k, t);
+    Mix8(p, 0, 1, 2, 3, 4, 5, 6, 7, 46, 36, 19, 37);
+    Mix8(p, 2, 1, 4, 7, 6, 5, 0, 3, 33, 27, 14, 42);
+    Mix8(p, 4, 1, 6, 3, 0, 5, 2, 7, 17, 49, 36, 39);
+    Mix8(p, 6, 1, 0, 7, 2, 5, 4, 3, 44, 9, 54, 56);
+    AddKey<s + 1>(p, k, t);
+    Mix8(p, 0, 1, 2, 3, 4, 5, 6, 7, 39, 30, 34, 24);
+    Mix8(p, 2, 1, 4, 7, 6, 5, 0, 3, 13, 50, 10, 17);
+    Mix8(p, 4, 1, 6, 3, 0, 5, 2, 7, 25, 29, 39, 43);
+    Mix8(p, 6, 1, 0, 7, 2, 5, 4, 3, 8, 35, 56, 22);
+}
+
+/** One UBI block: h = Threefish_h,t(m) ^ m. */
+void UBI(__m256i* h, const __m256i* m, uint64_t t0, uint64_t t1)
+{
+    __m256i k[9];
+    __m256i p[8];
+    const __m256i t[3] = {K(t0), K(t1), K(t0 ^ t1)};
+    k[8] = K(0x1BD11BDAA9FC1A22ULL);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+        p[i] = m[i];
+    }
+    Rounds8<0>(p, k, t);
+    Rounds8<2>(p, k, t);
+    Rounds8<4>(p, k, t);
+    Rounds8<6>(p, k, t);
+    Rounds8<8>(p, k, t);
+    Rounds8<10>(p, k, t);
+    Rounds8<12>(p, k, t);
+    Rounds8<14>(p, k, t);
+    Rounds8<16>(p, k, t);
+    AddKey<18>(p, k, t);
+    for (int i = 0; i < 8; i++)
+        h[i] = Xor(m[i], p[i]);
+}
+
+} // namespace
+
+void Groestl512_4way(unsigned char* out, const unsigned char* in)
+{
+    // One 128 byte block: the message, the 0x80 terminator and a block count of 1
+    __m256i g[16], m[16], h[16];
+    for (int i = 0; i < 8; i++)
+        m[i] = Load(in, i);
+    m[8] = K(0x80);
+    for (int i = 9; i < 15; i++)
+        m[i] = _mm256_setzero_si256();
+    m[15] = K(0x0100000000000000ULL);
+
+    // The initial state only encodes the 512 bit output size
+    for (int i = 0; i < 16; i++)
+        h[i] = i == 15 ? K(0x0002000000000000ULL) : _mm256_setzero_si256();
+
+    for (int i = 0; i < 16; i++)
+        g[i] = Xor(m[i], h[i]);
+    PermP(g);
+    PermQ(m);
+    for (int i = 0; i < 16; i++)
+        h[i] = Xor(h[i], Xor(g[i], m[i]));
+
+    // Output transformation
+    for (int i = 0; i < 16; i++)
+        g[i] = h[i];
+    PermP(g);
+    for (int i = 8; i < 16; i++)
+        Store(out, i - 8, Xor(h[i], g[i]));
+}
+
+void JH512_4way(unsigned char* out, const unsigned char* in)
+{
+    __m256i h[16], m[8];
+    for (int i = 0; i < 16; i++)
+        h[i] = K(JH_IV512[i]);
+
+    // Message block, then the padding block: 0x80 and the 512 bit message length
+    for (int block = 0; block < 2; block++) {
+        for (int i = 0; i < 8; i++) {
+            if (block == 0)
+                m[i] = Load(in, i);
+            else
+                m[i] = K(i == 0 ? 0x80 : i == 7 ? 0x0002000000000000ULL : 0);
+            h[i] = Xor(h[i], m[i]);
+        }
+        E8(h);
+        for (int i = 0; i < 8; i++)
+            h[i + 8] = Xor(h[i + 8], m[i]);
+    }
+
+    for (int i = 8; i < 16; i++)
+        Store(out, i - 8, h[i]);
+}
+
+void Skein512_4way(unsigned char* out, const unsigned char* in)
+{
+    __m256i h[8], m[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = K(SKEIN_IV[i]);
+        m[i] = Load(in, i);
+    }
+    // The message is a single, first and final block
+    UBI(h, m, 64, 0xF000000000000000ULL);
+
+    // Output block: a zero counter
+    for (int i = 0; i < 8; i++)
+        m[i] = _mm256_setzero_si256();
+    UBI(h, m, 8, 0xFF00000000000000ULL);
+
+    for (int i = 0; i < 8; i++)
+        Store(out, i, h[i]);
+}
+
+} // namespace quark_avx2
+
+#endif
@@ -2,12 +2,41 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/artax-config.h"
+#endif
+
 #include "crypto/sha256.h"
 
 #include "crypto/common.h"
 
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* chunk);
+}
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* chunk);
+}
+#endif
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -128,8 +157,155 @@ void Transform(uint32_t* s, const unsigned char* chunk)
 }
 
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*);
+
+/** Single-message transform used by CSHA256. */
+TransformType Transform = sha256::Transform;
+
+/** Multi-buffer transform used by SHA256DBatch, and how many messages it processes at once. */
+TransformType TransformMulti = NULL;
+size_t nTransformLanes = 1;
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv"
+            : "=a"(a), "=d"(d)
+            : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+/** Largest number of messages any multi-buffer transform handles at once. */
+const size_t MAX_LANES = 8;
+
+/** Double-SHA256 nLanes messages of len bytes each at once through TransformMulti. */
+void HashLanes(unsigned char* output, const unsigned char* input, size_t len, size_t nLanes)
+{
+    uint32_t s[8 * MAX_LANES];
+    unsigned char chunks[64 * MAX_LANES];
+    const size_t nFull = len / 64;
+    const size_t nTail = len % 64;
+    const size_t nPadBlocks = nTail < 56 ? 1 : 2;
+
+    for (size_t lane = 0; lane < nLanes; lane++)
+        sha256::Initialize(s + 8 * lane);
+
+    // Full message blocks
+    for (size_t b = 0; b < nFull; b++) {
+        for (size_t lane = 0; lane < nLanes; lane++)
+            memcpy(chunks + 64 * lane, input + lane * len + 64 * b, 64);
+        TransformMulti(s, chunks);
+    }
+
+    // Trailing bytes, 0x80 terminator and the bit length
+    unsigned char pad[128 * MAX_LANES];
+    memset(pad, 0, 128 * nLanes);
+    for (size_t lane = 0; lane < nLanes; lane++) {
+        unsigned char* p = pad + 128 * lane;
+        memcpy(p, input + lane * len + 64 * nFull, nTail);
+        p[nTail] = 0x80;
+        WriteBE64(p + 64 * nPadBlocks - 8, (uint64_t)len << 3);
+    }
+    for (size_t b = 0; b < nPadBlocks; b++) {
+        for (size_t lane = 0; lane < nLanes; lane++)
+            memcpy(chunks + 64 * lane, pad + 128 * lane + 64 * b, 64);
+        TransformMulti(s, chunks);
+    }
+
+    // Second hash over each 32-byte digest, which always fits a single padded block
+    memset(chunks, 0, 64 * nLanes);
+    for (size_t lane = 0; lane < nLanes; lane++) {
+        unsigned char* p = chunks + 64 * lane;
+        for (int i = 0; i < 8; i++)
+            WriteBE32(p + 4 * i, s[8 * lane + i]);
+        p[32] = 0x80;
+        WriteBE64(p + 56, 256);
+        sha256::Initialize(s + 8 * lane);
+    }
+    TransformMulti(s, chunks);
+
+    for (size_t lane = 0; lane < nLanes; lane++)
+        for (int i = 0; i < 8; i++)
+            WriteBE32(output + 32 * lane + 4 * i, s[8 * lane + i]);
+}
 } // namespace
 
+std::string SHA256AutoDetect(int nAllowedBackends)
+{
+    std::string ret = "standard";
+    Transform = sha256::Transform;
+    TransformMulti = NULL;
+    nTransformLanes = 1;
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_sse41 = false, have_avx2 = false, have_shani = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse41 = (ecx >> 19) & 1;
+        bool have_xsave = (ecx >> 27) & 1;
+        bool have_avx = (ecx >> 28) & 1;
+        if (__get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = have_xsave && have_avx && ((ebx >> 5) & 1) && AVXEnabled();
+            have_shani = (ebx >> 29) & 1;
+        }
+    }
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_shani && (nAllowedBackends & SHA256_BACKEND_SHANI)) {
+        Transform = sha256_shani::Transform;
+        ret = "shani(1way)";
+        // The SHA extensions outrun the multi-buffer transforms, even one message at a time
+        have_sse41 = false;
+        have_avx2 = false;
+    }
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_sse41 && (nAllowedBackends & SHA256_BACKEND_SSE41)) {
+        TransformMulti = sha256_sse41::Transform_4way;
+        nTransformLanes = 4;
+        ret += ",sse41(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && (nAllowedBackends & SHA256_BACKEND_AVX2)) {
+        TransformMulti = sha256_avx2::Transform_8way;
+        nTransformLanes = 8;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    return ret;
+}
+
+void SHA256DBatch(unsigned char* output, const unsigned char* input, size_t len, size_t count)
+{
+    if (TransformMulti) {
+        while (count >= nTransformLanes) {
+            HashLanes(output, input, len, nTransformLanes);
+            input += len * nTransformLanes;
+            output += 32 * nTransformLanes;
+            count -= nTransformLanes;
+        }
+    }
+
+    // Whatever does not fill all lanes goes through the single-message transform
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    for (; count > 0; count--) {
+        CSHA256().Write(input, len).Finalize(buf);
+        CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize(output);
+        input += len;
+        output += 32;
+    }
+}
+
 
 ////// SHA-256
 
@@ -147,12 +323,12 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf);
         bufsize = 0;
     }
     while (end >= data + 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
+        Transform(s, data);
         bytes += 64;
         data += 64;
     }
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,22 @@ public:
     CSHA256& Reset();
 };
 
+/** SHA256 backends SHA256AutoDetect() may pick from, as a bit mask. */
+enum SHA256Backend {
+    SHA256_BACKEND_STANDARD = 0,
+    SHA256_BACKEND_SSE41 = 1, //!< 4-way multi-buffer transform
+    SHA256_BACKEND_AVX2 = 2,  //!< 8-way multi-buffer transform
+    SHA256_BACKEND_SHANI = 4, //!< single-message SHA extensions transform
+    SHA256_BACKEND_ALL = 7,
+};
+
+/** Select the fastest SHA256 implementation among the allowed backends the CPU supports.
+ *  Returns a description of the selected implementation. */
+std::string SHA256AutoDetect(int nAllowedBackends = SHA256_BACKEND_ALL);
+
+/** Compute the double-SHA256 of count messages of len bytes each, stored back to back in input.
+ *  Writes count * 32 bytes to output. Messages are hashed side by side when a multi-buffer
+ *  backend is selected, e.g. merkle tree nodes (len 64) or stake kernels of one UTXO. */
+void SHA256DBatch(unsigned char* output, const unsigned char* input, size_t len, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
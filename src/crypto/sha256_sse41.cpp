@@ -0,0 +1,118 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// This is a translation to SSE4.1 intrinsics of the scalar SHA-256 transform in sha256.cpp,
+// processing 4 independent messages at once (one per lane). Built with -msse4.1.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256_sse41
+{
+namespace
+{
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+__m128i inline K1(uint32_t x) { return _mm_set1_epi32(x); }
+__m128i inline Set(uint32_t x3, uint32_t x2, uint32_t x1, uint32_t x0) { return _mm_set_epi32(x3, x2, x1, x0); }
+void inline Store(uint32_t* out, __m128i x) { _mm_storeu_si128((__m128i*)out, x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19))), Or(ShR(x, 22), ShL(x, 10))); }
+__m128i inline Sigma1(__m128i x) { return Xor(Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21))), Or(ShR(x, 25), ShL(x, 7))); }
+__m128i inline sigma0(__m128i x) { return Xor(Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14))), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor(Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13))), ShR(x, 10)); }
+
+/** One round of SHA-256 on all lanes; kw is the round constant plus message word. */
+void inline Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i kw)
+{
+    __m128i t1 = Add(Add(Add(h, Sigma1(e)), Ch(e, f, g)), kw);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Gather state word i of every lane. */
+__m128i inline LoadState(const uint32_t* s, int i)
+{
+    s += i;
+    return Set(s[24], s[16], s[8], s[0]);
+}
+
+/** Gather the big-endian message word at offset of every lane's 64-byte chunk. */
+__m128i inline Read(const unsigned char* chunk, int offset)
+{
+    chunk += offset;
+    return Set(ReadBE32(chunk + 192), ReadBE32(chunk + 128), ReadBE32(chunk + 64), ReadBE32(chunk + 0));
+}
+
+/** Add x to state word i of every lane. */
+void inline AddState(uint32_t* s, int i, __m128i x)
+{
+    uint32_t out[4];
+    Store(out, x);
+    for (int lane = 0; lane < 4; lane++)
+        s[8 * lane + i] += out[lane];
+}
+} // namespace
+
+/** Perform one SHA-256 transformation on each of 4 states (lane-major, 8 words per lane),
+ *  processing 4 consecutive 64-byte chunks. */
+void Transform_4way(uint32_t* s, const unsigned char* chunk)
+{
+    __m128i a = LoadState(s, 0), b = LoadState(s, 1), c = LoadState(s, 2), d = LoadState(s, 3);
+    __m128i e = LoadState(s, 4), f = LoadState(s, 5), g = LoadState(s, 6), h = LoadState(s, 7);
+    __m128i w[16];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = Read(chunk, 4 * i);
+
+    for (int i = 0; i < 64; i += 8) {
+        if (i >= 16) {
+            for (int j = i; j < i + 8; j++)
+                w[j & 15] = Add(Add(Add(sigma1(w[(j - 2) & 15]), w[(j - 7) & 15]), sigma0(w[(j - 15) & 15])), w[j & 15]);
+        }
+        Round(a, b, c, d, e, f, g, h, Add(K1(K[i + 0]), w[(i + 0) & 15]));
+        Round(h, a, b, c, d, e, f, g, Add(K1(K[i + 1]), w[(i + 1) & 15]));
+        Round(g, h, a, b, c, d, e, f, Add(K1(K[i + 2]), w[(i + 2) & 15]));
+        Round(f, g, h, a, b, c, d, e, Add(K1(K[i + 3]), w[(i + 3) & 15]));
+        Round(e, f, g, h, a, b, c, d, Add(K1(K[i + 4]), w[(i + 4) & 15]));
+        Round(d, e, f, g, h, a, b, c, Add(K1(K[i + 5]), w[(i + 5) & 15]));
+        Round(c, d, e, f, g, h, a, b, Add(K1(K[i + 6]), w[(i + 6) & 15]));
+        Round(b, c, d, e, f, g, h, a, Add(K1(K[i + 7]), w[(i + 7) & 15]));
+    }
+
+    AddState(s, 0, a);
+    AddState(s, 1, b);
+    AddState(s, 2, c);
+    AddState(s, 3, d);
+    AddState(s, 4, e);
+    AddState(s, 5, f);
+    AddState(s, 6, g);
+    AddState(s, 7, h);
+}
+} // namespace sha256_sse41
+
+#endif // ENABLE_SSE41
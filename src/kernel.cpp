@@ -6,7 +6,13 @@
 
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 
+#include <atomic>
+#include <cmath>
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -240,6 +246,76 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+CStakeModifierCache stakeModifierCache;
+
+bool CStakeModifierCache::Get(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime)
+{
+    LOCK(cs);
+    std::map<int, CEntry>::const_iterator it = mapModifiers.find(pindexFrom->nHeight);
+    // the walk that resolved the entry is still valid as long as its last block is in the active chain
+    if (it == mapModifiers.end() || it->second.hashBlockFrom != pindexFrom->GetBlockHash() ||
+        chainActive[it->second.pindexLast->nHeight] != it->second.pindexLast) {
+        nMisses++;
+        return false;
+    }
+
+    nStakeModifier = it->second.nStakeModifier;
+    nStakeModifierHeight = it->second.nStakeModifierHeight;
+    nStakeModifierTime = it->second.nStakeModifierTime;
+    nHits++;
+    return true;
+}
+
+void CStakeModifierCache::Add(const CBlockIndex* pindexFrom, uint64_t nStakeModifier, int nStakeModifierHeight, int64_t nStakeModifierTime, const CBlockIndex* pindexLast)
+{
+    LOCK(cs);
+    if (mapModifiers.size() >= MAX_STAKE_MODIFIER_CACHE_SIZE && !mapModifiers.count(pindexFrom->nHeight))
+        mapModifiers.erase(mapModifiers.begin());
+
+    CEntry& entry = mapModifiers[pindexFrom->nHeight];
+    entry.hashBlockFrom = pindexFrom->GetBlockHash();
+    entry.nStakeModifier = nStakeModifier;
+    entry.nStakeModifierHeight = nStakeModifierHeight;
+    entry.nStakeModifierTime = nStakeModifierTime;
+    entry.pindexLast = pindexLast;
+}
+
+void CStakeModifierCache::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    // Signalled after ActivateBestChain released cs_main; the chain may have moved on since
+    LOCK2(cs_main, cs);
+    // drop every entry resolved through a block that is no longer in the active chain
+    if (pindexTip && chainActive[pindexTip->nHeight] != pindexTip) {
+        const CBlockIndex* pindexFork = chainActive.FindFork(pindexTip);
+        int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+        std::map<int, CEntry>::iterator it = mapModifiers.begin();
+        while (it != mapModifiers.end()) {
+            if (it->second.pindexLast->nHeight > nForkHeight) {
+                mapModifiers.erase(it++);
+                nInvalidated++;
+            } else
+                ++it;
+        }
+    }
+    pindexTip = chainActive.Tip();
+}
+
+void CStakeModifierCache::Clear()
+{
+    LOCK(cs);
+    mapModifiers.clear();
+    pindexTip = NULL;
+}
+
+void CStakeModifierCache::GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, uint64_t& nInvalidatedRet, size_t& nSizeRet) const
+{
+    LOCK(cs);
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+    nInvalidatedRet = nInvalidated;
+    nSizeRet = mapModifiers.size();
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
@@ -248,6 +324,9 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
     if (!mapBlockIndex.count(hashBlockFrom))
         return error("GetKernelStakeModifier() : block not indexed");
     const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+    if (stakeModifierCache.Get(pindexFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime))
+        return true;
+
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
@@ -269,6 +348,7 @@ bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int
         }
     }
     nStakeModifier = pindex->nStakeModifier;
+    stakeModifierCache.Add(pindexFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, pindex);
     return true;
 }
 
@@ -279,14 +359,53 @@ uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutInde
     return Hash(ss.begin(), ss.end());
 }
 
-//test hash vs target
-bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay)
+CStakeKernelHasher::CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout) : prefix(SER_GETHASH, 0)
+{
+    // same layout as stakeHash(), minus the trailing nTimeTx
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << prevout.n << prevout.hash;
+    assert(ss.size() == PREFIX_SIZE);
+    memcpy(vchPrefix, &ss[0], PREFIX_SIZE);
+    prefix.write((const char*)vchPrefix, PREFIX_SIZE);
+}
+
+uint256 CStakeKernelHasher::GetHash(unsigned int nTimeTx) const
+{
+    CHashWriter ss(prefix);
+    ss << nTimeTx;
+    return ss.GetHash();
+}
+
+void CStakeKernelHasher::GetHashes(unsigned int nTimeTxFirst, unsigned int nCount, uint256* pHashesRet) const
+{
+    if (nCount == 0)
+        return;
+
+    // kernels of one input only differ in their last 4 bytes: lay them out back to back
+    // and let the SHA256 backend hash them side by side
+    std::vector<unsigned char> vchKernels(nCount * KERNEL_SIZE);
+    for (unsigned int i = 0; i < nCount; i++) {
+        unsigned char* pKernel = &vchKernels[i * KERNEL_SIZE];
+        memcpy(pKernel, vchPrefix, PREFIX_SIZE);
+        WriteLE32(pKernel + PREFIX_SIZE, nTimeTxFirst - i);
+    }
+    SHA256DBatch(pHashesRet[0].begin(), vchKernels.data(), KERNEL_SIZE, nCount);
+}
+
+// Kernel hash target of an input: the 256 bit multiply costs more than the hash itself, so the
+// search loops compute it once per input
+static uint256 GetStakeTarget(int64_t nValueIn, const uint256& bnTargetPerCoinDay)
 {
     //get the stake weight - weight is equal to coin amount
     uint256 bnCoinDayWeight = uint256(nValueIn) / 100;
+    return bnCoinDayWeight * bnTargetPerCoinDay;
+}
 
+//test hash vs target
+bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay)
+{
     // Now check if proof-of-stake hash meets target protocol
-    return hashProofOfStake < (bnCoinDayWeight * bnTargetPerCoinDay);
+    return hashProofOfStake < GetStakeTarget(nValueIn, bnTargetPerCoinDay);
 }
 
 //instead of looping outside and reinitializing variables many times, we will give a nTimeTx and also search interval so that we can do all the hashing here
@@ -315,13 +434,12 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
         return false;
     }
 
-    //create data stream once instead of repeating it in the loop
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier;
+    //hash the constant part of the kernel once instead of repeating it in the loop
+    CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout);
 
     //if wallet is simply checking to make sure a hash is valid
     if (fCheck) {
-        hashProofOfStake = stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        hashProofOfStake = hasher.GetHash(nTimeTx);
         return stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay);
     }
 
@@ -337,7 +455,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
 
         //hash this iteration
         nTryTime = nTimeTx + nHashDrift - i;
-        hashProofOfStake = stakeHash(nTryTime, ss, prevout.n, prevout.hash, nTimeBlockFrom);
+        hashProofOfStake = hasher.GetHash(nTryTime);
 
         // if stake hash does not meet the target then continue to next iteration
         if (!stakeTargetHit(hashProofOfStake, nValueIn, bnTargetPerCoinDay))
@@ -366,6 +484,206 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+bool GetStakeKernelInput(const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, CStakeKernelInput& input)
+{
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(blockFrom.GetHash(), input.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+        return false;
+
+    input.nTimeBlockFrom = blockFrom.GetBlockTime();
+    input.prevout = prevout;
+    input.nValueIn = txPrev.vout[prevout.n].nValue;
+    return true;
+}
+
+namespace {
+/** State shared by the workers of one SearchStakeKernel() call */
+struct CStakeKernelSearch {
+    const std::vector<CStakeKernelInput>& vInputs;
+    uint256 bnTargetPerCoinDay;
+    unsigned int nTimeTx;
+    unsigned int nHashDrift;
+    const CBlockIndex* pindexPrev;
+
+    //! set by the first worker that hits, or when a new block came in
+    std::atomic<bool> fDone;
+
+    CCriticalSection cs;
+    bool fFound;
+    size_t nInput;
+    unsigned int nTimeFound;
+    uint256 hashProofOfStake;
+
+    CStakeKernelSearch(const std::vector<CStakeKernelInput>& vInputsIn) : vInputs(vInputsIn), fDone(false), fFound(false), nInput(0), nTimeFound(0) {}
+};
+}
+
+// Each worker walks every nStride-th input, trying all timestamps of an input before moving to the next
+static void StakeKernelSearchWorker(CStakeKernelSearch* search, size_t nStart, size_t nStride)
+{
+    std::vector<uint256> vHashes(search->nHashDrift);
+    for (size_t n = nStart; n < search->vInputs.size() && !search->fDone; n += nStride) {
+        //new block came in, move on
+        if (search->pindexPrev && GetChainTipSnapshot()->pindexTip != search->pindexPrev) {
+            search->fDone = true;
+            return;
+        }
+
+        const CStakeKernelInput& input = search->vInputs[n];
+        CStakeKernelHasher hasher(input.nStakeModifier, input.nTimeBlockFrom, input.prevout);
+        uint256 bnTarget = GetStakeTarget(input.nValueIn, search->bnTargetPerCoinDay);
+
+        // hash the whole drift window of this input in one batch, then check in the usual order
+        hasher.GetHashes(search->nTimeTx + search->nHashDrift, search->nHashDrift, vHashes.data());
+        for (unsigned int i = 0; i < search->nHashDrift; i++) {
+            unsigned int nTryTime = search->nTimeTx + search->nHashDrift - i;
+            // CheckStakeKernelHash refuses a coinstake older than the block it stakes from
+            if (nTryTime < input.nTimeBlockFrom)
+                continue;
+            const uint256& hashProofOfStake = vHashes[i];
+            if (!(hashProofOfStake < bnTarget))
+                continue;
+
+            LOCK(search->cs);
+            if (!search->fFound) {
+                search->fFound = true;
+                search->nInput = n;
+                search->nTimeFound = nTryTime;
+                search->hashProofOfStake = hashProofOfStake;
+            }
+            search->fDone = true;
+            return;
+        }
+    }
+}
+
+static int GetStakeThreads(int nThreads, size_t nInputs)
+{
+    // 0 means autodetect, <0 leaves that many cores free
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_STAKE_THREADS));
+    if ((size_t)nThreads > nInputs)
+        nThreads = std::max((size_t)1, nInputs);
+    return nThreads;
+}
+
+bool SearchStakeKernel(unsigned int nBits, const std::vector<CStakeKernelInput>& vInputs, const CBlockIndex* pindexPrev, unsigned int& nTimeTx, unsigned int nHashDrift, int nThreads, size_t& nInputRet, uint256& hashProofOfStake)
+{
+    nThreads = GetStakeThreads(nThreads, vInputs.size());
+
+    CStakeKernelSearch search(vInputs);
+    search.bnTargetPerCoinDay.SetCompact(nBits);
+    search.nTimeTx = nTimeTx;
+    search.nHashDrift = nHashDrift;
+    search.pindexPrev = pindexPrev;
+
+    if (nThreads == 1) {
+        StakeKernelSearchWorker(&search, 0, 1);
+    } else {
+        boost::thread_group workers;
+        for (int i = 0; i < nThreads; i++)
+            workers.create_thread(boost::bind(&StakeKernelSearchWorker, &search, (size_t)i, (size_t)nThreads));
+        workers.join_all();
+    }
+
+    if (pindexPrev) {
+        mapHashedBlocks.clear();
+        mapHashedBlocks[pindexPrev->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    }
+
+    if (!search.fFound)
+        return false;
+
+    nInputRet = search.nInput;
+    nTimeTx = search.nTimeFound;
+    hashProofOfStake = search.hashProofOfStake;
+    return true;
+}
+
+namespace {
+/** State shared by the workers of one ForecastStakeKernels() call */
+struct CStakeForecastJob {
+    const std::vector<CStakeKernelInput>& vInputs;
+    uint256 bnTargetPerCoinDay;
+
+    CCriticalSection cs;
+    CStakeForecast& forecast;
+
+    CStakeForecastJob(const std::vector<CStakeKernelInput>& vInputsIn, CStakeForecast& forecastIn) : vInputs(vInputsIn), forecast(forecastIn) {}
+};
+}
+
+// Each worker walks every nStride-th input over the whole timestamp range and merges its totals at the end
+static void StakeForecastWorker(CStakeForecastJob* job, size_t nStart, size_t nStride)
+{
+    const unsigned int nCount = job->forecast.nTimeLast - job->forecast.nTimeFirst + 1;
+    std::vector<uint256> vHashes(nCount);
+    uint64_t nHashes = 0;
+    uint64_t nKernels = 0;
+    unsigned int nTimeKernel = 0;
+    size_t nInputKernel = 0;
+    double dKernelsPerSecond = 0;
+    const double dHashSpace = std::ldexp(1.0, 256);
+
+    for (size_t n = nStart; n < job->vInputs.size(); n += nStride) {
+        const CStakeKernelInput& input = job->vInputs[n];
+        CStakeKernelHasher hasher(input.nStakeModifier, input.nTimeBlockFrom, input.prevout);
+        uint256 bnTarget = GetStakeTarget(input.nValueIn, job->bnTargetPerCoinDay);
+        hasher.GetHashes(job->forecast.nTimeLast, nCount, vHashes.data());
+        nHashes += nCount;
+
+        // vHashes[i] is the kernel at nTimeLast - i, so the last hit seen is the earliest one
+        for (unsigned int i = 0; i < nCount; i++) {
+            if (!(vHashes[i] < bnTarget))
+                continue;
+            nKernels++;
+            unsigned int nTryTime = job->forecast.nTimeLast - i;
+            if (nTimeKernel == 0 || nTryTime < nTimeKernel || (nTryTime == nTimeKernel && n < nInputKernel)) {
+                nTimeKernel = nTryTime;
+                nInputKernel = n;
+            }
+        }
+
+        // Chance of one timestamp hitting the target
+        dKernelsPerSecond += std::min(1.0, bnTarget.getdouble() / dHashSpace);
+    }
+
+    LOCK(job->cs);
+    CStakeForecast& forecast = job->forecast;
+    forecast.nHashes += nHashes;
+    forecast.nKernels += nKernels;
+    forecast.dKernelsPerSecond += dKernelsPerSecond;
+    if (nTimeKernel != 0 && (forecast.nTimeKernel == 0 || nTimeKernel < forecast.nTimeKernel ||
+                                (nTimeKernel == forecast.nTimeKernel && nInputKernel < forecast.nInputKernel))) {
+        forecast.nTimeKernel = nTimeKernel;
+        forecast.nInputKernel = nInputKernel;
+    }
+}
+
+void ForecastStakeKernels(unsigned int nBits, const std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeFirst, unsigned int nTimeLast, int nThreads, CStakeForecast& forecast)
+{
+    forecast = CStakeForecast();
+    forecast.nTimeFirst = nTimeFirst;
+    forecast.nTimeLast = nTimeLast;
+    if (vInputs.empty() || nTimeLast < nTimeFirst)
+        return;
+
+    CStakeForecastJob job(vInputs, forecast);
+    job.bnTargetPerCoinDay.SetCompact(nBits);
+
+    nThreads = GetStakeThreads(nThreads, vInputs.size());
+    if (nThreads == 1) {
+        StakeForecastWorker(&job, 0, 1);
+    } else {
+        boost::thread_group workers;
+        for (int i = 0; i < nThreads; i++)
+            workers.create_thread(boost::bind(&StakeForecastWorker, &job, (size_t)i, (size_t)nThreads));
+        workers.join_all();
+    }
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
 {
@@ -5,6 +5,7 @@
 #ifndef BITCOIN_KERNEL_H
 #define BITCOIN_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 
 
@@ -21,12 +22,135 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Maximum number of cached kernel stake modifiers
+static const unsigned int MAX_STAKE_MODIFIER_CACHE_SIZE = 50000;
+
+/**
+ * Cache of resolved kernel stake modifiers, keyed by the height of the block the stake comes from.
+ * An entry stays valid while the last block walked to resolve it is still in the active chain.
+ * Get() checks exactly that on every lookup (callers hold cs_main), which is what keeps results
+ * correct. Dropping the entries past the fork point when the tip is reorganized only frees them
+ * early; the tip signal is not sent during initial download, so that pruning is skipped there.
+ */
+class CStakeModifierCache : public CValidationInterface
+{
+private:
+    struct CEntry {
+        uint256 hashBlockFrom;
+        uint64_t nStakeModifier;
+        int nStakeModifierHeight;
+        int64_t nStakeModifierTime;
+        const CBlockIndex* pindexLast;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<int, CEntry> mapModifiers;
+    const CBlockIndex* pindexTip;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInvalidated;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+
+public:
+    CStakeModifierCache() : pindexTip(NULL), nHits(0), nMisses(0), nInvalidated(0) {}
+
+    bool Get(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime);
+    void Add(const CBlockIndex* pindexFrom, uint64_t nStakeModifier, int nStakeModifierHeight, int64_t nStakeModifierTime, const CBlockIndex* pindexLast);
+    void Clear();
+    void GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, uint64_t& nInvalidatedRet, size_t& nSizeRet) const;
+};
+
+extern CStakeModifierCache stakeModifierCache;
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
+
+/**
+ * Stake kernel hasher: serializes the constant part of the kernel (modifier, block
+ * time, prevout) once, so a timestamp tried only appends the 4-byte nTimeTx instead
+ * of copying and re-serializing a CDataStream. The 48-byte prefix is less than one
+ * SHA256 block, so nothing is compressed ahead of time and every attempt still costs
+ * a full double SHA256; GetHashes batches those over the multi-buffer backend.
+ * GetHash(nTimeTx) equals stakeHash(nTimeTx, ...) for the same inputs.
+ */
+class CStakeKernelHasher
+{
+private:
+    //! Serialized nStakeModifier, nTimeBlockFrom, prevout.n, prevout.hash
+    static const size_t PREFIX_SIZE = 8 + 4 + 4 + 32;
+    //! Prefix followed by nTimeTx
+    static const size_t KERNEL_SIZE = PREFIX_SIZE + 4;
+
+    unsigned char vchPrefix[PREFIX_SIZE];
+    CHashWriter prefix;
+
+public:
+    CStakeKernelHasher(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, const COutPoint& prevout);
+    uint256 GetHash(unsigned int nTimeTx) const;
+
+    /**
+     * Hash nCount kernels at once, for nTimeTxFirst, nTimeTxFirst - 1, ... in that order,
+     * through the multi-buffer SHA256 backend when one is available.
+     * pHashesRet[i] equals GetHash(nTimeTxFirst - i).
+     */
+    void GetHashes(unsigned int nTimeTxFirst, unsigned int nCount, uint256* pHashesRet) const;
+};
+
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
+// -stakethreads default (0 = auto, <0 = leave that many cores free)
+static const int DEFAULT_STAKE_THREADS = 0;
+// Maximum number of kernel search threads
+static const int MAX_STAKE_THREADS = 16;
+
+// A stake input reduced to the values that stay constant while timestamps are searched
+struct CStakeKernelInput {
+    uint64_t nStakeModifier;
+    unsigned int nTimeBlockFrom;
+    COutPoint prevout;
+    int64_t nValueIn;
+};
+
+// Resolve the stake modifier and kernel fields of an unspent output
+bool GetStakeKernelInput(const CBlockHeader& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, CStakeKernelInput& input);
+
+// Search the grid of stake inputs x timestamps (nTimeTx + nHashDrift down to nTimeTx + 1) for a kernel,
+// split across nThreads workers. The search stops as soon as a worker hits or the published chain tip
+// is no longer pindexPrev (not checked if NULL). Doesn't need cs_main: the inputs carry all chain data.
+// Sets nInputRet, nTimeTx and hashProofOfStake on success return
+bool SearchStakeKernel(unsigned int nBits, const std::vector<CStakeKernelInput>& vInputs, const CBlockIndex* pindexPrev, unsigned int& nTimeTx, unsigned int nHashDrift, int nThreads, size_t& nInputRet, uint256& hashProofOfStake);
+
+// Furthest a proof-of-stake block may be timestamped past the adjusted time
+static const int64_t MAX_STAKE_FUTURE_DRIFT = 180;
+
+// Outcome of simulating the kernel search of a stake set over a range of future timestamps
+struct CStakeForecast {
+    unsigned int nTimeFirst;
+    unsigned int nTimeLast;
+    uint64_t nHashes;
+    //! input x timestamp pairs that meet the target
+    uint64_t nKernels;
+    //! earliest timestamp with a kernel and its input, nTimeKernel is 0 if there is none
+    unsigned int nTimeKernel;
+    size_t nInputKernel;
+    //! expected kernels per second of the whole set at this difficulty
+    double dKernelsPerSecond;
+
+    CStakeForecast() : nTimeFirst(0), nTimeLast(0), nHashes(0), nKernels(0), nTimeKernel(0), nInputKernel(0), dKernelsPerSecond(0) {}
+
+    //! expected seconds until the set stakes, -1 if it can't
+    double ExpectedTimeToStake() const { return dKernelsPerSecond > 0 ? 1 / dKernelsPerSecond : -1; }
+};
+
+// Hash every stake input at each timestamp from nTimeFirst to nTimeLast against nBits, split across
+// nThreads workers, the same way the stake miner will once those timestamps are reachable.
+// Doesn't touch chain state, so it can run without cs_main.
+void ForecastStakeKernels(unsigned int nBits, const std::vector<CStakeKernelInput>& vInputs, unsigned int nTimeFirst, unsigned int nTimeLast, int nThreads, CStakeForecast& forecast);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
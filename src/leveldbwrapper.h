@@ -164,9 +164,10 @@ public:
     }
 
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator* NewIterator()
+    // fFillCache: for short point-like scans whose blocks are worth keeping in the block cache
+    leveldb::Iterator* NewIterator(bool fFillCache = false)
     {
-        return pdb->NewIterator(iteroptions);
+        return pdb->NewIterator(fFillCache ? readoptions : iteroptions);
     }
 };
 
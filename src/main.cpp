@@ -13,14 +13,19 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsflush.h"
+#include "crypto/common.h"
 #include "init.h"
 #include "kernel.h"
+#include "mappedfile.h"
 #include "merchantnode-budget.h"
 #include "merchantnode-payments.h"
 #include "merchantnodeman.h"
+#include "merchantnode-sigcheck.h"
 #include "merkleblock.h"
 #include "net.h"
 #include "pow.h"
+#include "relaycache.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "swifttx.h"
@@ -34,6 +39,7 @@
 #include "wallet.h"
 #endif
 
+#include <atomic>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -94,6 +100,13 @@ struct COrphanTx {
 };
 map<uint256, COrphanTx> mapOrphanTransactions;
 map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+struct COrphanBlock {
+    CBlock block;
+    NodeId fromPeer;
+};
+/** Requested blocks that arrived before their parent during getblocks sync. Requires cs_main. */
+map<uint256, COrphanBlock> mapOrphanBlocks;
+multimap<uint256, uint256> mapOrphanBlocksByPrev;
 map<uint256, int64_t> mapRejectedBlocks;
 
 void EraseOrphansFor(NodeId peer);
@@ -138,6 +151,8 @@ CBlockIndex* pindexBestInvalid;
 set<CBlockIndex*, CBlockIndexWorkComparator> setBlockIndexCandidates;
 /** Number of nodes with fSyncStarted. */
 int nSyncStarted = 0;
+/** Number of nodes with fBlocksSyncStarted. */
+int nBlocksSyncStarted = 0;
 /** All pairs A->B, where A (or one if its ancestors) misses transactions, but B has transactions. */
 multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
 
@@ -192,6 +207,8 @@ set<int> setDirtyFileInfo;
 namespace
 {
 struct CMainSignals {
+    /** Notifies listeners of updated block chain tip */
+    boost::signals2::signal<void(const CBlockIndex*)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void(const CTransaction&, const CBlock*)> SyncTransaction;
     /** Notifies listeners of an erased transaction (currently disabled, requires transaction replacement). */
@@ -212,6 +229,7 @@ struct CMainSignals {
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn)
 {
+    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
 // XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
@@ -230,6 +248,7 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn)
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
 // XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
 
 void UnregisterAllValidationInterfaces()
@@ -241,6 +260,7 @@ void UnregisterAllValidationInterfaces()
     g_signals.UpdatedTransaction.disconnect_all_slots();
 // XX42    g_signals.EraseTransaction.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
+    g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
 
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock)
@@ -288,6 +308,13 @@ struct CNodeState {
     CBlockIndex* pindexLastCommonBlock;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Whether we've asked this peer for block inventory (getblocks) past the headers-first range.
+    bool fBlocksSyncStarted;
+    //! Blocks this peer announced past the headers-first range that we may still need, oldest first.
+    std::deque<uint256> vBlocksAnnounced;
+    //! Last block of the latest getblocks batch this peer announced, and the one we continued from.
+    uint256 hashBlocksBatchEnd;
+    uint256 hashBlocksContinued;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     list<QueuedBlock> vBlocksInFlight;
@@ -304,6 +331,9 @@ struct CNodeState {
         hashLastUnknownBlock = uint256(0);
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
+        fBlocksSyncStarted = false;
+        hashBlocksBatchEnd = uint256(0);
+        hashBlocksContinued = uint256(0);
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
@@ -359,6 +389,8 @@ void FinalizeNode(NodeId nodeid)
 
     if (state->fSyncStarted)
         nSyncStarted--;
+    if (state->fBlocksSyncStarted)
+        nBlocksSyncStarted--;
 
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         AddressCurrentlyConnected(state->address);
@@ -437,6 +469,20 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256& hash)
     }
 }
 
+/** Whether we sync headers-first with a peer: it answers getheaders with headers, not with an inv. */
+bool IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && pnode->nVersion >= HEADERS_FIRST_VERSION;
+}
+
+/** Whether we sync headers from a peer right now. Only the PoW range is synced headers-first: a
+ *  proof-of-stake header carries neither its kernel nor its signature, so it costs nothing to make up
+ *  and can't be checked without its block. Past LAST_POW_BLOCK, blocks are synced with getblocks. */
+bool IsHeadersFirstSync(const CNode* pnode)
+{
+    return IsHeadersFirstPeer(pnode) && pindexBestHeader != NULL && pindexBestHeader->nHeight < Params().LAST_POW_BLOCK();
+}
+
 /** Find the last common ancestor two blocks have.
  *  Both pa and pb must be non-NULL. */
 CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
@@ -592,8 +638,10 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewBackgroundFlush* pcoinsFlusher = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
+CMappedFileCache mappedBlockFiles(DEFAULT_BLOCK_FILE_MAPS);
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -675,6 +723,89 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
     return nEvicted;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// mapOrphanBlocks
+//
+
+void static EraseOrphanBlock(const uint256& hash)
+{
+    map<uint256, COrphanBlock>::iterator it = mapOrphanBlocks.find(hash);
+    if (it == mapOrphanBlocks.end())
+        return;
+    pair<multimap<uint256, uint256>::iterator, multimap<uint256, uint256>::iterator> range = mapOrphanBlocksByPrev.equal_range(it->second.block.hashPrevBlock);
+    for (multimap<uint256, uint256>::iterator itPrev = range.first; itPrev != range.second; ++itPrev) {
+        if (itPrev->second == hash) {
+            mapOrphanBlocksByPrev.erase(itPrev);
+            break;
+        }
+    }
+    mapOrphanBlocks.erase(it);
+}
+
+/** Keep a block we requested from peer through the getblocks download window that arrived before its
+ *  parent. Its kernel can't be checked yet: it goes through ProcessNewBlock once the parent is accepted. */
+bool static AddOrphanBlock(const CBlock& block, NodeId peer)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = block.GetHash();
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != peer || itInFlight->second.second->pindex != NULL)
+        return false;
+    MarkBlockAsReceived(hash);
+    if (mapOrphanBlocks.count(hash))
+        return true;
+
+    // Evict a random orphan
+    if (mapOrphanBlocks.size() >= MAX_ORPHAN_BLOCKS) {
+        map<uint256, COrphanBlock>::iterator it = mapOrphanBlocks.lower_bound(GetRandHash());
+        if (it == mapOrphanBlocks.end())
+            it = mapOrphanBlocks.begin();
+        EraseOrphanBlock(it->first);
+    }
+
+    COrphanBlock& orphan = mapOrphanBlocks[hash];
+    orphan.block = block;
+    orphan.fromPeer = peer;
+    mapOrphanBlocksByPrev.insert(make_pair(block.hashPrevBlock, hash));
+    LogPrint("net", "stored orphan block %s (prev %s, mapsz %u)\n", hash.ToString(), block.hashPrevBlock.ToString(), mapOrphanBlocks.size());
+    return true;
+}
+
+/** Process the orphan blocks waiting for hashParent, and in turn their own orphans, once it is accepted. */
+void static ProcessOrphanBlocks(const uint256& hashParent)
+{
+    std::vector<uint256> vWorkQueue(1, hashParent);
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+        std::vector<COrphanBlock> vChildren;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(vWorkQueue[i]);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
+                continue;
+            std::vector<uint256> vHashes;
+            pair<multimap<uint256, uint256>::iterator, multimap<uint256, uint256>::iterator> range = mapOrphanBlocksByPrev.equal_range(vWorkQueue[i]);
+            for (multimap<uint256, uint256>::iterator it = range.first; it != range.second; ++it)
+                vHashes.push_back(it->second);
+            BOOST_FOREACH (const uint256& hash, vHashes) {
+                vChildren.push_back(mapOrphanBlocks[hash]);
+                EraseOrphanBlock(hash);
+            }
+        }
+
+        BOOST_FOREACH (COrphanBlock& orphan, vChildren) {
+            CValidationState state;
+            ProcessNewBlock(state, NULL, &orphan.block);
+            int nDoS;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
+                LOCK(cs_main);
+                Misbehaving(orphan.fromPeer, nDoS);
+            }
+            vWorkQueue.push_back(orphan.block.GetHash());
+        }
+    }
+}
+
 bool IsStandardTx(const CTransaction& tx, string& reason)
 {
     AssertLockHeld(cs_main);
@@ -1466,6 +1597,32 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+/**
+ * Map the block file holding the block at pos and find the block's size,
+ * which is stored in front of it after the network magic. Returns false if
+ * the file cannot be mapped or the block does not fit in it; the caller
+ * then reads the file instead.
+ */
+static bool MapBlockFile(const CDiskBlockPos& pos, CMappedFileRef& file, unsigned int& nSize)
+{
+    if (pos.IsNull() || pos.nPos < 8)
+        return false;
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    file = mappedBlockFiles.Get(path, pos.nPos);
+    if (!file)
+        return false;
+    nSize = ReadLE32((const unsigned char*)file->data() + pos.nPos - 4);
+    if (nSize > MAX_BLOCK_SIZE)
+        return false;
+    if (file->size() - pos.nPos < nSize) {
+        // Written after the file was mapped
+        file = mappedBlockFiles.Get(path, (size_t)pos.nPos + nSize);
+        if (!file)
+            return false;
+    }
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
@@ -1481,14 +1638,23 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    CMappedFileRef mapped;
+                    unsigned int nSize;
+                    if (MapBlockFile(postx, mapped, nSize)) {
+                        CMemoryReader reader(mapped->data() + postx.nPos, mapped->data() + postx.nPos + nSize, SER_DISK, CLIENT_VERSION);
+                        reader >> header;
+                        reader.ignore(postx.nTxOffset);
+                        reader >> txOut;
+                    } else {
+                        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                        if (file.IsNull())
+                            return error("%s: OpenBlockFile failed", __func__);
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    }
                 } catch (std::exception& e) {
                     return error("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1562,14 +1728,21 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
     try {
-        filein >> block;
+        CMappedFileRef file;
+        unsigned int nSize;
+        if (MapBlockFile(pos, file, nSize)) {
+            CMemoryReader reader(file->data() + pos.nPos, file->data() + pos.nPos + nSize, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+
+            // Read block
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -2015,8 +2188,11 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            // A mapping that covers the pre-allocated space must not outlive it
+            mappedBlockFiles.Erase(GetBlockPosFilename(posOld, "blk"));
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2031,6 +2207,7 @@ void static FlushBlockFile(bool fFinalize = false)
 }
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
+static bool AcceptBlockStake(const CBlock& block, CBlockIndex* pindex, CValidationState& state);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
@@ -2074,6 +2251,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(100, error("ConnectBlock() : PoW period ended"),
             REJECT_INVALID, "PoW-ended");
 
+    // Blocks downloaded ahead of their parent get their kernel checked and stake modifier computed here
+    if (!fJustCheck && (pindex->nFlags & CBlockIndex::BLOCK_STAKE_PENDING) && !AcceptBlockStake(block, pindex, state))
+        return false;
+
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2246,20 +2427,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 enum FlushStateMode {
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
-    FLUSH_STATE_ALWAYS
+    FLUSH_STATE_ALWAYS,
+    FLUSH_STATE_SYNC //! like FLUSH_STATE_ALWAYS, and wait until pcoinsFlusher has written the chainstate
 };
 
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
+ * The block index is written synchronously; the chainstate is handed to
+ * pcoinsFlusher, which writes it together with its best block marker in the
+ * background, so it never refers to block index entries that are not on disk.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_SYNC) ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -2293,6 +2478,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (mode == FLUSH_STATE_SYNC && pcoinsFlusher && !pcoinsFlusher->Wait())
+                return state.Abort("Failed to write to coin database");
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 g_signals.SetBestChain(chainActive.GetLocator());
@@ -2308,7 +2495,7 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 void FlushStateToDisk()
 {
     CValidationState state;
-    FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+    FlushStateToDisk(state, FLUSH_STATE_SYNC);
 }
 
 /** Update chainActive and related internal data structures. */
@@ -2326,6 +2513,7 @@ void static UpdateTip(CBlockIndex* pindexNew)
         Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
+    PublishChainTipSnapshot();
 
     // Check the version of the last 100 blocks to see if we need to upgrade:
     static bool fWarned = false;
@@ -2750,6 +2938,7 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             }
             // Notify external listeners about the new tip.
             uiInterface.NotifyBlockTip(hashNewTip);
+            g_signals.UpdatedBlockTip(pindexNewTip);
         }
     } while (pindexMostWork != chainActive.Tip());
     CheckBlockIndex();
@@ -2762,6 +2951,49 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
     return true;
 }
 
+CChainTipSnapshot::CChainTipSnapshot()
+    : nSequence(0), pindexTip(NULL), nHeight(-1)
+{
+}
+
+static CCriticalSection cs_chainTipSnapshot;
+static CChainTipSnapshotRef chainTipSnapshot;
+
+void PublishChainTipSnapshot()
+{
+    // Built and published under cs_main so that snapshots are published in the order the tips were set
+    AssertLockHeld(cs_main);
+    CChainTipSnapshotRef snapshotPrev;
+    {
+        LOCK(cs_chainTipSnapshot);
+        snapshotPrev = chainTipSnapshot;
+    }
+
+    boost::shared_ptr<CChainTipSnapshot> snapshot(new CChainTipSnapshot());
+    CBlockIndex* pindexTip = chainActive.Tip();
+    snapshot->nSequence = snapshotPrev ? snapshotPrev->nSequence + 1 : 1;
+    snapshot->pindexTip = pindexTip;
+    if (pindexTip) {
+        snapshot->nHeight = pindexTip->nHeight;
+        snapshot->hashTip = pindexTip->GetBlockHash();
+    }
+
+    LOCK(cs_chainTipSnapshot);
+    chainTipSnapshot = snapshot;
+}
+
+CChainTipSnapshotRef GetChainTipSnapshot()
+{
+    {
+        LOCK(cs_chainTipSnapshot);
+        if (chainTipSnapshot)
+            return chainTipSnapshot;
+    }
+    LOCK(cs_main);
+    PublishChainTipSnapshot();
+    return GetChainTipSnapshot();
+}
+
 bool InvalidateBlock(CValidationState& state, CBlockIndex* pindex)
 {
     AssertLockHeld(cs_main);
@@ -2831,6 +3063,55 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/** ppcoin: compute the chain trust, proof-of-stake hash and stake modifier of a block index entry.
+ *  These depend on the stake data of all ancestors, so the parent's must already be final. */
+static void SetBlockIndexStake(CBlockIndex* pindexNew)
+{
+    uint256 hash = pindexNew->GetBlockHash();
+
+    // ppcoin: compute chain trust score
+    pindexNew->bnChainTrust = pindexNew->pprev->bnChainTrust + pindexNew->GetBlockTrust();
+
+    // ppcoin: record proof-of-stake hash value
+    if (pindexNew->IsProofOfStake()) {
+        if (!mapProofOfStake.count(hash))
+            LogPrintf("SetBlockIndexStake() : hashProofOfStake not found in map \n");
+        pindexNew->hashProofOfStake = mapProofOfStake[hash];
+    }
+
+    // ppcoin: compute stake modifier
+    uint64_t nStakeModifier = 0;
+    bool fGeneratedStakeModifier = false;
+    if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
+        LogPrintf("SetBlockIndexStake() : ComputeNextStakeModifier() failed \n");
+    pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+    pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+    if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+        LogPrintf("SetBlockIndexStake() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+}
+
+/**
+ * Complete an index entry flagged BLOCK_STAKE_PENDING, now that its parent is connected: compute the
+ * stake fields. Pending entries come from headers-first sync of the PoW range, since AcceptBlock
+ * refuses proof-of-stake blocks on a pending parent; the kernel check only guards against that changing.
+ */
+static bool AcceptBlockStake(const CBlock& block, CBlockIndex* pindex, CValidationState& state)
+{
+    uint256 hash = pindex->GetBlockHash();
+    if (block.IsProofOfStake() && !mapProofOfStake.count(hash)) {
+        uint256 hashProofOfStake;
+        if (!CheckProofOfStake(block, hashProofOfStake))
+            return state.DoS(100, error("%s : check proof-of-stake failed for block %s", __func__, hash.ToString()),
+                REJECT_INVALID, "bad-cs-kernel");
+        mapProofOfStake.insert(make_pair(hash, hashProofOfStake));
+    }
+
+    pindex->nFlags &= ~CBlockIndex::BLOCK_STAKE_PENDING;
+    SetBlockIndexStake(pindex);
+    setDirtyBlockIndex.insert(pindex);
+    return true;
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -2862,29 +3143,17 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
         // ppcoin: compute stake entropy bit for stake modifier
         if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
             LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
 
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
-
-        // ppcoin: compute stake modifier
-        uint64_t nStakeModifier = 0;
-        bool fGeneratedStakeModifier = false;
-        if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
-            LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
-        pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
-            LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, boost::lexical_cast<std::string>(nStakeModifier));
+        // A bare header (headers-first sync of the PoW range) and a block whose parent is still
+        // pending cannot compute a stake modifier yet: both are completed by AcceptBlockStake when
+        // the block is connected.
+        if (block.vtx.empty() || (pindexNew->pprev->nFlags & CBlockIndex::BLOCK_STAKE_PENDING))
+            pindexNew->nFlags |= CBlockIndex::BLOCK_STAKE_PENDING;
+        else
+            SetBlockIndexStake(pindexNew);
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
@@ -2903,8 +3172,13 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
-    if (block.IsProofOfStake())
+    if (block.IsProofOfStake() && !pindexNew->IsProofOfStake()) {
+        // The entry was created from a bare header
         pindexNew->SetProofOfStake();
+        pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+        pindexNew->nStakeTime = block.nTime;
+        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    }
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
@@ -3047,7 +3321,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // Check timestamp
     LogPrint("debug", "%s: block=%s  is proof of stake=%d\n", __func__, block.GetHash().ToString().c_str(), block.IsProofOfStake());
-    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? 180 : 7200)) // 3 minute future drift for PoS
+    if (block.GetBlockTime() > GetAdjustedTime() + (block.IsProofOfStake() ? MAX_STAKE_FUTURE_DRIFT : 7200)) // 3 minute future drift for PoS
         return state.Invalid(error("CheckBlock() : block timestamp too far in the future"),
             REJECT_INVALID, "time-too-new");
 
@@ -3166,7 +3440,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev, bool fCheckStake)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
@@ -3186,7 +3460,7 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     if (block.nBits != nBitsRequired)
         return error("%s : incorrect proof of work at %d", __func__, pindexPrev->nHeight + 1);
 
-    if (block.IsProofOfStake()) {
+    if (block.IsProofOfStake() && fCheckStake) {
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
 
@@ -3323,6 +3597,24 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
 
     }
 
+    if (block.vtx.empty() && pindexPrev) {
+        // A bare header from headers-first sync has not been through CheckBlock and CheckWork:
+        // check its timestamp, its Quark proof of work and its difficulty. Only the PoW range is
+        // synced that way, as nothing in a proof-of-stake header can be checked without its block.
+        if (pindexPrev->nHeight + 1 > Params().LAST_POW_BLOCK())
+            return state.Invalid(error("%s : proof-of-stake header %s without its block", __func__, hash.ToString()),
+                REJECT_INVALID, "bad-header-pos");
+        if (block.GetBlockTime() > GetAdjustedTime() + 7200)
+            return state.Invalid(error("%s : header timestamp too far in the future", __func__),
+                REJECT_INVALID, "time-too-new");
+        if (!CheckProofOfWork(hash, block.nBits))
+            return state.DoS(50, error("%s : proof of work failed for header %s", __func__, hash.ToString()),
+                REJECT_INVALID, "high-hash");
+        if (!CheckWork(block, pindexPrev, false))
+            return state.DoS(50, error("%s : incorrect difficulty for header %s", __func__, hash.ToString()),
+                REJECT_INVALID, "bad-diffbits");
+    }
+
     if (!ContextualCheckBlockHeader(block, state, pindexPrev))
         return false;
 
@@ -3364,6 +3656,13 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         }
     }
 
+    // The kernel of a block whose parent is not connected yet can't be checked: the stake input and the
+    // blocks its modifier is taken from may still be downloading. Headers-first sync only covers the PoW
+    // range, so such a proof-of-stake block is refused here and comes again through getblocks.
+    if (block.IsProofOfStake() && (pindexPrev->nFlags & CBlockIndex::BLOCK_STAKE_PENDING))
+        return state.DoS(0, error("%s : parent of proof-of-stake block %s is not connected yet", __func__, block.GetHash().ToString()),
+                         0, "stake-parent-pending");
+
     if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
         return false;
 
@@ -3953,7 +4252,7 @@ bool InitBlockIndex()
             if (!ActivateBestChain(state, &block))
                 return error("LoadBlockIndex() : genesis block cannot be activated");
             // Force a chainstate write so that when we VerifyDB in a moment, it doesnt check stale data
-            return FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
+            return FlushStateToDisk(state, FLUSH_STATE_SYNC);
         } catch (std::runtime_error& e) {
             return error("LoadBlockIndex() : failed to initialize block database: %s", e.what());
         }
@@ -4280,8 +4579,10 @@ bool static AlreadyHave(const CInv& inv)
                mapTxLockReqRejected.count(inv.hash);
     case MSG_TXLOCK_VOTE:
         return mapTxLockVote.count(inv.hash);
-    case MSG_SPORK:
+    case MSG_SPORK: {
+        LOCK(cs_mapSporks);
         return mapSporks.count(inv.hash);
+    }
     case MSG_MERCHANTNODE_WINNER:
         if (merchantnodePayments.mapMerchantnodePayeeVotes.count(inv.hash)) {
             merchantnodeSync.AddedMerchantnodeWinner(inv.hash);
@@ -4326,6 +4627,33 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+/** Number of serialized "block" messages kept for peers requesting the same blocks */
+static const size_t BLOCK_MESSAGE_CACHE_SIZE = 8;
+/** Most recently served first; guarded by cs_main */
+static std::list<std::pair<uint256, CSerializedNetMsgRef> > listBlockMessages;
+
+/** The "block" message for pindex, read and serialized once for all peers downloading it */
+static CSerializedNetMsgRef GetBlockMessage(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    const uint256 hash = pindex->GetBlockHash();
+    for (std::list<std::pair<uint256, CSerializedNetMsgRef> >::iterator it = listBlockMessages.begin(); it != listBlockMessages.end(); ++it) {
+        if (it->first == hash) {
+            listBlockMessages.splice(listBlockMessages.begin(), listBlockMessages, it);
+            return it->second;
+        }
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        assert(!"cannot load block from disk");
+    CSerializedNetMsgRef msg = MakeSerializedNetMsg("block", block);
+    listBlockMessages.push_front(std::make_pair(hash, msg));
+    if (listBlockMessages.size() > BLOCK_MESSAGE_CACHE_SIZE)
+        listBlockMessages.pop_back();
+    return msg;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4363,14 +4691,14 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                        pfrom->PushSerializedMessage(GetBlockMessage(mi->second));
                     else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -4406,9 +4734,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSerializedNetMsgRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushSerializedMessage((*mi).second);
                         pushed = true;
                     }
                 }
@@ -4416,105 +4744,67 @@ void static ProcessGetData(CNode* pfrom)
                 if (!pushed && inv.type == MSG_TX) {
                     CTransaction tx;
                     if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
+                        pfrom->PushSerializedMessage(MakeSerializedNetMsg("tx", tx));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
                     if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "txlvote", mapTxLockVote[inv.hash]));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
                     if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "ix", mapTxLockReq[inv.hash]));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_SPORK) {
+                    LOCK(cs_mapSporks);
                     if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "spork", mapSporks[inv.hash]));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_MERCHANTNODE_WINNER) {
                     if (merchantnodePayments.mapMerchantnodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << merchantnodePayments.mapMerchantnodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "mnw", merchantnodePayments.mapMerchantnodePayeeVotes[inv.hash]));
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_BUDGET_VOTE) {
                     if (budget.mapSeenMerchantnodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMerchantnodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "mvote", budget.mapSeenMerchantnodeBudgetVotes[inv.hash]));
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
                     if (budget.mapSeenMerchantnodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMerchantnodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "mprop", budget.mapSeenMerchantnodeBudgetProposals[inv.hash]));
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
                     if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "fbvote", budget.mapSeenFinalizedBudgetVotes[inv.hash]));
                         pushed = true;
                     }
                 }
 
                 if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
                     if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_MERCHANTNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMerchantnodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMerchantnodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
+                        pfrom->PushSerializedMessage(relayMessageCache.GetOrSerialize(inv, "fbs", budget.mapSeenFinalizedBudgets[inv.hash]));
                         pushed = true;
                     }
                 }
 
-                if (!pushed && inv.type == MSG_MERCHANTNODE_PING) {
-                    if (mnodeman.mapSeenMerchantnodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMerchantnodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
+                if (!pushed && (inv.type == MSG_MERCHANTNODE_ANNOUNCE || inv.type == MSG_MERCHANTNODE_PING)) {
+                    CSerializedNetMsgRef msg;
+                    if (mnodeman.GetSeenMessage(inv, msg)) {
+                        pfrom->PushSerializedMessage(msg);
                         pushed = true;
                     }
                 }
@@ -4699,6 +4989,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pfrom->nVersion < CADDR_TIME_VERSION && addrman.size() > 1000)
             return true;
         if (vAddr.size() > 1000) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message addr size() = %u", vAddr.size());
         }
@@ -4764,6 +5055,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
+        uint256 hashLastBlockInv;
+        unsigned int nBlockInvs = 0;
 
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
@@ -4780,11 +5073,26 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
-                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                if (!fAlreadyHave && !fImporting && !fReindex && !IsHeadersFirstSync(pfrom)) {
+                    // Queue it for the download window in SendMessages, which requests it from this peer
+                    // or from another one that announced it too
+                    CNodeState* state = State(pfrom->GetId());
+                    if (state->vBlocksAnnounced.size() < BLOCK_DOWNLOAD_WINDOW)
+                        state->vBlocksAnnounced.push_back(inv.hash);
+                    LogPrint("net", "getblocks (%d) %s from peer=%d\n", chainActive.Height(), inv.hash.ToString(), pfrom->id);
+                } else if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                    // First request the headers preceding the announced block. In the normal case, right
+                    // after the headers the block is fetched directly. During initial download the
+                    // download window in SendMessages fetches it.
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                    if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().TargetSpacing() * 20) {
+                        vToFetch.push_back(inv);
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                    }
+                    LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
                 }
+                hashLastBlockInv = inv.hash;
+                nBlockInvs++;
             }
 
             // Track requests for our stuff
@@ -4796,6 +5104,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        // A getblocks reply announces several blocks at once; a newly found block comes on its own
+        if (nBlockInvs > 1)
+            State(pfrom->GetId())->hashBlocksBatchEnd = hashLastBlockInv;
+
         if (!vToFetch.empty())
             pfrom->PushMessage("getdata", vToFetch);
     }
@@ -4820,7 +5132,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks" || (strCommand == "getheaders" && !IsHeadersFirstPeer(pfrom))) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4833,7 +5145,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // Send the rest of the chain
         if (pindex)
             pindex = chainActive.Next(pindex);
-        int nLimit = 500;
+        int nLimit = MAX_GETBLOCKS_RESULTS;
         LogPrint("net", "getblocks %d to %s limit %d from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop == uint256(0) ? "end" : hashStop.ToString(), nLimit, pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
             if (pindex->GetBlockHash() == hashStop) {
@@ -4852,7 +5164,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4882,6 +5194,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (fDebug)
             LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex)) {
+            // Proof-of-stake headers are not synced headers-first, see IsHeadersFirstSync
+            if (pindex->nHeight > Params().LAST_POW_BLOCK())
+                break;
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
@@ -5018,6 +5333,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return true;
         }
         CBlockIndex* pindexLast = NULL;
+        bool fPastProofOfWork = false;
         BOOST_FOREACH (const CBlockHeader& header, headers) {
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
@@ -5025,9 +5341,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
+            // Only the PoW range is synced headers-first: stop at the first proof-of-stake header.
+            // Its block comes through getblocks once the PoW range is connected.
+            CBlockIndex* pindexPrev = pindexLast;
+            if (pindexPrev == NULL) {
+                BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+                if (mi != mapBlockIndex.end())
+                    pindexPrev = mi->second;
+            }
+            if (pindexPrev != NULL && pindexPrev->nHeight >= Params().LAST_POW_BLOCK()) {
+                fPastProofOfWork = true;
+                break;
+            }
+
+            // A CBlock without transactions is accepted as a bare header: AcceptBlockHeader checks its
+            // work and AddToBlockIndex leaves the stake fields for when the block itself is connected
             if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
@@ -5042,7 +5370,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !fPastProofOfWork && pindexLast->nHeight < Params().LAST_POW_BLOCK()) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -5063,7 +5391,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
         if (!mapBlockIndex.count(block.hashPrevBlock)) {
-            if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
+            bool fOrphan = false;
+            if (!IsHeadersFirstSync(pfrom)) {
+                LOCK(cs_main);
+                fOrphan = AddOrphanBlock(block, pfrom->GetId());
+            }
+            if (IsHeadersFirstSync(pfrom)) {
+                // Fetch the missing headers; the block is requested again through the download window
+                LOCK(cs_main);
+                MarkBlockAsReceived(hashBlock);
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashBlock);
+            } else if (fOrphan) {
+                // Requested by the download window ahead of its parent; processed once the parent is accepted
+            } else if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 //we already asked for this block, so lets work backwards and ask for the previous block
                 pfrom->PushMessage("getblocks", chainActive.GetLocator(), block.hashPrevBlock);
                 pfrom->vBlockRequested.push_back(block.hashPrevBlock);
@@ -5076,7 +5416,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             pfrom->AddInventoryKnown(inv);
 
             CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
                 ProcessNewBlock(state, pfrom, &block);
                 int nDoS;
                 if(state.IsInvalid(nDoS)) {
@@ -5087,9 +5428,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                         if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
                     }
                 }
+                ProcessOrphanBlocks(hashBlock);
                 //disconnect this node if its old protocol version
                 pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
             } else {
+                LOCK(cs_main);
+                MarkBlockAsReceived(hashBlock);
                 LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
             }
         }
@@ -5102,7 +5446,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     // Making users (which are behind NAT and can only make outgoing connections) ignore
     // getaddr message mitigates the attack.
     else if ((strCommand == "getaddr") && (pfrom->fInbound)) {
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_inventory);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH (const CAddress& addr, vAddr)
             pfrom->PushAddress(addr);
@@ -5308,7 +5655,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 LogPrint("net", "Unparseable reject message received\n");
             }
         }
-    } else {
+    }
+
+    // Handled on the message handler threads in parallel, dispatched directly
+    else if (strCommand == "spork" || strCommand == "getsporks") {
+        ProcessSpork(pfrom, strCommand, vRecv);
+    }
+
+    else {
         //probably one the extensions
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
@@ -5334,6 +5688,87 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/**
+ * Serializes the message handler threads for everything outside the parallel
+ * message set, and SendMessages, so that these keep the single-threaded
+ * semantics they were written for.
+ */
+static CCriticalSection cs_serialMessages;
+// Set when a handler gave up on cs_serialMessages; the holder then wakes them on release
+static std::atomic<bool> fSerialMessagesContended(false);
+
+/**
+ * Messages whose handlers only touch the sending peer and internally locked
+ * state (addrman, cs_inventory, cs_mapSporks, the chain tip snapshot), and
+ * so run without cs_serialMessages. mnp is not one of them: it writes the
+ * merchantnode seen maps that AlreadyHave and ProcessGetData read.
+ */
+static bool IsParallelMessage(const std::string& strCommand)
+{
+    return strCommand == "ping" || strCommand == "pong" || strCommand == "addr" || strCommand == "getaddr" ||
+           strCommand == "spork" || strCommand == "getsporks";
+}
+
+/** Tries to take cs_serialMessages without blocking the calling handler thread */
+class CSerialMessageLock
+{
+private:
+    boost::unique_lock<CCriticalSection> lock;
+    bool fBlocked;
+
+public:
+    CSerialMessageLock(bool fSerial = true) : lock(cs_serialMessages, boost::defer_lock), fBlocked(false)
+    {
+        if (fSerial && !lock.try_lock()) {
+            fSerialMessagesContended = true;
+            // Retry once: the holder may have released before it could see the flag
+            fBlocked = !lock.try_lock();
+        }
+    }
+
+    ~CSerialMessageLock()
+    {
+        if (lock.owns_lock()) {
+            lock.unlock();
+            if (fSerialMessagesContended.exchange(false))
+                WakeMessageHandlers();
+        }
+    }
+
+    bool Blocked() const
+    {
+        return fBlocked;
+    }
+};
+
+/**
+ * Hands the signatures of the complete merchantnode messages waiting in the
+ * receive queue to the signature check threads together, so that processing
+ * them one by one finds the signing keys recovered already. Requires
+ * LOCK(cs_vRecvMsg).
+ */
+static void QueueMerchantnodeSigChecks(CNode* pfrom)
+{
+    if (fLiteMode) return;
+
+    std::vector<CMerchantnodeSigCheck> vChecks;
+    for (std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin(); it != pfrom->vRecvMsg.end() && it->complete(); ++it) {
+        CNetMessage& msg = *it;
+        if (msg.fSigChecksQueued)
+            continue;
+        msg.fSigChecksQueued = true;
+        std::string strCommand = msg.hdr.GetCommand();
+        if (!IsMerchantnodeSigMessage(strCommand))
+            continue;
+        CDataStream vPayload(msg.vRecv.begin(), msg.vRecv.begin() + msg.hdr.nMessageSize, msg.vRecv.GetType(), msg.vRecv.GetVersion());
+        GetMerchantnodeSigChecks(strCommand, vPayload, vChecks);
+    }
+
+    // A lone signature is checked as its message is processed
+    if (vChecks.size() > 1)
+        VerifyMerchantnodeSigChecks(vChecks);
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -5349,13 +5784,22 @@ bool ProcessMessages(CNode* pfrom)
     //  (x) data
     //
     bool fOk = true;
+    pfrom->fMsgSerialBlocked = false;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        CSerialMessageLock lockSerial;
+        if (lockSerial.Blocked()) {
+            pfrom->fMsgSerialBlocked = true;
+            return fOk;
+        }
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    QueueMerchantnodeSigChecks(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -5406,8 +5850,18 @@ bool ProcessMessages(CNode* pfrom)
             continue;
         }
 
+        // While another handler thread holds the serial lock, leave the
+        // message queued and go on with the other peers
+        CSerialMessageLock lockSerial(!IsParallelMessage(strCommand));
+        if (lockSerial.Blocked()) {
+            pfrom->fMsgSerialBlocked = true;
+            --it;
+            break;
+        }
+
         // Process message
         bool fRet = false;
+        int64_t nProcessStart = GetTimeMicros();
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
@@ -5433,6 +5887,12 @@ bool ProcessMessages(CNode* pfrom)
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
+        int64_t nWait = nProcessStart - msg.nTime;
+        pfrom->nMsgProcessed++;
+        pfrom->nMsgWaitUsec += nWait;
+        pfrom->nMsgWaitUsecMax = std::max(pfrom->nMsgWaitUsecMax, nWait);
+        pfrom->nMsgProcessUsec += GetTimeMicros() - nProcessStart;
+
         break;
     }
 
@@ -5451,6 +5911,11 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (pto->nVersion == 0)
             return true;
 
+        // Retried on the next round while another handler thread holds the serial lock
+        CSerialMessageLock lockSerial;
+        if (lockSerial.Blocked())
+            return true;
+
         //
         // Message: ping
         //
@@ -5490,8 +5955,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodes) {
                 // Periodically clear setAddrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
+                if (nLastRebroadcast) {
+                    LOCK(pnode->cs_inventory);
                     pnode->setAddrKnown.clear();
+                }
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -5505,21 +5972,19 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         if (fSendTrickle) {
             vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH (const CAddress& addr, pto->vAddrToSend) {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000) {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
-                    }
+            {
+                LOCK(pto->cs_inventory);
+                vAddr.reserve(pto->vAddrToSend.size());
+                BOOST_FOREACH (const CAddress& addr, pto->vAddrToSend) {
+                    // returns true if wasn't already contained in the set
+                    if (pto->setAddrKnown.insert(addr).second)
+                        vAddr.push_back(addr);
                 }
+                pto->vAddrToSend.clear();
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                pto->PushMessage("addr", vAddr);
+            // receiver rejects addr messages larger than 1000
+            for (size_t i = 0; i < vAddr.size(); i += 1000)
+                pto->PushMessage("addr", vector<CAddress>(vAddr.begin() + i, vAddr.begin() + std::min(vAddr.size(), i + 1000)));
         }
 
         CNodeState& state = *State(pto->GetId());
@@ -5545,18 +6010,40 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (pindexBestHeader == NULL)
             pindexBestHeader = chainActive.Tip();
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
-        if (!state.fSyncStarted && !pto->fClient && fFetch /*&& !fImporting*/ && !fReindex) {
+        if (!state.fSyncStarted && !pto->fClient && fFetch /*&& !fImporting*/ && !fReindex && IsHeadersFirstSync(pto)) {
             // Only actively request headers from a single peer, unless we're close to end of initial download.
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
             }
         }
 
+        // Headers-first sync ends at LAST_POW_BLOCK: once that range is connected, or right away with a peer
+        // that has no headers-first sync, continue with getblocks. Several peers are asked, and the download
+        // window below spreads the blocks they announce over them.
+        if (!state.fBlocksSyncStarted && !pto->fClient && fFetch && !fReindex && !IsHeadersFirstSync(pto) &&
+            (!IsHeadersFirstPeer(pto) || chainActive.Height() >= Params().LAST_POW_BLOCK()) &&
+            (nBlocksSyncStarted < MAX_BLOCKS_SYNC_PEERS || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60)) {
+            state.fBlocksSyncStarted = true;
+            nBlocksSyncStarted++;
+            LogPrint("net", "initial getblocks (%d) to peer=%d (startheight:%d)\n", chainActive.Height(), pto->id, pto->nStartingHeight);
+            pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+        }
+
+        // Ask for the batch after the last one this peer announced as soon as its blocks leave room for it,
+        // without waiting for the batch to be downloaded
+        if (state.fBlocksSyncStarted && state.hashBlocksBatchEnd != 0 && state.hashBlocksBatchEnd != state.hashBlocksContinued &&
+            state.vBlocksAnnounced.size() + MAX_GETBLOCKS_RESULTS <= BLOCK_DOWNLOAD_WINDOW) {
+            state.hashBlocksContinued = state.hashBlocksBatchEnd;
+            CBlockLocator locator = chainActive.GetLocator(chainActive.Tip());
+            locator.vHave.insert(locator.vHave.begin(), state.hashBlocksContinued);
+            LogPrint("net", "getblocks after %s to peer=%d\n", state.hashBlocksContinued.ToString(), pto->id);
+            pto->PushMessage("getblocks", locator, uint256(0));
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -5648,6 +6135,23 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
         }
 
+        // Past the headers-first range, request the blocks this peer announced that we don't have, haven't
+        // kept as orphans and haven't requested from another peer. Peers that announced the same getblocks
+        // batch thus each get a different part of it. Only the first MAX_ORPHAN_BLOCKS are looked at, so every
+        // block arriving before its parent can be kept; the kernel is checked once the parent is accepted.
+        if (!pto->fDisconnect && !pto->fClient && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            while (!state.vBlocksAnnounced.empty() && mapBlockIndex.count(state.vBlocksAnnounced.front()))
+                state.vBlocksAnnounced.pop_front();
+            for (unsigned int i = 0; i < state.vBlocksAnnounced.size() && i < MAX_ORPHAN_BLOCKS && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER; i++) {
+                const uint256& hash = state.vBlocksAnnounced[i];
+                if (mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash) || mapBlocksInFlight.count(hash))
+                    continue;
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                MarkBlockAsInFlight(pto->GetId(), hash);
+                LogPrint("net", "Requesting announced block %s peer=%d\n", hash.ToString(), pto->id);
+            }
+        }
+
         //
         // Message: getdata (non-blocks)
         //
@@ -41,12 +41,15 @@
 #include <utility>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewBackgroundFlush;
 class CSporkDB;
 class CBloomFilter;
+class CMappedFileCache;
 class CInv;
 class CScriptCheck;
 class CValidationInterface;
@@ -76,6 +79,8 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
+/** -blockfilemaps default, number of block files kept memory-mapped for reading */
+static const unsigned int DEFAULT_BLOCK_FILE_MAPS = 8;
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** Threshold for nLockTime: below this value it is interpreted as block number, otherwise as UNIX timestamp. */
@@ -96,6 +101,13 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Number of block hashes sent in one getblocks result. */
+static const unsigned int MAX_GETBLOCKS_RESULTS = 500;
+/** Number of peers whose getblocks inventory we download from at once, past the headers-first range. */
+static const int MAX_BLOCKS_SYNC_PEERS = 4;
+/** Blocks received ahead of their parent during getblocks sync, kept until the parent is accepted. Also
+ *  how far into a peer's announced blocks we request, so that all requested blocks can be kept. */
+static const unsigned int MAX_ORPHAN_BLOCKS = 256;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 3600;
 /** Maximum length of reject messages. */
@@ -243,7 +255,7 @@ bool AbortNode(const std::string& msg, const std::string& userMessage = "");
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
-/** Flush all state, indexes and buffers to disk. */
+/** Flush all state, indexes and buffers to disk, and wait until the chainstate is written. */
 void FlushStateToDisk();
 
 
@@ -438,7 +450,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev, bool fCheckStake = true);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -604,9 +616,37 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex);
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 
+/**
+ * Immutable summary of the active chain tip, republished after every ActivateBestChain so that
+ * read-only RPC calls can answer without cs_main. pindexTip and its ancestors (pprev, pskip,
+ * nHeight, hashes) never change once indexed and may be walked without locks.
+ */
+struct CChainTipSnapshot {
+    uint64_t nSequence; //! increases with every publication
+    const CBlockIndex* pindexTip;
+    int nHeight;
+    uint256 hashTip;
+
+    CChainTipSnapshot();
+};
+
+typedef boost::shared_ptr<const CChainTipSnapshot> CChainTipSnapshotRef;
+
+/** Publish a snapshot of the current tip. Requires cs_main. */
+void PublishChainTipSnapshot();
+
+/** Latest published tip snapshot; publishes one first if there is none yet. */
+CChainTipSnapshotRef GetChainTipSnapshot();
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Write-behind layer below pcoinsTip that flushes it to the database in the background (protected by cs_main) */
+extern CCoinsViewBackgroundFlush* pcoinsFlusher;
+
+/** Memory mappings of the block files used by ReadBlockFromDisk */
+extern CMappedFileCache mappedBlockFiles;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
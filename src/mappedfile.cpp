@@ -0,0 +1,149 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile(const boost::filesystem::path& path) : pdata(NULL), nSize(0)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pdata = (const char*)p;
+            nSize = st.st_size;
+        } else {
+            LogPrint("mmap", "Unable to map %s: %s\n", path.string(), strerror(errno));
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+    // Not implemented on Windows; callers read the file instead
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+/** Current size of the file at path */
+static bool GetFileSize(const boost::filesystem::path& path, size_t& nSizeRet)
+{
+#ifndef WIN32
+    struct stat st;
+    if (stat(path.string().c_str(), &st) != 0)
+        return false;
+    nSizeRet = st.st_size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+CMappedFileCache::CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn), nHits(0), nMaps(0)
+{
+}
+
+void CMappedFileCache::Trim()
+{
+    while (listFiles.size() > nMaxFiles) {
+        mapFiles.erase(listFiles.back().first);
+        listFiles.pop_back();
+    }
+}
+
+void CMappedFileCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    Trim();
+}
+
+void CMappedFileCache::EraseLocked(const std::string& strPath)
+{
+    std::map<std::string, list_type::iterator>::iterator mi = mapFiles.find(strPath);
+    if (mi != mapFiles.end()) {
+        listFiles.erase(mi->second);
+        mapFiles.erase(mi);
+    }
+}
+
+CMappedFileRef CMappedFileCache::Get(const boost::filesystem::path& path, size_t nMinSize)
+{
+    // Touching a mapped page past the end of the file raises SIGBUS, so the
+    // bounds come from the file as it is now rather than from the mapping
+    size_t nFileSize = 0;
+    bool fFileSize = GetFileSize(path, nFileSize);
+
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return CMappedFileRef();
+
+    std::string strPath = path.string();
+    if (!fFileSize || nFileSize < nMinSize) {
+        EraseLocked(strPath);
+        return CMappedFileRef();
+    }
+    std::map<std::string, list_type::iterator>::iterator mi = mapFiles.find(strPath);
+    if (mi != mapFiles.end()) {
+        size_t nMapped = mi->second->second->size();
+        if (nMapped >= nMinSize && nMapped <= nFileSize) {
+            listFiles.splice(listFiles.begin(), listFiles, mi->second);
+            nHits++;
+            return mi->second->second;
+        }
+        // The file grew or was truncated since it was mapped
+        listFiles.erase(mi->second);
+        mapFiles.erase(mi);
+    }
+
+    CMappedFileRef file(new CMappedFile(path));
+    if (file->IsNull() || file->size() < nMinSize || file->size() > nFileSize)
+        return CMappedFileRef();
+    nMaps++;
+    listFiles.push_front(std::make_pair(strPath, file));
+    mapFiles.insert(std::make_pair(strPath, listFiles.begin()));
+    Trim();
+    return file;
+}
+
+void CMappedFileCache::Erase(const boost::filesystem::path& path)
+{
+    LOCK(cs);
+    EraseLocked(path.string());
+}
+
+void CMappedFileCache::Clear()
+{
+    LOCK(cs);
+    listFiles.clear();
+    mapFiles.clear();
+}
+
+void CMappedFileCache::GetStats(CMappedFileCacheStats& stats) const
+{
+    LOCK(cs);
+    stats.nMappings = listFiles.size();
+    stats.nHits = nHits;
+    stats.nMaps = nMaps;
+}
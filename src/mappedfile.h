@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/** Read-only memory mapping of a whole file, as large as the file was when it was mapped */
+class CMappedFile : private boost::noncopyable
+{
+private:
+    const char* pdata;
+    size_t nSize;
+
+public:
+    //! Map path; IsNull() tells whether that failed
+    CMappedFile(const boost::filesystem::path& path);
+    ~CMappedFile();
+
+    bool IsNull() const { return pdata == NULL; }
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+typedef boost::shared_ptr<const CMappedFile> CMappedFileRef;
+
+struct CMappedFileCacheStats {
+    size_t nMappings;
+    uint64_t nHits;
+    uint64_t nMaps; //! files mapped, including files mapped again because they grew
+};
+
+/**
+ * Least recently used set of file mappings.
+ *
+ * Files that are appended to, like the block files, are mapped again once
+ * a read reaches past the end of the existing mapping, and files that shrank
+ * are mapped again at their new size. Readers hold on to
+ * the mapping they got, so evicting or replacing it never unmaps memory
+ * that is still being read.
+ */
+class CMappedFileCache
+{
+private:
+    typedef std::list<std::pair<std::string, CMappedFileRef> > list_type;
+
+    mutable CCriticalSection cs;
+    list_type listFiles; //! most recently used first
+    std::map<std::string, list_type::iterator> mapFiles;
+    size_t nMaxFiles;
+    uint64_t nHits;
+    uint64_t nMaps;
+
+    void Trim();
+    void EraseLocked(const std::string& strPath);
+
+public:
+    CMappedFileCache(size_t nMaxFilesIn);
+
+    //! Number of mappings to keep; 0 disables mapping
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    /**
+     * A mapping of path that covers at least its first nMinSize bytes, or
+     * NULL if the file is smaller or cannot be mapped. Callers then fall
+     * back to reading the file. The file's current size is checked on every
+     * call, so a mapping that outlived a truncation is never handed out.
+     */
+    CMappedFileRef Get(const boost::filesystem::path& path, size_t nMinSize);
+
+    //! Drop the mapping of path, e.g. before the file is truncated
+    void Erase(const boost::filesystem::path& path);
+
+    //! Drop all mappings, e.g. before files are deleted or rewritten
+    void Clear();
+
+    void GetStats(CMappedFileCacheStats& stats) const;
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
@@ -1735,7 +1735,7 @@ bool CBudgetVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!merchantnodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMerchantnode)) {
         LogPrint("mnbudget","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1750,10 +1750,15 @@ bool CBudgetVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     return true;
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMerchantnode* pmn = mnodeman.Find(vin);
 
@@ -2240,7 +2245,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantno
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!merchantnodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMerchantnode)) {
         LogPrint("mnbudget","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2255,11 +2260,16 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantno
     return true;
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMerchantnode* pmn = mnodeman.Find(vin);
 
@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "merchantnode-helpers.h"
+#include "merchantnode-sigcheck.h"
 #include "init.h"
 #include "main.h"
 #include "merchantnodeman.h"
@@ -108,20 +109,17 @@ bool CMerchantnodeSigner::SignMessage(std::string strMessage, std::string& error
 
 bool CMerchantnodeSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << strMessageMagic;
-    ss << strMessage;
-
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    // Usually recovered already when the message was queued
+    CKeyID keyID2;
+    if (!merchantnodeSigCache.Recover(GetMerchantnodeMessageHash(strMessage), vchSig, keyID2)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CMerchantnodeSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID2 != pubkey.GetID())
+        LogPrintf("CMerchantnodeSigner::VerifyMessage -- keys don't match: %s %s\n", keyID2.ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    return (keyID2 == pubkey.GetID());
 }
 
 bool CMerchantnodeSigner::SetCollateralAddress(std::string strAddress)
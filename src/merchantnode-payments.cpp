@@ -438,9 +438,7 @@ bool CMerchantnodePaymentWinner::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerc
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMerchantnode.prevout.ToStringShort() +
-                             boost::lexical_cast<std::string>(nBlockHeight) +
-                             payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!merchantnodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMerchantnode)) {
         LogPrint("merchantnode","CMerchantnodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -766,14 +764,19 @@ void CMerchantnodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CMerchantnodePaymentWinner::GetStrMessage() const
+{
+    return vinMerchantnode.prevout.ToStringShort() +
+           boost::lexical_cast<std::string>(nBlockHeight) +
+           payee.ToString();
+}
+
 bool CMerchantnodePaymentWinner::SignatureValid()
 {
     CMerchantnode* pmn = mnodeman.Find(vinMerchantnode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMerchantnode.prevout.ToStringShort() +
-                                 boost::lexical_cast<std::string>(nBlockHeight) +
-                                 payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!merchantnodeSigner.VerifyMessage(pmn->pubKeyMerchantnode, vchSig, strMessage, errorMessage)) {
@@ -197,6 +197,7 @@ public:
     bool Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    std::string GetStrMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn)
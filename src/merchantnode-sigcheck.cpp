@@ -0,0 +1,205 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "merchantnode-sigcheck.h"
+
+#include "checkqueue.h"
+#include "hash.h"
+#include "main.h"
+#include "merchantnode.h"
+#include "merchantnode-budget.h"
+#include "merchantnode-payments.h"
+#include "merchantnode-vote.h"
+#include "random.h"
+#include "util.h"
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+CMerchantnodeSigCache merchantnodeSigCache(DEFAULT_MERCHANTNODE_SIG_CACHE_SIZE);
+
+static CCheckQueue<CMerchantnodeSigCheck> mnsigcheckqueue(16);
+static std::atomic<int> nSigCheckThreads(0);
+// CCheckQueue takes one master at a time
+static boost::mutex csSigCheckBatch;
+
+uint256 GetMerchantnodeMessageHash(const std::string& strMessage)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << strMessage;
+    return ss.GetHash();
+}
+
+static uint256 GetSigCacheEntry(const uint256& hashMessage, const std::vector<unsigned char>& vchSig)
+{
+    return Hash(hashMessage.begin(), hashMessage.end(), vchSig.begin(), vchSig.end());
+}
+
+CMerchantnodeSigCache::CMerchantnodeSigCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn), nHits(0), nMisses(0)
+{
+}
+
+void CMerchantnodeSigCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = nMaxSizeIn;
+    if (nMaxSize == 0)
+        mapKeys.clear();
+}
+
+bool CMerchantnodeSigCache::Get(const uint256& hashEntry, CKeyID& keyIDRet)
+{
+    LOCK(cs);
+    std::map<uint256, CKeyID>::const_iterator it = mapKeys.find(hashEntry);
+    if (it == mapKeys.end()) {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    keyIDRet = it->second;
+    return true;
+}
+
+void CMerchantnodeSigCache::Set(const uint256& hashEntry, const CKeyID& keyID)
+{
+    LOCK(cs);
+    if (nMaxSize == 0)
+        return;
+    while (mapKeys.size() >= nMaxSize) {
+        // Evict a random entry, as the script signature cache does
+        std::map<uint256, CKeyID>::iterator it = mapKeys.lower_bound(GetRandHash());
+        if (it == mapKeys.end())
+            it = mapKeys.begin();
+        mapKeys.erase(it);
+    }
+    mapKeys[hashEntry] = keyID;
+}
+
+bool CMerchantnodeSigCache::Have(const uint256& hashMessage, const std::vector<unsigned char>& vchSig) const
+{
+    uint256 hashEntry = GetSigCacheEntry(hashMessage, vchSig);
+    LOCK(cs);
+    return mapKeys.count(hashEntry);
+}
+
+bool CMerchantnodeSigCache::Recover(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet)
+{
+    uint256 hashEntry = GetSigCacheEntry(hashMessage, vchSig);
+    if (!Get(hashEntry, keyIDRet)) {
+        CPubKey pubkey;
+        keyIDRet = pubkey.RecoverCompact(hashMessage, vchSig) ? pubkey.GetID() : CKeyID();
+        Set(hashEntry, keyIDRet);
+    }
+    return !keyIDRet.IsNull();
+}
+
+void CMerchantnodeSigCache::Clear()
+{
+    LOCK(cs);
+    mapKeys.clear();
+}
+
+void CMerchantnodeSigCache::GetStats(size_t& nSizeRet, uint64_t& nHitsRet, uint64_t& nMissesRet) const
+{
+    LOCK(cs);
+    nSizeRet = mapKeys.size();
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+}
+
+bool CMerchantnodeSigCheck::operator()()
+{
+    CKeyID keyID;
+    merchantnodeSigCache.Recover(hashMessage, vchSig, keyID);
+    return true;
+}
+
+bool CMerchantnodeSigCheck::IsCached() const
+{
+    return merchantnodeSigCache.Have(hashMessage, vchSig);
+}
+
+void ThreadMerchantnodeSigCheck()
+{
+    RenameThread("artax-mnsigcheck");
+    nSigCheckThreads++;
+    try {
+        mnsigcheckqueue.Thread();
+    } catch (...) {
+        nSigCheckThreads--;
+        throw;
+    }
+    nSigCheckThreads--;
+}
+
+bool IsMerchantnodeSigMessage(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw" ||
+           strCommand == "mvote" || strCommand == "fbvote" || strCommand == "mcvote";
+}
+
+bool GetMerchantnodeSigChecks(const std::string& strCommand, CDataStream& vRecv, std::vector<CMerchantnodeSigCheck>& vChecks)
+{
+    try {
+        if (strCommand == "mnb") {
+            CMerchantnodeBroadcast mnb;
+            vRecv >> mnb;
+            vChecks.push_back(CMerchantnodeSigCheck(mnb.GetStrMessage(), mnb.sig));
+            if (mnb.lastPing != CMerchantnodePing())
+                vChecks.push_back(CMerchantnodeSigCheck(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+        } else if (strCommand == "mnp") {
+            CMerchantnodePing mnp;
+            vRecv >> mnp;
+            vChecks.push_back(CMerchantnodeSigCheck(mnp.GetStrMessage(), mnp.vchSig));
+        } else if (strCommand == "mnw") {
+            CMerchantnodePaymentWinner winner;
+            vRecv >> winner;
+            vChecks.push_back(CMerchantnodeSigCheck(winner.GetStrMessage(), winner.vchSig));
+        } else if (strCommand == "mvote") {
+            CBudgetVote vote;
+            vRecv >> vote;
+            vChecks.push_back(CMerchantnodeSigCheck(vote.GetStrMessage(), vote.vchSig));
+        } else if (strCommand == "fbvote") {
+            CFinalizedBudgetVote vote;
+            vRecv >> vote;
+            vChecks.push_back(CMerchantnodeSigCheck(vote.GetStrMessage(), vote.vchSig));
+        } else if (strCommand == "mcvote") {
+            CCommunityVote vote;
+            vRecv >> vote;
+            vChecks.push_back(CMerchantnodeSigCheck(vote.GetStrMessage(), vote.vchSig));
+        } else {
+            return false;
+        }
+    } catch (const std::exception&) {
+        // Reported when the message itself is processed
+        return false;
+    }
+    return true;
+}
+
+bool VerifyMerchantnodeSigChecks(std::vector<CMerchantnodeSigCheck>& vChecks)
+{
+    if (nSigCheckThreads == 0)
+        return false;
+    boost::unique_lock<boost::mutex> lock(csSigCheckBatch, boost::try_to_lock);
+    if (!lock.owns_lock())
+        return false;
+
+    std::vector<CMerchantnodeSigCheck> vQueue;
+    vQueue.reserve(vChecks.size());
+    for (size_t i = 0; i < vChecks.size(); i++) {
+        if (!vChecks[i].IsCached()) {
+            vQueue.push_back(CMerchantnodeSigCheck());
+            vQueue.back().swap(vChecks[i]);
+        }
+    }
+    vChecks.clear();
+
+    CCheckQueueControl<CMerchantnodeSigCheck> control(&mnsigcheckqueue);
+    control.Add(vQueue);
+    control.Wait();
+    return true;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MERCHANTNODE_SIGCHECK_H
+#define MERCHANTNODE_SIGCHECK_H
+
+#include "pubkey.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** Default for -mnsigcachesize, the number of recovered merchantnode message keys kept */
+static const unsigned int DEFAULT_MERCHANTNODE_SIG_CACHE_SIZE = 50000;
+
+/** Hash that merchantnodeSigner signs for strMessage */
+uint256 GetMerchantnodeMessageHash(const std::string& strMessage);
+
+/**
+ * Keys recovered from compact merchantnode message signatures, so that a
+ * signature verified ahead of processing (or relayed to us again) is not
+ * recovered twice. Failed recoveries are remembered as well.
+ */
+class CMerchantnodeSigCache
+{
+private:
+    mutable CCriticalSection cs;
+    //! Hash(message hash, signature) -> recovered key id, null if recovery failed
+    std::map<uint256, CKeyID> mapKeys;
+    size_t nMaxSize;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    bool Get(const uint256& hashEntry, CKeyID& keyIDRet);
+    void Set(const uint256& hashEntry, const CKeyID& keyID);
+
+public:
+    CMerchantnodeSigCache(size_t nMaxSizeIn);
+
+    void SetMaxSize(size_t nMaxSizeIn);
+
+    //! Whether the key for this signature is known already
+    bool Have(const uint256& hashMessage, const std::vector<unsigned char>& vchSig) const;
+
+    //! Key id that signed hashMessage, from the cache or by recovering it; false if recovery fails
+    bool Recover(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, CKeyID& keyIDRet);
+
+    void Clear();
+    void GetStats(size_t& nSizeRet, uint64_t& nHitsRet, uint64_t& nMissesRet) const;
+};
+
+extern CMerchantnodeSigCache merchantnodeSigCache;
+
+/** Recovery of one merchantnode message signature into merchantnodeSigCache, for CCheckQueue */
+class CMerchantnodeSigCheck
+{
+private:
+    uint256 hashMessage;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CMerchantnodeSigCheck() {}
+    CMerchantnodeSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn) : hashMessage(GetMerchantnodeMessageHash(strMessage)), vchSig(vchSigIn) {}
+
+    //! Always true: a bad signature is rejected when its message is processed
+    bool operator()();
+
+    bool IsCached() const;
+
+    void swap(CMerchantnodeSigCheck& check)
+    {
+        std::swap(hashMessage, check.hashMessage);
+        vchSig.swap(check.vchSig);
+    }
+};
+
+/** Worker thread of the merchantnode signature check queue */
+void ThreadMerchantnodeSigCheck();
+
+/** Whether strCommand is one of the messages GetMerchantnodeSigChecks reads */
+bool IsMerchantnodeSigMessage(const std::string& strCommand);
+
+/**
+ * Read a merchantnode broadcast, ping, payment vote or budget vote message
+ * from vRecv and append its signature checks to vChecks. Returns false for
+ * other commands and for payloads that do not parse.
+ */
+bool GetMerchantnodeSigChecks(const std::string& strCommand, CDataStream& vRecv, std::vector<CMerchantnodeSigCheck>& vChecks);
+
+/**
+ * Recover the signatures of vChecks that are not cached yet on the signature
+ * check threads, so that processing the messages in order finds them cached.
+ * Returns false without doing anything when there are no worker threads or
+ * another thread is running a batch.
+ */
+bool VerifyMerchantnodeSigChecks(std::vector<CMerchantnodeSigCheck>& vChecks);
+
+#endif // MERCHANTNODE_SIGCHECK_H
@@ -81,9 +81,11 @@ void CMerchantnodeSync::Reset()
     countBudgetItemFin = 0;
     sumCommunityItemProp = 0;
     countCommunityItemProp = 0;
+    countMerchantnodeListDigest = 0;
     RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_INITIAL;
     RequestedMerchantnodeAttempt = 0;
     nAssetSyncStarted = GetTime();
+    nSyncStarted = GetTime();
 }
 
 void CMerchantnodeSync::AddedMerchantnodeList(uint256 hash)
@@ -156,16 +158,20 @@ bool CMerchantnodeSync::IsCommunityPropEmpty()
 
 void CMerchantnodeSync::GetNextAsset()
 {
+    LogPrint("merchantnode", "CMerchantnodeSync::GetNextAsset - asset %d took %d seconds\n", RequestedMerchantnodeAssets, GetTime() - nAssetSyncStarted);
     switch (RequestedMerchantnodeAssets) {
     case (MERCHANTNODE_SYNC_INITIAL):
     case (MERCHANTNODE_SYNC_FAILED): // should never be used here actually, use Reset() instead
         ClearFulfilledRequest();
         RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_SPORKS;
+        nSyncStarted = GetTime();
         break;
     case (MERCHANTNODE_SYNC_SPORKS):
         RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_LIST;
         break;
     case (MERCHANTNODE_SYNC_LIST):
+        LogPrint("merchantnode", "CMerchantnodeSync::GetNextAsset - %d list entries announced by %d peers, %d of them answering a digest\n",
+            sumMerchantnodeList, countMerchantnodeList, countMerchantnodeListDigest);
         RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_MNW;
         break;
     case (MERCHANTNODE_SYNC_MNW):
@@ -175,7 +181,7 @@ void CMerchantnodeSync::GetNextAsset()
         RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_COMMUNITYVOTE;
         break;
     case (MERCHANTNODE_SYNC_COMMUNITYVOTE):
-        LogPrintf("CMerchantnodeSync::GetNextAsset - Sync has finished\n");
+        LogPrintf("CMerchantnodeSync::GetNextAsset - Sync has finished in %d seconds\n", GetTime() - nSyncStarted);
         RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_FINISHED;
         break;
     }
@@ -222,6 +228,14 @@ void CMerchantnodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CD
             sumMerchantnodeList += nCount;
             countMerchantnodeList++;
             break;
+        case (MERCHANTNODE_SYNC_LIST_DIGEST):
+            if (RequestedMerchantnodeAssets != MERCHANTNODE_SYNC_LIST) return;
+            sumMerchantnodeList += nCount;
+            countMerchantnodeList++;
+            countMerchantnodeListDigest++;
+            // the peer has answered; entries it announced keep lastMerchantnodeList moving as they arrive
+            lastMerchantnodeList = GetTime();
+            break;
         case (MERCHANTNODE_SYNC_MNW):
             if (nItemID != RequestedMerchantnodeAssets) return;
             sumMerchantnodeWinner += nCount;
@@ -334,6 +348,12 @@ void CMerchantnodeSync::Process()
                     return;
                 }
 
+                // enough peers compared their list with ours and what differed has arrived
+                if (countMerchantnodeListDigest >= MERCHANTNODE_SYNC_THRESHOLD && lastMerchantnodeList < GetTime() - MERCHANTNODE_SYNC_TIMEOUT) {
+                    GetNextAsset();
+                    return;
+                }
+
                 if (pnode->HasFulfilledRequest("mnsync")) continue;
                 pnode->FulfilledRequest("mnsync");
 
@@ -9,6 +9,7 @@
 #define MERCHANTNODE_SYNC_INITIAL 0
 #define MERCHANTNODE_SYNC_SPORKS 1
 #define MERCHANTNODE_SYNC_LIST 2
+#define MERCHANTNODE_SYNC_LIST_DIGEST 12
 #define MERCHANTNODE_SYNC_MNW 3
 #define MERCHANTNODE_SYNC_BUDGET 4
 #define MERCHANTNODE_SYNC_BUDGET_PROP 10
@@ -55,6 +56,8 @@ public:
     int countBudgetItemProp;
     int countBudgetItemFin;
     int countCommunityItemProp;
+    // peers that answered a list digest, reporting how many entries differed
+    int countMerchantnodeListDigest;
 
     // Count peers we've requested the list from
     int RequestedMerchantnodeAssets;
@@ -62,6 +65,8 @@ public:
 
     // Time when current merchantnode asset sync started
     int64_t nAssetSyncStarted;
+    // Time when the sync left MERCHANTNODE_SYNC_INITIAL
+    int64_t nSyncStarted;
 
     CMerchantnodeSync();
 
@@ -848,7 +848,7 @@ bool CCommunityVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!merchantnodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMerchantnode)) {
         LogPrint("merchantnode", "CCommunityVote::Sign - Error upon calling SignMessage");
@@ -863,10 +863,15 @@ bool CCommunityVote::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     return true;
 }
 
+std::string CCommunityVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CCommunityVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMerchantnode* pmn = mnodeman.Find(vin);
 
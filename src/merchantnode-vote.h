@@ -60,6 +60,7 @@ public:
 
     bool Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode);
     bool SignatureValid(bool fSignatureCheck);
+    std::string GetStrMessage() const;
     void Relay();
 
     std::string GetVoteString()
@@ -15,12 +15,15 @@
 #include "wallet.h"
 #include "activemerchantnode.h"
 
+#include <atomic>
+
 #include <boost/lexical_cast.hpp>
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenMerchantnodeScanningErrors;
 // cache block hashes as we calculate them
 std::map<int64_t, uint256> mapCacheBlockHashes;
+CMerchantnodeCollateralWatcher merchantnodeCollateralWatcher;
 
 //Get the last hash that matches the modulus given. Processed in reverse order
 bool GetBlockHash(uint256& hash, int nBlockHeight)
@@ -141,9 +144,106 @@ CMerchantnode::CMerchantnode(const CMerchantnodeBroadcast& mnb)
 //
 // When a new merchantnode broadcast is sent, update our information
 //
+CMerchantnodeCollateralWatcher::CollateralState CMerchantnodeCollateralWatcher::Get(const COutPoint& outpoint) const
+{
+    LOCK(cs);
+    std::map<COutPoint, Entry>::const_iterator it = mapCollaterals.find(outpoint);
+    if (it == mapCollaterals.end())
+        return COLLATERAL_UNKNOWN;
+    if (it->second.nExpires != 0 && GetTime() >= it->second.nExpires)
+        return COLLATERAL_UNKNOWN;
+    return it->second.state;
+}
+
+void CMerchantnodeCollateralWatcher::Set(const COutPoint& outpoint, bool fUnspent)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs);
+    nProbes++;
+    Entry& entry = mapCollaterals[outpoint];
+    entry.state = fUnspent ? COLLATERAL_UNSPENT : COLLATERAL_SPENT;
+    entry.nExpires = fUnspent ? 0 : GetTime() + MERCHANTNODE_SPENT_PROBE_SECONDS;
+}
+
+void CMerchantnodeCollateralWatcher::Forget(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    mapCollaterals.erase(outpoint);
+}
+
+void CMerchantnodeCollateralWatcher::Clear()
+{
+    LOCK(cs);
+    mapCollaterals.clear();
+}
+
+void CMerchantnodeCollateralWatcher::GetStats(size_t& nWatchedRet, uint64_t& nProbesRet, uint64_t& nSpentRet, uint64_t& nInvalidatedRet) const
+{
+    LOCK(cs);
+    nWatchedRet = mapCollaterals.size();
+    nProbesRet = nProbes;
+    nSpentRet = nSpent;
+    nInvalidatedRet = nInvalidated;
+}
+
+void CMerchantnodeCollateralWatcher::Invalidate(const COutPoint& outpoint)
+{
+    std::map<COutPoint, Entry>::iterator it = mapCollaterals.find(outpoint);
+    if (it != mapCollaterals.end() && it->second.state != COLLATERAL_UNKNOWN) {
+        it->second.state = COLLATERAL_UNKNOWN;
+        it->second.nExpires = 0;
+        nInvalidated++;
+    }
+}
+
+void CMerchantnodeCollateralWatcher::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    LOCK(cs);
+    if (mapCollaterals.empty())
+        return;
+
+    BOOST_FOREACH (const CTxIn& txin, tx.vin) {
+        if (pblock == NULL) {
+            // Accepted to the mempool, or conflicted or disconnected: probe again
+            Invalidate(txin.prevout);
+            continue;
+        }
+        std::map<COutPoint, Entry>::iterator it = mapCollaterals.find(txin.prevout);
+        if (it != mapCollaterals.end() && (it->second.state != COLLATERAL_SPENT || it->second.nExpires != 0)) {
+            LogPrint("merchantnode", "CMerchantnodeCollateralWatcher -- collateral %s spent in block %s\n", txin.prevout.ToString(), pblock->GetHash().ToString());
+            it->second.state = COLLATERAL_SPENT;
+            it->second.nExpires = 0;
+            nSpent++;
+        }
+    }
+
+    // A disconnected block takes the outputs it created with it
+    if (pblock == NULL) {
+        uint256 hash = tx.GetHash();
+        std::map<COutPoint, Entry>::iterator it = mapCollaterals.lower_bound(COutPoint(hash, 0));
+        for (; it != mapCollaterals.end() && it->first.hash == hash; ++it)
+            Invalidate(it->first);
+    }
+}
+
+static std::atomic<uint64_t> nMerchantnodeStateChanges(0);
+static std::atomic<uint64_t> nMerchantnodeKeyChanges(0);
+
+uint64_t GetMerchantnodeStateChanges()
+{
+    return nMerchantnodeStateChanges;
+}
+
+uint64_t GetMerchantnodeKeyChanges()
+{
+    return nMerchantnodeKeyChanges;
+}
+
 bool CMerchantnode::UpdateFromNewBroadcast(CMerchantnodeBroadcast& mnb)
 {
     if (mnb.sigTime > sigTime) {
+        if (pubKeyMerchantnode != mnb.pubKeyMerchantnode || pubKeyCollateralAddress != mnb.pubKeyCollateralAddress)
+            nMerchantnodeKeyChanges++;
         pubKeyMerchantnode = mnb.pubKeyMerchantnode;
         pubKeyCollateralAddress = mnb.pubKeyCollateralAddress;
         sigTime = mnb.sigTime;
@@ -156,11 +256,24 @@ bool CMerchantnode::UpdateFromNewBroadcast(CMerchantnodeBroadcast& mnb)
             lastPing = mnb.lastPing;
             mnodeman.mapSeenMerchantnodePing.insert(make_pair(lastPing.GetHash(), lastPing));
         }
+        nMerchantnodeStateChanges++;
         return true;
     }
     return false;
 }
 
+uint256 CalculateMerchantnodeScore(const CTxIn& vin, const uint256& hashBlock, const uint256& hashBlockDigest)
+{
+    uint256 aux = vin.prevout.hash + vin.prevout.n;
+
+    CHashWriter ss2(SER_GETHASH, PROTOCOL_VERSION);
+    ss2 << hashBlock;
+    ss2 << aux;
+    uint256 hash3 = ss2.GetHash();
+
+    return (hash3 > hashBlockDigest ? hash3 - hashBlockDigest : hashBlockDigest - hash3);
+}
+
 //
 // Deterministically calculate a given "score" for a Merchantnode depending on how close it's hash is to
 // the proof of work for that block. The further away they are the better, the furthest will win the election
@@ -171,7 +284,6 @@ uint256 CMerchantnode::CalculateScore(int mod, int64_t nBlockHeight)
     if (chainActive.Tip() == NULL) return 0;
 
     uint256 hash = 0;
-    uint256 aux = vin.prevout.hash + vin.prevout.n;
 
     if (!GetBlockHash(hash, nBlockHeight)) {
         LogPrint("merchantnode","CalculateScore ERROR - nHeight %d - Returned 0\n", nBlockHeight);
@@ -182,17 +294,18 @@ uint256 CMerchantnode::CalculateScore(int mod, int64_t nBlockHeight)
     ss << hash;
     uint256 hash2 = ss.GetHash();
 
-    CHashWriter ss2(SER_GETHASH, PROTOCOL_VERSION);
-    ss2 << hash;
-    ss2 << aux;
-    uint256 hash3 = ss2.GetHash();
-
-    uint256 r = (hash3 > hash2 ? hash3 - hash2 : hash2 - hash3);
-
-    return r;
+    return CalculateMerchantnodeScore(vin, hash, hash2);
 }
 
 void CMerchantnode::Check(bool forceCheck)
+{
+    int nActiveStateOld = activeState;
+    UpdateActiveState(forceCheck);
+    if (activeState != nActiveStateOld)
+        nMerchantnodeStateChanges++;
+}
+
+void CMerchantnode::UpdateActiveState(bool forceCheck)
 {
     if (ShutdownRequested()) return;
 
@@ -220,21 +333,30 @@ void CMerchantnode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut((MERCHANTNODE_COLLATERAL-0.01) * COIN, merchantnodeSigner.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if (!lockMain) return;
-
-            if (!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)) {
-                activeState = MERCHANTNODE_VIN_SPENT;
-                return;
+        CMerchantnodeCollateralWatcher::CollateralState collateralState = merchantnodeCollateralWatcher.Get(vin.prevout);
+        if (collateralState == CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN) {
+            // Nothing seen yet, or something touched the collateral since it was probed
+            CValidationState state;
+            CMutableTransaction tx = CMutableTransaction();
+            CTxOut vout = CTxOut((MERCHANTNODE_COLLATERAL-0.01) * COIN, merchantnodeSigner.collateralPubKey);
+            tx.vin.push_back(vin);
+            tx.vout.push_back(vout);
+
+            {
+                TRY_LOCK(cs_main, lockMain);
+                if (!lockMain) return;
+
+                bool fUnspent = AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
+                merchantnodeCollateralWatcher.Set(vin.prevout, fUnspent);
+                if (!fUnspent)
+                    collateralState = CMerchantnodeCollateralWatcher::COLLATERAL_SPENT;
             }
         }
+
+        if (collateralState == CMerchantnodeCollateralWatcher::COLLATERAL_SPENT) {
+            activeState = MERCHANTNODE_VIN_SPENT;
+            return;
+        }
     }
 
     activeState = MERCHANTNODE_ENABLED; // OK
@@ -715,7 +837,7 @@ bool CMerchantnodePing::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!merchantnodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMerchantnode)) {
         LogPrint("merchantnode","CMerchantnodePing::Sign() - Error: %s\n", errorMessage);
@@ -730,8 +852,13 @@ bool CMerchantnodePing::Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode)
     return true;
 }
 
+std::string CMerchantnodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CMerchantnodePing::VerifySignature(CPubKey& pubKeyMerchantnode, int &nDos) {
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
     std::string errorMessage = "";
 
     if (!merchantnodeSigner.VerifyMessage(pubKeyMerchantnode, vchSig, strMessage, errorMessage)){
@@ -775,19 +902,16 @@ bool CMerchantnodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCh
         	if (!VerifySignature(pmn->pubKeyMerchantnode, nDos))
                 return false;
 
-            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                if ((*mi).second->nHeight < chainActive.Height() - 24) {
-                    LogPrint("merchantnode","CMerchantnodePing::CheckAndUpdate - Merchantnode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                    // Do nothing here (no Merchantnode update, no mnping relay)
-                    // Let this node to be visible but fail to accept mnping
-
-                    return false;
-                }
-            } else {
-                if (fDebug) LogPrint("merchantnode","CMerchantnodePing::CheckAndUpdate - Merchantnode %s block hash %s is unknown\n", vin.prevout.hash.ToString(), blockHash.ToString());
-                // maybe we stuck so we shouldn't ban this node, just fail to accept it
-                // TODO: or should we also request this block?
+            // Pings are handled without cs_main: look for the block among the last
+            // 25 blocks of the published tip instead of in mapBlockIndex
+            CChainTipSnapshotRef tip = GetChainTipSnapshot();
+            const CBlockIndex* pindex = tip->pindexTip;
+            while (pindex && pindex->nHeight >= tip->nHeight - 24 && pindex->GetBlockHash() != blockHash)
+                pindex = pindex->pprev;
+            if (pindex == NULL || pindex->GetBlockHash() != blockHash) {
+                LogPrint("merchantnode","CMerchantnodePing::CheckAndUpdate - Merchantnode %s block hash %s is unknown or too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
+                // Do nothing here (no Merchantnode update, no mnping relay)
+                // Let this node to be visible but fail to accept mnping
 
                 return false;
             }
@@ -797,9 +921,7 @@ bool CMerchantnodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCh
             //mnodeman.mapSeenMerchantnodeBroadcast.lastPing is probably outdated, so we'll update it
             CMerchantnodeBroadcast mnb(*pmn);
             uint256 hash = mnb.GetHash();
-            if (mnodeman.mapSeenMerchantnodeBroadcast.count(hash)) {
-                mnodeman.mapSeenMerchantnodeBroadcast[hash].lastPing = *this;
-            }
+            mnodeman.UpdateSeenBroadcastPing(hash, *this);
 
             pmn->Check(true);
             if (!pmn->IsEnabled()) return false;
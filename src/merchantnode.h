@@ -14,6 +14,7 @@
 #include "sync.h"
 #include "timedata.h"
 #include "util.h"
+#include "validationinterface.h"
 
 #define MERCHANTNODE_MIN_CONFIRMATIONS 15
 #define MERCHANTNODE_MIN_MNP_SECONDS (10 * 60)
@@ -22,6 +23,8 @@
 #define MERCHANTNODE_EXPIRATION_SECONDS (120 * 60)
 #define MERCHANTNODE_REMOVAL_SECONDS (130 * 60)
 #define MERCHANTNODE_CHECK_SECONDS 5
+// A probe that found the collateral spent is repeated after this long, in case the spend left the mempool unannounced
+#define MERCHANTNODE_SPENT_PROBE_SECONDS 60
 
 #define MERCHANTNODE_COLLATERAL 2500
 
@@ -34,6 +37,73 @@ extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
+/**
+ * Score of the merchantnode with collateral vin for the block hashBlock.
+ * hashBlockDigest is the hash of hashBlock, which is the same for all
+ * merchantnodes; see CMerchantnode::CalculateScore.
+ */
+uint256 CalculateMerchantnodeScore(const CTxIn& vin, const uint256& hashBlock, const uint256& hashBlockDigest);
+
+/** Number of times a merchantnode changed its state or was updated by a newer broadcast */
+uint64_t GetMerchantnodeStateChanges();
+
+/** Number of times a newer broadcast changed the keys of a merchantnode */
+uint64_t GetMerchantnodeKeyChanges();
+
+/**
+ * Spent state of merchantnode collaterals, kept up to date from the transactions
+ * the node sees instead of probing the mempool for every merchantnode each cycle.
+ *
+ * A probe result is recorded for each collateral checked. A block spending a
+ * watched collateral marks it spent for good; a mempool transaction spending it,
+ * or any transaction leaving the chain or mempool that spends or created it,
+ * makes the state unknown so the next check probes that one collateral again.
+ * Some mempool removals are not announced (e.g. the descendants dropped in
+ * DisconnectTip), so a probe that found the collateral spent only holds for
+ * MERCHANTNODE_SPENT_PROBE_SECONDS.
+ */
+class CMerchantnodeCollateralWatcher : public CValidationInterface
+{
+public:
+    enum CollateralState {
+        COLLATERAL_UNKNOWN,
+        COLLATERAL_UNSPENT,
+        COLLATERAL_SPENT
+    };
+
+private:
+    struct Entry {
+        CollateralState state;
+        int64_t nExpires; //! time a probed spend is to be checked again, 0 for none
+
+        Entry() : state(COLLATERAL_UNKNOWN), nExpires(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    std::map<COutPoint, Entry> mapCollaterals;
+    uint64_t nProbes;
+    uint64_t nSpent;
+    uint64_t nInvalidated;
+
+    void Invalidate(const COutPoint& outpoint);
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
+public:
+    CMerchantnodeCollateralWatcher() : nProbes(0), nSpent(0), nInvalidated(0) {}
+
+    CollateralState Get(const COutPoint& outpoint) const;
+    //! Record the result of probing the mempool; call with cs_main held so no spend is missed
+    void Set(const COutPoint& outpoint, bool fUnspent);
+    //! Stop watching a collateral, e.g. when its merchantnode is removed
+    void Forget(const COutPoint& outpoint);
+    void Clear();
+    void GetStats(size_t& nWatchedRet, uint64_t& nProbesRet, uint64_t& nSpentRet, uint64_t& nInvalidatedRet) const;
+};
+
+extern CMerchantnodeCollateralWatcher merchantnodeCollateralWatcher;
+
 
 //
 // The Merchantnode Ping Class : Contains a different serialize method for sending pings from merchantnodes throughout the network
@@ -65,6 +135,7 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false);
     bool Sign(CKey& keyMerchantnode, CPubKey& pubKeyMerchantnode);
     bool VerifySignature(CPubKey& pubKeyMerchantnode, int &nDos);
+    std::string GetStrMessage() const;
     void Relay();
 
     uint256 GetHash()
@@ -114,6 +185,8 @@ private:
     mutable CCriticalSection cs;
     int64_t lastTimeChecked;
 
+    void UpdateActiveState(bool forceCheck);
+
 public:
     enum state {
         MERCHANTNODE_PRE_ENABLED,
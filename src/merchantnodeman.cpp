@@ -10,12 +10,13 @@
 #include "merchantnode-helpers.h"
 #include "addrman.h"
 #include "merchantnode.h"
+#include "relaycache.h"
 #include "spork.h"
 #include "util.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 
-#define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MERCHANTNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
+#include <set>
 
 /** Merchantnode manager */
 CMerchantnodeMan mnodeman;
@@ -195,8 +196,68 @@ void DumpMerchantnodes()
     LogPrint("merchantnode","Merchantnode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
-CMerchantnodeMan::CMerchantnodeMan()
+CMerchantnodeIndexHasher::CMerchantnodeIndexHasher() : salt(GetRandHash()) {}
+
+unsigned int CMerchantnodeListDigest::GetBucketCount(size_t nEntries)
+{
+    unsigned int nBuckets = MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS;
+    while (nBuckets < MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS && nBuckets * 4 < nEntries)
+        nBuckets *= 2;
+    return nBuckets;
+}
+
+bool CMerchantnodeListDigest::IsValidBucketCount(size_t nBuckets)
+{
+    return nBuckets >= MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS && nBuckets <= MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS &&
+           (nBuckets & (nBuckets - 1)) == 0;
+}
+
+static uint256 GetPayeeIndexKey(const CScript& payee)
+{
+    return Hash(payee.begin(), payee.end());
+}
+
+static uint256 GetPayeeIndexKey(const CMerchantnode& mn)
 {
+    return GetPayeeIndexKey(GetScriptForDestination(mn.pubKeyCollateralAddress.GetID()));
+}
+
+CMerchantnodeMan::CMerchantnodeMan() : nDsegListVersion(0), nDsegStateChanges(0), nListVersion(0), nRankCacheClock(0),
+                                       nIndexListVersion(0), nIndexKeyChanges(0)
+{
+}
+
+bool CMerchantnodeMan::IsIndexed() const
+{
+    return nIndexListVersion == nListVersion && nIndexKeyChanges == GetMerchantnodeKeyChanges();
+}
+
+void CMerchantnodeMan::IndexMerchantnode(size_t nIndex)
+{
+    const CMerchantnode& mn = vMerchantnodes[nIndex];
+    mapIndexByOutpoint.insert(std::make_pair(mn.vin.prevout, nIndex));
+    // insert() keeps the first node for keys that are used more than once
+    mapIndexByPayee.insert(std::make_pair(GetPayeeIndexKey(mn), nIndex));
+    mapIndexByPubKey.insert(std::make_pair(mn.pubKeyMerchantnode.GetHash(), nIndex));
+}
+
+void CMerchantnodeMan::UpdateIndexes()
+{
+    AssertLockHeld(cs);
+    if (IsIndexed())
+        return;
+
+    // Read the key counter first, so an update racing with the rebuild triggers another
+    nIndexKeyChanges = GetMerchantnodeKeyChanges();
+    nIndexListVersion = nListVersion;
+    mapIndexByOutpoint.clear();
+    mapIndexByPayee.clear();
+    mapIndexByPubKey.clear();
+    mapIndexByOutpoint.reserve(vMerchantnodes.size());
+    mapIndexByPayee.reserve(vMerchantnodes.size());
+    mapIndexByPubKey.reserve(vMerchantnodes.size());
+    for (size_t i = 0; i < vMerchantnodes.size(); i++)
+        IndexMerchantnode(i);
 }
 
 bool CMerchantnodeMan::Add(CMerchantnode& mn)
@@ -209,7 +270,11 @@ bool CMerchantnodeMan::Add(CMerchantnode& mn)
     CMerchantnode* pmn = Find(mn.vin);
     if (pmn == NULL) {
         LogPrint("merchantnode", "CMerchantnodeMan: Adding new Merchantnode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
+        // Find() brought the indexes up to date; appending keeps every position
         vMerchantnodes.push_back(mn);
+        nListVersion++;
+        IndexMerchantnode(vMerchantnodes.size() - 1);
+        nIndexListVersion = nListVersion;
         return true;
     }
 
@@ -279,7 +344,9 @@ void CMerchantnodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            merchantnodeCollateralWatcher.Forget((*it).vin.prevout);
             it = vMerchantnodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -305,6 +372,24 @@ void CMerchantnodeMan::CheckAndRemove(bool forceExpiredRemoval)
         }
     }
 
+    // check who asked for / who we asked for the entries differing from a digest
+    it1 = mAskedUsForMerchantnodeListDigest.begin();
+    while (it1 != mAskedUsForMerchantnodeListDigest.end()) {
+        if ((*it1).second < GetTime()) {
+            mAskedUsForMerchantnodeListDigest.erase(it1++);
+        } else {
+            ++it1;
+        }
+    }
+    it1 = mWeAskedForMerchantnodeListDigest.begin();
+    while (it1 != mWeAskedForMerchantnodeListDigest.end()) {
+        if ((*it1).second < GetTime()) {
+            mWeAskedForMerchantnodeListDigest.erase(it1++);
+        } else {
+            ++it1;
+        }
+    }
+
     // check which Merchantnodes we've asked for
     map<COutPoint, int64_t>::iterator it2 = mWeAskedForMerchantnodeListEntry.begin();
     while (it2 != mWeAskedForMerchantnodeListEntry.end()) {
@@ -344,8 +429,143 @@ void CMerchantnodeMan::Clear()
     mAskedUsForMerchantnodeList.clear();
     mWeAskedForMerchantnodeList.clear();
     mWeAskedForMerchantnodeListEntry.clear();
+    mAskedUsForMerchantnodeListDigest.clear();
+    mWeAskedForMerchantnodeListDigest.clear();
     mapSeenMerchantnodeBroadcast.clear();
     mapSeenMerchantnodePing.clear();
+    merchantnodeCollateralWatcher.Clear();
+    ClearRankCache();
+}
+
+void CMerchantnodeMan::ClearRankCache()
+{
+    LOCK(cs);
+    nListVersion++;
+    mapScores.clear();
+    mapRankings.clear();
+}
+
+static bool CompareScoreEntry(const CMerchantnodeScores::Entry& a, const CMerchantnodeScores::Entry& b)
+{
+    // Best first, ties in list order. GetCurrentMasterNode's linear scan also
+    // picked the first of equal winners; the ranks came from an unstable
+    // sort, so ties had no defined order there and any order matches it.
+    if (a.nScore != b.nScore)
+        return a.nScore > b.nScore;
+    return a.nIndex < b.nIndex;
+}
+
+static bool CompareEntryOutpoint(const CMerchantnodeScores::Entry& a, const CMerchantnodeScores::Entry& b)
+{
+    return a.outpoint < b.outpoint;
+}
+
+const CMerchantnodeScores* CMerchantnodeMan::GetScores(int64_t nBlockHeight, const uint256& hashBlock)
+{
+    AssertLockHeld(cs);
+    CMerchantnodeScores& scores = mapScores[nBlockHeight];
+    scores.nLastUsed = ++nRankCacheClock;
+    if (scores.hashBlock == hashBlock && scores.nListVersion == nListVersion)
+        return &scores;
+
+    // Reuse the scores of merchantnodes that were already scored for this block
+    std::vector<CMerchantnodeScores::Entry> vKnown;
+    if (scores.hashBlock == hashBlock) {
+        vKnown.swap(scores.vEntries);
+        std::sort(vKnown.begin(), vKnown.end(), CompareEntryOutpoint);
+    }
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    uint256 hashBlockDigest = ss.GetHash();
+
+    scores.hashBlock = hashBlock;
+    scores.nListVersion = nListVersion;
+    scores.vEntries.clear();
+    scores.vEntries.reserve(vMerchantnodes.size());
+    for (size_t i = 0; i < vMerchantnodes.size(); i++) {
+        CMerchantnodeScores::Entry entry;
+        entry.nIndex = i;
+        entry.outpoint = vMerchantnodes[i].vin.prevout;
+        std::vector<CMerchantnodeScores::Entry>::const_iterator it = std::lower_bound(vKnown.begin(), vKnown.end(), entry, CompareEntryOutpoint);
+        if (it != vKnown.end() && it->outpoint == entry.outpoint)
+            entry.nScore = it->nScore;
+        else
+            entry.nScore = CalculateMerchantnodeScore(vMerchantnodes[i].vin, hashBlock, hashBlockDigest).GetCompact(false);
+        scores.vEntries.push_back(entry);
+    }
+    std::sort(scores.vEntries.begin(), scores.vEntries.end(), CompareScoreEntry);
+
+    while (mapScores.size() > MERCHANTNODES_SCORE_CACHE_HEIGHTS) {
+        std::map<int64_t, CMerchantnodeScores>::iterator itOldest = mapScores.begin();
+        for (std::map<int64_t, CMerchantnodeScores>::iterator it = mapScores.begin(); it != mapScores.end(); ++it)
+            if (it->second.nLastUsed < itOldest->second.nLastUsed)
+                itOldest = it;
+        mapScores.erase(itOldest);
+    }
+    return &mapScores[nBlockHeight];
+}
+
+const CMerchantnodeRanking* CMerchantnodeMan::GetRanking(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinAge)
+{
+    AssertLockHeld(cs);
+
+    //make sure we know about this block
+    uint256 hashBlock = 0;
+    if (!GetBlockHash(hashBlock, nBlockHeight)) return NULL;
+    if (nBlockHeight == 0)
+        nBlockHeight = chainActive.Tip()->nHeight;
+
+    CMerchantnodeRankingKey key;
+    key.nBlockHeight = nBlockHeight;
+    key.nMinProtocol = minProtocol;
+    key.fOnlyActive = fOnlyActive;
+    key.fMinAge = fMinAge;
+    int64_t nNow = GetAdjustedTime();
+
+    std::map<CMerchantnodeRankingKey, CMerchantnodeRanking>::iterator mi = mapRankings.find(key);
+    if (mi != mapRankings.end() && mi->second.hashBlock == hashBlock && mi->second.nListVersion == nListVersion &&
+        mi->second.nStateChanges == GetMerchantnodeStateChanges() && nNow < mi->second.nValidUntil) {
+        mi->second.nLastUsed = ++nRankCacheClock;
+        return &mi->second;
+    }
+
+    // Refresh the states the ranking depends on first
+    if (fOnlyActive)
+        Check();
+    const CMerchantnodeScores* pscores = GetScores(nBlockHeight, hashBlock);
+
+    CMerchantnodeRanking& ranking = mapRankings[key];
+    ranking.hashBlock = hashBlock;
+    ranking.nListVersion = nListVersion;
+    ranking.nStateChanges = GetMerchantnodeStateChanges();
+    ranking.nLastUsed = ++nRankCacheClock;
+    // States are refreshed at most every MERCHANTNODE_CHECK_SECONDS anyway
+    ranking.nValidUntil = nNow + MERCHANTNODE_CHECK_SECONDS;
+    ranking.vRanked.clear();
+    ranking.vRankByOutpoint.clear();
+    BOOST_FOREACH (const CMerchantnodeScores::Entry& entry, pscores->vEntries) {
+        CMerchantnode& mn = vMerchantnodes[entry.nIndex];
+        if (mn.protocolVersion < minProtocol) continue;
+        if (fMinAge && nNow - mn.sigTime < MN_WINNER_MINIMUM_AGE) {
+            // Included once it is old enough
+            ranking.nValidUntil = std::min(ranking.nValidUntil, mn.sigTime + MN_WINNER_MINIMUM_AGE);
+            continue;
+        }
+        if (fOnlyActive && !mn.IsEnabled()) continue;
+        ranking.vRanked.push_back(std::make_pair(entry.nScore, entry.nIndex));
+        ranking.vRankByOutpoint.push_back(std::make_pair(entry.outpoint, (int)ranking.vRanked.size()));
+    }
+    std::sort(ranking.vRankByOutpoint.begin(), ranking.vRankByOutpoint.end());
+
+    while (mapRankings.size() > MERCHANTNODES_RANKING_CACHE_SIZE) {
+        std::map<CMerchantnodeRankingKey, CMerchantnodeRanking>::iterator itOldest = mapRankings.begin();
+        for (std::map<CMerchantnodeRankingKey, CMerchantnodeRanking>::iterator it = mapRankings.begin(); it != mapRankings.end(); ++it)
+            if (it->second.nLastUsed < itOldest->second.nLastUsed)
+                itOldest = it;
+        mapRankings.erase(itOldest);
+    }
+    return &mapRankings[key];
 }
 
 int CMerchantnodeMan::stable_size ()
@@ -417,6 +637,24 @@ void CMerchantnodeMan::DsegUpdate(CNode* pnode)
 {
     LOCK(cs);
 
+    if (pnode->nVersion >= MERCHANTNODE_LIST_DIGEST_VERSION) {
+        if (Params().NetworkID() == CBaseChainParams::MAIN && !(pnode->addr.IsRFC1918() || pnode->addr.IsLocal())) {
+            std::map<CNetAddr, int64_t>::iterator it = mWeAskedForMerchantnodeListDigest.find(pnode->addr);
+            if (it != mWeAskedForMerchantnodeListDigest.end() && GetTime() < (*it).second) {
+                LogPrint("merchantnode", "dsegdigest - we already asked peer %i for the list; skipping...\n", pnode->GetId());
+                return;
+            }
+        }
+
+        UpdateDsegEntries();
+        CMerchantnodeListDigest digest = GetListDigest(CMerchantnodeListDigest::GetBucketCount(vDsegEntries.size()));
+        pnode->PushMessage("dsegdigest", digest);
+        LogPrint("merchantnode", "dsegdigest - Asked peer %i for the entries differing from %d entries in %d buckets\n",
+            pnode->GetId(), vDsegEntries.size(), digest.vBuckets.size());
+        mWeAskedForMerchantnodeListDigest[pnode->addr] = GetTime() + MERCHANTNODES_DSEG_DIGEST_SECONDS;
+        return;
+    }
+
     if (Params().NetworkID() == CBaseChainParams::MAIN) {
         if (!(pnode->addr.IsRFC1918() || pnode->addr.IsLocal())) {
             std::map<CNetAddr, int64_t>::iterator it = mWeAskedForMerchantnodeList.find(pnode->addr);
@@ -434,40 +672,71 @@ void CMerchantnodeMan::DsegUpdate(CNode* pnode)
     mWeAskedForMerchantnodeList[pnode->addr] = askAgain;
 }
 
+void CMerchantnodeMan::UpdateDsegEntries()
+{
+    AssertLockHeld(cs);
+    if (nDsegListVersion == nListVersion && nDsegStateChanges == GetMerchantnodeStateChanges())
+        return;
+
+    // Read the state counter first, so a change racing with the rebuild triggers another
+    nDsegStateChanges = GetMerchantnodeStateChanges();
+    nDsegListVersion = nListVersion;
+    vDsegEntries.clear();
+    for (size_t i = 0; i < vMerchantnodes.size(); i++) {
+        CMerchantnode& mn = vMerchantnodes[i];
+        if (mn.addr.IsRFC1918() || !mn.IsEnabled())
+            continue;
+        DsegEntry entry;
+        entry.outpoint = mn.vin.prevout;
+        entry.hashBroadcast = CMerchantnodeBroadcast(mn).GetHash();
+        entry.nIndex = i;
+        vDsegEntries.push_back(entry);
+    }
+}
+
+CMerchantnodeListDigest CMerchantnodeMan::GetListDigest(unsigned int nBuckets)
+{
+    LOCK(cs);
+    UpdateDsegEntries();
+
+    CMerchantnodeListDigest digest(nBuckets);
+    BOOST_FOREACH (const DsegEntry& entry, vDsegEntries)
+        digest.Add(entry.outpoint, entry.hashBroadcast);
+    return digest;
+}
+
 CMerchantnode* CMerchantnodeMan::Find(const CScript& payee)
 {
     LOCK(cs);
-    CScript payee2;
+    UpdateIndexes();
 
-    BOOST_FOREACH (CMerchantnode& mn, vMerchantnodes) {
-        payee2 = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
-        if (payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    boost::unordered_map<uint256, size_t, CMerchantnodeIndexHasher>::const_iterator it = mapIndexByPayee.find(GetPayeeIndexKey(payee));
+    if (it == mapIndexByPayee.end())
+        return NULL;
+    return &vMerchantnodes[it->second];
 }
 
 CMerchantnode* CMerchantnodeMan::Find(const CTxIn& vin)
 {
     LOCK(cs);
+    UpdateIndexes();
 
-    BOOST_FOREACH (CMerchantnode& mn, vMerchantnodes) {
-        if (mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    boost::unordered_map<COutPoint, size_t, CMerchantnodeIndexHasher>::const_iterator it = mapIndexByOutpoint.find(vin.prevout);
+    if (it == mapIndexByOutpoint.end())
+        return NULL;
+    return &vMerchantnodes[it->second];
 }
 
 
 CMerchantnode* CMerchantnodeMan::Find(const CPubKey& pubKeyMerchantnode)
 {
     LOCK(cs);
+    UpdateIndexes();
 
-    BOOST_FOREACH (CMerchantnode& mn, vMerchantnodes) {
-        if (mn.pubKeyMerchantnode == pubKeyMerchantnode)
-            return &mn;
-    }
-    return NULL;
+    boost::unordered_map<uint256, size_t, CMerchantnodeIndexHasher>::const_iterator it = mapIndexByPubKey.find(pubKeyMerchantnode.GetHash());
+    if (it == mapIndexByPubKey.end())
+        return NULL;
+    return &vMerchantnodes[it->second];
 }
 
 //
@@ -546,18 +815,14 @@ CMerchantnode* CMerchantnodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExc
 
     int rand = GetRandInt(nCountEnabled - vecToExclude.size());
     LogPrint("merchantnode", "CMerchantnodeMan::FindRandomNotInVec - rand %d\n", rand);
-    bool found;
+
+    std::set<COutPoint> setToExclude;
+    for (CTxIn& usedVin : vecToExclude)
+        setToExclude.insert(usedVin.prevout);
 
     for (CMerchantnode& mn : vMerchantnodes) {
         if (mn.protocolVersion < protocolVersion || !mn.IsEnabled()) continue;
-        found = false;
-        for (CTxIn& usedVin : vecToExclude) {
-            if (mn.vin.prevout == usedVin.prevout) {
-                found = true;
-                break;
-            }
-        }
-        if (found) continue;
+        if (setToExclude.count(mn.vin.prevout)) continue;
         if (--rand < 1) {
             return &mn;
         }
@@ -568,106 +833,70 @@ CMerchantnode* CMerchantnodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExc
 
 CMerchantnode* CMerchantnodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMerchantnode* winner = NULL;
-
-    // scan for winner
-    for (CMerchantnode& mn : vMerchantnodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
-
-        // calculate the score for each Merchantnode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    LOCK(cs);
 
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
-    }
+    // the winner is the enabled Merchantnode with the best score
+    const CMerchantnodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, true, false);
+    if (pranking == NULL || pranking->vRanked.empty() || pranking->vRanked[0].first <= 0) return NULL;
 
-    return winner;
+    return &vMerchantnodes[pranking->vRanked[0].second];
 }
 
 int CMerchantnodeMan::GetMerchantnodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMerchantnodeScores;
-    int64_t nMerchantnode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMerchantnode_Age = 0;
-
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
-
-    // scan for winner
-    for (CMerchantnode& mn : vMerchantnodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("merchantnode","Skipping Merchantnode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
-
-        if (IsSporkActive(SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT)) {
-            nMerchantnode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMerchantnode_Age) < nMerchantnode_Min_Age) {
-                if (fDebug) LogPrint("merchantnode","Skipping just activated Merchantnode. Age: %ld\n", nMerchantnode_Age);
-                continue;                                                   // Skip merchantnodes younger than (default) 1 hour
-            }
-        }
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMerchantnodeScores.push_back(make_pair(n2, mn.vin));
-    }
+    LOCK(cs);
 
-    sort(vecMerchantnodeScores.rbegin(), vecMerchantnodeScores.rend(), CompareScoreTxIn());
+    // Skip merchantnodes younger than (default) 1 hour
+    bool fMinAge = IsSporkActive(SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT);
+    const CMerchantnodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, fOnlyActive, fMinAge);
+    if (pranking == NULL) return -1;
 
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMerchantnodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout)
-            return rank;
-    }
+    std::vector<std::pair<COutPoint, int> >::const_iterator it = std::lower_bound(pranking->vRankByOutpoint.begin(), pranking->vRankByOutpoint.end(), std::make_pair(vin.prevout, 0));
+    if (it == pranking->vRankByOutpoint.end() || it->first != vin.prevout)
+        return -1;
 
-    return -1;
+    return it->second;
 }
 
 std::vector<pair<int, CMerchantnode> > CMerchantnodeMan::GetMerchantnodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CMerchantnode> > vecMerchantnodeScores;
     std::vector<pair<int, CMerchantnode> > vecMerchantnodeRanks;
 
+    LOCK(cs);
+
     //make sure we know about this block
     uint256 hash = 0;
     if (!GetBlockHash(hash, nBlockHeight)) return vecMerchantnodeRanks;
+    if (nBlockHeight == 0)
+        nBlockHeight = chainActive.Tip()->nHeight;
 
-    // scan for winner
-    BOOST_FOREACH (CMerchantnode& mn, vMerchantnodes) {
-        mn.Check();
+    Check();
+    const CMerchantnodeScores* pscores = GetScores(nBlockHeight, hash);
+
+    // Disabled merchantnodes are listed as if they scored 9999
+    std::vector<size_t> vDisabled;
+    BOOST_FOREACH (const CMerchantnodeScores::Entry& entry, pscores->vEntries) {
+        CMerchantnode& mn = vMerchantnodes[entry.nIndex];
+        if (mn.protocolVersion >= minProtocol && !mn.IsEnabled())
+            vDisabled.push_back(entry.nIndex);
+    }
 
-        if (mn.protocolVersion < minProtocol) continue;
+    int rank = 0;
+    bool fDisabledListed = false;
+    BOOST_FOREACH (const CMerchantnodeScores::Entry& entry, pscores->vEntries) {
+        CMerchantnode& mn = vMerchantnodes[entry.nIndex];
+        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
-        if (!mn.IsEnabled()) {
-            vecMerchantnodeScores.push_back(make_pair(9999, mn));
-            continue;
+        if (!fDisabledListed && entry.nScore < 9999) {
+            BOOST_FOREACH (size_t nIndex, vDisabled)
+                vecMerchantnodeRanks.push_back(make_pair(++rank, vMerchantnodes[nIndex]));
+            fDisabledListed = true;
         }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMerchantnodeScores.push_back(make_pair(n2, mn));
+        vecMerchantnodeRanks.push_back(make_pair(++rank, mn));
     }
-
-    sort(vecMerchantnodeScores.rbegin(), vecMerchantnodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMerchantnode) & s, vecMerchantnodeScores) {
-        rank++;
-        vecMerchantnodeRanks.push_back(make_pair(rank, s.second));
+    if (!fDisabledListed) {
+        BOOST_FOREACH (size_t nIndex, vDisabled)
+            vecMerchantnodeRanks.push_back(make_pair(++rank, vMerchantnodes[nIndex]));
     }
 
     return vecMerchantnodeRanks;
@@ -675,33 +904,12 @@ std::vector<pair<int, CMerchantnode> > CMerchantnodeMan::GetMerchantnodeRanks(in
 
 CMerchantnode* CMerchantnodeMan::GetMerchantnodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMerchantnodeScores;
-
-    // scan for winner
-    BOOST_FOREACH (CMerchantnode& mn, vMerchantnodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMerchantnodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMerchantnodeScores.rbegin(), vecMerchantnodeScores.rend(), CompareScoreTxIn());
+    LOCK(cs);
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMerchantnodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
+    const CMerchantnodeRanking* pranking = GetRanking(nBlockHeight, minProtocol, fOnlyActive, false);
+    if (pranking == NULL || nRank < 1 || nRank > (int)pranking->vRanked.size()) return NULL;
 
-    return NULL;
+    return &vMerchantnodes[pranking->vRanked[nRank - 1].second];
 }
 
 void CMerchantnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
@@ -765,6 +973,7 @@ void CMerchantnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDa
 
         if (nDoS > 0) {
             // if anything significant failed, mark that node
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), nDoS);
         } else {
             // if nothing significant failed, search existing Merchantnode list
@@ -829,6 +1038,55 @@ void CMerchantnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDa
             pfrom->PushMessage("ssc", MERCHANTNODE_SYNC_LIST, nInvCount);
             LogPrint("merchantnode", "dseg - Sent %d Merchantnode entries to peer %i\n", nInvCount, pfrom->GetId());
         }
+
+    } else if (strCommand == "dsegdigest") { //Get the Merchantnode list entries differing from a digest
+
+        CMerchantnodeListDigest digest;
+        vRecv >> digest;
+
+        if (!CMerchantnodeListDigest::IsValidBucketCount(digest.vBuckets.size())) {
+            LogPrintf("CMerchantnodeMan::ProcessMessage() : dsegdigest - invalid bucket count %d\n", digest.vBuckets.size());
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        LOCK(cs);
+
+        bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
+        if (!isLocal && Params().NetworkID() == CBaseChainParams::MAIN) {
+            std::map<CNetAddr, int64_t>::iterator i = mAskedUsForMerchantnodeListDigest.find(pfrom->addr);
+            if (i != mAskedUsForMerchantnodeListDigest.end() && GetTime() < (*i).second) {
+                LogPrintf("CMerchantnodeMan::ProcessMessage() : dsegdigest - peer already asked me for the list\n");
+                Misbehaving(pfrom->GetId(), 34);
+                return;
+            }
+            mAskedUsForMerchantnodeListDigest[pfrom->addr] = GetTime() + MERCHANTNODES_DSEG_DIGEST_SECONDS;
+        }
+
+        CMerchantnodeListDigest ours = GetListDigest(digest.vBuckets.size());
+        int nDiffBuckets = 0;
+        for (size_t i = 0; i < ours.vBuckets.size(); i++) {
+            if (ours.vBuckets[i] != digest.vBuckets[i])
+                nDiffBuckets++;
+        }
+
+        int nInvCount = 0;
+        BOOST_FOREACH (const DsegEntry& entry, vDsegEntries) {
+            unsigned int nBucket = ours.GetBucket(entry.outpoint);
+            if (ours.vBuckets[nBucket] == digest.vBuckets[nBucket])
+                continue;
+            pfrom->PushInventory(CInv(MSG_MERCHANTNODE_ANNOUNCE, entry.hashBroadcast));
+            nInvCount++;
+
+            if (!mapSeenMerchantnodeBroadcast.count(entry.hashBroadcast))
+                mapSeenMerchantnodeBroadcast.insert(make_pair(entry.hashBroadcast, CMerchantnodeBroadcast(vMerchantnodes[entry.nIndex])));
+        }
+
+        pfrom->PushMessage("ssc", MERCHANTNODE_SYNC_LIST_DIGEST, nInvCount);
+        LogPrint("merchantnode", "dsegdigest - %d of %d buckets differ, sent %d of %d Merchantnode entries to peer %i (%u bytes of digest and inv instead of %u)\n",
+            nDiffBuckets, ours.vBuckets.size(), nInvCount, vDsegEntries.size(), pfrom->GetId(),
+            ::GetSerializeSize(digest, SER_NETWORK, PROTOCOL_VERSION) + nInvCount * ::GetSerializeSize(CInv(), SER_NETWORK, PROTOCOL_VERSION),
+            vDsegEntries.size() * ::GetSerializeSize(CInv(), SER_NETWORK, PROTOCOL_VERSION));
     }
 }
 
@@ -836,19 +1094,18 @@ void CMerchantnodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
 
-    vector<CMerchantnode>::iterator it = vMerchantnodes.begin();
-    while (it != vMerchantnodes.end()) {
-        if ((*it).vin == vin) {
-            LogPrint("merchantnode", "CMerchantnodeMan: Removing Merchantnode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
-            vMerchantnodes.erase(it);
-            break;
-        }
-        ++it;
+    CMerchantnode* pmn = Find(vin);
+    if (pmn != NULL && pmn->vin == vin) {
+        LogPrint("merchantnode", "CMerchantnodeMan: Removing Merchantnode %s - %i now\n", pmn->vin.prevout.hash.ToString(), size() - 1);
+        merchantnodeCollateralWatcher.Forget(pmn->vin.prevout);
+        vMerchantnodes.erase(vMerchantnodes.begin() + (pmn - &vMerchantnodes[0]));
+        nListVersion++;
     }
 }
 
 void CMerchantnodeMan::UpdateMerchantnodeList(CMerchantnodeBroadcast mnb)
 {
+    LOCK(cs);
     mapSeenMerchantnodePing.insert(make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
     mapSeenMerchantnodeBroadcast.insert(make_pair(mnb.GetHash(), mnb));
     merchantnodeSync.AddedMerchantnodeList(mnb.GetHash());
@@ -864,6 +1121,45 @@ void CMerchantnodeMan::UpdateMerchantnodeList(CMerchantnodeBroadcast mnb)
     }
 }
 
+void CMerchantnodeMan::AddSeenPing(CMerchantnodePing mnp)
+{
+    LOCK(cs);
+    mapSeenMerchantnodePing.insert(make_pair(mnp.GetHash(), mnp));
+}
+
+void CMerchantnodeMan::UpdateSeenBroadcastPing(const uint256& hash, const CMerchantnodePing& mnp)
+{
+    // Under cs, like GetSeenMessage, so a reply can't be serialized from the old
+    // lastPing and cached after the Erase below
+    LOCK(cs);
+    map<uint256, CMerchantnodeBroadcast>::iterator it = mapSeenMerchantnodeBroadcast.find(hash);
+    if (it == mapSeenMerchantnodeBroadcast.end())
+        return;
+    it->second.lastPing = mnp;
+    // The broadcast hash does not cover lastPing, so the cached mnb reply is stale now
+    relayMessageCache.Erase(CInv(MSG_MERCHANTNODE_ANNOUNCE, hash));
+}
+
+bool CMerchantnodeMan::GetSeenMessage(const CInv& inv, CSerializedNetMsgRef& msg)
+{
+    LOCK(cs);
+    if (inv.type == MSG_MERCHANTNODE_ANNOUNCE) {
+        map<uint256, CMerchantnodeBroadcast>::iterator it = mapSeenMerchantnodeBroadcast.find(inv.hash);
+        if (it == mapSeenMerchantnodeBroadcast.end())
+            return false;
+        msg = relayMessageCache.GetOrSerialize(inv, "mnb", it->second);
+        return true;
+    }
+    if (inv.type == MSG_MERCHANTNODE_PING) {
+        map<uint256, CMerchantnodePing>::iterator it = mapSeenMerchantnodePing.find(inv.hash);
+        if (it == mapSeenMerchantnodePing.end())
+            return false;
+        msg = relayMessageCache.GetOrSerialize(inv, "mnp", it->second);
+        return true;
+    }
+    return false;
+}
+
 std::string CMerchantnodeMan::ToString() const
 {
     std::ostringstream info;
@@ -14,8 +14,18 @@
 #include "sync.h"
 #include "util.h"
 
+#include <boost/unordered_map.hpp>
+
 #define MERCHANTNODES_DUMP_SECONDS (15 * 60)
 #define MERCHANTNODES_DSEG_SECONDS (3 * 60 * 60)
+// A digest request only costs the entries that differ, so peers may repeat it sooner
+#define MERCHANTNODES_DSEG_DIGEST_SECONDS (10 * 60)
+#define MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS 16
+#define MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS 4096
+// Block heights whose merchantnode scores are kept, and rankings derived from them
+#define MERCHANTNODES_SCORE_CACHE_HEIGHTS 16
+#define MERCHANTNODES_RANKING_CACHE_SIZE 64
+#define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MERCHANTNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 using namespace std;
 
@@ -48,6 +58,108 @@ public:
     ReadResult Read(CMerchantnodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Scores of all merchantnodes for the block at one height */
+struct CMerchantnodeScores {
+    struct Entry {
+        int64_t nScore; //! compact form of CalculateScore, as the rankings compare it
+        size_t nIndex;  //! position in vMerchantnodes for nListVersion
+        COutPoint outpoint;
+    };
+
+    uint256 hashBlock;
+    uint64_t nListVersion;
+    uint64_t nLastUsed;
+    std::vector<Entry> vEntries; //! best score first
+
+    CMerchantnodeScores() : hashBlock(0), nListVersion(0), nLastUsed(0) {}
+};
+
+/** Which merchantnodes a ranking includes */
+struct CMerchantnodeRankingKey {
+    int64_t nBlockHeight;
+    int nMinProtocol;
+    bool fOnlyActive;
+    bool fMinAge; //! skip merchantnodes younger than MN_WINNER_MINIMUM_AGE
+
+    bool operator<(const CMerchantnodeRankingKey& b) const
+    {
+        if (nBlockHeight != b.nBlockHeight) return nBlockHeight < b.nBlockHeight;
+        if (nMinProtocol != b.nMinProtocol) return nMinProtocol < b.nMinProtocol;
+        if (fOnlyActive != b.fOnlyActive) return fOnlyActive < b.fOnlyActive;
+        return fMinAge < b.fMinAge;
+    }
+};
+
+/** Ranks of the merchantnodes included by a CMerchantnodeRankingKey */
+struct CMerchantnodeRanking {
+    uint256 hashBlock;
+    uint64_t nListVersion;
+    uint64_t nStateChanges; //! GetMerchantnodeStateChanges() when ranked
+    int64_t nValidUntil; //! adjusted time at which the filters may select differently
+    uint64_t nLastUsed;
+    std::vector<std::pair<int64_t, size_t> > vRanked;   //! score and vMerchantnodes position, rank 1 first
+    std::vector<std::pair<COutPoint, int> > vRankByOutpoint; //! sorted by outpoint
+
+    CMerchantnodeRanking() : hashBlock(0), nListVersion(0), nStateChanges(0), nValidUntil(0), nLastUsed(0) {}
+};
+
+/**
+ * Summary of the merchantnode entries dseg announces: entries are spread over
+ * a power of two of buckets by collateral, and each bucket holds the XOR of
+ * the low 64 bits of its broadcast hashes. A peer answers "dsegdigest" with
+ * the entries of the buckets where its own digest differs.
+ */
+class CMerchantnodeListDigest
+{
+public:
+    std::vector<uint64_t> vBuckets;
+
+    CMerchantnodeListDigest() {}
+    CMerchantnodeListDigest(unsigned int nBuckets) : vBuckets(nBuckets, 0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vBuckets);
+    }
+
+    /// Bucket count for a list of nEntries, about four entries per bucket
+    static unsigned int GetBucketCount(size_t nEntries);
+    static bool IsValidBucketCount(size_t nBuckets);
+
+    unsigned int GetBucket(const COutPoint& outpoint) const
+    {
+        return (outpoint.hash.GetLow64() + outpoint.n) & (vBuckets.size() - 1);
+    }
+
+    void Add(const COutPoint& outpoint, const uint256& hashBroadcast)
+    {
+        vBuckets[GetBucket(outpoint)] ^= hashBroadcast.GetLow64();
+    }
+};
+
+/** Salted hasher for the merchantnode list indexes, whose keys come from the network */
+class CMerchantnodeIndexHasher
+{
+private:
+    uint256 salt;
+
+public:
+    CMerchantnodeIndexHasher();
+
+    size_t operator()(const uint256& key) const
+    {
+        return key.GetHash(salt);
+    }
+
+    size_t operator()(const COutPoint& key) const
+    {
+        return key.hash.GetHash(salt) ^ key.n;
+    }
+};
+
 class CMerchantnodeMan
 {
 private:
@@ -65,6 +177,49 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForMerchantnodeList;
     // which Merchantnodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMerchantnodeListEntry;
+    // who's asked for / who we asked for the entries differing from a list
+    // digest, and when they may again; not kept in mncache.dat
+    std::map<CNetAddr, int64_t> mAskedUsForMerchantnodeListDigest;
+    std::map<CNetAddr, int64_t> mWeAskedForMerchantnodeListDigest;
+
+    // Collateral, broadcast hash and vMerchantnodes position of each entry
+    // dseg announces (enabled, not on a local network), rebuilt when the list
+    // (nListVersion) or the state of a node changes. Protected by cs.
+    struct DsegEntry {
+        COutPoint outpoint;
+        uint256 hashBroadcast;
+        size_t nIndex;
+    };
+    uint64_t nDsegListVersion;
+    uint64_t nDsegStateChanges;
+    std::vector<DsegEntry> vDsegEntries;
+
+    void UpdateDsegEntries();
+
+    // Rank cache: scores per height are computed once per block, rankings
+    // derived from them are reused until the list (nListVersion) or the state
+    // of a node changes, or MERCHANTNODE_CHECK_SECONDS pass. Protected by cs.
+    uint64_t nListVersion;
+    uint64_t nRankCacheClock;
+    std::map<int64_t, CMerchantnodeScores> mapScores;
+    std::map<CMerchantnodeRankingKey, CMerchantnodeRanking> mapRankings;
+
+    const CMerchantnodeScores* GetScores(int64_t nBlockHeight, const uint256& hashBlock);
+    const CMerchantnodeRanking* GetRanking(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinAge);
+
+    // Positions in vMerchantnodes by collateral, payee script hash and
+    // merchantnode pubkey hash; payee and pubkey map to the first node using
+    // them, as the scans did. Add() extends them, other list changes
+    // (nListVersion) and key updates make them rebuild on the next lookup.
+    uint64_t nIndexListVersion;
+    uint64_t nIndexKeyChanges;
+    boost::unordered_map<COutPoint, size_t, CMerchantnodeIndexHasher> mapIndexByOutpoint;
+    boost::unordered_map<uint256, size_t, CMerchantnodeIndexHasher> mapIndexByPayee;
+    boost::unordered_map<uint256, size_t, CMerchantnodeIndexHasher> mapIndexByPubKey;
+
+    bool IsIndexed() const;
+    void IndexMerchantnode(size_t nIndex);
+    void UpdateIndexes();
 
 public:
     // Keep track of all broadcasts I've seen
@@ -85,6 +240,8 @@ public:
 
         READWRITE(mapSeenMerchantnodeBroadcast);
         READWRITE(mapSeenMerchantnodePing);
+        if (ser_action.ForRead())
+            nListVersion++;
     }
 
     CMerchantnodeMan();
@@ -105,12 +262,19 @@ public:
     /// Clear Merchantnode vector
     void Clear();
 
+    /// Forget the cached scores and rankings
+    void ClearRankCache();
+
     int CountEnabled(int protocolVersion = -1);
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
+    /// Ask pnode for its list, or for the entries differing from our list digest if it supports that
     void DsegUpdate(CNode* pnode);
 
+    /// Digest of the entries dseg announces, over nBuckets buckets
+    CMerchantnodeListDigest GetListDigest(unsigned int nBuckets);
+
     /// Find an entry
     CMerchantnode* Find(const CScript& payee);
     CMerchantnode* Find(const CTxIn& vin);
@@ -149,6 +313,15 @@ public:
 
     /// Update merchantnode list and maps using provided CMerchantnodeBroadcast
     void UpdateMerchantnodeList(CMerchantnodeBroadcast mnb);
+
+    /// Remember a ping as seen, from outside the message handlers
+    void AddSeenPing(CMerchantnodePing mnp);
+
+    /// Update the lastPing of a seen broadcast, if known, and drop its cached getdata reply
+    void UpdateSeenBroadcastPing(const uint256& hash, const CMerchantnodePing& mnp);
+
+    /// The getdata reply for a seen broadcast or ping, false if we don't know it
+    bool GetSeenMessage(const CInv& inv, CSerializedNetMsgRef& msg);
 };
 
 #endif
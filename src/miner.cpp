@@ -92,6 +92,326 @@ void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
 }
 
+namespace {
+/**
+ * Mempool transactions picked for a block on top of pindexPrev, in block order. Transactions that
+ * enter the mempool later are appended as they come, as long as each of them ranks below every
+ * transaction already picked: a fresh selection would then take all of vtx first too, and end up
+ * the same. Otherwise, and when the tip or the block size settings change, one of its transactions
+ * leaves the mempool or prioritisation changes, it is rebuilt from scratch. Transactions passed over
+ * are looked at again on every update.
+ * Guarded by cs_main and mempool.cs.
+ */
+struct CBlockTxSelection {
+    const CBlockIndex* pindexPrev;
+    int nHeight;
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    unsigned int nTransactionsUpdated;
+    //! some mempool transactions weren't final yet, they may be by the next call
+    bool fNonFinal;
+    //! hashes of vtx
+    set<uint256> setIncluded;
+    vector<CTransaction> vtx;
+    vector<CAmount> vTxFees;
+    vector<int64_t> vTxSigOps;
+    uint64_t nBlockSize;
+    int nBlockSigOps;
+    CAmount nFees;
+    //! sort order in effect when the last transaction of vtx was picked
+    bool fSortedByFee;
+    //! lowest ranked transactions of vtx among those picked in priority order and in fee order
+    bool fHaveLowestByPriority;
+    bool fHaveLowestByFee;
+    TxPriority lowestByPriority;
+    TxPriority lowestByFee;
+
+    CBlockTxSelection() { SetNull(); }
+
+    void SetNull()
+    {
+        pindexPrev = NULL;
+        nHeight = 0;
+        nBlockMaxSize = 0;
+        nBlockPrioritySize = 0;
+        nBlockMinSize = 0;
+        nTransactionsUpdated = 0;
+        fNonFinal = false;
+        setIncluded.clear();
+        vtx.clear();
+        vTxFees.clear();
+        vTxSigOps.clear();
+        nBlockSize = 1000;
+        nBlockSigOps = 100;
+        nFees = 0;
+        fSortedByFee = false;
+        fHaveLowestByPriority = false;
+        fHaveLowestByFee = false;
+    }
+
+    //! Whether a fresh selection could take a transaction ranked as tx before one of vtx
+    bool Outranks(const TxPriority& tx) const
+    {
+        return (fHaveLowestByPriority && !TxPriorityCompare(false)(tx, lowestByPriority)) ||
+               (fHaveLowestByFee && !TxPriorityCompare(true)(tx, lowestByFee));
+    }
+};
+
+CBlockTxSelection txSelection;
+uint64_t nTxSelectionReused = 0;
+uint64_t nTxSelectionUpdated = 0;
+uint64_t nTxSelectionRebuilt = 0;
+}
+
+// Bring txSelection up to date with the mempool for a block on top of pindexPrev
+static void UpdateBlockTxSelection(const CBlockIndex* pindexPrev, unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    const int nHeight = pindexPrev->nHeight + 1;
+    bool fRebuild = txSelection.pindexPrev != pindexPrev || txSelection.nHeight != nHeight ||
+                    txSelection.nBlockMaxSize != nBlockMaxSize || txSelection.nBlockPrioritySize != nBlockPrioritySize ||
+                    txSelection.nBlockMinSize != nBlockMinSize;
+    if (!fRebuild && !txSelection.fNonFinal && txSelection.nTransactionsUpdated == mempool.GetTransactionsUpdated()) {
+        nTxSelectionReused++;
+        return;
+    }
+
+    for (const CTransaction& tx : txSelection.vtx) {
+        if (fRebuild)
+            break;
+        fRebuild = !mempool.mapTx.count(tx.GetHash());
+    }
+
+    CCoinsViewCache view(pcoinsTip);
+    if (fRebuild) {
+        txSelection.SetNull();
+        txSelection.pindexPrev = pindexPrev;
+        txSelection.nHeight = nHeight;
+        txSelection.nBlockMaxSize = nBlockMaxSize;
+        txSelection.nBlockPrioritySize = nBlockPrioritySize;
+        txSelection.nBlockMinSize = nBlockMinSize;
+        txSelection.fSortedByFee = (nBlockPrioritySize <= 0);
+        nTxSelectionRebuilt++;
+    } else {
+        // Spend what was already picked, so new transactions see the same coins they would in the block
+        for (const CTransaction& tx : txSelection.vtx) {
+            CValidationState state;
+            CTxUndo txundo;
+            UpdateCoins(tx, state, view, txundo, nHeight);
+        }
+    }
+    txSelection.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    txSelection.fNonFinal = false;
+
+    // Priority order to process transactions
+    list<COrphan> vOrphan; // list memory doesn't move
+    map<uint256, vector<COrphan*> > mapDependers;
+    bool fPrintPriority = GetBoolArg("-printpriority", false);
+
+    // This vector will be sorted into a priority queue:
+    vector<TxPriority> vecPriority;
+    vecPriority.reserve(mempool.mapTx.size());
+    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
+         mi != mempool.mapTx.end(); ++mi) {
+        const CTransaction& tx = mi->second.GetTx();
+        if (txSelection.setIncluded.count(mi->first))
+            continue;
+        if (tx.IsCoinBase() || tx.IsCoinStake())
+            continue;
+        // transactions that aren't final yet are looked at again next time
+        if (!IsFinalTx(tx, nHeight)) {
+            txSelection.fNonFinal = true;
+            continue;
+        }
+
+        COrphan* porphan = NULL;
+        double dPriority = 0;
+        CAmount nTotalIn = 0;
+        bool fMissingInputs = false;
+        for (const CTxIn& txin : tx.vin) {
+            // Read prev transaction
+            if (!view.HaveCoins(txin.prevout.hash)) {
+                // This should never happen; all transactions in the memory
+                // pool should connect to either transactions in the chain
+                // or other transactions in the memory pool.
+                if (!mempool.mapTx.count(txin.prevout.hash)) {
+                    LogPrintf("ERROR: mempool transaction missing input\n");
+                    if (fDebug) assert("mempool transaction missing input" == 0);
+                    fMissingInputs = true;
+                    if (porphan)
+                        vOrphan.pop_back();
+                    break;
+                }
+
+                // Has to wait for dependencies
+                if (!porphan) {
+                    // Use list for automatic deletion
+                    vOrphan.push_back(COrphan(&tx));
+                    porphan = &vOrphan.back();
+                }
+                mapDependers[txin.prevout.hash].push_back(porphan);
+                porphan->setDependsOn.insert(txin.prevout.hash);
+                nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
+                continue;
+            }
+            const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+            assert(coins);
+
+            CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
+            nTotalIn += nValueIn;
+
+            int nConf = nHeight - coins->nHeight;
+
+            dPriority += (double)nValueIn * nConf;
+        }
+        if (fMissingInputs) continue;
+
+        // Priority is sum(valuein * age) / modified_txsize
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        dPriority = tx.ComputePriority(dPriority, nTxSize);
+
+        uint256 hash = tx.GetHash();
+        mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+
+        CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
+
+        // A fresh selection might take this one ahead of some of vtx, maybe in its place in a full
+        // block: appending it could pick differently, so start over
+        if (!fRebuild && txSelection.Outranks(TxPriority(dPriority, feeRate, &tx))) {
+            txSelection.SetNull();
+            UpdateBlockTxSelection(pindexPrev, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+            return;
+        }
+
+        if (porphan) {
+            porphan->dPriority = dPriority;
+            porphan->feeRate = feeRate;
+        } else
+            vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
+    }
+
+    if (!fRebuild)
+        nTxSelectionUpdated++;
+
+    // Collect transactions into block, continuing in the order the last picked one was taken in
+    uint64_t& nBlockSize = txSelection.nBlockSize;
+    int& nBlockSigOps = txSelection.nBlockSigOps;
+    bool fSortedByFee = txSelection.fSortedByFee;
+
+    TxPriorityCompare comparer(fSortedByFee);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty()) {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().get<0>();
+        CFeeRate feeRate = vecPriority.front().get<1>();
+        const CTransaction& tx = *(vecPriority.front().get<2>());
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // Size limits
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (nBlockSize + nTxSize >= nBlockMaxSize)
+            continue;
+
+        // Legacy limits on sigOps:
+        unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+            continue;
+
+        // Skip free transactions if we're past the minimum block size:
+        const uint256& hash = tx.GetHash();
+        double dPriorityDelta = 0;
+        CAmount nFeeDelta = 0;
+        mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+        if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            continue;
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        if (!fSortedByFee &&
+            ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
+            fSortedByFee = true;
+            comparer = TxPriorityCompare(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+
+        if (!view.HaveInputs(tx))
+            continue;
+
+        CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+        nTxSigOps += GetP2SHSigOpCount(tx, view);
+        if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+            continue;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+        CValidationState state;
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+            continue;
+
+        CTxUndo txundo;
+        UpdateCoins(tx, state, view, txundo, nHeight);
+
+        // Added
+        txSelection.setIncluded.insert(hash);
+        txSelection.vtx.push_back(tx);
+        txSelection.vTxFees.push_back(nTxFees);
+        txSelection.vTxSigOps.push_back(nTxSigOps);
+        nBlockSize += nTxSize;
+        nBlockSigOps += nTxSigOps;
+        txSelection.nFees += nTxFees;
+        txSelection.fSortedByFee = fSortedByFee;
+        TxPriority picked(dPriority, feeRate, (const CTransaction*)NULL);
+        if (fSortedByFee && (!txSelection.fHaveLowestByFee || comparer(picked, txSelection.lowestByFee))) {
+            txSelection.lowestByFee = picked;
+            txSelection.fHaveLowestByFee = true;
+        } else if (!fSortedByFee && (!txSelection.fHaveLowestByPriority || comparer(picked, txSelection.lowestByPriority))) {
+            txSelection.lowestByPriority = picked;
+            txSelection.fHaveLowestByPriority = true;
+        }
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, feeRate.ToString(), tx.GetHash().ToString());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        if (mapDependers.count(hash)) {
+            BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
+                if (!porphan->setDependsOn.empty()) {
+                    porphan->setDependsOn.erase(hash);
+                    if (porphan->setDependsOn.empty()) {
+                        vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void InvalidateBlockTxSelection()
+{
+    LOCK2(cs_main, mempool.cs);
+    txSelection.SetNull();
+}
+
+void GetBlockTxSelectionStats(uint64_t& nReusedRet, uint64_t& nUpdatedRet, uint64_t& nRebuiltRet)
+{
+    LOCK2(cs_main, mempool.cs);
+    nReusedRet = nTxSelectionReused;
+    nUpdatedRet = nTxSelectionUpdated;
+    nRebuiltRet = nTxSelectionRebuilt;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
 {
     CReserveKey reservekey(pwallet);
@@ -171,172 +491,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
 
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        UpdateBlockTxSelection(pindexPrev, nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+        pblock->vtx.insert(pblock->vtx.end(), txSelection.vtx.begin(), txSelection.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), txSelection.vTxFees.begin(), txSelection.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), txSelection.vTxSigOps.begin(), txSelection.vTxSigOps.end());
+        uint64_t nBlockSize = txSelection.nBlockSize;
+        uint64_t nBlockTx = txSelection.vtx.size();
+        nFees = txSelection.nFees;
 
         if (!fProofOfStake) {
             //Merchantnode and general budget payments
@@ -381,6 +543,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
             LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
             mempool.clear();
+            txSelection.SetNull();
             return NULL;
         }
     }
@@ -406,6 +569,72 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     pblock->hashMerkleRoot = pblock->BuildMerkleTree();
 }
 
+CStakeScheduler stakeScheduler;
+
+CStakeScheduler::CStakeScheduler() : pindexNotified(NULL), nNotifiedTimeMicros(0), pindexAttempted(NULL), nAttemptTime(0),
+                                     nAttempts(0), nTipAttempts(0), nLatencyLast(0), nLatencyTotal(0), nLatencyMax(0)
+{
+}
+
+void CStakeScheduler::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        pindexNotified = pindex;
+        nNotifiedTimeMicros = GetTimeMicros();
+    }
+    condTip.notify_all();
+}
+
+int64_t CStakeScheduler::GetNextAttemptTime(const CBlockIndex* pindexTip)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // A coinstake has to be later than the tip; after a miss only the timestamps that entered the
+    // drift window since the last attempt are left to hash, so wait for the next one
+    int64_t nTime = pindexTip->GetBlockTime() + 1;
+    if (pindexAttempted == pindexTip)
+        nTime = std::max(nTime, nAttemptTime + 1);
+    return nTime;
+}
+
+void CStakeScheduler::WaitUntil(const CBlockIndex* pindexTip, int64_t nTime)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // UpdatedBlockTip fires after chainActive moved and needs the mutex, so a tip arriving
+    // after the caller looked at chainActive is either seen here or wakes us up
+    while (chainActive.Tip() == pindexTip) {
+        int64_t nWait = nTime * 1000 - (GetTimeMillis() + GetTimeOffset() * 1000);
+        if (nWait <= 0)
+            break;
+        condTip.timed_wait(lock, boost::posix_time::milliseconds(nWait));
+    }
+}
+
+void CStakeScheduler::AttemptStarted(const CBlockIndex* pindexTip)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nAttempts++;
+    if (pindexTip == pindexNotified && pindexAttempted != pindexTip) {
+        nLatencyLast = GetTimeMicros() - nNotifiedTimeMicros;
+        nLatencyTotal += nLatencyLast;
+        nLatencyMax = std::max(nLatencyMax, nLatencyLast);
+        nTipAttempts++;
+        LogPrint("staking", "CStakeScheduler : stake attempt on block %d %.2fms after it arrived\n", pindexTip->nHeight, nLatencyLast * 0.001);
+    }
+    pindexAttempted = pindexTip;
+    nAttemptTime = GetAdjustedTime();
+}
+
+void CStakeScheduler::GetStats(uint64_t& nAttemptsRet, uint64_t& nTipAttemptsRet, int64_t& nLatencyLastRet, int64_t& nLatencyAvgRet, int64_t& nLatencyMaxRet)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nAttemptsRet = nAttempts;
+    nTipAttemptsRet = nTipAttempts;
+    nLatencyLastRet = nLatencyLast;
+    nLatencyAvgRet = nTipAttempts ? nLatencyTotal / (int64_t)nTipAttempts : 0;
+    nLatencyMaxRet = nLatencyMax;
+}
+
 #ifdef ENABLE_WALLET
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -481,8 +710,9 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
                 fMintableCoins = pwallet->MintableCoins();
             }
 
-            if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK()) {
-                MilliSleep(5000);
+            const CBlockIndex* pindexTip = chainActive.Tip();
+            if (pindexTip->nHeight < Params().LAST_POW_BLOCK()) {
+                stakeScheduler.WaitUntil(pindexTip, GetAdjustedTime() + 5);
                 continue;
             }
 
@@ -490,16 +720,16 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
                 (pwallet->GetBalance() > 0 && nReserveBalance >= pwallet->GetBalance()) ||
                 !merchantnodeSync.IsSynced()) {
                 nLastCoinStakeSearchInterval = 0;
-                MilliSleep(5000);
+                stakeScheduler.WaitUntil(pindexTip, GetAdjustedTime() + 5);
                 continue;
             }
 
-            if (mapHashedBlocks.count(chainActive.Tip()->nHeight)) { //search our map of hashed blocks, see if bestblock has been hashed yet
-                if (GetTime() - mapHashedBlocks[chainActive.Tip()->nHeight] < max(pwallet->nHashInterval, (unsigned int)1)) { // wait half of the nHashDrift with max wait of 3 minutes
-                    MilliSleep(5000);
-                    continue;
-                }
+            int64_t nNextAttempt = stakeScheduler.GetNextAttemptTime(pindexTip);
+            if (GetAdjustedTime() < nNextAttempt) {
+                stakeScheduler.WaitUntil(pindexTip, nNextAttempt);
+                continue;
             }
+            stakeScheduler.AttemptStarted(pindexTip);
         }
 
         //
@@ -545,29 +775,32 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         while (true) {
             unsigned int nHashesDone = 0;
 
-            uint256 hash;
-            while (true) {
-                hash = pblock->GetHash();
-                if (hash <= hashTarget) {
-                    // Found a solution
-                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                    LogPrintf("BitcoinMiner:\n");
-                    LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashTarget.GetHex());
-                    ProcessBlockFound(pblock, *pwallet, reservekey);
-                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
-
-                    // In regression test mode, stop mining after a block is found. This
-                    // allows developers to controllably generate a block on demand.
-                    if (Params().MineBlocksOnDemand())
-                        throw boost::thread_interrupted();
-
-                    break;
-                }
-                pblock->nNonce += 1;
-                nHashesDone += 1;
-                if ((pblock->nNonce & 0xFF) == 0)
+            // Hash the rest of this 256 nonce window in one batch; only the nonce differs
+            // between the headers, so their common prefix is hashed once
+            uint256 vHashes[0x100];
+            unsigned int nBatch = 0x100 - (pblock->nNonce & 0xFF);
+            CBlockHeaderHasher(*pblock).GetHashes(pblock->nNonce, nBatch, vHashes);
+            unsigned int i = 0;
+            for (; i < nBatch; i++) {
+                if (vHashes[i] <= hashTarget)
                     break;
             }
+            pblock->nNonce += i;
+            nHashesDone += i;
+            if (i < nBatch) {
+                // Found a solution
+                const uint256& hash = vHashes[i];
+                SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                LogPrintf("BitcoinMiner:\n");
+                LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashTarget.GetHex());
+                ProcessBlockFound(pblock, *pwallet, reservekey);
+                SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+                // In regression test mode, stop mining after a block is found. This
+                // allows developers to controllably generate a block on demand.
+                if (Params().MineBlocksOnDemand())
+                    throw boost::thread_interrupted();
+            }
 
             // Meter hashes/sec
             static int64_t nHashCounter;
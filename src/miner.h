@@ -6,8 +6,13 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "validationinterface.h"
+
 #include <stdint.h>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
@@ -22,6 +27,10 @@ void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake);
 CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfStake);
+/** Drop the mempool transactions CreateNewBlock keeps picked for the current tip, e.g. after prioritisation changes */
+void InvalidateBlockTxSelection();
+/** Times CreateNewBlock reused, extended or rebuilt its transaction selection */
+void GetBlockTxSelectionStats(uint64_t& nReusedRet, uint64_t& nUpdatedRet, uint64_t& nRebuiltRet);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
@@ -29,6 +38,44 @@ void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
 
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
 
+/**
+ * Wakes the proof-of-stake miner when a stake attempt can find something new: as soon as a new
+ * tip can be staked on, then once a second as new kernel timestamps enter the drift window.
+ * Tracks the reaction latency from a tip arriving to the first stake attempt on it.
+ */
+class CStakeScheduler : public CValidationInterface
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condTip;
+    const CBlockIndex* pindexNotified;
+    int64_t nNotifiedTimeMicros;
+    const CBlockIndex* pindexAttempted;
+    int64_t nAttemptTime;
+    uint64_t nAttempts;
+    uint64_t nTipAttempts;
+    int64_t nLatencyLast;
+    int64_t nLatencyTotal;
+    int64_t nLatencyMax;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+
+public:
+    CStakeScheduler();
+
+    /** Adjusted time at which the next stake attempt on pindexTip should start */
+    int64_t GetNextAttemptTime(const CBlockIndex* pindexTip);
+    /** Sleep until the given adjusted time, or until the tip moves away from pindexTip */
+    void WaitUntil(const CBlockIndex* pindexTip, int64_t nTime);
+    /** Record the start of a stake attempt on pindexTip */
+    void AttemptStarted(const CBlockIndex* pindexTip);
+    /** Attempts made, how many of them were the first on a notified tip, and their latency in microseconds */
+    void GetStats(uint64_t& nAttemptsRet, uint64_t& nTipAttemptsRet, int64_t& nLatencyLastRet, int64_t& nLatencyAvgRet, int64_t& nLatencyMaxRet);
+};
+
+extern CStakeScheduler stakeScheduler;
+
 extern double dHashesPerSec;
 extern int64_t nHPSTimerStart;
 
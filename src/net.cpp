@@ -18,6 +18,7 @@
 #include "miner.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "socketpoller.h"
 #include "ui_interface.h"
 #include "wallet.h"
 
@@ -35,7 +36,9 @@
 #endif
 
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
@@ -62,6 +65,9 @@ namespace
 {
 const int MAX_OUTBOUND_CONNECTIONS = 16;
 
+/** Messages at least this large are moved from ssSend to the send queue instead of copied */
+const unsigned int SEND_SWAP_MIN_SIZE = 64 * 1024;
+
 struct ListenSocket {
     SOCKET socket;
     bool whitelisted;
@@ -88,7 +94,7 @@ bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSerializedNetMsgRef> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -107,6 +113,7 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore* semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
+static int nMsgHandlerThreads = 1;
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -410,7 +417,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest)
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsPollableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -667,6 +674,12 @@ void CNode::copyStats(CNodeStats& stats)
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    X(nMsgHandler);
+    X(nMsgProcessed);
+    stats.dMsgWait = nMsgProcessed ? ((double)nMsgWaitUsec) / nMsgProcessed / 1e6 : 0;
+    stats.dMsgWaitMax = ((double)nMsgWaitUsecMax) / 1e6;
+    stats.dMsgProcessTime = nMsgProcessed ? ((double)nMsgProcessUsec) / nMsgProcessed / 1e6 : 0;
 }
 #undef X
 
@@ -701,13 +714,53 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
     return true;
 }
 
+// requires LOCK(cs_vRecvMsg)
+char* CNode::GetRecvDataBuffer(unsigned int& nSize)
+{
+    if (vRecvMsg.empty())
+        return NULL;
+    CNetMessage& msg = vRecvMsg.back();
+    if (!msg.in_data || msg.complete() || msg.hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH ||
+        msg.hdr.nMessageSize - msg.nDataPos < RECV_DIRECT_MIN_SIZE)
+        return NULL;
+    return msg.GetDataBuffer(nSize);
+}
+
+// requires LOCK(cs_vRecvMsg)
+void CNode::ReceiveMsgData(unsigned int nBytes)
+{
+    CNetMessage& msg = vRecvMsg.back();
+    msg.DataReceived(nBytes);
+    if (msg.complete()) {
+        msg.nTime = GetTimeMicros();
+        messageHandlerCondition.notify_all();
+    }
+}
+
+/** Payload buffers of large messages, kept for the next large message instead of being freed */
+static const size_t RECV_BUFFER_POOL_SIZE = 8;
+static CCriticalSection cs_vRecvBufferPool;
+static std::vector<CSerializeData> vRecvBufferPool;
+
+CNetMessage::~CNetMessage()
+{
+    if (vRecv.capacity() < RECV_DIRECT_MIN_SIZE || vRecv.capacity() > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return;
+    LOCK(cs_vRecvBufferPool);
+    if (vRecvBufferPool.size() >= RECV_BUFFER_POOL_SIZE)
+        return;
+    vRecv.clear();
+    vRecvBufferPool.push_back(CSerializeData());
+    vRecv.SwapBuffer(vRecvBufferPool.back());
+}
+
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -738,15 +791,28 @@ int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
     return nCopy;
 }
 
+void CNetMessage::ReserveData(unsigned int nSize)
+{
+    if (vRecv.size() >= nDataPos + nSize)
+        return;
+    // Start large payloads in a recycled buffer
+    if (vRecv.capacity() == 0 && hdr.nMessageSize >= RECV_DIRECT_MIN_SIZE) {
+        LOCK(cs_vRecvBufferPool);
+        if (!vRecvBufferPool.empty()) {
+            vRecv.SwapBuffer(vRecvBufferPool.back());
+            vRecvBufferPool.pop_back();
+        }
+    }
+    // Allocate up to 256 KiB ahead, but never more than the total message size.
+    vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nSize + 256 * 1024));
+}
+
 int CNetMessage::readData(const char* pch, unsigned int nBytes)
 {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
+    ReserveData(nCopy);
 
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
@@ -754,14 +820,22 @@ int CNetMessage::readData(const char* pch, unsigned int nBytes)
     return nCopy;
 }
 
+char* CNetMessage::GetDataBuffer(unsigned int& nSize)
+{
+    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
+    ReserveData(std::min(nRemaining, (unsigned int)RECV_DIRECT_MIN_SIZE));
+    nSize = std::min(nRemaining, (unsigned int)vRecv.size() - nDataPos);
+    return &vRecv[nDataPos];
+}
+
 
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode* pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializedNetMsgRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData& data = *it;
+        const CSerializeData& data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -800,9 +874,85 @@ void SocketSendData(CNode* pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+// Poller tokens at or above this identify listen sockets, node sockets use their NodeId
+static const uint64_t LISTEN_SOCKET_TOKEN = (uint64_t)1 << 32;
+
+static boost::scoped_ptr<CSocketPoller> socketPoller;
+
+bool InitSocketPoller(bool fSelect)
+{
+    socketPoller.reset(CSocketPoller::Create(fSelect));
+    return socketPoller->HasSelectLimit();
+}
+
+bool IsPollableSocket(SOCKET hSocket)
+{
+    if (!IsSelectableSocket(hSocket))
+        return false;
+#ifndef WIN32
+    // epoll may be compiled in but have failed at runtime
+    if ((!socketPoller || socketPoller->HasSelectLimit()) && hSocket >= FD_SETSIZE)
+        return false;
+#endif
+    return true;
+}
+
+static void AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH (CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+    } else if (!IsPollableSocket(hSocket)) {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else if (CNode::IsBanned(addr) && !whitelisted) {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    } else {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
+
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+        }
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    if (!socketPoller)
+        InitSocketPoller(GetBoolArg("-socketselect", false));
+    CSocketPoller* poller = socketPoller.get();
+    LogPrintf("Socket handler waiting with %s\n", poller->GetName());
+    std::vector<int> vListenPollState(vhListenSocket.size(), 0);
+    boost::unordered_map<NodeId, CNode*> mapPolledNodes;
+    std::vector<CSocketEvent> vEvents;
+    int64_t nLastInactivityCheck = 0;
     while (true) {
         //
         // Disconnect nodes
@@ -866,159 +1016,98 @@ void ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Declare which sockets we want to receive from or send to
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+        for (size_t i = 0; i < vhListenSocket.size(); i++) {
+            if (vhListenSocket[i].socket != INVALID_SOCKET)
+                poller->Watch(vhListenSocket[i].socket, LISTEN_SOCKET_TOKEN + i, CSocketPoller::POLL_RECV, vListenPollState[i]);
         }
 
+        vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
+            vNodesCopy = vNodes;
+            BOOST_FOREACH (CNode* pnode, vNodesCopy)
+                pnode->AddRef();
         }
+        mapPolledNodes.clear();
+        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
-
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+            // Implement the following logic:
+            // * If there is data to send, wait for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, wait for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
+            int nEvents = 0;
+            {
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend && !pnode->vSendMsg.empty())
+                    nEvents = CSocketPoller::POLL_SEND;
+            }
+            if (nEvents == 0) {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+                                    pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    nEvents = CSocketPoller::POLL_RECV;
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
+            poller->Watch(pnode->hSocket, pnode->id, nEvents, pnode->nPollState);
+            mapPolledNodes[pnode->id] = pnode;
         }
 
+        poller->Wait(50, vEvents); // 50ms: frequency to poll pnode->vSend
+        boost::this_thread::interruption_point();
+
         //
-        // Accept new connections
+        // Accept new connections and service the ready sockets
         //
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                struct sockaddr_storage sockaddr;
-                socklen_t len = sizeof(sockaddr);
-                SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-                CAddress addr;
-                int nInbound = 0;
-
-                if (hSocket != INVALID_SOCKET)
-                    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                        LogPrintf("Warning: Unknown socket family\n");
-
-                bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-                {
-                    LOCK(cs_vNodes);
-                    BOOST_FOREACH (CNode* pnode, vNodes)
-                        if (pnode->fInbound)
-                            nInbound++;
-                }
-
-                if (hSocket == INVALID_SOCKET) {
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK)
-                        LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
-                    LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
-                    LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else if (CNode::IsBanned(addr) && !whitelisted) {
-                    LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                    CloseSocket(hSocket);
-                } else {
-                    CNode* pnode = new CNode(hSocket, addr, "", true);
-                    pnode->AddRef();
-                    pnode->fWhitelisted = whitelisted;
+        BOOST_FOREACH (const CSocketEvent& event, vEvents) {
+            boost::this_thread::interruption_point();
 
-                    {
-                        LOCK(cs_vNodes);
-                        vNodes.push_back(pnode);
-                    }
-                }
+            if (event.nToken >= LISTEN_SOCKET_TOKEN) {
+                size_t nListen = event.nToken - LISTEN_SOCKET_TOKEN;
+                if (nListen < vhListenSocket.size() && vhListenSocket[nListen].socket != INVALID_SOCKET && (event.fRecv || event.fError))
+                    AcceptConnection(vhListenSocket[nListen]);
+                continue;
             }
-        }
 
-        //
-        // Service each socket
-        //
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy)
-                pnode->AddRef();
-        }
-        BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-            boost::this_thread::interruption_point();
+            // Sockets stay registered with epoll until closed; skip the ones not watched this round
+            boost::unordered_map<NodeId, CNode*>::const_iterator it = mapPolledNodes.find((NodeId)event.nToken);
+            if (it == mapPolledNodes.end())
+                continue;
+            CNode* pnode = it->second;
 
             //
             // Receive
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (event.fRecv || event.fError) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        // The rest of a large payload is read straight into the message
+                        unsigned int nDirect = 0;
+                        char* pchDirect = pnode->GetRecvDataBuffer(nDirect);
+                        int nBytes = pchDirect ? recv(pnode->hSocket, pchDirect, nDirect, MSG_DONTWAIT) :
+                                                 recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0) {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            if (pchDirect)
+                                pnode->ReceiveMsgData(nBytes);
+                            else if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
@@ -1046,29 +1135,36 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (event.fSend) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     SocketSendData(pnode);
             }
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
+        //
+        // Inactivity checking; the timeouts have a resolution of one second
+        //
+        int64_t nTime = GetTime();
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+                if (pnode->hSocket == INVALID_SOCKET)
+                    continue;
+                if (nTime - pnode->nTimeConnected > 60) {
+                    if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+                        LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+                        LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+                        pnode->fDisconnect = true;
+                    } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+                        LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+                        pnode->fDisconnect = true;
+                    } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+                        LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+                        pnode->fDisconnect = true;
+                    }
                 }
             }
         }
@@ -1462,7 +1558,18 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant* grantOu
 }
 
 
-void ThreadMessageHandler()
+void WakeMessageHandlers()
+{
+    messageHandlerCondition.notify_all();
+}
+
+/**
+ * Message handler worker nHandler of nMsgHandlerThreads. Each worker serves the
+ * peers with id % nMsgHandlerThreads == nHandler, so that a slow handler only
+ * delays its own shard; the messages that must not run concurrently are
+ * serialized across workers by ProcessMessages.
+ */
+void ThreadMessageHandler(int nHandler)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -1470,18 +1577,22 @@ void ThreadMessageHandler()
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true) {
         vector<CNode*> vNodesCopy;
+        CNode* pnodeTrickle = NULL;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
+            vNodesCopy.reserve(vNodes.size() / nMsgHandlerThreads + 1);
+            BOOST_FOREACH (CNode* pnode, vNodes) {
+                if (pnode->nMsgHandler == nHandler)
+                    vNodesCopy.push_back(pnode->AddRef());
             }
+
+            // Every worker draws the trickle node from all peers and only serves
+            // it when it owns it, which keeps one trickle node per round on average
+            if (!vNodes.empty())
+                pnodeTrickle = vNodes[GetRand(vNodes.size())];
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
 
@@ -1496,7 +1607,8 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize()) {
+                    // A peer waiting for the serial lock is retried when the holder wakes us up
+                    if (pnode->nSendSize < SendBufferSize() && !pnode->fMsgSerialBlocked) {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())) {
                             fSleep = false;
                         }
@@ -1563,7 +1675,7 @@ bool BindListenPort(const CService& addrBind, string& strError, bool fWhiteliste
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket)) {
+    if (!IsPollableSocket(hListenSocket)) {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
         return false;
@@ -1732,7 +1844,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    nMsgHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    LogPrintf("Using %d message handler threads\n", nMsgHandlerThreads);
+    for (int i = 0; i < nMsgHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -1804,13 +1919,10 @@ void CExplicitNetCleanup::callCleanup()
 
 void RelayTransaction(const CTransaction& tx)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
+    RelayTransaction(tx, MakeSerializedNetMsg("tx", tx));
 }
 
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
+void RelayTransaction(const CTransaction& tx, const CSerializedNetMsgRef& msg)
 {
     CInv inv(MSG_TX, tx.GetHash());
     {
@@ -1822,7 +1934,7 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
         }
 
         // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
+        mapRelay.insert(std::make_pair(inv, msg));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
     LOCK(cs_vNodes);
@@ -1840,7 +1952,7 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
 {
-    CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
+    CSerializedNetMsgRef msg = MakeSerializedNetMsg("ix", tx);
 
     //broadcast the new lock
     LOCK(cs_vNodes);
@@ -1848,7 +1960,7 @@ void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
         if (!relayToAll && !pnode->fRelayTxes)
             continue;
 
-        pnode->PushMessage("ix", tx);
+        pnode->PushSerializedMessage(msg);
     }
 }
 
@@ -2021,6 +2133,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 {
     nServices = 0;
     hSocket = hSocketIn;
+    nPollState = 0;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2058,6 +2171,13 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
         id = nLastNodeId++;
     }
 
+    nMsgHandler = id % nMsgHandlerThreads;
+    fMsgSerialBlocked = false;
+    nMsgProcessed = 0;
+    nMsgWaitUsec = 0;
+    nMsgWaitUsecMax = 0;
+    nMsgProcessUsec = 0;
+
     if (fLogIPs)
         LogPrint("net", "Added connection to %s peer=%d\n", addrName, id);
     else
@@ -2145,28 +2265,61 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         return;
     }
 
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    FinalizeMessageHeader(ssSend);
 
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    LogPrint("net", "(%d bytes) peer=%d\n", ssSend.size() - CMessageHeader::HEADER_SIZE, id);
+
+    // Large messages hand their buffer over; small ones are copied so that
+    // ssSend keeps its capacity for the next message
+    boost::shared_ptr<CSerializeData> msg = boost::make_shared<CSerializeData>();
+    if (ssSend.size() >= SEND_SWAP_MIN_SIZE)
+        ssSend.SwapBuffer(*msg);
+    else
+        ssSend.GetAndClear(*msg);
+    QueueSendMessage(msg);
 
-    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+void CNode::PushSerializedMessage(const CSerializedNetMsgRef& msg)
+{
+    LOCK(cs_vSend);
+    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0) {
+        LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
+        return;
+    }
+    if (fDebug) {
+        const char* pszCommand = &(*msg)[MESSAGE_START_SIZE];
+        LogPrint("net", "sending: %s (%d bytes, shared) peer=%d\n",
+            SanitizeString(std::string(pszCommand, strnlen(pszCommand, CMessageHeader::COMMAND_SIZE))),
+            msg->size() - CMessageHeader::HEADER_SIZE, id);
+    }
+    QueueSendMessage(msg);
+}
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+// requires LOCK(cs_vSend)
+void CNode::QueueSendMessage(const CSerializedNetMsgRef& msg)
+{
+    vSendMsg.push_back(msg);
+    nSendSize += msg->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
+}
 
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+void FinalizeMessageHeader(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size() >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
 }
 
 //
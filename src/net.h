@@ -30,6 +30,8 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
@@ -62,6 +64,12 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Payloads at least this large are received straight into their message buffer */
+static const unsigned int RECV_DIRECT_MIN_SIZE = 64 * 1024;
+/** -msghandlerthreads default: worker threads the connected peers are sharded across */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Upper bound for -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -80,10 +88,37 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhitelisted = false);
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
+/** Create the poller the socket handler waits with; returns whether it is select() with its FD_SETSIZE limit */
+bool InitSocketPoller(bool fSelect);
+/** Whether the socket handler can wait on hSocket; checked before a socket becomes a node */
+bool IsPollableSocket(SOCKET hSocket);
 void SocketSendData(CNode* pnode);
+/** Wake the message handler threads, e.g. when work they skipped can be done now */
+void WakeMessageHandlers();
 
 typedef int NodeId;
 
+/**
+ * A complete wire message, header and payload. It is serialized and
+ * checksummed once, and the send queues of all peers it is pushed to share it.
+ */
+typedef boost::shared_ptr<const CSerializeData> CSerializedNetMsgRef;
+
+/** Fill in the payload size and checksum of the message header at the start of ss */
+void FinalizeMessageHeader(CDataStream& ss);
+
+/** Serialize a message once, to be queued to any number of peers with CNode::PushSerializedMessage */
+template <typename T>
+CSerializedNetMsgRef MakeSerializedNetMsg(const char* pszCommand, const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(pszCommand, 0) << obj;
+    FinalizeMessageHeader(ss);
+    boost::shared_ptr<CSerializeData> msg = boost::make_shared<CSerializeData>();
+    ss.SwapBuffer(*msg);
+    return msg;
+}
+
 // Signals for message handling
 struct CNodeSignals {
     boost::signals2::signal<int()> GetHeight;
@@ -132,7 +167,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSerializedNetMsgRef> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -171,6 +206,11 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    int nMsgHandler;
+    uint64_t nMsgProcessed;
+    double dMsgWait;
+    double dMsgWaitMax;
+    double dMsgProcessTime;
 };
 
 
@@ -188,6 +228,8 @@ public:
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
+    bool fSigChecksQueued; // signatures handed to the merchantnode signature check queue
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
     {
         hdrbuf.resize(24);
@@ -195,8 +237,12 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fSigChecksQueued = false;
     }
 
+    // Hands large payload buffers back to the receive buffer pool
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -212,6 +258,17 @@ public:
 
     int readHeader(const char* pch, unsigned int nBytes);
     int readData(const char* pch, unsigned int nBytes);
+
+    // Unfilled part of the payload buffer, growing it by up to 256 KiB
+    char* GetDataBuffer(unsigned int& nSize);
+    // Account for nBytes written to GetDataBuffer
+    void DataReceived(unsigned int nBytes)
+    {
+        nDataPos += nBytes;
+    }
+
+private:
+    void ReserveData(unsigned int nSize);
 };
 
 
@@ -284,11 +341,12 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
+    int nPollState; // interest registered with the socket handler's poller
     CDataStream ssSend;
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializedNetMsgRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -328,6 +386,15 @@ public:
     int nRefCount;
     NodeId id;
 
+    // Message processing, only touched by the handler thread that owns the peer.
+    // Wait is the time from the complete receipt of a message until it is processed.
+    int nMsgHandler;
+    bool fMsgSerialBlocked; // the next message waits for a serial one elsewhere to finish
+    uint64_t nMsgProcessed;
+    int64_t nMsgWaitUsec;
+    int64_t nMsgWaitUsecMax;
+    int64_t nMsgProcessUsec;
+
 protected:
     // Denial-of-service detection/prevention
     // Key is IP address, value is banned-until-time
@@ -349,7 +416,7 @@ public:
     uint256 hashContinue;
     int nStartingHeight;
 
-    // flood relay
+    // flood relay, guarded by cs_inventory: the addr handlers of other peers push to it
     std::vector<CAddress> vAddrToSend;
     mruset<CAddress> setAddrKnown;
     bool fGetAddr;
@@ -409,6 +476,15 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes);
 
+    // requires LOCK(cs_vRecvMsg)
+    // The rest of the payload being received when it is large enough to read
+    // the socket straight into it, else NULL and the caller uses ReceiveMsgBytes
+    char* GetRecvDataBuffer(unsigned int& nSize);
+
+    // requires LOCK(cs_vRecvMsg)
+    // Account for nBytes read into GetRecvDataBuffer
+    void ReceiveMsgData(unsigned int nBytes);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -431,6 +507,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_inventory);
         setAddrKnown.insert(addr);
     }
 
@@ -439,6 +516,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_inventory);
         if (addr.IsValid() && !setAddrKnown.count(addr)) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
@@ -477,6 +555,12 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    // Queue a message built with MakeSerializedNetMsg; the buffer is shared, not copied
+    void PushSerializedMessage(const CSerializedNetMsgRef& msg);
+
+    // requires LOCK(cs_vSend)
+    void QueueSendMessage(const CSerializedNetMsgRef& msg);
+
     void PushVersion();
 
 
@@ -731,7 +815,7 @@ public:
 
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+void RelayTransaction(const CTransaction& tx, const CSerializedNetMsgRef& msg);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
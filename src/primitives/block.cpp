@@ -6,6 +6,8 @@
 
 #include "primitives/block.h"
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "script/standard.h"
 #include "script/sign.h"
@@ -13,9 +15,90 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <assert.h>
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+#include <boost/thread/mutex.hpp>
+
+static std::atomic<uint64_t> nBlockHashCacheHits(0);
+static std::atomic<uint64_t> nBlockHashCacheMisses(0);
+
+// Guards the cached hash of every header. Held only for the compare or copy, never
+// while hashing. Function-local so chainparams can hash genesis during static init.
+static boost::mutex& BlockHashCacheMutex()
+{
+    static boost::mutex mutex;
+    return mutex;
+}
+
+CBlockHeader::CBlockHeader(const CBlockHeader& other)
+{
+    fHashCached = false;
+    *this = other;
+}
+
+CBlockHeader& CBlockHeader::operator=(const CBlockHeader& other)
+{
+    nVersion = other.nVersion;
+    hashPrevBlock = other.hashPrevBlock;
+    hashMerkleRoot = other.hashMerkleRoot;
+    nTime = other.nTime;
+    nBits = other.nBits;
+    nNonce = other.nNonce;
+    if (this != &other) {
+        boost::unique_lock<boost::mutex> lock(BlockHashCacheMutex());
+        fHashCached = other.fHashCached;
+        memcpy(vchHashedHeader, other.vchHashedHeader, HEADER_SIZE);
+        hashCached = other.hashCached;
+    }
+    return *this;
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    return HashQuark(BEGIN(nVersion), END(nNonce));
+    {
+        boost::unique_lock<boost::mutex> lock(BlockHashCacheMutex());
+        if (fHashCached && memcmp(vchHashedHeader, BEGIN(nVersion), HEADER_SIZE) == 0) {
+            nBlockHashCacheHits++;
+            return hashCached;
+        }
+    }
+    nBlockHashCacheMisses++;
+    uint256 hash = HashQuark(BEGIN(nVersion), END(nNonce));
+    SetCachedHash(hash);
+    return hash;
+}
+
+void CBlockHeader::SetCachedHash(const uint256& hash) const
+{
+    assert(END(nNonce) - BEGIN(nVersion) == (ptrdiff_t)HEADER_SIZE);
+    boost::unique_lock<boost::mutex> lock(BlockHashCacheMutex());
+    memcpy(vchHashedHeader, BEGIN(nVersion), HEADER_SIZE);
+    hashCached = hash;
+    fHashCached = true;
+}
+
+void GetBlockHashCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet)
+{
+    nHitsRet = nBlockHashCacheHits;
+    nMissesRet = nBlockHashCacheMisses;
+}
+
+CBlockHeaderHasher::CBlockHeaderHasher(const CBlockHeader& header)
+{
+    prefix.Write((const unsigned char*)BEGIN(header.nVersion), (const unsigned char*)BEGIN(header.nNonce) - (const unsigned char*)BEGIN(header.nVersion));
+}
+
+void CBlockHeaderHasher::GetHashes(uint32_t nNonceFirst, unsigned int nCount, uint256* phashes) const
+{
+    if (nCount == 0)
+        return;
+    std::vector<unsigned char> vTails(sizeof(uint32_t) * nCount);
+    for (unsigned int i = 0; i < nCount; i++)
+        WriteLE32(&vTails[sizeof(uint32_t) * i], nNonceFirst + i);
+    prefix.FinalizeTails(phashes[0].begin(), &vTails[0], sizeof(uint32_t), nCount);
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -63,15 +146,18 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // The complete pairs of this level already lie back to back as 64 byte messages,
+        // so hash them all in one batch.
+        vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+        SHA256DBatch(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), 2 * sizeof(uint256), nSize / 2);
+        if (nSize % 2 == 1) {
+            // An odd hash out is paired with itself
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree.back() = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -8,6 +8,7 @@
 #ifndef BITCOIN_PRIMITIVES_BLOCK_H
 #define BITCOIN_PRIMITIVES_BLOCK_H
 
+#include "crypto/quark.h"
 #include "primitives/transaction.h"
 #include "keystore.h"
 #include "serialize.h"
@@ -35,11 +36,27 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+    //! Size of the hashed header, nVersion through nNonce
+    static const size_t HEADER_SIZE = 80;
+
+private:
+    // memory only: the header as last hashed by GetHash() and its hash. Any change to a
+    // header field shows up as a mismatch against the copy, so nothing has to invalidate it.
+    // GetHash() is const and shared headers are hashed from several threads, so these are
+    // only read or written under a lock in block.cpp, copies included.
+    mutable bool fHashCached;
+    mutable unsigned char vchHashedHeader[HEADER_SIZE];
+    mutable uint256 hashCached;
+
+public:
     CBlockHeader()
     {
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other);
+    CBlockHeader& operator=(const CBlockHeader& other);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -61,6 +78,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -68,8 +86,12 @@ public:
         return (nBits == 0);
     }
 
+    //! Quark hash of the header, only recomputed when a header field changed since the last call
     uint256 GetHash() const;
 
+    //! Remember hash as the hash of the current header fields, for callers that already know it
+    void SetCachedHash(const uint256& hash) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -77,6 +99,26 @@ public:
 };
 
 
+/** GetHash() calls answered from the cached hash (hits) and calls that computed it (misses). */
+void GetBlockHashCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet);
+
+/** Proof-of-work hashes of one header for a range of nonces. The 80-byte header
+ * fits in one blake512 block, so every nonce still costs the full chain; only the
+ * context setup and the copies of the header fields are saved per nonce.
+ */
+class CBlockHeaderHasher
+{
+private:
+    CQuarkHasher prefix;
+
+public:
+    explicit CBlockHeaderHasher(const CBlockHeader& header);
+
+    //! Hashes of the header with nonces nNonceFirst .. nNonceFirst + nCount - 1
+    void GetHashes(uint32_t nNonceFirst, unsigned int nCount, uint256* phashes) const;
+};
+
+
 class CBlock : public CBlockHeader
 {
 public:
@@ -122,14 +164,8 @@ public:
 
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        return block;
+        // Copies the cached hash along with the header fields
+        return *this;
     }
 
     // ppcoin: two types of block: proof-of-work or proof-of-stake
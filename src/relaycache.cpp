@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "relaycache.h"
+
+CRelayMessageCache relayMessageCache;
+
+CRelayMessageCache::CRelayMessageCache(size_t nMaxBytesIn) : nBytes(0), nMaxBytes(nMaxBytesIn), nHits(0), nMisses(0), nBytesSaved(0)
+{
+}
+
+void CRelayMessageCache::Trim()
+{
+    while (nBytes > nMaxBytes && !listMessages.empty()) {
+        nBytes -= listMessages.back().second->size();
+        mapMessages.erase(listMessages.back().first);
+        listMessages.pop_back();
+    }
+}
+
+void CRelayMessageCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+bool CRelayMessageCache::Get(const CInv& inv, CSerializedNetMsgRef& msg)
+{
+    LOCK(cs);
+    std::map<CInv, list_type::iterator>::iterator mi = mapMessages.find(inv);
+    if (mi == mapMessages.end()) {
+        nMisses++;
+        return false;
+    }
+    listMessages.splice(listMessages.begin(), listMessages, mi->second);
+    msg = mi->second->second;
+    nHits++;
+    nBytesSaved += msg->size();
+    return true;
+}
+
+void CRelayMessageCache::Put(const CInv& inv, const CSerializedNetMsgRef& msg)
+{
+    LOCK(cs);
+    if (msg->size() > nMaxBytes || mapMessages.count(inv))
+        return;
+    listMessages.push_front(std::make_pair(inv, msg));
+    mapMessages.insert(std::make_pair(inv, listMessages.begin()));
+    nBytes += msg->size();
+    Trim();
+}
+
+void CRelayMessageCache::Erase(const CInv& inv)
+{
+    LOCK(cs);
+    std::map<CInv, list_type::iterator>::iterator mi = mapMessages.find(inv);
+    if (mi == mapMessages.end())
+        return;
+    nBytes -= mi->second->second->size();
+    listMessages.erase(mi->second);
+    mapMessages.erase(mi);
+}
+
+void CRelayMessageCache::GetStats(CRelayMessageCacheStats& stats) const
+{
+    LOCK(cs);
+    stats.nEntries = listMessages.size();
+    stats.nBytes = nBytes;
+    stats.nMaxBytes = nMaxBytes;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nBytesSaved = nBytesSaved;
+}
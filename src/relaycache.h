@@ -0,0 +1,85 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RELAYCACHE_H
+#define BITCOIN_RELAYCACHE_H
+
+#include "net.h"
+#include "protocol.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <stdint.h>
+
+/** -relaycachesize default, in MiB */
+static const unsigned int DEFAULT_RELAY_CACHE_SIZE = 16;
+
+struct CRelayMessageCacheStats {
+    size_t nEntries;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nBytesSaved; //! serialized bytes served from the cache instead of being produced again
+};
+
+/**
+ * Serialized getdata replies of merchantnode, budget, spork and SwiftTX
+ * objects, keyed by inventory. Most of these objects are identified by the
+ * hash of their whole content, so a cached message stays valid for as long
+ * as the owning manager still knows the object; callers check that before
+ * asking here. A merchantnode broadcast's hash does not cover its lastPing,
+ * which is updated in place: CMerchantnodeMan updates it and Erases the
+ * message under the same lock it serializes and Puts the message with.
+ * Least recently used entries are evicted once the cache holds more than
+ * its maximum number of bytes.
+ */
+class CRelayMessageCache
+{
+private:
+    typedef std::list<std::pair<CInv, CSerializedNetMsgRef> > list_type;
+
+    mutable CCriticalSection cs;
+    list_type listMessages; //! most recently used first
+    std::map<CInv, list_type::iterator> mapMessages;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nBytesSaved;
+
+    void Trim();
+
+public:
+    CRelayMessageCache(size_t nMaxBytesIn = DEFAULT_RELAY_CACHE_SIZE << 20);
+
+    void SetMaxBytes(size_t nMaxBytesIn);
+
+    /** Look up the message for inv, counting a hit or a miss */
+    bool Get(const CInv& inv, CSerializedNetMsgRef& msg);
+
+    void Put(const CInv& inv, const CSerializedNetMsgRef& msg);
+
+    /** Drop the message for inv, for an object that changed without changing its hash */
+    void Erase(const CInv& inv);
+
+    /** The message for inv, serializing obj as pszCommand if it is not cached yet */
+    template <typename T>
+    CSerializedNetMsgRef GetOrSerialize(const CInv& inv, const char* pszCommand, const T& obj)
+    {
+        CSerializedNetMsgRef msg;
+        if (!Get(inv, msg)) {
+            msg = MakeSerializedNetMsg(pszCommand, obj);
+            Put(inv, msg);
+        }
+        return msg;
+    }
+
+    void GetStats(CRelayMessageCacheStats& stats) const;
+};
+
+extern CRelayMessageCache relayMessageCache;
+
+#endif // BITCOIN_RELAYCACHE_H
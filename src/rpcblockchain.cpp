@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "coinsflush.h"
 #include "main.h"
 #include "rpcserver.h"
 #include "sync.h"
@@ -115,7 +116,7 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockcount", "") + HelpExampleRpc("getblockcount", ""));
 
-    return chainActive.Height();
+    return GetChainTipSnapshot()->nHeight;
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -129,7 +130,7 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             "\nExamples\n" +
             HelpExampleCli("getbestblockhash", "") + HelpExampleRpc("getbestblockhash", ""));
 
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainTipSnapshot()->hashTip.GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -143,7 +144,8 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getdifficulty", "") + HelpExampleRpc("getdifficulty", ""));
 
-    return GetDifficulty();
+    CChainTipSnapshotRef snapshot = GetChainTipSnapshot();
+    return snapshot->pindexTip ? GetDifficulty(snapshot->pindexTip) : 1.0;
 }
 
 
@@ -235,11 +237,13 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
+    // Walk back from the snapshot tip: block index links never change, so no cs_main is needed
+    CChainTipSnapshotRef snapshot = GetChainTipSnapshot();
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || nHeight > snapshot->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
+    const CBlockIndex* pblockindex = snapshot->pindexTip->GetAncestor(nHeight);
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -503,7 +507,18 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainstateflush\": {       (json object) background writes of the chainstate to disk\n"
+            "    \"flushes\": xxxx,         (numeric) writes completed\n"
+            "    \"writing\": true|false,   (boolean) whether a write is running\n"
+            "    \"pending\": xxxx,         (numeric) entries of the write that is running\n"
+            "    \"lastwritems\": xxxx,     (numeric) duration of the last write in milliseconds\n"
+            "    \"totalwritems\": xxxx,    (numeric) duration of all writes in milliseconds\n"
+            "    \"stalls\": xxxx,          (numeric) flushes that had to wait for the previous write\n"
+            "    \"laststallms\": xxxx,     (numeric) time the last of them waited in milliseconds\n"
+            "    \"maxstallms\": xxxx,      (numeric) longest such wait in milliseconds\n"
+            "    \"totalstallms\": xxxx     (numeric) time all of them waited in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -516,6 +531,21 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    if (pcoinsFlusher) {
+        CCoinsFlushStats stats;
+        pcoinsFlusher->GetFlushStats(stats);
+        UniValue flush(UniValue::VOBJ);
+        flush.push_back(Pair("flushes", stats.nFlushes));
+        flush.push_back(Pair("writing", stats.fWriting));
+        flush.push_back(Pair("pending", (uint64_t)stats.nPendingEntries));
+        flush.push_back(Pair("lastwritems", stats.nLastWriteMicros / 1000));
+        flush.push_back(Pair("totalwritems", stats.nTotalWriteMicros / 1000));
+        flush.push_back(Pair("stalls", stats.nStalls));
+        flush.push_back(Pair("laststallms", stats.nLastStallMicros / 1000));
+        flush.push_back(Pair("maxstallms", stats.nMaxStallMicros / 1000));
+        flush.push_back(Pair("totalstallms", stats.nTotalStallMicros / 1000));
+        obj.push_back(Pair("chainstateflush", flush));
+    }
     return obj;
 }
 
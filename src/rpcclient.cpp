@@ -118,6 +118,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"reservebalance", 0},
         {"reservebalance", 1},
         {"setstakesplitthreshold", 0},
+        {"getstakeforecast", 0},
         {"autocombinerewards", 0},
         {"autocombinerewards", 1},
         {"getfeeinfo", 0},
@@ -9,6 +9,7 @@
 #include "main.h"
 #include "merchantnode-budget.h"
 #include "merchantnode-payments.h"
+#include "merchantnode-sigcheck.h"
 #include "merchantnodeconfig.h"
 #include "merchantnodeman.h"
 #include "rpcserver.h"
@@ -298,6 +299,26 @@ UniValue merchantnodeconnect(const UniValue& params, bool fHelp)
     }
 }
 
+// Payment queue count of the last tip getmerchantnodecount was asked about
+static CCriticalSection cs_merchantnodeQueueCount;
+static uint256 hashQueueCountTip;
+static int64_t nQueueCountTime = 0;
+static int nQueueCount = 0;
+
+/** Merchantnodes in the payment queue after tip; the scan is redone at most once a minute per tip */
+static int GetMerchantnodeQueueCount(const CChainTipSnapshotRef& tip)
+{
+    if (tip->pindexTip == NULL)
+        return 0;
+    LOCK(cs_merchantnodeQueueCount);
+    if (hashQueueCountTip != tip->hashTip || GetTime() - nQueueCountTime > 60) {
+        mnodeman.GetNextMerchantnodeInQueueForPayment(tip->nHeight, true, nQueueCount);
+        hashQueueCountTip = tip->hashTip;
+        nQueueCountTime = GetTime();
+    }
+    return nQueueCount;
+}
+
 UniValue getmerchantnodecount (const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() > 0))
@@ -310,28 +331,56 @@ UniValue getmerchantnodecount (const UniValue& params, bool fHelp)
             "  \"total\": n,        (numeric) Total merchantnodes\n"
             "  \"stable\": n,       (numeric) Stable count\n"
             "  \"enabled\": n,      (numeric) Enabled merchantnodes\n"
-            "  \"inqueue\": n       (numeric) Merchantnodes in queue\n"
+            "  \"inqueue\": n,      (numeric) Merchantnodes in queue\n"
+            "  \"ipv4\": n,         (numeric) Merchantnodes on IPv4\n"
+            "  \"ipv6\": n,         (numeric) Merchantnodes on IPv6\n"
+            "  \"onion\": n,        (numeric) Merchantnodes on Tor\n"
+            "  \"collateralwatch\": {  (json object) collateral spent state tracking\n"
+            "    \"watched\": n,      (numeric) collaterals being watched\n"
+            "    \"probes\": n,       (numeric) mempool probes made to learn a state\n"
+            "    \"spent\": n,        (numeric) collaterals seen spent in a block\n"
+            "    \"invalidated\": n   (numeric) states reset by mempool or reorganized transactions\n"
+            "  },\n"
+            "  \"sigcache\": {     (json object) recovered message signature keys\n"
+            "    \"size\": n,        (numeric) signatures cached\n"
+            "    \"hits\": n,        (numeric) signatures found in the cache\n"
+            "    \"misses\": n       (numeric) signatures recovered\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmerchantnodecount", "") + HelpExampleRpc("getmerchantnodecount", ""));
 
     UniValue obj(UniValue::VOBJ);
-    int nCount = 0;
     int ipv4 = 0, ipv6 = 0, onion = 0;
-
-    if (chainActive.Tip())
-        mnodeman.GetNextMerchantnodeInQueueForPayment(chainActive.Tip()->nHeight, true, nCount);
-
     mnodeman.CountNetworks(ActiveProtocol(), ipv4, ipv6, onion);
 
     obj.push_back(Pair("total", mnodeman.size()));
     obj.push_back(Pair("stable", mnodeman.stable_size()));
     obj.push_back(Pair("enabled", mnodeman.CountEnabled()));
-    obj.push_back(Pair("inqueue", nCount));
+    obj.push_back(Pair("inqueue", GetMerchantnodeQueueCount(GetChainTipSnapshot())));
     obj.push_back(Pair("ipv4", ipv4));
     obj.push_back(Pair("ipv6", ipv6));
     obj.push_back(Pair("onion", onion));
 
+    size_t nWatched;
+    uint64_t nProbes, nSpent, nInvalidated;
+    merchantnodeCollateralWatcher.GetStats(nWatched, nProbes, nSpent, nInvalidated);
+    UniValue collateralWatch(UniValue::VOBJ);
+    collateralWatch.push_back(Pair("watched", (uint64_t)nWatched));
+    collateralWatch.push_back(Pair("probes", nProbes));
+    collateralWatch.push_back(Pair("spent", nSpent));
+    collateralWatch.push_back(Pair("invalidated", nInvalidated));
+    obj.push_back(Pair("collateralwatch", collateralWatch));
+
+    size_t nSigCacheSize;
+    uint64_t nHits, nMisses;
+    merchantnodeSigCache.GetStats(nSigCacheSize, nHits, nMisses);
+    UniValue sigCache(UniValue::VOBJ);
+    sigCache.push_back(Pair("size", (uint64_t)nSigCacheSize));
+    sigCache.push_back(Pair("hits", nHits));
+    sigCache.push_back(Pair("misses", nMisses));
+    obj.push_back(Pair("sigcache", sigCache));
+
     return obj;
 }
 
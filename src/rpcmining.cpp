@@ -10,6 +10,7 @@
 #include "chainparams.h"
 #include "core_io.h"
 #include "init.h"
+#include "kernel.h"
 #include "main.h"
 #include "miner.h"
 #include "net.h"
@@ -231,6 +232,21 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"stakemodifiercache\": {     (json object) kernel stake modifier cache statistics\n"
+            "    \"hits\": n,                (numeric) lookups answered from the cache\n"
+            "    \"misses\": n,              (numeric) lookups that walked the chain\n"
+            "    \"invalidated\": n,         (numeric) entries dropped by reorganizations\n"
+            "    \"size\": n                 (numeric) number of cached entries\n"
+            "  }\n"
+            "  \"blockhashcache\": {         (json object) block header hash cache statistics\n"
+            "    \"hits\": n,                (numeric) header hashes answered without recomputing Quark\n"
+            "    \"misses\": n               (numeric) header hashes computed\n"
+            "  }\n"
+            "  \"templatecache\": {          (json object) block template transaction selection statistics\n"
+            "    \"reused\": n,              (numeric) templates built from an unchanged selection\n"
+            "    \"updated\": n,             (numeric) templates that only added new mempool transactions\n"
+            "    \"rebuilt\": n              (numeric) templates that selected from the whole mempool\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmininginfo", "") + HelpExampleRpc("getmininginfo", ""));
@@ -248,6 +264,31 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("pooledtx", (uint64_t)mempool.size()));
     obj.push_back(Pair("testnet", Params().TestnetToBeDeprecatedFieldRPC()));
     obj.push_back(Pair("chain", Params().NetworkIDString()));
+
+    uint64_t nHits, nMisses, nInvalidated;
+    size_t nSize;
+    stakeModifierCache.GetStats(nHits, nMisses, nInvalidated, nSize);
+    UniValue modifierCache(UniValue::VOBJ);
+    modifierCache.push_back(Pair("hits", nHits));
+    modifierCache.push_back(Pair("misses", nMisses));
+    modifierCache.push_back(Pair("invalidated", nInvalidated));
+    modifierCache.push_back(Pair("size", (uint64_t)nSize));
+    obj.push_back(Pair("stakemodifiercache", modifierCache));
+
+    uint64_t nHashHits, nHashMisses;
+    GetBlockHashCacheStats(nHashHits, nHashMisses);
+    UniValue hashCache(UniValue::VOBJ);
+    hashCache.push_back(Pair("hits", nHashHits));
+    hashCache.push_back(Pair("misses", nHashMisses));
+    obj.push_back(Pair("blockhashcache", hashCache));
+
+    uint64_t nReused, nUpdated, nRebuilt;
+    GetBlockTxSelectionStats(nReused, nUpdated, nRebuilt);
+    UniValue templateCache(UniValue::VOBJ);
+    templateCache.push_back(Pair("reused", nReused));
+    templateCache.push_back(Pair("updated", nUpdated));
+    templateCache.push_back(Pair("rebuilt", nRebuilt));
+    obj.push_back(Pair("templatecache", templateCache));
 #ifdef ENABLE_WALLET
     obj.push_back(Pair("generate", getgenerate(params, false)));
     obj.push_back(Pair("hashespersec", gethashespersec(params, false)));
@@ -282,6 +323,7 @@ UniValue prioritisetransaction(const UniValue& params, bool fHelp)
     CAmount nAmount = params[2].get_int64();
 
     mempool.PrioritiseTransaction(hash, params[0].get_str(), params[1].get_real(), nAmount);
+    InvalidateBlockTxSelection();
     return true;
 }
 
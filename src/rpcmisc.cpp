@@ -10,6 +10,7 @@
 #include "init.h"
 #include "main.h"
 #include "merchantnode-sync.h"
+#include "miner.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpcserver.h"
@@ -152,6 +153,7 @@ UniValue mnsync(const UniValue& params, bool fHelp)
             "  \"countBudgetItemFin\": n,       (numeric) Number of MN budget finalization messages (local)\n"
             "  \"sumCommunityItemProp\": n,        (numeric) Number of MN community messages (total)\n"
             "  \"countCommunityItemProp\": n,      (numeric) Number of MN community messages (local)\n"
+            "  \"countMerchantnodeListDigest\": n, (numeric) Number of peers that answered a MN list digest\n"
             "  \"RequestedMerchantnodeAssets\": n, (numeric) Status code of last sync phase\n"
             "  \"RequestedMerchantnodeAttempt\": n, (numeric) Status code of last sync attempt\n"
             "}\n"
@@ -181,6 +183,7 @@ UniValue mnsync(const UniValue& params, bool fHelp)
         obj.push_back(Pair("countBudgetItemFin", merchantnodeSync.countBudgetItemFin));
         obj.push_back(Pair("sumCommunityItemProp", merchantnodeSync.sumCommunityItemProp));
         obj.push_back(Pair("countCommunityItemProp", merchantnodeSync.countCommunityItemProp));
+        obj.push_back(Pair("countMerchantnodeListDigest", merchantnodeSync.countMerchantnodeListDigest));
         obj.push_back(Pair("RequestedMerchantnodeAssets", merchantnodeSync.RequestedMerchantnodeAssets));
         obj.push_back(Pair("RequestedMerchantnodeAttempt", merchantnodeSync.RequestedMerchantnodeAttempt));
 
@@ -512,6 +515,13 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
             "  \"enoughcoins\": true|false,        (boolean) if available coins are greater than reserve balance\n"
             "  \"mnsync\": true|false,             (boolean) if merchantnode data is synced\n"
             "  \"staking status\": true|false,     (boolean) if the wallet is staking or not\n"
+            "  \"scheduler\": {                    (json object) stake scheduler statistics\n"
+            "    \"attempts\": n,                  (numeric) stake attempts made\n"
+            "    \"tipattempts\": n,               (numeric) first attempts on a newly arrived block\n"
+            "    \"lastlatency\": x.xxx,           (numeric) milliseconds from the last block arriving to staking on it\n"
+            "    \"avglatency\": x.xxx,            (numeric) average of those latencies in milliseconds\n"
+            "    \"maxlatency\": x.xxx             (numeric) largest of those latencies in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getstakingstatus", "") + HelpExampleRpc("getstakingstatus", ""));
@@ -533,6 +543,17 @@ UniValue getstakingstatus(const UniValue& params, bool fHelp)
         nStaking = true;
     obj.push_back(Pair("staking status", nStaking));
 
+    uint64_t nAttempts, nTipAttempts;
+    int64_t nLatencyLast, nLatencyAvg, nLatencyMax;
+    stakeScheduler.GetStats(nAttempts, nTipAttempts, nLatencyLast, nLatencyAvg, nLatencyMax);
+    UniValue scheduler(UniValue::VOBJ);
+    scheduler.push_back(Pair("attempts", nAttempts));
+    scheduler.push_back(Pair("tipattempts", nTipAttempts));
+    scheduler.push_back(Pair("lastlatency", nLatencyLast * 0.001));
+    scheduler.push_back(Pair("avglatency", nLatencyAvg * 0.001));
+    scheduler.push_back(Pair("maxlatency", nLatencyMax * 0.001));
+    obj.push_back(Pair("scheduler", scheduler));
+
     return obj;
 }
 #endif // ENABLE_WALLET
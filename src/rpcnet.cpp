@@ -11,6 +11,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
+#include "relaycache.h"
 #include "sync.h"
 #include "timedata.h"
 #include "util.h"
@@ -91,6 +92,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"timeoffset\": ttt,         (numeric) The time offset in seconds\n"
             "    \"pingtime\": n,             (numeric) ping time\n"
             "    \"pingwait\": n,             (numeric) ping wait\n"
+            "    \"msghandler\": n,           (numeric) The message handler thread serving this peer\n"
+            "    \"msgprocessed\": n,         (numeric) Messages processed from this peer\n"
+            "    \"msgwait\": n,              (numeric) Average seconds a received message waited to be processed\n"
+            "    \"msgwaitmax\": n,           (numeric) Longest wait of a received message in seconds\n"
+            "    \"msgproctime\": n,          (numeric) Average seconds spent processing a message\n"
             "    \"version\": v,              (numeric) The peer version, such as 7001\n"
             "    \"subver\": \"/Artax Core:x.x.x.x/\",  (string) The string version\n"
             "    \"inbound\": true|false,     (boolean) Inbound (true) or Outbound (false)\n"
@@ -131,6 +137,11 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.push_back(Pair("pingtime", stats.dPingTime));
         if (stats.dPingWait > 0.0)
             obj.push_back(Pair("pingwait", stats.dPingWait));
+        obj.push_back(Pair("msghandler", stats.nMsgHandler));
+        obj.push_back(Pair("msgprocessed", stats.nMsgProcessed));
+        obj.push_back(Pair("msgwait", stats.dMsgWait));
+        obj.push_back(Pair("msgwaitmax", stats.dMsgWaitMax));
+        obj.push_back(Pair("msgproctime", stats.dMsgProcessTime));
         obj.push_back(Pair("version", stats.nVersion));
         // Use the sanitized form of subver here, to avoid tricksy remote peers from
         // corrupting or modifiying the JSON output by putting special characters in
@@ -336,7 +347,15 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"relaycache\": {        (json object) Serialized getdata replies kept for merchantnode, budget, spork and SwiftTX objects\n"
+            "    \"entries\": n,        (numeric) Cached messages\n"
+            "    \"bytes\": n,          (numeric) Size of the cached messages\n"
+            "    \"maxbytes\": n,       (numeric) Limit set with -relaycachesize\n"
+            "    \"hits\": n,           (numeric) Replies served from the cache\n"
+            "    \"misses\": n,         (numeric) Replies that had to be serialized\n"
+            "    \"bytessaved\": n      (numeric) Bytes of replies served without serializing them again\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getnettotals", "") + HelpExampleRpc("getnettotals", ""));
@@ -345,6 +364,17 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    CRelayMessageCacheStats stats;
+    relayMessageCache.GetStats(stats);
+    UniValue relaycache(UniValue::VOBJ);
+    relaycache.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    relaycache.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    relaycache.push_back(Pair("maxbytes", (uint64_t)stats.nMaxBytes));
+    relaycache.push_back(Pair("hits", stats.nHits));
+    relaycache.push_back(Pair("misses", stats.nMisses));
+    relaycache.push_back(Pair("bytessaved", stats.nBytesSaved));
+    obj.push_back(Pair("relaycache", relaycache));
     return obj;
 }
 
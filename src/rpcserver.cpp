@@ -249,6 +249,211 @@ UniValue stop(const UniValue& params, bool fHelp)
 }
 
 
+/**
+ * RPC concurrency classes. Thread-safe commands take no global locks and run concurrently on the
+ * RPC threads. All other commands run under cs_main (and pwalletMain->cs_wallet when a wallet is
+ * loaded); they would only serialize on those locks, so they are admitted one at a time through a
+ * FIFO queue and the remaining RPC threads wait there rather than contending with the network
+ * threads for cs_main.
+ */
+enum RPCConcurrencyClass {
+    RPC_CONCURRENT,
+    RPC_CHAINSTATE,
+};
+
+static RPCConcurrencyClass GetConcurrencyClass(const CRPCCommand* pcmd)
+{
+    return pcmd->threadSafe ? RPC_CONCURRENT : RPC_CHAINSTATE;
+}
+
+/** Ticket queue admitting callers in arrival order. */
+class CRPCQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    uint64_t nNextTicket;
+    uint64_t nServing;
+
+public:
+    CRPCQueue() : nNextTicket(0), nServing(0) {}
+
+    void Enter()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        uint64_t nTicket = nNextTicket++;
+        while (nTicket != nServing)
+            cond.wait(lock);
+    }
+
+    void Leave()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nServing++;
+        cond.notify_all();
+    }
+
+    //! Callers waiting or running
+    int Size()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return nNextTicket - nServing;
+    }
+
+    //! Holds a place at the head of the queue for the lifetime of the object
+    class Entry
+    {
+    private:
+        CRPCQueue& queue;
+
+    public:
+        Entry(CRPCQueue& queueIn) : queue(queueIn) { queue.Enter(); }
+        ~Entry() { queue.Leave(); }
+    };
+};
+
+static CRPCQueue rpcQueue;
+
+/** Run a chainstate-class command under the global locks, taken in the usual cs_main, cs_wallet order. */
+static UniValue ExecuteLocked(const CRPCCommand* pcmd, const UniValue& params, int64_t& nExecStart)
+{
+    LOCK(cs_main);
+#ifdef ENABLE_WALLET
+    if (pwalletMain) {
+        LOCK(pwalletMain->cs_wallet);
+        nExecStart = GetTimeMicros();
+        return pcmd->actor(params, false);
+    }
+#endif
+    nExecStart = GetTimeMicros();
+    return pcmd->actor(params, false);
+}
+
+/** Latency histogram with 1-2-5 bucket edges from 1 ms to 5 s, plus an overflow bucket. */
+class CRPCLatencyHistogram
+{
+private:
+    static const int NUM_EDGES = 13;
+    static const int64_t vEdges[NUM_EDGES];
+    uint64_t vCount[NUM_EDGES + 1];
+    int64_t nTotal;
+    int64_t nMax;
+
+public:
+    CRPCLatencyHistogram() : nTotal(0), nMax(0)
+    {
+        std::fill(vCount, vCount + NUM_EDGES + 1, 0);
+    }
+
+    void Add(int64_t nMicros)
+    {
+        vCount[std::upper_bound(vEdges, vEdges + NUM_EDGES, nMicros) - vEdges]++;
+        nTotal += nMicros;
+        nMax = std::max(nMax, nMicros);
+    }
+
+    UniValue ToJSON(uint64_t nCalls) const
+    {
+        UniValue buckets(UniValue::VOBJ);
+        for (int i = 0; i <= NUM_EDGES; i++) {
+            if (vCount[i] == 0)
+                continue;
+            if (i < NUM_EDGES)
+                buckets.push_back(Pair(strprintf("<%gms", vEdges[i] / 1000.0), vCount[i]));
+            else
+                buckets.push_back(Pair(strprintf(">=%gms", vEdges[NUM_EDGES - 1] / 1000.0), vCount[i]));
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("avg_ms", nCalls ? nTotal / 1000.0 / nCalls : 0.0));
+        obj.push_back(Pair("max_ms", nMax / 1000.0));
+        obj.push_back(Pair("histogram", buckets));
+        return obj;
+    }
+};
+
+const int64_t CRPCLatencyHistogram::vEdges[CRPCLatencyHistogram::NUM_EDGES] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000, 10000000};
+
+struct CRPCMethodStats {
+    uint64_t nCalls;
+    uint64_t nErrors;
+    CRPCLatencyHistogram wait; //! time from dispatch until the command's locks were held
+    CRPCLatencyHistogram exec; //! time spent in the command itself
+
+    CRPCMethodStats() : nCalls(0), nErrors(0) {}
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+static void RecordRPCLatency(const std::string& strMethod, int64_t nWait, int64_t nExec, bool fError)
+{
+    LOCK(cs_rpcStats);
+    CRPCMethodStats& stats = mapRPCStats[strMethod];
+    stats.nCalls++;
+    stats.nErrors += fError;
+    stats.wait.Add(nWait);
+    stats.exec.Add(nExec);
+}
+
+UniValue getrpcstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getrpcstats ( \"method\" )\n"
+            "\nReturns per-method RPC latency statistics since startup, split into the time spent waiting\n"
+            "for the dispatch queue and global locks, and the time spent executing.\n"
+            "\nArguments:\n"
+            "1. \"method\"     (string, optional) Only return statistics for this method\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queued\": n,             (numeric) Lock-taking calls currently waiting or running\n"
+            "  \"methods\": {\n"
+            "    \"method\": {\n"
+            "      \"class\": \"xxxx\",     (string) Concurrency class: \"concurrent\" or \"chainstate\"\n"
+            "      \"calls\": n,          (numeric) Number of calls\n"
+            "      \"errors\": n,         (numeric) Number of calls that returned an error\n"
+            "      \"wait\": {            (object) Queue and lock wait\n"
+            "        \"avg_ms\": x.xxx,   (numeric) Average in milliseconds\n"
+            "        \"max_ms\": x.xxx,   (numeric) Maximum in milliseconds\n"
+            "        \"histogram\": { \"<1ms\": n, ... }  (object) Calls per latency bucket\n"
+            "      },\n"
+            "      \"exec\": { ... }      (object) Execution time, same layout as \"wait\"\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") + HelpExampleCli("getrpcstats", "\"getbalance\"") + HelpExampleRpc("getrpcstats", ""));
+
+    string strFilter;
+    if (params.size() > 0)
+        strFilter = params[0].get_str();
+
+    UniValue methods(UniValue::VOBJ);
+    {
+        LOCK(cs_rpcStats);
+        for (std::map<std::string, CRPCMethodStats>::const_iterator it = mapRPCStats.begin(); it != mapRPCStats.end(); ++it) {
+            if (!strFilter.empty() && it->first != strFilter)
+                continue;
+            const CRPCMethodStats& stats = it->second;
+            const CRPCCommand* pcmd = tableRPC[it->first];
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("class", pcmd && GetConcurrencyClass(pcmd) == RPC_CONCURRENT ? "concurrent" : "chainstate"));
+            obj.push_back(Pair("calls", stats.nCalls));
+            obj.push_back(Pair("errors", stats.nErrors));
+            obj.push_back(Pair("wait", stats.wait.ToJSON(stats.nCalls)));
+            obj.push_back(Pair("exec", stats.exec.ToJSON(stats.nCalls)));
+            methods.push_back(Pair(it->first, obj));
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("queued", rpcQueue.Size()));
+    ret.push_back(Pair("methods", methods));
+    return ret;
+}
+
+
 /**
  * Call Table
  */
@@ -260,6 +465,7 @@ static const CRPCCommand vRPCCommands[] =
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
+        {"control", "getrpcstats", &getrpcstats, true, true, false},
 
         /* P2P networking */
         {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
@@ -276,13 +482,13 @@ static const CRPCCommand vRPCCommands[] =
 
         /* Block chain and UTXO */
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
-        {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
-        {"blockchain", "getblockcount", &getblockcount, true, false, false},
+        {"blockchain", "getbestblockhash", &getbestblockhash, true, true, false},
+        {"blockchain", "getblockcount", &getblockcount, true, true, false},
         {"blockchain", "getblock", &getblock, true, false, false},
-        {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblockhash", &getblockhash, true, true, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
-        {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
+        {"blockchain", "getdifficulty", &getdifficulty, true, true, false},
         {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
@@ -382,6 +588,7 @@ static const CRPCCommand vRPCCommands[] =
         {"wallet", "getreceivedbyaddress", &getreceivedbyaddress, false, false, true},
         {"wallet", "getstakingstatus", &getstakingstatus, false, false, true},
         {"wallet", "getstakesplitthreshold", &getstakesplitthreshold, false, false, true},
+        {"wallet", "getstakeforecast", &getstakeforecast, false, true, true},
         {"wallet", "gettransaction", &gettransaction, false, false, true},
         {"wallet", "getunconfirmedbalance", &getunconfirmedbalance, false, false, true},
         {"wallet", "getwalletinfo", &getwalletinfo, false, false, true},
@@ -1022,44 +1229,26 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    int64_t nStart = GetTimeMicros();
+    int64_t nExecStart = nStart;
+    bool fError = true;
     try {
         // Execute
         UniValue result;
-        {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
-#ifdef ENABLE_WALLET
-            else if (!pwalletMain) {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            } else {
-                while (true) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (!lockMain) {
-                        MilliSleep(50);
-                        continue;
-                    }
-                    while (true) {
-                        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
-                            MilliSleep(50);
-                            continue;
-                        }
-                        result = pcmd->actor(params, false);
-                        break;
-                    }
-                    break;
-                }
-            }
-#else  // ENABLE_WALLET
-            else {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            }
-#endif // !ENABLE_WALLET
+        if (GetConcurrencyClass(pcmd) == RPC_CONCURRENT) {
+            result = pcmd->actor(params, false);
+        } else {
+            CRPCQueue::Entry entry(rpcQueue);
+            result = ExecuteLocked(pcmd, params, nExecStart);
         }
+        fError = false;
+        RecordRPCLatency(strMethod, nExecStart - nStart, GetTimeMicros() - nExecStart, fError);
         return result;
+    } catch (const UniValue& objError) {
+        RecordRPCLatency(strMethod, nExecStart - nStart, GetTimeMicros() - nExecStart, fError);
+        throw;
     } catch (std::exception& e) {
+        RecordRPCLatency(strMethod, nExecStart - nStart, GetTimeMicros() - nExecStart, fError);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 }
@@ -12,6 +12,7 @@
 #include "init.h"
 #include "net.h"
 #include "netbase.h"
+#include "pow.h"
 #include "rpcserver.h"
 #include "timedata.h"
 #include "util.h"
@@ -2152,6 +2153,88 @@ UniValue getstakesplitthreshold(const UniValue& params, bool fHelp)
     return int(pwalletMain->nStakeSplitThreshold);
 }
 
+UniValue getstakeforecast(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getstakeforecast ( seconds )\n"
+            "\nHash the wallet's stake set ahead over the next timestamps at the current difficulty, the way the\n"
+            "stake miner will once they are reachable, and estimate the expected time to stake.\n"
+            "\nArguments:\n"
+            "1. seconds        (numeric, optional, default=" + strprintf("%d", MAX_STAKE_FUTURE_DRIFT) + ") timestamps to look ahead, at most the future drift limit\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"inputs\": n,                 (numeric) stakeable inputs simulated\n"
+            "  \"weight\": x.xxx,             (numeric) their total value in XAX\n"
+            "  \"bits\": \"xxxxxxxx\",          (string) difficulty the next block needs\n"
+            "  \"from\": ttt,                 (numeric) first timestamp simulated\n"
+            "  \"to\": ttt,                   (numeric) last timestamp simulated\n"
+            "  \"hashes\": n,                 (numeric) kernel hashes computed\n"
+            "  \"kernels\": n,                (numeric) input and timestamp pairs meeting the target\n"
+            "  \"nextkernel\": ttt,           (numeric, optional) earliest timestamp with a kernel, if any\n"
+            "  \"nextkernelin\": n,           (numeric, optional) seconds from now until that timestamp\n"
+            "  \"kernelspersecond\": x.xxx,   (numeric) expected kernels per second at this difficulty\n"
+            "  \"expectedtimetostake\": n,    (numeric) expected seconds until the set stakes, -1 if it can't\n"
+            "  \"elapsed\": n                 (numeric) milliseconds the simulation took\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getstakeforecast", "") + HelpExampleCli("getstakeforecast", "60") + HelpExampleRpc("getstakeforecast", "60"));
+
+    int64_t nSeconds = MAX_STAKE_FUTURE_DRIFT;
+    if (params.size() > 0)
+        nSeconds = params[0].get_int64();
+    if (nSeconds < 1 || nSeconds > MAX_STAKE_FUTURE_DRIFT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("seconds must be between 1 and %d", MAX_STAKE_FUTURE_DRIFT));
+
+    // Take a snapshot of the stake set under the locks, then hash without them
+    std::vector<CStakeKernelInput> vInputs;
+    CBlockHeader header;
+    int64_t nNow;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        if (chainActive.Tip()->nHeight < Params().LAST_POW_BLOCK())
+            throw JSONRPCError(RPC_MISC_ERROR, "Proof-of-stake has not started yet");
+
+        CAmount nBalance = pwalletMain->GetBalance();
+        if (nBalance > nReserveBalance) {
+            std::set<std::pair<const CWalletTx*, unsigned int> > setStakeCoins;
+            std::vector<const std::pair<const CWalletTx*, unsigned int>*> vCoins;
+            pwalletMain->SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance);
+            pwalletMain->GetStakeKernelInputs(setStakeCoins, vInputs, vCoins);
+        }
+
+        nNow = GetAdjustedTime();
+        header.nTime = nNow;
+        header.nBits = GetNextWorkRequired(chainActive.Tip(), &header);
+        nNow = std::max(nNow, chainActive.Tip()->GetBlockTime());
+    }
+
+    CStakeForecast forecast;
+    int64_t nStart = GetTimeMillis();
+    ForecastStakeKernels(header.nBits, vInputs, nNow + 1, nNow + nSeconds, GetArg("-stakethreads", DEFAULT_STAKE_THREADS), forecast);
+
+    CAmount nWeight = 0;
+    for (const CStakeKernelInput& input : vInputs)
+        nWeight += input.nValueIn;
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("inputs", (uint64_t)vInputs.size()));
+    obj.push_back(Pair("weight", ValueFromAmount(nWeight)));
+    obj.push_back(Pair("bits", strprintf("%08x", header.nBits)));
+    obj.push_back(Pair("from", (int64_t)forecast.nTimeFirst));
+    obj.push_back(Pair("to", (int64_t)forecast.nTimeLast));
+    obj.push_back(Pair("hashes", forecast.nHashes));
+    obj.push_back(Pair("kernels", forecast.nKernels));
+    if (forecast.nTimeKernel != 0) {
+        obj.push_back(Pair("nextkernel", (int64_t)forecast.nTimeKernel));
+        obj.push_back(Pair("nextkernelin", (int64_t)forecast.nTimeKernel - GetAdjustedTime()));
+    }
+    obj.push_back(Pair("kernelspersecond", forecast.dKernelsPerSecond));
+    obj.push_back(Pair("expectedtimetostake", (int64_t)forecast.ExpectedTimeToStake()));
+    obj.push_back(Pair("elapsed", GetTimeMillis() - nStart));
+    return obj;
+}
+
 UniValue autocombinerewards(const UniValue& params, bool fHelp)
 {
     bool fEnable;
@@ -0,0 +1,196 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketpoller.h"
+
+#include "netbase.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+/** select() backend: the interest set is rebuilt from the Watch calls of every round */
+class CSelectSocketPoller : public CSocketPoller
+{
+private:
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    SOCKET hSocketMax;
+    std::vector<std::pair<SOCKET, uint64_t> > vWatched;
+
+    void Clear()
+    {
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        hSocketMax = 0;
+        vWatched.clear();
+    }
+
+public:
+    CSelectSocketPoller()
+    {
+        Clear();
+    }
+
+    void Watch(SOCKET hSocket, uint64_t nToken, int nEvents, int& nPollState)
+    {
+#ifndef WIN32
+        // The network code does not hand such sockets to a select() poller (IsPollableSocket)
+        if (hSocket >= FD_SETSIZE) {
+            LogPrintf("socket %d can not be waited on with select()\n", hSocket);
+            return;
+        }
+#endif
+        FD_SET(hSocket, &fdsetError);
+        if (nEvents & POLL_RECV)
+            FD_SET(hSocket, &fdsetRecv);
+        if (nEvents & POLL_SEND)
+            FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        vWatched.push_back(std::make_pair(hSocket, nToken));
+        nPollState = POLL_REGISTERED | nEvents;
+    }
+
+    bool Wait(int nTimeoutMs, std::vector<CSocketEvent>& vEvents)
+    {
+        vEvents.clear();
+        struct timeval timeout = MillisToTimeval(nTimeoutMs);
+        bool fHaveFds = !vWatched.empty();
+        int nSelect = select(fHaveFds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        bool fResult = true;
+        if (nSelect == SOCKET_ERROR) {
+            if (fHaveFds) {
+                LogPrintf("socket select error %s\n", NetworkErrorString(WSAGetLastError()));
+                // Let the caller try every socket so that the broken one gets dropped
+                for (size_t i = 0; i < vWatched.size(); i++) {
+                    vEvents.push_back(CSocketEvent(vWatched[i].second));
+                    vEvents.back().fRecv = true;
+                }
+            }
+            MilliSleep(nTimeoutMs);
+            fResult = false;
+        } else if (nSelect > 0) {
+            for (size_t i = 0; i < vWatched.size(); i++) {
+                SOCKET hSocket = vWatched[i].first;
+                CSocketEvent event(vWatched[i].second);
+                event.fRecv = FD_ISSET(hSocket, &fdsetRecv);
+                event.fSend = FD_ISSET(hSocket, &fdsetSend);
+                event.fError = FD_ISSET(hSocket, &fdsetError);
+                if (event.fRecv || event.fSend || event.fError)
+                    vEvents.push_back(event);
+            }
+        }
+        Clear();
+        return fResult;
+    }
+
+    const char* GetName() const
+    {
+        return "select";
+    }
+
+    bool HasSelectLimit() const
+    {
+        return true;
+    }
+};
+
+#ifdef USE_EPOLL
+/** Ready events returned by one epoll_wait; more are picked up by the next round */
+static const int MAX_EPOLL_EVENTS = 1024;
+
+/** epoll backend: registrations persist and are only modified when the interest changes */
+class CEpollSocketPoller : public CSocketPoller
+{
+private:
+    int hEpoll;
+    std::vector<struct epoll_event> vReady;
+
+public:
+    CEpollSocketPoller(int hEpollIn) : hEpoll(hEpollIn), vReady(MAX_EPOLL_EVENTS) {}
+
+    ~CEpollSocketPoller()
+    {
+        close(hEpoll);
+    }
+
+    void Watch(SOCKET hSocket, uint64_t nToken, int nEvents, int& nPollState)
+    {
+        nEvents &= (POLL_RECV | POLL_SEND);
+        if ((nPollState & POLL_REGISTERED) && (nPollState & (POLL_RECV | POLL_SEND)) == nEvents)
+            return;
+
+        struct epoll_event event;
+        event.events = ((nEvents & POLL_RECV) ? (uint32_t)EPOLLIN : 0) | ((nEvents & POLL_SEND) ? (uint32_t)EPOLLOUT : 0);
+        event.data.u64 = nToken;
+        int nOp = (nPollState & POLL_REGISTERED) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        int nRet = epoll_ctl(hEpoll, nOp, hSocket, &event);
+        // The descriptor number was reused after a close, or the registration
+        // went away with the old descriptor: retry with the other operation
+        if (nRet != 0 && (errno == EEXIST || errno == ENOENT))
+            nRet = epoll_ctl(hEpoll, nOp == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, hSocket, &event);
+        if (nRet != 0) {
+            LogPrintf("epoll_ctl failed for socket %d: %s\n", hSocket, NetworkErrorString(errno));
+            nPollState = 0;
+            return;
+        }
+        nPollState = POLL_REGISTERED | nEvents;
+    }
+
+    bool Wait(int nTimeoutMs, std::vector<CSocketEvent>& vEvents)
+    {
+        vEvents.clear();
+        int nReady = epoll_wait(hEpoll, &vReady[0], vReady.size(), nTimeoutMs);
+        if (nReady < 0) {
+            if (errno == EINTR)
+                return true;
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(errno));
+            MilliSleep(nTimeoutMs);
+            return false;
+        }
+        vEvents.reserve(nReady);
+        for (int i = 0; i < nReady; i++) {
+            CSocketEvent event(vReady[i].data.u64);
+            event.fRecv = vReady[i].events & EPOLLIN;
+            event.fSend = vReady[i].events & EPOLLOUT;
+            event.fError = vReady[i].events & (EPOLLERR | EPOLLHUP);
+            vEvents.push_back(event);
+        }
+        return true;
+    }
+
+    const char* GetName() const
+    {
+        return "epoll";
+    }
+
+    bool HasSelectLimit() const
+    {
+        return false;
+    }
+};
+#endif
+}
+
+CSocketPoller* CSocketPoller::Create(bool fSelect)
+{
+#ifdef USE_EPOLL
+    if (!fSelect) {
+        int hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll >= 0)
+            return new CEpollSocketPoller(hEpoll);
+        LogPrintf("epoll_create1 failed: %s, falling back to select()\n", NetworkErrorString(errno));
+    }
+#endif
+    return new CSelectSocketPoller();
+}
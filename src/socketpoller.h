@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETPOLLER_H
+#define BITCOIN_SOCKETPOLLER_H
+
+#include "compat.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** Readiness of one watched socket, as reported by CSocketPoller::Wait */
+struct CSocketEvent {
+    uint64_t nToken;
+    bool fRecv;
+    bool fSend;
+    bool fError;
+
+    CSocketEvent(uint64_t nTokenIn) : nToken(nTokenIn), fRecv(false), fSend(false), fError(false) {}
+};
+
+/**
+ * Waits for the sockets of the network thread to become readable or writable.
+ *
+ * Before every Wait the caller declares, per socket, the events it wants and
+ * hands back the poll state that was stored for the socket the previous round
+ * (0 for a socket never watched). The epoll backend keeps its registrations
+ * between rounds and only issues a system call when that interest changes, so
+ * the kernel work of a round is O(ready sockets) instead of O(connections), and
+ * there is no FD_SETSIZE limit. The caller still declares the interest of every
+ * socket each round, which is a cheap check in user space. The select() backend
+ * rebuilds its fd_sets every round and is used where epoll is not available;
+ * it cannot wait on more than FD_SETSIZE sockets, see HasSelectLimit.
+ *
+ * A socket stays registered with epoll until it is closed; events can
+ * therefore be reported for tokens that were not watched this round, and
+ * callers must ignore tokens they do not know.
+ */
+class CSocketPoller
+{
+public:
+    enum {
+        POLL_RECV = (1 << 0),
+        POLL_SEND = (1 << 1),
+        POLL_REGISTERED = (1 << 2), //! poll state only: the backend knows the socket
+    };
+
+    virtual ~CSocketPoller() {}
+
+    /** Declare interest in nEvents (POLL_RECV | POLL_SEND) for the coming Wait. */
+    virtual void Watch(SOCKET hSocket, uint64_t nToken, int nEvents, int& nPollState) = 0;
+
+    /** Wait up to nTimeoutMs for readiness and return the ready sockets in vEvents. */
+    virtual bool Wait(int nTimeoutMs, std::vector<CSocketEvent>& vEvents) = 0;
+
+    virtual const char* GetName() const = 0;
+
+    /** True for select(): at most FD_SETSIZE sockets, and outside Windows only descriptors below FD_SETSIZE */
+    virtual bool HasSelectLimit() const = 0;
+
+    /** Epoll when compiled in and usable, select() otherwise or when fSelect is set */
+    static CSocketPoller* Create(bool fSelect = false);
+};
+
+#endif // BITCOIN_SOCKETPOLLER_H
@@ -61,6 +61,7 @@ using namespace boost;
 class CSporkMessage;
 class CSporkManager;
 
+extern CCriticalSection cs_mapSporks; // guards mapSporks and mapSporksActive
 extern std::map<uint256, CSporkMessage> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
@@ -43,7 +43,6 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
     if (strCommand == "ix") {
         //LogPrintf("ProcessMessageSwiftTX::ix\n");
-        CDataStream vMsg(vRecv);
         CTransaction tx;
         vRecv >> tx;
 
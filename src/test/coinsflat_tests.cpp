@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflat.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+static CCoins MakeCoins(unsigned int nOutputs, int nHeight)
+{
+    CCoins coins;
+    coins.nHeight = nHeight;
+    coins.nVersion = 1;
+    coins.fCoinStake = nHeight % 2;
+    coins.vout.resize(nOutputs);
+    for (unsigned int n = 0; n < nOutputs; n++) {
+        coins.vout[n].nValue = 1 + n;
+        coins.vout[n].scriptPubKey = CScript() << ToByteVector(GetRandHash());
+    }
+    return coins;
+}
+
+BOOST_AUTO_TEST_SUITE(coinsflat_tests)
+
+BOOST_AUTO_TEST_CASE(coinsflat_transactions)
+{
+    CCoinsFlatCache cache;
+    CCoins coins;
+    bool fHave;
+    uint256 txid = GetRandHash();
+
+    BOOST_CHECK(!cache.GetCoins(txid, coins, fHave));
+
+    CCoins coinsIn = MakeCoins(5, 100);
+    coinsIn.Spend(1);
+    coinsIn.Spend(4);
+    cache.SetCoins(txid, coinsIn);
+    // Trailing spent outputs are not stored, the hole at 1 is
+    BOOST_CHECK_EQUAL(cache.GetSize(), 4U);
+    BOOST_CHECK(cache.GetCoins(txid, coins, fHave));
+    BOOST_CHECK(fHave);
+    BOOST_CHECK(coins == coinsIn);
+
+    CTxOutCoin coin;
+    BOOST_CHECK(cache.GetCoin(COutPoint(txid, 1), coin));
+    BOOST_CHECK(coin.IsSpent());
+    BOOST_CHECK(cache.GetCoin(COutPoint(txid, 2), coin));
+    BOOST_CHECK(coin.out == coinsIn.vout[2]);
+    BOOST_CHECK_EQUAL(coin.nHeight, 100);
+    BOOST_CHECK(!cache.GetCoin(COutPoint(txid, 4), coin));
+
+    // A pruned transaction is remembered as having no outputs
+    coinsIn.Clear();
+    cache.SetCoins(txid, coinsIn);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 1U);
+    BOOST_CHECK(cache.GetCoins(txid, coins, fHave));
+    BOOST_CHECK(!fHave);
+    BOOST_CHECK(coins.IsPruned());
+
+    cache.EraseCoins(txid);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 0U);
+    BOOST_CHECK(!cache.GetCoins(txid, coins, fHave));
+}
+
+BOOST_AUTO_TEST_CASE(coinsflat_random)
+{
+    CCoinsFlatCache cache;
+    std::map<uint256, CCoins> mapExpected;
+    std::vector<uint256> vTxids;
+
+    for (int i = 0; i < 20000; i++) {
+        int nAction = insecure_rand() % 4;
+        if (nAction == 0 && !vTxids.empty()) {
+            const uint256& txid = vTxids[insecure_rand() % vTxids.size()];
+            cache.EraseCoins(txid);
+            mapExpected.erase(txid);
+        } else if (nAction == 1 && !vTxids.empty()) {
+            const uint256& txid = vTxids[insecure_rand() % vTxids.size()];
+            CCoins coins = MakeCoins(1 + insecure_rand() % 8, i);
+            for (unsigned int n = 0; n < coins.vout.size(); n++)
+                if (insecure_rand() % 3 == 0)
+                    coins.Spend(n);
+            cache.SetCoins(txid, coins);
+            mapExpected[txid] = coins;
+        } else {
+            uint256 txid = GetRandHash();
+            CCoins coins = MakeCoins(1 + insecure_rand() % 8, i);
+            cache.SetCoins(txid, coins);
+            mapExpected[txid] = coins;
+            vTxids.push_back(txid);
+        }
+    }
+
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > cache.GetSize() * sizeof(COutPoint));
+    for (size_t i = 0; i < vTxids.size(); i++) {
+        CCoins coins;
+        bool fHave;
+        std::map<uint256, CCoins>::const_iterator it = mapExpected.find(vTxids[i]);
+        if (it == mapExpected.end()) {
+            BOOST_CHECK(!cache.GetCoins(vTxids[i], coins, fHave));
+            continue;
+        }
+        BOOST_CHECK(cache.GetCoins(vTxids[i], coins, fHave));
+        BOOST_CHECK_EQUAL(fHave, !it->second.IsPruned());
+        if (fHave)
+            BOOST_CHECK(coins == it->second);
+    }
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,178 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflush.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Base view whose writes block until released, to keep a background write in flight */
+class CCoinsViewSlow : public CCoinsView
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::map<uint256, CCoins> mapCoins;
+    uint256 hashBestBlock;
+    bool fBlocked;
+    bool fFail;
+
+public:
+    CCoinsViewSlow() : hashBestBlock(0), fBlocked(false), fFail(false) {}
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::map<uint256, CCoins>::const_iterator it = mapCoins.find(txid);
+        if (it == mapCoins.end() || it->second.IsPruned())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        CCoins coins;
+        return GetCoins(txid, coins);
+    }
+
+    uint256 GetBestBlock() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return hashBestBlock;
+    }
+
+    bool BatchWrite(CCoinsMap& mapWrite, const uint256& hashBlock)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fBlocked)
+            cond.wait(lock);
+        if (fFail)
+            return false;
+        for (CCoinsMap::iterator it = mapWrite.begin(); it != mapWrite.end(); it++)
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                mapCoins[it->first] = it->second.coins;
+        mapWrite.clear();
+        hashBestBlock = hashBlock;
+        return true;
+    }
+
+    void SetBlocked(bool fBlockedIn)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fBlocked = fBlockedIn;
+        }
+        cond.notify_all();
+    }
+
+    void SetFail(bool fFailIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fFail = fFailIn;
+    }
+
+    bool HasWritten(const uint256& txid) const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return mapCoins.count(txid);
+    }
+};
+
+CCoins MakeCoins(int nHeight)
+{
+    CCoins coins;
+    coins.nHeight = nHeight;
+    coins.nVersion = 1;
+    coins.vout.resize(2);
+    coins.vout[0].nValue = 1;
+    coins.vout[1].nValue = 2;
+    return coins;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(coinsflush_tests)
+
+BOOST_AUTO_TEST_CASE(coinsflush_reads_during_write)
+{
+    CCoinsViewSlow base;
+    CCoinsViewBackgroundFlush flusher(&base, true);
+    CCoinsViewCache tip(&flusher);
+
+    uint256 txid1 = GetRandHash();
+    uint256 block1 = GetRandHash();
+    *tip.ModifyCoins(txid1) = MakeCoins(1);
+    tip.SetBestBlock(block1);
+
+    base.SetBlocked(true);
+    BOOST_CHECK(tip.Flush());
+
+    // The write is held up, but the flushed state is visible through the layer
+    CCoins coins;
+    BOOST_CHECK(!base.HasWritten(txid1));
+    BOOST_CHECK(flusher.GetCoins(txid1, coins));
+    BOOST_CHECK(coins == MakeCoins(1));
+    BOOST_CHECK(flusher.HaveCoins(txid1));
+    BOOST_CHECK(flusher.GetBestBlock() == block1);
+    BOOST_CHECK(tip.AccessCoins(txid1) != NULL);
+
+    // Spend an output and flush again; that has to wait for the first write
+    tip.ModifyCoins(txid1)->Spend(0);
+    uint256 block2 = GetRandHash();
+    tip.SetBestBlock(block2);
+    base.SetBlocked(false);
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK(flusher.Wait());
+
+    BOOST_CHECK(base.GetCoins(txid1, coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+    BOOST_CHECK(base.GetBestBlock() == block2);
+
+    CCoinsFlushStats stats;
+    flusher.GetFlushStats(stats);
+    BOOST_CHECK_EQUAL(stats.nFlushes, 2U);
+    BOOST_CHECK(!stats.fWriting);
+    BOOST_CHECK_EQUAL(stats.nPendingEntries, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coinsflush_write_failure)
+{
+    CCoinsViewSlow base;
+    CCoinsViewBackgroundFlush flusher(&base, true);
+    CCoinsViewCache tip(&flusher);
+
+    uint256 txid = GetRandHash();
+    *tip.ModifyCoins(txid) = MakeCoins(1);
+    tip.SetBestBlock(GetRandHash());
+    base.SetFail(true);
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK(!flusher.Wait());
+
+    // The failed snapshot is still served, and later flushes report the failure
+    CCoins coins;
+    BOOST_CHECK(flusher.GetCoins(txid, coins));
+    *tip.ModifyCoins(GetRandHash()) = MakeCoins(2);
+    BOOST_CHECK(!tip.Flush());
+}
+
+BOOST_AUTO_TEST_CASE(coinsflush_synchronous)
+{
+    CCoinsViewSlow base;
+    CCoinsViewBackgroundFlush flusher(&base, false);
+    CCoinsViewCache tip(&flusher);
+
+    uint256 txid = GetRandHash();
+    *tip.ModifyCoins(txid) = MakeCoins(1);
+    tip.SetBestBlock(GetRandHash());
+    BOOST_CHECK(tip.Flush());
+    BOOST_CHECK(base.HasWritten(txid));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/rfc6979_hmac_sha256.h"
+#include "crypto/quark.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -52,6 +53,7 @@ void TestSHA1(const std::string &in, const std::string &hexout) { TestVector(CSH
 void TestSHA256(const std::string &in, const std::string &hexout) { TestVector(CSHA256(), in, ParseHex(hexout));}
 void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
 void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
+void TestQuark(const std::string &in, const std::string &hexout) { TestVector(CQuarkHasher(), in, ParseHex(hexout));}
 
 void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
     std::vector<unsigned char> key = ParseHex(hexkey);
@@ -131,6 +133,78 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_batch)
+{
+    static const size_t lens[] = {32, 52, 55, 56, 64, 80, 119, 128};
+    // Every backend combination, so both the multi-buffer lanes and the leftovers get covered
+    for (int nBackends = 0; nBackends <= SHA256_BACKEND_ALL; nBackends++) {
+        SHA256AutoDetect(nBackends);
+        for (unsigned int i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            size_t len = lens[i];
+            size_t count = 1 + insecure_rand() % 20;
+            std::vector<unsigned char> in(len * count);
+            for (unsigned int j = 0; j < in.size(); j++)
+                in[j] = insecure_rand();
+            std::vector<unsigned char> out(32 * count);
+            SHA256DBatch(&out[0], &in[0], len, count);
+            for (unsigned int j = 0; j < count; j++) {
+                unsigned char hash[CSHA256::OUTPUT_SIZE];
+                CSHA256().Write(&in[j * len], len).Finalize(hash);
+                CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+                BOOST_CHECK(std::vector<unsigned char>(hash, hash + sizeof(hash)) == std::vector<unsigned char>(&out[32 * j], &out[32 * (j + 1)]));
+            }
+        }
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(quark_testvectors) {
+    for (int nBackends = 0; nBackends <= QUARK_BACKEND_ALL; nBackends++) {
+        QuarkAutoDetect(nBackends);
+        TestQuark("", "0800f13b5af35b8363864de22b7bedeca369e2a7c6c77b4f69441cb03a517d9c");
+        TestQuark("abc", "a54b64292dd6aade02bea66228cd721e637cd5a2c1c7dee320b08ae60349d9d0");
+        TestQuark("The quick brown fox jumps over the lazy dog",
+                  "70ecce6fe9c9e2041cc90324a570b9ed1329c7ebe9397c5cef3de815c46113a5");
+        TestQuark("0123456789012345678901234567890123456789012345678901234567890123"
+                  "4567890123456789012345678901234567890123456789012345678901234567890123456789",
+                  "357e3f6a1445feb362ac46668a72005bfb5bb20e6935d1e2716225361a44eed9");
+    }
+    QuarkAutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(quark_batch)
+{
+    static const size_t lens[] = {0, 4, 32, 64, 80, 128};
+    for (int nBackends = 0; nBackends <= QUARK_BACKEND_ALL; nBackends++) {
+        QuarkAutoDetect(nBackends);
+        for (unsigned int i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            // Enough messages to span more than one internal batch
+            size_t len = lens[i];
+            size_t count = 1 + insecure_rand() % 100;
+            std::vector<unsigned char> prefix(insecure_rand() % 100);
+            for (unsigned int j = 0; j < prefix.size(); j++)
+                prefix[j] = insecure_rand();
+            std::vector<unsigned char> in(len * count + 1);
+            for (unsigned int j = 0; j < in.size(); j++)
+                in[j] = insecure_rand();
+            std::vector<unsigned char> out(32 * count), outTails(32 * count);
+            QuarkHashBatch(&out[0], &in[0], len, count);
+            CQuarkHasher hasher;
+            if (!prefix.empty())
+                hasher.Write(&prefix[0], prefix.size());
+            hasher.FinalizeTails(&outTails[0], &in[0], len, count);
+            for (unsigned int j = 0; j < count; j++) {
+                unsigned char hash[CQuarkHasher::OUTPUT_SIZE];
+                CQuarkHasher().Write(&in[j * len], len).Finalize(hash);
+                BOOST_CHECK(std::vector<unsigned char>(hash, hash + sizeof(hash)) == std::vector<unsigned char>(&out[32 * j], &out[32 * (j + 1)]));
+                CQuarkHasher(hasher).Write(&in[j * len], len).Finalize(hash);
+                BOOST_CHECK(std::vector<unsigned char>(hash, hash + sizeof(hash)) == std::vector<unsigned char>(&outTails[32 * j], &outTails[32 * (j + 1)]));
+            }
+        }
+    }
+    QuarkAutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
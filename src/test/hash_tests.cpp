@@ -2,12 +2,17 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
+#include "crypto/quark.h"
 #include "hash.h"
+#include "primitives/block.h"
 #include "utilstrencodings.h"
 
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -46,4 +51,80 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(block_header_hash_cache)
+{
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    uint64_t nHits, nMisses, nHitsBefore, nMissesBefore;
+    GetBlockHashCacheStats(nHitsBefore, nMissesBefore);
+    header.nNonce++;
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(hash == HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+    BOOST_CHECK(header.GetHash() == hash);
+    GetBlockHashCacheStats(nHits, nMisses);
+    BOOST_CHECK_EQUAL(nMisses - nMissesBefore, 1U);
+    BOOST_CHECK_EQUAL(nHits - nHitsBefore, 1U);
+
+    // Copies keep the cached hash, changed fields are noticed
+    CBlock block(header);
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == hash);
+    block.nTime++;
+    BOOST_CHECK(block.GetHash() == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+    BOOST_CHECK(block.GetHash() != hash);
+    block.nTime--;
+    BOOST_CHECK(block.GetHash() == hash);
+    header.SetNull();
+    BOOST_CHECK(header.GetHash() == HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+}
+
+static void HashSharedHeader(const CBlockHeader* pheader, uint256 hashExpected, int* pnBad)
+{
+    for (int i = 0; i < 200; i++) {
+        CBlockHeader copy(*pheader);
+        if (pheader->GetHash() != hashExpected || copy.GetHash() != hashExpected)
+            (*pnBad)++;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_header_hash_cache_threads)
+{
+    // One header hashed and copied from several threads, starting with an empty cache
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    header.nNonce++;
+    const uint256 hashExpected = HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+    CBlockHeader shared;
+    shared.nVersion = header.nVersion;
+    shared.hashPrevBlock = header.hashPrevBlock;
+    shared.hashMerkleRoot = header.hashMerkleRoot;
+    shared.nTime = header.nTime;
+    shared.nBits = header.nBits;
+    shared.nNonce = header.nNonce;
+
+    boost::thread_group threads;
+    std::vector<int> vBad(4, 0);
+    for (unsigned int i = 0; i < vBad.size(); i++)
+        threads.create_thread(boost::bind(&HashSharedHeader, &shared, hashExpected, &vBad[i]));
+    threads.join_all();
+    for (unsigned int i = 0; i < vBad.size(); i++)
+        BOOST_CHECK_EQUAL(vBad[i], 0);
+}
+
+BOOST_AUTO_TEST_CASE(block_header_hasher)
+{
+    // A nonce window around the genesis nonce must contain the genesis hash
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    const uint32_t nNonce = header.nNonce;
+    for (int nBackends = 0; nBackends <= QUARK_BACKEND_ALL; nBackends++) {
+        QuarkAutoDetect(nBackends);
+        std::vector<uint256> vHashes(100);
+        CBlockHeaderHasher(header).GetHashes(nNonce - 50, vHashes.size(), &vHashes[0]);
+        BOOST_CHECK(vHashes[50] == Params().HashGenesisBlock());
+        for (unsigned int i = 0; i < vHashes.size(); i += 7) {
+            header.nNonce = nNonce - 50 + i;
+            BOOST_CHECK(vHashes[i] == header.GetHash());
+        }
+        header.nNonce = nNonce;
+    }
+    QuarkAutoDetect();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
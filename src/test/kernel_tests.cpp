@@ -0,0 +1,121 @@
+// Copyright (c) 2017-2018 The Artax developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernel.h"
+#include "random.h"
+
+#include <cmath>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+BOOST_AUTO_TEST_CASE(stake_kernel_hasher)
+{
+    for (int i = 0; i < 32; i++) {
+        uint64_t nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        unsigned int nTimeBlockFrom = 1500000000 + GetRand(100000000);
+        COutPoint prevout(GetRandHash(), GetRand(100));
+
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier;
+        CStakeKernelHasher hasher(nStakeModifier, nTimeBlockFrom, prevout);
+
+        // the cached prefix must not be consumed by GetHash()
+        for (unsigned int nTimeTx = nTimeBlockFrom; nTimeTx < nTimeBlockFrom + 8; nTimeTx++)
+            BOOST_CHECK(hasher.GetHash(nTimeTx) == stakeHash(nTimeTx, ss, prevout.n, prevout.hash, nTimeBlockFrom));
+
+        // batches of any size, including partial multi-buffer lanes
+        unsigned int nCount = 1 + GetRand(40);
+        std::vector<uint256> vHashes(nCount);
+        hasher.GetHashes(nTimeBlockFrom + nCount, nCount, vHashes.data());
+        for (unsigned int j = 0; j < nCount; j++)
+            BOOST_CHECK(vHashes[j] == hasher.GetHash(nTimeBlockFrom + nCount - j));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_forecast)
+{
+    // About one kernel in 40 hashes for 100 XAX inputs
+    const unsigned int nBits = 0x1d00ffff;
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+
+    std::vector<CStakeKernelInput> vInputs(50);
+    for (size_t i = 0; i < vInputs.size(); i++) {
+        vInputs[i].nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+        vInputs[i].nTimeBlockFrom = 1500000000 + i;
+        vInputs[i].prevout = COutPoint(GetRandHash(), i % 4);
+        vInputs[i].nValueIn = 100 * COIN;
+    }
+    const unsigned int nTimeFirst = 1600000001, nTimeLast = 1600000180;
+
+    uint64_t nKernels = 0;
+    unsigned int nTimeKernel = 0;
+    size_t nInputKernel = 0;
+    for (unsigned int nTime = nTimeLast; nTime >= nTimeFirst; nTime--) {
+        for (size_t i = 0; i < vInputs.size(); i++) {
+            CStakeKernelHasher hasher(vInputs[i].nStakeModifier, vInputs[i].nTimeBlockFrom, vInputs[i].prevout);
+            if (stakeTargetHit(hasher.GetHash(nTime), vInputs[i].nValueIn, bnTargetPerCoinDay)) {
+                nKernels++;
+                if (nTimeKernel != nTime) {
+                    nTimeKernel = nTime;
+                    nInputKernel = i;
+                }
+            }
+        }
+    }
+    BOOST_CHECK(nKernels > 0);
+
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        CStakeForecast forecast;
+        ForecastStakeKernels(nBits, vInputs, nTimeFirst, nTimeLast, nThreads, forecast);
+        BOOST_CHECK_EQUAL(forecast.nHashes, vInputs.size() * 180);
+        BOOST_CHECK_EQUAL(forecast.nKernels, nKernels);
+        BOOST_CHECK_EQUAL(forecast.nTimeKernel, nTimeKernel);
+        BOOST_CHECK_EQUAL(forecast.nInputKernel, nInputKernel);
+        // 50 inputs x 1e8 weight x 0xffff * 2^208 / 2^256
+        BOOST_CHECK_CLOSE(forecast.dKernelsPerSecond, 50 * 1e8 * 65535 / std::ldexp(1.0, 48), 0.01);
+        BOOST_CHECK(forecast.ExpectedTimeToStake() > 0);
+    }
+
+    // Without inputs there is nothing to stake
+    CStakeForecast forecast;
+    ForecastStakeKernels(nBits, std::vector<CStakeKernelInput>(), nTimeFirst, nTimeLast, 1, forecast);
+    BOOST_CHECK_EQUAL(forecast.nKernels, 0U);
+    BOOST_CHECK_EQUAL(forecast.ExpectedTimeToStake(), -1);
+}
+
+BOOST_AUTO_TEST_CASE(stake_search_time_order)
+{
+    // About every other hash hits a target this easy
+    const unsigned int nBits = 0x207fffff;
+    const unsigned int nTimeTx = 1600000000, nHashDrift = 60;
+
+    std::vector<CStakeKernelInput> vInputs(1);
+    vInputs[0].nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+    vInputs[0].prevout = COutPoint(GetRandHash(), 0);
+    vInputs[0].nValueIn = 100;
+
+    // No timestamp in the window is at or after the block staked from
+    vInputs[0].nTimeBlockFrom = nTimeTx + nHashDrift + 1;
+    for (int nThreads = 1; nThreads <= 2; nThreads++) {
+        unsigned int nTimeFound = nTimeTx;
+        size_t nInput;
+        uint256 hashProofOfStake;
+        BOOST_CHECK(!SearchStakeKernel(nBits, vInputs, NULL, nTimeFound, nHashDrift, nThreads, nInput, hashProofOfStake));
+    }
+
+    // Only the later part of the window may be used
+    vInputs[0].nTimeBlockFrom = nTimeTx + nHashDrift - 20;
+    unsigned int nTimeFound = nTimeTx;
+    size_t nInput;
+    uint256 hashProofOfStake;
+    BOOST_REQUIRE(SearchStakeKernel(nBits, vInputs, NULL, nTimeFound, nHashDrift, 1, nInput, hashProofOfStake));
+    BOOST_CHECK(nTimeFound >= vInputs[0].nTimeBlockFrom);
+    CStakeKernelHasher hasher(vInputs[0].nStakeModifier, vInputs[0].nTimeBlockFrom, vInputs[0].prevout);
+    BOOST_CHECK(hasher.GetHash(nTimeFound) == hashProofOfStake);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
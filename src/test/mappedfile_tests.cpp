@@ -0,0 +1,141 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "mappedfile.h"
+#include "random.h"
+#include "serialize.h"
+#include "streams.h"
+#include "util.h"
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+static void AppendToFile(const boost::filesystem::path& path, const std::vector<char>& vch)
+{
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE_EQUAL(fwrite(&vch[0], 1, vch.size(), file), vch.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_SUITE(mappedfile_tests)
+
+BOOST_AUTO_TEST_CASE(memory_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << (uint32_t)0x01020304 << std::string("artax") << (uint64_t)42;
+    std::vector<char> vch(ss.begin(), ss.end());
+
+    CMemoryReader reader(&vch[0], &vch[0] + vch.size(), SER_DISK, 0);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "artax");
+    BOOST_CHECK_EQUAL(reader.tell(), 10U);
+    BOOST_CHECK_EQUAL(reader.size(), 8U);
+    reader.ignore(4);
+    BOOST_CHECK_THROW(reader >> n >> n, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(mapped_file_cache)
+{
+    boost::filesystem::path dir = GetTempPath() / strprintf("test_artax_mappedfile_%lu", (unsigned long)GetRand(1 << 30));
+    boost::filesystem::create_directories(dir);
+    boost::filesystem::path path1 = dir / "blk00000.dat";
+    boost::filesystem::path path2 = dir / "blk00001.dat";
+    AppendToFile(path1, std::vector<char>(100, 'a'));
+    AppendToFile(path2, std::vector<char>(100, 'b'));
+
+    CMappedFileCache cache(1);
+    CMappedFileRef file = cache.Get(path1, 100);
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(file->size(), 100U);
+    BOOST_CHECK_EQUAL(file->data()[99], 'a');
+    BOOST_CHECK(cache.Get(path1, 50) == file);
+
+    // Reading past the end maps the file again once it has grown
+    BOOST_CHECK(!cache.Get(path1, 150));
+    AppendToFile(path1, std::vector<char>(100, 'c'));
+    CMappedFileRef fileGrown = cache.Get(path1, 150);
+    BOOST_REQUIRE(fileGrown);
+    BOOST_CHECK_EQUAL(fileGrown->size(), 200U);
+    BOOST_CHECK_EQUAL(fileGrown->data()[150], 'c');
+    // The old mapping stays usable while it is held
+    BOOST_CHECK_EQUAL(file->data()[0], 'a');
+
+    // Only one mapping is kept
+    BOOST_CHECK(cache.Get(path2, 100));
+    CMappedFileCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMappings, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMaps, 3U);
+
+    // A file that shrank is not read through its old mapping
+    CMappedFileRef fileLong = cache.Get(path2, 100);
+    FILE* file2 = fopen(path2.string().c_str(), "rb+");
+    BOOST_REQUIRE(file2 != NULL);
+    BOOST_CHECK(TruncateFile(file2, 60));
+    fclose(file2);
+    BOOST_CHECK(!cache.Get(path2, 100));
+    CMappedFileRef fileShort = cache.Get(path2, 50);
+    BOOST_REQUIRE(fileShort);
+    BOOST_CHECK(fileShort != fileLong);
+    BOOST_CHECK_EQUAL(fileShort->size(), 60U);
+    cache.Erase(path2);
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMappings, 0U);
+
+    cache.SetMaxFiles(0);
+    BOOST_CHECK(!cache.Get(path2, 100));
+    BOOST_CHECK(!cache.Get(dir / "blk00002.dat", 0));
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(read_block_mapped_and_fallback)
+{
+    // A block file of its own, next to the ones of the test chain
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(1000, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+
+    CMappedFileCacheStats statsBefore, stats;
+    mappedBlockFiles.GetStats(statsBefore);
+    CBlock blockMapped;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockMapped, pos));
+    mappedBlockFiles.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nMaps, statsBefore.nMaps + 1);
+    BOOST_CHECK(blockMapped.GetHash() == block.GetHash());
+    BOOST_CHECK(blockMapped.vtx == block.vtx);
+
+    mappedBlockFiles.SetMaxFiles(0);
+    CBlock blockRead;
+    BOOST_REQUIRE(ReadBlockFromDisk(blockRead, pos));
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRead.vtx == block.vtx);
+
+    // Cutting the file short under a cached mapping fails both paths cleanly
+    mappedBlockFiles.SetMaxFiles(DEFAULT_BLOCK_FILE_MAPS);
+    BOOST_REQUIRE(ReadBlockFromDisk(blockMapped, pos));
+    FILE* file = OpenBlockFile(CDiskBlockPos(pos.nFile, 0));
+    BOOST_REQUIRE(file != NULL);
+    BOOST_CHECK(TruncateFile(file, pos.nPos + 40));
+    fclose(file);
+    BOOST_CHECK(!ReadBlockFromDisk(blockMapped, pos));
+    mappedBlockFiles.SetMaxFiles(0);
+    BOOST_CHECK(!ReadBlockFromDisk(blockRead, pos));
+
+    mappedBlockFiles.SetMaxFiles(DEFAULT_BLOCK_FILE_MAPS);
+    boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
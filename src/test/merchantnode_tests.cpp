@@ -0,0 +1,442 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "merchantnode.h"
+#include "merchantnode-sync.h"
+#include "merchantnodeman.h"
+#include "protocol.h"
+#include "random.h"
+#include "relaycache.h"
+#include "spork.h"
+#include "streams.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(merchantnode_tests)
+
+static CMerchantnodeBroadcast DeserializeBroadcast(const CSerializedNetMsgRef& msg)
+{
+    CDataStream ss(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMerchantnodeBroadcast mnb;
+    ss >> mnb;
+    return mnb;
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_seen_broadcast_ping_update)
+{
+    CMerchantnodeMan man;
+    CMerchantnodeBroadcast mnb;
+    mnb.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mnb.sigTime = 1500000000;
+    mnb.lastPing.vin = mnb.vin;
+    mnb.lastPing.sigTime = mnb.sigTime;
+    uint256 hash = mnb.GetHash();
+    man.mapSeenMerchantnodeBroadcast[hash] = mnb;
+
+    // A getdata reply is cached the way ProcessGetData does it
+    CInv inv(MSG_MERCHANTNODE_ANNOUNCE, hash);
+    CSerializedNetMsgRef msg = relayMessageCache.GetOrSerialize(inv, "mnb", man.mapSeenMerchantnodeBroadcast[hash]);
+    BOOST_CHECK_EQUAL(DeserializeBroadcast(msg).lastPing.sigTime, mnb.sigTime);
+
+    // A newer ping keeps the broadcast hash, but the next reply must carry it
+    CMerchantnodePing mnp = mnb.lastPing;
+    mnp.sigTime += MERCHANTNODE_PING_SECONDS;
+    man.UpdateSeenBroadcastPing(hash, mnp);
+    BOOST_CHECK(man.mapSeenMerchantnodeBroadcast[hash].GetHash() == hash);
+
+    msg = relayMessageCache.GetOrSerialize(inv, "mnb", man.mapSeenMerchantnodeBroadcast[hash]);
+    CMerchantnodeBroadcast mnbReply = DeserializeBroadcast(msg);
+    BOOST_CHECK(mnbReply.lastPing == mnp);
+    BOOST_CHECK_EQUAL(mnbReply.lastPing.sigTime, mnp.sigTime);
+
+    relayMessageCache.Erase(inv);
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_list_digest_bucket_count)
+{
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(0));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(1));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS / 2));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS + 1));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(3 * MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount(MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS * 2));
+    BOOST_CHECK(!CMerchantnodeListDigest::IsValidBucketCount((size_t)-1));
+    BOOST_CHECK(CMerchantnodeListDigest::IsValidBucketCount(MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS));
+    BOOST_CHECK(CMerchantnodeListDigest::IsValidBucketCount(MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS));
+
+    // Whatever the list size, the count we ask with is one a peer accepts
+    BOOST_CHECK_EQUAL(CMerchantnodeListDigest::GetBucketCount(0), (unsigned int)MERCHANTNODE_LIST_DIGEST_MIN_BUCKETS);
+    BOOST_CHECK_EQUAL(CMerchantnodeListDigest::GetBucketCount(1000000), (unsigned int)MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS);
+    for (size_t nEntries = 0; nEntries < 100000; nEntries = nEntries * 2 + 1) {
+        unsigned int nBuckets = CMerchantnodeListDigest::GetBucketCount(nEntries);
+        BOOST_CHECK(CMerchantnodeListDigest::IsValidBucketCount(nBuckets));
+        BOOST_CHECK(nBuckets * 4 >= nEntries || nBuckets == (unsigned int)MERCHANTNODE_LIST_DIGEST_MAX_BUCKETS);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_list_digest_compare)
+{
+    const unsigned int nBuckets = CMerchantnodeListDigest::GetBucketCount(200);
+    std::vector<std::pair<COutPoint, uint256> > vEntries;
+    for (int i = 0; i < 200; i++)
+        vEntries.push_back(std::make_pair(COutPoint(GetRandHash(), insecure_rand() % 4), GetRandHash()));
+
+    CMerchantnodeListDigest ours(nBuckets);
+    CMerchantnodeListDigest theirs(nBuckets);
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        ours.Add(vEntries[i].first, vEntries[i].second);
+        BOOST_CHECK(ours.GetBucket(vEntries[i].first) < nBuckets);
+    }
+    // The order entries are added in does not matter
+    for (size_t i = vEntries.size(); i-- > 0;)
+        theirs.Add(vEntries[i].first, vEntries[i].second);
+    BOOST_CHECK(ours.vBuckets == theirs.vBuckets);
+
+    // Survives the trip over the network
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << theirs;
+    CMerchantnodeListDigest received;
+    ss >> received;
+    BOOST_CHECK(received.vBuckets == theirs.vBuckets);
+
+    // The peer misses one entry and has an older broadcast of another
+    const COutPoint& outpointMissing = vEntries[3].first;
+    const COutPoint& outpointChanged = vEntries[7].first;
+    theirs.Add(outpointMissing, vEntries[3].second);
+    theirs.Add(outpointChanged, vEntries[7].second);
+    theirs.Add(outpointChanged, GetRandHash());
+
+    std::set<unsigned int> setDiffering;
+    setDiffering.insert(ours.GetBucket(outpointMissing));
+    setDiffering.insert(ours.GetBucket(outpointChanged));
+    for (unsigned int nBucket = 0; nBucket < nBuckets; nBucket++)
+        BOOST_CHECK_EQUAL(ours.vBuckets[nBucket] != theirs.vBuckets[nBucket], setDiffering.count(nBucket) > 0);
+
+    // Adding an entry twice cancels it out
+    std::vector<uint64_t> vBucketsBefore = theirs.vBuckets;
+    theirs.Add(outpointChanged, vEntries[9].second);
+    theirs.Add(outpointChanged, vEntries[9].second);
+    BOOST_CHECK(theirs.vBuckets == vBucketsBefore);
+}
+
+static void ProcessSyncStatusCount(CMerchantnodeSync& sync, int nItemID, int nCount)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nItemID << nCount;
+    std::string strCommand = "ssc";
+    sync.ProcessMessage(NULL, strCommand, ss);
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_sync_list_digest_count)
+{
+    SetMockTime(1500000000);
+    CMerchantnodeSync sync;
+
+    // Not asking for the list: the answer is ignored
+    sync.RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_SPORKS;
+    ProcessSyncStatusCount(sync, MERCHANTNODE_SYNC_LIST_DIGEST, 5);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeListDigest, 0);
+    BOOST_CHECK_EQUAL(sync.sumMerchantnodeList, 0);
+    BOOST_CHECK_EQUAL(sync.lastMerchantnodeList, 0);
+
+    // A digest answer counts as a list answer, and as a digest answer
+    sync.RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_LIST;
+    ProcessSyncStatusCount(sync, MERCHANTNODE_SYNC_LIST_DIGEST, 5);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeListDigest, 1);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeList, 1);
+    BOOST_CHECK_EQUAL(sync.sumMerchantnodeList, 5);
+    BOOST_CHECK_EQUAL(sync.lastMerchantnodeList, 1500000000);
+
+    // An answer without differing entries still moves the sync on
+    SetMockTime(1500000010);
+    ProcessSyncStatusCount(sync, MERCHANTNODE_SYNC_LIST_DIGEST, 0);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeListDigest, 2);
+    BOOST_CHECK_EQUAL(sync.sumMerchantnodeList, 5);
+    BOOST_CHECK_EQUAL(sync.lastMerchantnodeList, 1500000010);
+
+    // A full list answer is not a digest answer
+    ProcessSyncStatusCount(sync, MERCHANTNODE_SYNC_LIST, 7);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeListDigest, 2);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeList, 3);
+    BOOST_CHECK_EQUAL(sync.sumMerchantnodeList, 12);
+
+    // Nothing is counted once the sync is done
+    sync.RequestedMerchantnodeAssets = MERCHANTNODE_SYNC_FINISHED;
+    ProcessSyncStatusCount(sync, MERCHANTNODE_SYNC_LIST_DIGEST, 5);
+    BOOST_CHECK_EQUAL(sync.countMerchantnodeListDigest, 2);
+
+    SetMockTime(0);
+}
+
+static CMerchantnode MakeRankTestMerchantnode(int64_t nNow)
+{
+    CMerchantnode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), insecure_rand() % 2));
+    mn.unitTest = true;
+    mn.protocolVersion = PROTOCOL_VERSION - (int)(insecure_rand() % 2);
+    // Half of them right at the minimum age, the rest well past it
+    if (insecure_rand() % 2)
+        mn.sigTime = nNow - MN_WINNER_MINIMUM_AGE + (int64_t)(insecure_rand() % 5) - 2;
+    else
+        mn.sigTime = nNow - MN_WINNER_MINIMUM_AGE - (int64_t)(insecure_rand() % 100000);
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.sigTime = nNow;
+    if (insecure_rand() % 8 == 0)
+        mn.lastPing.sigTime -= MERCHANTNODE_EXPIRATION_SECONDS;
+    return mn;
+}
+
+static bool CompareScoreDescending(const std::pair<int64_t, COutPoint>& a, const std::pair<int64_t, COutPoint>& b)
+{
+    return a.first > b.first;
+}
+
+/** The scores the linear scans ranked by, best first. Their sort was unstable, so ties come in any order. */
+static std::vector<std::pair<int64_t, COutPoint> > ScanScores(std::vector<CMerchantnode>& vList, int64_t nBlockHeight, int minProtocol, bool fOnlyActive, bool fMinAge)
+{
+    std::vector<std::pair<int64_t, COutPoint> > vScores;
+    BOOST_FOREACH (CMerchantnode& mn, vList) {
+        if (mn.protocolVersion < minProtocol) continue;
+        if (fMinAge && GetAdjustedTime() - mn.sigTime < MN_WINNER_MINIMUM_AGE) continue;
+        if (fOnlyActive && !mn.IsEnabled()) continue;
+        vScores.push_back(std::make_pair(mn.CalculateScore(1, nBlockHeight).GetCompact(false), mn.vin.prevout));
+    }
+    std::sort(vScores.begin(), vScores.end(), CompareScoreDescending);
+    return vScores;
+}
+
+static int64_t ScoreOf(const std::vector<std::pair<int64_t, COutPoint> >& vScores, const COutPoint& outpoint)
+{
+    for (size_t i = 0; i < vScores.size(); i++)
+        if (vScores[i].second == outpoint)
+            return vScores[i].first;
+    return -1;
+}
+
+static void CheckRanksAgainstScan(CMerchantnodeMan& man, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    man.Check();
+    std::vector<CMerchantnode> vList = man.GetFullMerchantnodeVector();
+    bool fMinAge = IsSporkActive(SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT);
+
+    // GetMerchantnodeRank: the rank of a node is one the scan could have given it
+    std::vector<std::pair<int64_t, COutPoint> > vScores = ScanScores(vList, nBlockHeight, minProtocol, fOnlyActive, fMinAge);
+    BOOST_FOREACH (CMerchantnode& mn, vList) {
+        int nRank = man.GetMerchantnodeRank(mn.vin, nBlockHeight, minProtocol, fOnlyActive);
+        int64_t nScore = ScoreOf(vScores, mn.vin.prevout);
+        if (nScore == -1) {
+            BOOST_CHECK_EQUAL(nRank, -1);
+        } else {
+            BOOST_REQUIRE(nRank >= 1 && nRank <= (int)vScores.size());
+            BOOST_CHECK_EQUAL(vScores[nRank - 1].first, nScore);
+        }
+    }
+    BOOST_CHECK_EQUAL(man.GetMerchantnodeRank(CTxIn(COutPoint(GetRandHash(), 0)), nBlockHeight, minProtocol, fOnlyActive), -1);
+
+    // GetMerchantnodeByRank: every rank holds a different node with the score the scan has there
+    vScores = ScanScores(vList, nBlockHeight, minProtocol, fOnlyActive, false);
+    std::set<COutPoint> setRanked;
+    for (int nRank = 1; nRank <= (int)vScores.size(); nRank++) {
+        CMerchantnode* pmn = man.GetMerchantnodeByRank(nRank, nBlockHeight, minProtocol, fOnlyActive);
+        BOOST_REQUIRE(pmn != NULL);
+        BOOST_CHECK_EQUAL(ScoreOf(vScores, pmn->vin.prevout), vScores[nRank - 1].first);
+        setRanked.insert(pmn->vin.prevout);
+    }
+    BOOST_CHECK_EQUAL(setRanked.size(), vScores.size());
+    BOOST_CHECK(man.GetMerchantnodeByRank(0, nBlockHeight, minProtocol, fOnlyActive) == NULL);
+    BOOST_CHECK(man.GetMerchantnodeByRank((int)vScores.size() + 1, nBlockHeight, minProtocol, fOnlyActive) == NULL);
+
+    // GetCurrentMasterNode: the first enabled node with the best positive score
+    int64_t nBest = 0;
+    CMerchantnode* pwinner = NULL;
+    BOOST_FOREACH (CMerchantnode& mn, vList) {
+        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+        int64_t nScore = mn.CalculateScore(1, nBlockHeight).GetCompact(false);
+        if (nScore > nBest) {
+            nBest = nScore;
+            pwinner = &mn;
+        }
+    }
+    CMerchantnode* pcurrent = man.GetCurrentMasterNode(1, nBlockHeight, minProtocol);
+    BOOST_CHECK_EQUAL(pcurrent == NULL, pwinner == NULL);
+    if (pcurrent != NULL && pwinner != NULL)
+        BOOST_CHECK(pcurrent->vin == pwinner->vin);
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_rank_cache_matches_scan)
+{
+    int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+    const int64_t nHeights[] = {100, 101};
+    BOOST_FOREACH (int64_t nHeight, nHeights)
+        mapCacheBlockHashes[nHeight] = GetRandHash();
+
+    CMerchantnodeMan man;
+    for (int i = 0; i < 60; i++) {
+        CMerchantnode mn = MakeRankTestMerchantnode(nNow);
+        man.Add(mn);
+    }
+
+    for (int nRound = 0; nRound < 40; nRound++) {
+        // The minimum age only applies with payment enforcement on
+        {
+            LOCK(cs_mapSporks);
+            if (nRound % 2) {
+                CSporkMessage spork;
+                spork.nSporkID = SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT;
+                spork.nValue = 0;
+                spork.nTimeSigned = nNow;
+                mapSporksActive[spork.nSporkID] = spork;
+            } else {
+                mapSporksActive.erase(SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT);
+            }
+        }
+
+        switch (insecure_rand() % 5) {
+        case 0: {
+            // New nodes
+            for (int i = insecure_rand() % 5; i >= 0; i--) {
+                CMerchantnode mn = MakeRankTestMerchantnode(nNow);
+                man.Add(mn);
+            }
+            break;
+        }
+        case 1: {
+            // Removals
+            std::vector<CMerchantnode> vList = man.GetFullMerchantnodeVector();
+            for (int i = insecure_rand() % 3; i >= 0 && !vList.empty(); i--)
+                man.Remove(vList[insecure_rand() % vList.size()].vin);
+            break;
+        }
+        case 2: {
+            // A node stops or resumes pinging, and its state follows
+            std::vector<CMerchantnode> vList = man.GetFullMerchantnodeVector();
+            if (vList.empty()) break;
+            CMerchantnode* pmn = man.Find(vList[insecure_rand() % vList.size()].vin);
+            BOOST_REQUIRE(pmn != NULL);
+            pmn->lastPing.sigTime = pmn->IsEnabled() ? nNow - MERCHANTNODE_EXPIRATION_SECONDS : nNow;
+            pmn->Check(true);
+            break;
+        }
+        case 3: {
+            // Right up to and onto the minimum age of the next node to reach it
+            std::vector<CMerchantnode> vList = man.GetFullMerchantnodeVector();
+            int64_t nNext = 0;
+            BOOST_FOREACH (const CMerchantnode& mn, vList) {
+                int64_t nOldEnough = mn.sigTime + MN_WINNER_MINIMUM_AGE;
+                if (nOldEnough > nNow && (nNext == 0 || nOldEnough < nNext))
+                    nNext = nOldEnough;
+            }
+            if (nNext != 0)
+                nNow = nNext - (int64_t)(insecure_rand() % 2);
+            break;
+        }
+        default:
+            nNow += insecure_rand() % (2 * MERCHANTNODE_CHECK_SECONDS);
+        }
+        SetMockTime(nNow);
+
+        BOOST_FOREACH (int64_t nHeight, nHeights) {
+            CheckRanksAgainstScan(man, nHeight, 0, true);
+            CheckRanksAgainstScan(man, nHeight, 0, false);
+            CheckRanksAgainstScan(man, nHeight, PROTOCOL_VERSION, true);
+        }
+    }
+
+    {
+        LOCK(cs_mapSporks);
+        mapSporksActive.erase(SPORK_8_MERCHANTNODE_PAYMENT_ENFORCEMENT);
+    }
+    BOOST_FOREACH (int64_t nHeight, nHeights)
+        mapCacheBlockHashes.erase(nHeight);
+    SetMockTime(0);
+}
+
+/** Exposes the validation interface callback, which main.cpp calls through the signals */
+class CTestCollateralWatcher : public CMerchantnodeCollateralWatcher
+{
+public:
+    using CMerchantnodeCollateralWatcher::SyncTransaction;
+};
+
+static CTransaction SpendOutpoint(const COutPoint& outpoint)
+{
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(outpoint));
+    tx.vout.push_back(CTxOut(1 * COIN, CScript() << OP_TRUE));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(merchantnode_collateral_watcher)
+{
+    LOCK(cs_main);
+    int64_t nNow = 1500000000;
+    SetMockTime(nNow);
+    CTestCollateralWatcher watcher;
+    CBlock block;
+
+    // Block connect: a spend in a block holds, however old it gets
+    COutPoint outpointConnected(GetRandHash(), 0);
+    watcher.Set(outpointConnected, true);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointConnected), CMerchantnodeCollateralWatcher::COLLATERAL_UNSPENT);
+    CTransaction txSpend = SpendOutpoint(outpointConnected);
+    watcher.SyncTransaction(txSpend, &block);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointConnected), CMerchantnodeCollateralWatcher::COLLATERAL_SPENT);
+    SetMockTime(nNow + 10 * MERCHANTNODE_SPENT_PROBE_SECONDS);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointConnected), CMerchantnodeCollateralWatcher::COLLATERAL_SPENT);
+
+    // Block disconnect: the spend and the transaction that created the collateral both leave the chain
+    watcher.SyncTransaction(txSpend, NULL);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointConnected), CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN);
+    CTransaction txCollateral = SpendOutpoint(COutPoint(GetRandHash(), 0));
+    COutPoint outpointCreated(txCollateral.GetHash(), 0);
+    watcher.Set(outpointCreated, true);
+    watcher.SyncTransaction(txCollateral, NULL);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointCreated), CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN);
+
+    // Mempool: a new spend makes the state unknown, so it is probed again
+    nNow += 10 * MERCHANTNODE_SPENT_PROBE_SECONDS;
+    SetMockTime(nNow);
+    COutPoint outpointMempool(GetRandHash(), 1);
+    watcher.Set(outpointMempool, true);
+    watcher.SyncTransaction(SpendOutpoint(outpointMempool), NULL);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN);
+
+    // The probe finds the mempool spend. When that spend is removed as a conflict, the removal is announced.
+    watcher.Set(outpointMempool, false);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_SPENT);
+    watcher.SyncTransaction(SpendOutpoint(outpointMempool), NULL);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN);
+
+    // A removal that is not announced, like mempool.remove(tx, removed, true) in
+    // DisconnectTip, only holds the probed spend until it is probed again
+    watcher.Set(outpointMempool, false);
+    SetMockTime(nNow + MERCHANTNODE_SPENT_PROBE_SECONDS - 1);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_SPENT);
+    SetMockTime(nNow + MERCHANTNODE_SPENT_PROBE_SECONDS);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_UNKNOWN);
+
+    // A block confirming the probed spend makes it final
+    watcher.Set(outpointMempool, false);
+    watcher.SyncTransaction(SpendOutpoint(outpointMempool), &block);
+    SetMockTime(nNow + 10 * MERCHANTNODE_SPENT_PROBE_SECONDS);
+    BOOST_CHECK_EQUAL(watcher.Get(outpointMempool), CMerchantnodeCollateralWatcher::COLLATERAL_SPENT);
+
+    size_t nWatched;
+    uint64_t nProbes, nSpent, nInvalidated;
+    watcher.GetStats(nWatched, nProbes, nSpent, nInvalidated);
+    BOOST_CHECK_EQUAL(nWatched, 3U);
+    BOOST_CHECK_EQUAL(nProbes, 6U);
+    BOOST_CHECK_EQUAL(nSpent, 2U);
+    BOOST_CHECK_EQUAL(nInvalidated, 4U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -48,6 +48,36 @@ struct {
     {2, 0xbbbeb305}, {2, 0xfe1c810a},
 };
 
+// Add a chain of nCount transactions spending the first output of txFrom, each paying nFee
+static void AddTxChain(const CTransaction& txFrom, int nCount, CAmount nFee)
+{
+    uint256 hash = txFrom.GetHash();
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[0].nValue;
+    for (int i = 0; i < nCount; i++) {
+        tx.vin[0].prevout.hash = hash;
+        tx.vout[0].nValue -= nFee;
+        hash = tx.GetHash();
+        mempool.addUnchecked(hash, CTxMemPoolEntry(tx, nFee, GetTime(), 111.0, 11));
+    }
+}
+
+// Same transactions besides the coinbase, with the same fees
+static void CheckSameTransactions(const CBlockTemplate& a, const CBlockTemplate& b)
+{
+    BOOST_CHECK_EQUAL(a.block.vtx.size(), b.block.vtx.size());
+    std::map<uint256, CAmount> mapA, mapB;
+    for (unsigned int i = 1; i < a.block.vtx.size(); i++)
+        mapA[a.block.vtx[i].GetHash()] = a.vTxFees[i];
+    for (unsigned int i = 1; i < b.block.vtx.size(); i++)
+        mapB[b.block.vtx[i].GetHash()] = b.vTxFees[i];
+    BOOST_CHECK(mapA == mapB);
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -77,7 +107,7 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
         txCoinbase.vin[0].scriptSig.push_back(chainActive.Height());
         txCoinbase.vout[0].scriptPubKey = CScript();
         pblock->vtx[0] = CTransaction(txCoinbase);
-        if (txFirst.size() < 2)
+        if (txFirst.size() < 4)
             txFirst.push_back(new CTransaction(pblock->vtx[0]));
         pblock->hashMerkleRoot = pblock->BuildMerkleTree();
         pblock->nNonce = blockinfo[i].nonce;
@@ -258,6 +288,84 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     SetMockTime(0);
     mempool.clear();
 
+    // A selection extended with new mempool transactions that rank below the picked ones matches
+    // one built from scratch
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    delete pblocktemplate;
+    AddTxChain(*txFirst[0], 20, 1000000);
+    CBlockTemplate* ptemplateFirst;
+    BOOST_CHECK(ptemplateFirst = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    BOOST_CHECK_EQUAL(ptemplateFirst->block.vtx.size(), 21U);
+    delete ptemplateFirst;
+
+    uint64_t nReused, nUpdated, nRebuilt, nUpdatedBefore;
+    GetBlockTxSelectionStats(nReused, nUpdatedBefore, nRebuilt);
+    AddTxChain(*txFirst[1], 20, 500000);
+    CBlockTemplate* ptemplateExtended;
+    BOOST_CHECK(ptemplateExtended = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    GetBlockTxSelectionStats(nReused, nUpdated, nRebuilt);
+    BOOST_CHECK_EQUAL(nUpdated, nUpdatedBefore + 1);
+
+    InvalidateBlockTxSelection();
+    CBlockTemplate* ptemplateFresh;
+    BOOST_CHECK(ptemplateFresh = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    CheckSameTransactions(*ptemplateExtended, *ptemplateFresh);
+    BOOST_CHECK_EQUAL(ptemplateExtended->block.vtx.size(), 41U);
+    delete ptemplateExtended;
+    delete ptemplateFresh;
+
+    // A transaction paying more than the picked ones is not just appended: the selection is rebuilt
+    uint64_t nRebuiltBefore = nRebuilt;
+    AddTxChain(*txFirst[2], 5, 5000000);
+    BOOST_CHECK(ptemplateExtended = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    GetBlockTxSelectionStats(nReused, nUpdated, nRebuilt);
+    BOOST_CHECK_EQUAL(nRebuilt, nRebuiltBefore + 1);
+    InvalidateBlockTxSelection();
+    BOOST_CHECK(ptemplateFresh = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    CheckSameTransactions(*ptemplateExtended, *ptemplateFresh);
+    BOOST_CHECK_EQUAL(ptemplateExtended->block.vtx.size(), 46U);
+    delete ptemplateExtended;
+    delete ptemplateFresh;
+
+    // Other block size settings rebuild the selection: the transactions skipped for size
+    // with a small block are considered again with a large one
+    mapArgs["-blockmaxsize"] = "2000";
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    BOOST_CHECK(pblocktemplate->block.vtx.size() < 41U);
+    delete pblocktemplate;
+    mapArgs.erase("-blockmaxsize");
+    nRebuiltBefore = nRebuilt;
+    BOOST_CHECK(ptemplateExtended = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    GetBlockTxSelectionStats(nReused, nUpdated, nRebuilt);
+    BOOST_CHECK_EQUAL(nRebuilt, nRebuiltBefore + 1);
+    InvalidateBlockTxSelection();
+    BOOST_CHECK(ptemplateFresh = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    CheckSameTransactions(*ptemplateExtended, *ptemplateFresh);
+    delete ptemplateExtended;
+    delete ptemplateFresh;
+
+    // In a full block, a better paying transaction takes the place of lower ranked ones, as it
+    // would in a block built from scratch
+    mapArgs["-blockmaxsize"] = "2000";
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    delete pblocktemplate;
+    AddTxChain(*txFirst[3], 5, 10000000);
+    nRebuiltBefore = nRebuilt;
+    BOOST_CHECK(ptemplateExtended = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    GetBlockTxSelectionStats(nReused, nUpdated, nRebuilt);
+    BOOST_CHECK_EQUAL(nRebuilt, nRebuiltBefore + 1);
+    bool fPicked = false;
+    for (unsigned int i = 1; i < ptemplateExtended->block.vtx.size(); i++)
+        fPicked |= ptemplateExtended->block.vtx[i].vin[0].prevout.hash == txFirst[3]->GetHash();
+    BOOST_CHECK(fPicked);
+    InvalidateBlockTxSelection();
+    BOOST_CHECK(ptemplateFresh = CreateNewBlock(scriptPubKey, pwalletMain, false));
+    CheckSameTransactions(*ptemplateExtended, *ptemplateFresh);
+    delete ptemplateExtended;
+    delete ptemplateFresh;
+    mapArgs.erase("-blockmaxsize");
+    mempool.clear();
+
     BOOST_FOREACH(CTransaction *tx, txFirst)
         delete tx;
 
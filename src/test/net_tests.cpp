@@ -0,0 +1,78 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the shared send buffers and the direct receive path
+//
+
+#include "net.h"
+#include "serialize.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(net_tests)
+
+BOOST_AUTO_TEST_CASE(serialized_message_matches_pushmessage)
+{
+    std::vector<unsigned char> vPayload(100000, 0x5a);
+    CNode node(INVALID_SOCKET, CAddress(CService("1.2.3.4", 1234)), "", true);
+
+    // Large enough for EndMessage to hand its buffer over instead of copying
+    node.PushMessage("block", vPayload);
+    BOOST_CHECK_EQUAL(node.vSendMsg.size(), 1U);
+    BOOST_CHECK_EQUAL(node.ssSend.size(), 0U);
+
+    CSerializedNetMsgRef msg = MakeSerializedNetMsg("block", vPayload);
+    BOOST_CHECK(*msg == *node.vSendMsg.front());
+
+    // The same buffer ends up in the queue of every peer it is pushed to
+    CNode node2(INVALID_SOCKET, CAddress(CService("1.2.3.5", 1234)), "", true);
+    node2.PushSerializedMessage(msg);
+    node.PushSerializedMessage(msg);
+    BOOST_CHECK(node2.vSendMsg.front() == msg);
+    BOOST_CHECK(node.vSendMsg.back() == msg);
+    BOOST_CHECK_EQUAL(node.nSendSize, 2 * msg->size());
+}
+
+BOOST_AUTO_TEST_CASE(receive_large_payload_in_place)
+{
+    std::vector<unsigned char> vPayload(300000);
+    for (size_t i = 0; i < vPayload.size(); i++)
+        vPayload[i] = i % 251;
+    CSerializedNetMsgRef msg = MakeSerializedNetMsg("block", vPayload);
+
+    CNode node(INVALID_SOCKET, CAddress(CService("1.2.3.4", 1234)), "", true);
+    LOCK(node.cs_vRecvMsg);
+    unsigned int nSize = 0;
+    BOOST_CHECK(node.GetRecvDataBuffer(nSize) == NULL);
+
+    // The header and the start of the payload arrive through the copying path
+    unsigned int nPos = 1000;
+    BOOST_CHECK(node.ReceiveMsgBytes(&(*msg)[0], nPos));
+    while (nPos < msg->size()) {
+        char* pch = node.GetRecvDataBuffer(nSize);
+        if (pch == NULL) {
+            // The tail below RECV_DIRECT_MIN_SIZE is copied again
+            BOOST_CHECK(msg->size() - nPos < RECV_DIRECT_MIN_SIZE);
+            BOOST_CHECK(node.ReceiveMsgBytes(&(*msg)[nPos], msg->size() - nPos));
+            break;
+        }
+        BOOST_CHECK(nSize > 0 && nSize <= msg->size() - nPos);
+        memcpy(pch, &(*msg)[nPos], nSize);
+        node.ReceiveMsgData(nSize);
+        nPos += nSize;
+    }
+
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1U);
+    CNetMessage& netmsg = node.vRecvMsg.front();
+    BOOST_CHECK(netmsg.complete());
+    BOOST_CHECK_EQUAL(netmsg.hdr.GetCommand(), "block");
+    std::vector<unsigned char> vReceived;
+    netmsg.vRecv >> vReceived;
+    BOOST_CHECK(vReceived == vPayload);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
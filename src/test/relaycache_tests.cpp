@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Artax developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "relaycache.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+
+static CSerializedNetMsgRef MakeMessage(size_t nSize)
+{
+    return boost::make_shared<CSerializeData>(nSize, 'x');
+}
+
+BOOST_AUTO_TEST_SUITE(relaycache_tests)
+
+BOOST_AUTO_TEST_CASE(relaycache_hits_and_misses)
+{
+    CRelayMessageCache cache(1000);
+    CInv inv(MSG_MERCHANTNODE_PING, 1);
+    CSerializedNetMsgRef msg;
+
+    BOOST_CHECK(!cache.Get(inv, msg));
+    cache.Put(inv, MakeMessage(100));
+    BOOST_CHECK(cache.Get(inv, msg));
+    BOOST_CHECK_EQUAL(msg->size(), 100U);
+    BOOST_CHECK(cache.Get(inv, msg));
+
+    // Same hash, other inventory type
+    BOOST_CHECK(!cache.Get(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1), msg));
+
+    CRelayMessageCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 100U);
+    BOOST_CHECK_EQUAL(stats.nHits, 2U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK_EQUAL(stats.nBytesSaved, 200U);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_evicts_least_recently_used)
+{
+    CRelayMessageCache cache(1000);
+    CSerializedNetMsgRef msg;
+    for (int i = 0; i < 4; i++)
+        cache.Put(CInv(MSG_SPORK, i), MakeMessage(300));
+
+    // The oldest entry made room for the fourth
+    BOOST_CHECK(!cache.Get(CInv(MSG_SPORK, 0), msg));
+    BOOST_CHECK(cache.Get(CInv(MSG_SPORK, 1), msg));
+
+    // 1 was just used, so 2 goes next
+    cache.Put(CInv(MSG_SPORK, 4), MakeMessage(300));
+    BOOST_CHECK(!cache.Get(CInv(MSG_SPORK, 2), msg));
+    BOOST_CHECK(cache.Get(CInv(MSG_SPORK, 1), msg));
+
+    // Messages larger than the whole cache are not kept
+    cache.Put(CInv(MSG_SPORK, 5), MakeMessage(2000));
+    BOOST_CHECK(!cache.Get(CInv(MSG_SPORK, 5), msg));
+
+    cache.SetMaxBytes(0);
+    CRelayMessageCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_erase)
+{
+    CRelayMessageCache cache(1000);
+    CSerializedNetMsgRef msg;
+    cache.Put(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1), MakeMessage(100));
+    cache.Put(CInv(MSG_MERCHANTNODE_ANNOUNCE, 2), MakeMessage(200));
+
+    cache.Erase(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1));
+    cache.Erase(CInv(MSG_MERCHANTNODE_ANNOUNCE, 3));
+    BOOST_CHECK(!cache.Get(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1), msg));
+    BOOST_CHECK(cache.Get(CInv(MSG_MERCHANTNODE_ANNOUNCE, 2), msg));
+
+    // The next Put serializes the object again
+    cache.Put(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1), MakeMessage(150));
+    BOOST_CHECK(cache.Get(CInv(MSG_MERCHANTNODE_ANNOUNCE, 1), msg));
+    BOOST_CHECK_EQUAL(msg->size(), 150U);
+
+    CRelayMessageCacheStats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 350U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
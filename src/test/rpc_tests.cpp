@@ -6,6 +6,7 @@
 #include "rpcclient.h"
 
 #include "base58.h"
+#include "main.h"
 #include "netbase.h"
 
 #include <boost/algorithm/string.hpp>
@@ -202,4 +203,44 @@ BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
     BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_latency_stats)
+{
+    UniValue params(UniValue::VARR);
+    tableRPC.execute("getchaintips", params);
+    tableRPC.execute("getchaintips", params);
+    tableRPC.execute("getblockcount", params);
+    BOOST_CHECK_THROW(tableRPC.execute("getblockhash", params), UniValue);
+
+    UniValue stats = CallRPC("getrpcstats");
+    BOOST_CHECK_EQUAL(find_value(stats, "queued").get_int(), 0);
+    const UniValue& methods = find_value(stats, "methods");
+    const UniValue& tips = find_value(methods, "getchaintips");
+    BOOST_CHECK_EQUAL(find_value(tips, "class").get_str(), "chainstate");
+    BOOST_CHECK_EQUAL(find_value(tips, "calls").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(tips, "errors").get_int(), 0);
+    BOOST_CHECK(find_value(find_value(tips, "exec"), "histogram").isObject());
+    BOOST_CHECK_EQUAL(find_value(find_value(methods, "getblockcount"), "class").get_str(), "concurrent");
+    BOOST_CHECK_EQUAL(find_value(find_value(methods, "getblockhash"), "errors").get_int(), 1);
+
+    stats = CallRPC("getrpcstats getblockhash");
+    BOOST_CHECK_EQUAL(find_value(stats, "methods").size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_tip_snapshot)
+{
+    LOCK(cs_main);
+    PublishChainTipSnapshot();
+    CChainTipSnapshotRef snapshot = GetChainTipSnapshot();
+    BOOST_CHECK(snapshot->pindexTip == chainActive.Tip());
+    BOOST_CHECK_EQUAL(CallRPC("getblockcount").get_int(), chainActive.Height());
+    BOOST_CHECK_EQUAL(CallRPC("getbestblockhash").get_str(), chainActive.Tip()->GetBlockHash().GetHex());
+    BOOST_CHECK_EQUAL(CallRPC("getblockhash 0").get_str(), chainActive.Genesis()->GetBlockHash().GetHex());
+    BOOST_CHECK_THROW(CallRPC(strprintf("getblockhash %d", chainActive.Height() + 1)), runtime_error);
+
+    // Every publication gets a new, higher sequence number; earlier references stay valid
+    PublishChainTipSnapshot();
+    BOOST_CHECK_EQUAL(GetChainTipSnapshot()->nSequence, snapshot->nSequence + 1);
+    BOOST_CHECK(snapshot->pindexTip == chainActive.Tip());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,8 @@
 
 #define BOOST_TEST_MODULE Artax Test Suite
 
+#include "crypto/quark.h"
+#include "crypto/sha256.h"
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
@@ -33,6 +35,8 @@ struct TestingSetup {
     ECCVerifyHandle globalVerifyHandle;
 
     TestingSetup() {
+        SHA256AutoDetect();
+        QuarkAutoDetect();
         ECC_Start();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
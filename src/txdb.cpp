@@ -16,60 +16,317 @@
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+namespace
 {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
+//! Key prefix of the per-output records
+const char DB_COIN = 'C';
+//! Key prefix of the per-transaction records written before the upgrade
+const char DB_COINS_LEGACY = 'c';
+//! Key of the best block hash
+const char DB_BEST_BLOCK = 'H';
+//! Key of the best block hash before the upgrade, which older clients still read
+const char DB_BEST_BLOCK_LEGACY = 'B';
+//! Key of the chainstate format version
+const char DB_VERSION = 'V';
+
+//! Format version of the per-output layout
+const int CHAINSTATE_VERSION = 1;
+
+//! Transactions converted per committed batch during Upgrade
+const size_t UPGRADE_BATCH_TRANSACTIONS = 100000;
+
+/** Database key of one output */
+struct CCoinsOutputKey {
+    char chType;
+    uint256 hash;
+    uint32_t n;
+
+    CCoinsOutputKey() : chType(DB_COIN), hash(0), n(0) {}
+    CCoinsOutputKey(const uint256& hashIn, uint32_t nIn) : chType(DB_COIN), hash(hashIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(chType);
+        READWRITE(hash);
+        READWRITE(VARINT(n));
+    }
+};
+}
+
+/**
+ * Queue the record changes that turn coinsOld, what the database holds for
+ * hash, into coins. Outputs that are unchanged are not rewritten.
+ */
+void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coinsOld, const CCoins& coins, size_t& nWritten, size_t& nErased)
+{
+    bool fSameTx = coinsOld.IsPruned() || coins.IsPruned() ||
+                   (coinsOld.nHeight == coins.nHeight && coinsOld.nVersion == coins.nVersion &&
+                    coinsOld.fCoinBase == coins.fCoinBase && coinsOld.fCoinStake == coins.fCoinStake);
+    unsigned int nOutputs = std::max(coinsOld.vout.size(), coins.vout.size());
+    for (unsigned int n = 0; n < nOutputs; n++) {
+        bool fHadOutput = coinsOld.IsAvailable(n);
+        if (coins.IsAvailable(n)) {
+            if (!fHadOutput || !fSameTx || coinsOld.vout[n] != coins.vout[n]) {
+                batch.Write(CCoinsOutputKey(hash, n), CTxOutCoin(coins, n));
+                nWritten++;
+            }
+        } else if (fHadOutput) {
+            batch.Erase(CCoinsOutputKey(hash, n));
+            nErased++;
+        }
+    }
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
 {
-    batch.Write('B', hash);
+    batch.Write(DB_BEST_BLOCK, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize / 2, fMemory, fWipe),
+                                                                             nMaxCacheUsage(nCacheSize / 2)
 {
 }
 
+leveldb::Iterator* CCoinsViewDB::GetReadCursor() const
+{
+    AssertLockHeld(cs_cursor);
+    if (!pcursorRead)
+        pcursorRead.reset(const_cast<CLevelDBWrapper*>(&db)->NewIterator(true));
+    return pcursorRead.get();
+}
+
+bool CCoinsViewDB::ReadCoins(const uint256& txid, CCoins& coins) const
+{
+    coins.Clear();
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << DB_COIN << txid;
+    leveldb::Slice slPrefix(&ssPrefix[0], ssPrefix.size());
+
+    LOCK(cs_cursor);
+    leveldb::Iterator* pcursor = GetReadCursor();
+    for (pcursor->Seek(slPrefix); pcursor->Valid() && pcursor->key().starts_with(slPrefix); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        CCoinsOutputKey key;
+        CTxOutCoin coin;
+        ssKey >> key;
+        ssValue >> coin;
+        coin.AddTo(coins, key.n);
+    }
+    HandleError(pcursor->status());
+    return !coins.IsPruned();
+}
+
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    LOCK(cs_cache);
+    bool fHave;
+    if (cache.GetCoins(txid, coins, fHave))
+        return fHave;
+    fHave = ReadCoins(txid, coins);
+    cache.SetCoins(txid, coins);
+    if (cache.DynamicMemoryUsage() > nMaxCacheUsage)
+        cache.Clear();
+    return fHave;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(make_pair('c', txid));
+    {
+        LOCK(cs_cache);
+        CCoins coins;
+        bool fHave;
+        if (cache.GetCoins(txid, coins, fHave))
+            return fHave;
+    }
+    // Any output record will do, nothing has to be deserialized
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << DB_COIN << txid;
+    leveldb::Slice slPrefix(&ssPrefix[0], ssPrefix.size());
+
+    LOCK(cs_cursor);
+    leveldb::Iterator* pcursor = GetReadCursor();
+    pcursor->Seek(slPrefix);
+    if (pcursor->Valid() && pcursor->key().starts_with(slPrefix))
+        return true;
+    HandleError(pcursor->status());
+    return false;
+}
+
+size_t CCoinsViewDB::GetCacheUsage() const
+{
+    LOCK(cs_cache);
+    return cache.DynamicMemoryUsage();
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain))
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256(0);
     return hashBestChain;
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    bool fOk = BatchWriteSnapshot(mapCoins, hashBlock);
+    mapCoins.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t nWritten = 0;
+    size_t nErased = 0;
+    // Readers may run concurrently (see CCoinsViewBackgroundFlush), so
+    // cs_cache is only held around the cache accesses. The cache gets the
+    // new state before the database does, which is the state the layers
+    // above expect.
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            // A fresh entry has nothing in the database yet
+            CCoins coinsOld;
+            bool fCached = true;
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH)) {
+                LOCK(cs_cache);
+                bool fHave;
+                fCached = cache.GetCoins(it->first, coinsOld, fHave);
+            }
+            if (!fCached)
+                ReadCoins(it->first, coinsOld);
+            BatchWriteCoins(batch, it->first, coinsOld, it->second.coins, nWritten, nErased);
+            {
+                LOCK(cs_cache);
+                cache.SetCoins(it->first, it->second.coins);
+            }
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database: %u outputs written, %u erased...\n",
+        (unsigned int)changed, (unsigned int)count, (unsigned int)nWritten, (unsigned int)nErased);
+    bool fOk = db.WriteBatch(batch);
+    {
+        // The read cursor still sees the database as it was before the batch
+        LOCK(cs_cursor);
+        pcursorRead.reset();
+    }
+    LOCK(cs_cache);
+    if (!fOk || cache.DynamicMemoryUsage() > nMaxCacheUsage)
+        cache.Clear();
+    return fOk;
+}
+
+/** Erase every per-output record, in committed batches */
+bool static EraseOutputRecords(CLevelDBWrapper& db)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::string(1, DB_COIN));
+    while (pcursor->Valid() && pcursor->key()[0] == DB_COIN) {
+        CLevelDBBatch batch;
+        for (size_t i = 0; i < UPGRADE_BATCH_TRANSACTIONS && pcursor->Valid() && pcursor->key()[0] == DB_COIN; i++, pcursor->Next()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                CCoinsOutputKey key;
+                ssKey >> key;
+                batch.Erase(key);
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+        if (!db.WriteBatch(batch))
+            return error("%s : failed to write to coin database", __func__);
+    }
+    HandleError(pcursor->status());
+    return true;
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    int nVersion = 0;
+    if (db.Read(DB_VERSION, nVersion) && nVersion > CHAINSTATE_VERSION)
+        return error("%s : chainstate format %d is newer than this client supports (%d), use -reindex or a newer client", __func__, nVersion, CHAINSTATE_VERSION);
+
+    // Older clients only know the legacy best block key. Once it is gone they
+    // treat the chainstate as empty and rebuild it from the block files,
+    // instead of running at their old tip without the converted outputs. If
+    // one did that, its records and best block are the current state and the
+    // per-output records left behind are stale.
+    uint256 hashLegacyBest;
+    bool fLegacyBest = db.Read(DB_BEST_BLOCK_LEGACY, hashLegacyBest);
+    if (nVersion == CHAINSTATE_VERSION && fLegacyBest) {
+        LogPrintf("The chainstate database was written by an older client, converting it again...\n");
+        if (!EraseOutputRecords(db))
+            return false;
+        nVersion = 0;
+    }
+    if (nVersion < CHAINSTATE_VERSION) {
+        CLevelDBBatch batch;
+        batch.Write(DB_VERSION, CHAINSTATE_VERSION);
+        batch.Erase(DB_BEST_BLOCK);
+        if (fLegacyBest) {
+            batch.Write(DB_BEST_BLOCK, hashLegacyBest);
+            batch.Erase(DB_BEST_BLOCK_LEGACY);
+        }
+        if (!db.WriteBatch(batch))
+            return error("%s : failed to write to coin database", __func__);
+    }
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::string(1, DB_COINS_LEGACY));
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COINS_LEGACY)
+        return true;
+
+    LogPrintf("Upgrading the chainstate database to one record per output...\n");
+    int64_t nStart = GetTimeMillis();
+    uint64_t nTransactions = 0;
+    uint64_t nOutputs = 0;
+    while (pcursor->Valid() && pcursor->key()[0] == DB_COINS_LEGACY) {
+        CLevelDBBatch batch;
+        for (size_t i = 0; i < UPGRADE_BATCH_TRANSACTIONS && pcursor->Valid() && pcursor->key()[0] == DB_COINS_LEGACY; i++, pcursor->Next()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                std::pair<char, uint256> key;
+                CCoins coins;
+                ssKey >> key;
+                ssValue >> coins;
+                for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                    if (coins.IsAvailable(n)) {
+                        batch.Write(CCoinsOutputKey(key.second, n), CTxOutCoin(coins, n));
+                        nOutputs++;
+                    }
+                }
+                batch.Erase(key);
+                nTransactions++;
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+        // The iterator reads from the snapshot it was created on, so the
+        // records converted so far can be committed while it moves on
+        if (!db.WriteBatch(batch))
+            return error("%s : failed to write to coin database", __func__);
+        LogPrintf("Upgrading the chainstate database: %u transactions converted\n", nTransactions);
+    }
+    HandleError(pcursor->status());
+
+    LogPrintf("Upgraded the chainstate database: %u transactions, %u outputs in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
@@ -115,54 +372,69 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
+/** Feed one transaction into the gettxoutsetinfo hash, in the layout used since the per-transaction records */
+void static HashCoinsStats(CHashWriter& ss, CCoinsStats& stats, CAmount& nTotalAmount, const uint256& txhash, const CCoins& coins)
+{
+    ss << txhash;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i + 1);
+            ss << out;
+            nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    pcursor->Seek(std::string(1, DB_COIN));
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    // The outputs of a transaction are adjacent; collect them before hashing
+    uint256 txhash = 0;
+    CCoins coins;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
             leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() == 0 || slKey[0] != DB_COIN)
+                break;
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            CCoinsOutputKey key;
+            ssKey >> key;
+            if (key.hash != txhash) {
+                if (!coins.IsPruned())
+                    HashCoinsStats(ss, stats, nTotalAmount, txhash, coins);
+                coins.Clear();
+                txhash = key.hash;
             }
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CTxOutCoin coin;
+            ssValue >> coin;
+            coin.AddTo(coins, key.n);
+            stats.nSerializedSize += slKey.size() + slValue.size();
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (!coins.IsPruned())
+        HashCoinsStats(ss, stats, nTotalAmount, txhash, coins);
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
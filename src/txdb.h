@@ -7,14 +7,18 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "coinsflat.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
 class CCoins;
 class uint256;
 
@@ -25,20 +29,61 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/).
+ *
+ * Every unspent output is its own record, keyed by 'C', txid and VARINT(n),
+ * so spending one output of a transaction erases one small record instead
+ * of rewriting all remaining outputs. Transactions are read back with a
+ * prefix scan. Outputs recently read or written are kept in a flat cache,
+ * which also lets BatchWrite work out which records changed without going
+ * to disk.
+ *
+ * The database carries a format version ('V'), and the best block moved to
+ * a key older clients do not read, so they cannot mistake the converted
+ * database for an empty UTXO set at their old tip.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    mutable CCriticalSection cs_cache;
+    mutable CCoinsFlatCache cache;
+    //! the cache is emptied when it grows beyond this many bytes
+    size_t nMaxCacheUsage;
+
+    //! Iterator shared by the lookups, so a cache miss does not create one.
+    //! It reads from the snapshot it was created on and is dropped after every write.
+    mutable CCriticalSection cs_cursor;
+    mutable boost::scoped_ptr<leveldb::Iterator> pcursorRead;
+
+    leveldb::Iterator* GetReadCursor() const;
+
+    //! Read the outputs of txid from the database
+    bool ReadCoins(const uint256& txid, CCoins& coins) const;
+
 public:
+    //! nCacheSize is split between LevelDB and the output cache
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWriteSnapshot(const CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    /**
+     * Convert a chainstate written with one record per transaction to one
+     * record per output. Runs in batches that each commit atomically, so an
+     * interrupted upgrade continues on the next start. Fails on a format
+     * newer than this client's.
+     */
+    bool Upgrade();
+
+    //! Memory used by the output cache
+    size_t GetCacheUsage() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -12,7 +12,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70918;
+static const int PROTOCOL_VERSION = 70920;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -20,6 +20,12 @@ static const int INIT_PROTO_VERSION = 209;
 //! In this version, 'getheaders' was introduced.
 static const int GETHEADERS_VERSION = 70077;
 
+//! In this version, 'getheaders' is answered with 'headers' instead of an inv (headers-first sync).
+static const int HEADERS_FIRST_VERSION = 70919;
+
+//! In this version, 'dsegdigest' was introduced: the merchantnode list entries differing from a digest.
+static const int MERCHANTNODE_LIST_DIGEST_VERSION = 70920;
+
 //! disconnect from peers older than this proto version
 static const int MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT = 70916;
 static const int MIN_PEER_PROTO_VERSION_AFTER_ENFORCEMENT = 70918;
@@ -458,6 +458,57 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToUnspentIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (IsMine(wtx))
+        mapWalletUnspent[wtx.GetHash()] = &wtx;
+}
+
+void CWallet::PruneUnspentIndex(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    map<uint256, const CWalletTx*>::iterator it = mapWalletUnspent.find(hash);
+    if (it != mapWalletUnspent.end() && IsFullySpentInChain(*it->second))
+        mapWalletUnspent.erase(it);
+}
+
+/** Whether every output of ours is spent by a wallet transaction in the active chain. */
+bool CWallet::IsFullySpentInChain(const CWalletTx& wtx) const
+{
+    const uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) == ISMINE_NO)
+            continue;
+        bool fSpent = false;
+        pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (TxSpends::const_iterator it = range.first; it != range.second && !fSpent; ++it) {
+            map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+            fSpent = mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) > 0;
+        }
+        if (!fSpent)
+            return false;
+    }
+    return true;
+}
+
+const map<uint256, const CWalletTx*>& CWallet::GetUnspentIndex() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    if (fWalletUnspentRebuild) {
+        mapWalletUnspent.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+            if (IsMine(it->second) && !IsFullySpentInChain(it->second))
+                mapWalletUnspent.insert(mapWalletUnspent.end(), make_pair(it->first, &it->second));
+        }
+        fWalletUnspentRebuild = false;
+        LogPrint("wallet", "%s : %u of %u transactions with unspent outputs\n", __func__, mapWalletUnspent.size(), mapWallet.size());
+    }
+    return mapWalletUnspent;
+}
+
 bool CWallet::GetMerchantnodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, std::string strTxHash, std::string strOutputIndex)
 {
     // wait for reindex and/or import to finish
@@ -629,6 +680,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH (PAIRTYPE(const uint256, CWalletTx) & item, mapWallet)
             item.second.MarkDirty();
+        // What is ours may have changed too
+        fWalletUnspentRebuild = true;
     }
 }
 
@@ -642,6 +695,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         AddToSpends(hash);
+        // The chain may not be loaded yet, sort out what is spent on first use
+        fWalletUnspentRebuild = true;
     } else {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
@@ -685,6 +740,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        AddToUnspentIndex(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -732,8 +788,15 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     // available of the outputs it spends. So force those to be
     // recomputed, also:
     BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-        if (mapWallet.count(txin.prevout.hash))
-            mapWallet[txin.prevout.hash].MarkDirty();
+        map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi == mapWallet.end())
+            continue;
+        mi->second.MarkDirty();
+        // A confirmed spend may use up the last of its outputs, anything else may give some back
+        if (pblock)
+            PruneUnspentIndex(mi->first);
+        else
+            AddToUnspentIndex(mi->second);
     }
 }
 
@@ -743,6 +806,7 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
+        mapWalletUnspent.erase(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -1317,8 +1381,9 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1334,8 +1399,9 @@ CAmount CWallet::GetLockedCoins() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
 
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetLockedCredit();
@@ -1350,8 +1416,9 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1364,8 +1431,9 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -1377,8 +1445,9 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -1392,8 +1461,9 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -1406,8 +1476,9 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -1419,8 +1490,9 @@ CAmount CWallet::GetLockedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
+            const CWalletTx* pcoin = it->second;
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
                 nTotal += pcoin->GetLockedWatchOnlyCredit();
         }
@@ -1437,9 +1509,10 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        const map<uint256, const CWalletTx*>& mapUnspent = GetUnspentIndex();
+        for (map<uint256, const CWalletTx*>::const_iterator it = mapUnspent.begin(); it != mapUnspent.end(); ++it) {
             const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            const CWalletTx* pcoin = it->second;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -1585,6 +1658,37 @@ bool CWallet::SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int
     return true;
 }
 
+void CWallet::GetStakeKernelInputs(const std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, std::vector<CStakeKernelInput>& vInputsRet, std::vector<const std::pair<const CWalletTx*, unsigned int>*>& vCoinsRet) const
+{
+    vInputsRet.clear();
+    vCoinsRet.clear();
+    vInputsRet.reserve(setCoins.size());
+    vCoinsRet.reserve(setCoins.size());
+    for (const pair<const CWalletTx*, unsigned int>& pcoin : setCoins) {
+        //make sure that enough time has elapsed between
+        CBlockIndex* pindex = NULL;
+        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
+        if (it != mapBlockIndex.end())
+            pindex = it->second;
+        else {
+            if (fDebug)
+                LogPrintf("GetStakeKernelInputs() : failed to find block index \n");
+            continue;
+        }
+
+        // Read block header
+        CBlockHeader block = pindex->GetBlockHeader();
+
+        CStakeKernelInput input;
+        if (!GetStakeKernelInput(block, *pcoin.first, COutPoint(pcoin.first->GetHash(), pcoin.second), input)) {
+            LogPrintf("GetStakeKernelInputs() : failed to get kernel stake modifier \n");
+            continue;
+        }
+        vInputsRet.push_back(input);
+        vCoinsRet.push_back(&pcoin);
+    }
+}
+
 bool CWallet::MintableCoins()
 {
     LOCK(cs_main);
@@ -2079,8 +2183,16 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
 // ppcoin: create coin stake transaction
 bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, CAmount nFees, CMutableTransaction& txNew, unsigned int& nTxNewTime)
 {
+    // The tip to stake on; block index entries never change once connected, so it is
+    // safe to read without cs_main once taken
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+    }
+
     // We start paying the fees to stakers only after v1.2.0 fork.
-    if (Params().NetworkID() == CBaseChainParams::MAIN && chainActive.Height() < SOFT_FORK_VERSION_120)
+    if (Params().NetworkID() == CBaseChainParams::MAIN && pindexPrev->nHeight < SOFT_FORK_VERSION_120)
         nFees = 0;
 
     // The following split & combine thresholds are important to security
@@ -2110,6 +2222,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     if (GetTime() - nLastStakeSetUpdate > nStakeSetUpdateTime) {
         setStakeCoins.clear();
+        pindexStakeSearched = NULL;
         if (!SelectStakeCoins(setStakeCoins, nBalance - nReserveBalance))
             return false;
 
@@ -2124,100 +2237,115 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     CAmount nCredit = 0;
     CScript scriptPubKeyKernel;
 
-    //prevent staking a time that won't be accepted
-    if (GetAdjustedTime() <= chainActive.Tip()->nTime)
-        MilliSleep(10000);
+    //prevent staking a time that won't be accepted, the stake scheduler calls again once it is
+    if (GetAdjustedTime() <= pindexPrev->nTime)
+        return false;
 
-    for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin : setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
-        }
+    // Timestamps up to nStakeSearchedUntil were already hashed without a hit on this tip with this
+    // stake set, so only the ones that came into the drift window since then need hashing
+    unsigned int nSearchStart = GetAdjustedTime();
+    unsigned int nSearchEnd = nSearchStart + nHashDrift;
+    if (pindexStakeSearched == pindexPrev && nStakeSearchedUntil > nSearchStart)
+        nSearchStart = std::min(nStakeSearchedUntil, nSearchEnd);
+    if (nSearchStart == nSearchEnd)
+        return false;
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+    // Reduce the stake set to kernel inputs once, under cs_main since that resolves the stake
+    // modifiers against the chain; the search threads then only hash these inputs
+    vector<CStakeKernelInput> vKernelInputs;
+    vector<const pair<const CWalletTx*, unsigned int>*> vKernelCoins;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindexPrev)
+            return false;
+        GetStakeKernelInputs(setStakeCoins, vKernelInputs, vKernelCoins);
+    }
+
+    size_t nKernel = 0;
+    uint256 hashProofOfStake = 0;
+    int nStakeThreads = GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
+    bool fSkippedCoin = false;
+
+    while (!vKernelInputs.empty()) {
+        nTxNewTime = nSearchStart;
+        if (!SearchStakeKernel(nBits, vKernelInputs, pindexPrev, nTxNewTime, nSearchEnd - nSearchStart, nStakeThreads, nKernel, hashProofOfStake)) {
+            // Only a search of the whole set, on a tip that is still current, can be skipped next time
+            if (!fSkippedCoin && GetChainTipSnapshot()->pindexTip == pindexPrev) {
+                pindexStakeSearched = pindexPrev;
+                nStakeSearchedUntil = nSearchEnd;
+            }
+            break;
+        }
+        const pair<const CWalletTx*, unsigned int>& pcoin = *vKernelCoins[nKernel];
 
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+        //Double check that this will pass time requirements
+        if (nTxNewTime <= nMedianTimePast) {
+            LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
+            // Search on without this coin
+            fSkippedCoin = true;
+            vKernelInputs.erase(vKernelInputs.begin() + nKernel);
+            vKernelCoins.erase(vKernelCoins.begin() + nKernel);
+            continue;
+        }
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
-            }
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found prevout=%s nTimeTx=%u hashProof=%s\n",
+                vKernelInputs[nKernel].prevout.ToString(), nTxNewTime, hashProofOfStake.ToString());
 
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            break;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            break; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            CKeyID keyID = CKeyID(uint160(vSolutions[0]));
+            if (!keystore.GetKey(keyID, key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                break; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                CKeyID keyID = CKeyID(uint160(vSolutions[0]));
-                if (!keystore.GetKey(keyID, key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + nFees + GetBlockValue(pIndex0->nHeight);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + nFees + GetBlockValue(pindexPrev->nHeight);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
     // Calculate reward
     CAmount nReward;
-    const CBlockIndex* pIndex0 = chainActive.Tip();
-    nReward = nFees + GetBlockValue(pIndex0->nHeight);
+    nReward = nFees + GetBlockValue(pindexPrev->nHeight);
     nCredit += nReward;
 
     CAmount nMinFee = 0;
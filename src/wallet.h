@@ -160,9 +160,26 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Wallet transactions that may still have unspent outputs of ours, the only ones
+     * balances and coin lists have to look at. Transactions are added when they enter
+     * the wallet or when one of their spenders leaves the chain, and dropped once every
+     * output of ours is spent by a transaction in the chain. A reorg that unconfirms the
+     * spender notifies the wallet about it, which puts the spent transactions back.
+     */
+    mutable std::map<uint256, const CWalletTx*> mapWalletUnspent;
+    //! Set when mapWalletUnspent has to be rebuilt from mapWallet before its next use
+    mutable bool fWalletUnspentRebuild;
+    void AddToUnspentIndex(const CWalletTx& wtx);
+    void PruneUnspentIndex(const uint256& hash);
+    bool IsFullySpentInChain(const CWalletTx& wtx) const;
+    const std::map<uint256, const CWalletTx*>& GetUnspentIndex() const;
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, CAmount nTargetAmount) const;
+    /** Resolve the kernel inputs of a stake set, vCoinsRet[i] is the coin of vInputsRet[i] */
+    void GetStakeKernelInputs(const std::set<std::pair<const CWalletTx*, unsigned int> >& setCoins, std::vector<CStakeKernelInput>& vInputsRet, std::vector<const std::pair<const CWalletTx*, unsigned int>*>& vCoinsRet) const;
     int CountInputsWithAmount(CAmount nInputAmount);
 
     /*
@@ -187,9 +204,11 @@ public:
 
     // Stake Settings
     unsigned int nHashDrift;
-    unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
     int nStakeSetUpdateTime;
+    //! last tip whose kernel timestamps up to nStakeSearchedUntil were hashed without a hit
+    const CBlockIndex* pindexStakeSearched;
+    unsigned int nStakeSearchedUntil;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -234,12 +253,14 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fWalletUnlockStakingOnly = false;
+        fWalletUnspentRebuild = false;
 
         // Stake Settings
         nHashDrift = 45;
         nStakeSplitThreshold = 2000;
-        nHashInterval = 22;
         nStakeSetUpdateTime = 300; // 5 minutes
+        pindexStakeSearched = NULL;
+        nStakeSearchedUntil = 0;
 
         //MultiSend
         vMultiSend.clear();